@@ -0,0 +1,29 @@
+#ifndef BOOST_NETWORK_DETAIL_ASIO_COMPAT_HPP_20131019
+#define BOOST_NETWORK_DETAIL_ASIO_COMPAT_HPP_20131019
+
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+/** Asio calls that later Boost releases removed: get_io_service() on I/O
+    objects, which Boost 1.70 replaced with their executor's context, and
+    the io_service argument of the SSL context.
+*/
+
+#include <boost/version.hpp>
+#include <boost/asio/io_service.hpp>
+
+#if BOOST_VERSION >= 107000
+#  define BOOST_NETWORK_IO_SERVICE(object) \
+     static_cast< ::boost::asio::io_service &>((object).get_executor().context())
+#else
+#  define BOOST_NETWORK_IO_SERVICE(object) (object).get_io_service()
+#endif
+
+#if BOOST_VERSION >= 104700
+#  define BOOST_NETWORK_SSL_CONTEXT(service, method) ::boost::asio::ssl::context(method)
+#else
+#  define BOOST_NETWORK_SSL_CONTEXT(service, method) ::boost::asio::ssl::context(service, method)
+#endif
+
+#endif /* end of include guard: BOOST_NETWORK_DETAIL_ASIO_COMPAT_HPP_20131019 */
@@ -11,6 +11,7 @@
 #include <boost/network/protocol/http/client/connection/connection_delegate_factory.hpp>
 #include <boost/network/protocol/http/traits/delegate_factory.hpp>
 #include <boost/network/protocol/http/client/connection/async_normal.hpp>
+#include <boost/network/detail/asio_compat.hpp>
 
 namespace boost { namespace network { namespace http { namespace impl {
 
@@ -48,7 +49,7 @@ namespace boost { namespace network { namespace http { namespace impl {
               resolve,
               follow_redirect,
               delegate_factory_type::new_connection_delegate(
-                  resolver.get_io_service(),
+                  BOOST_NETWORK_IO_SERVICE(resolver),
                   https,
                   certificate_filename,
                   verify_path)));
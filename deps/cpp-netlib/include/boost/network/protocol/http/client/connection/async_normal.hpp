@@ -28,6 +28,7 @@
 #include <boost/assert.hpp>
 #include <boost/bind/protect.hpp>
 #include <iterator>
+#include <boost/network/detail/asio_compat.hpp>
 
 #include <boost/network/protocol/http/traits/delegate_factory.hpp>
 
@@ -67,7 +68,7 @@ namespace boost { namespace network { namespace http { namespace impl {
             follow_redirect_(follow_redirect),
             resolver_(resolver),
             resolve_(resolve),
-            request_strand_(resolver.get_io_service()),
+            request_strand_(BOOST_NETWORK_IO_SERVICE(resolver)),
             delegate_(delegate) {}
 
       // This is the main entry point for the connection/request pipeline. We're
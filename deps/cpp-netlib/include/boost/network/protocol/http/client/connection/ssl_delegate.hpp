@@ -9,6 +9,7 @@
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/network/detail/asio_compat.hpp>
 #include <boost/network/protocol/http/client/connection/connection_delegate.hpp>
 #include <boost/optional.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -20,7 +20,7 @@ boost::network::http::impl::ssl_delegate::ssl_delegate(asio::io_service & servic
 void boost::network::http::impl::ssl_delegate::connect(
     asio::ip::tcp::endpoint & endpoint,
     function<void(system::error_code const &)> handler) {
-  context_.reset(new asio::ssl::context(
+  context_.reset(new BOOST_NETWORK_SSL_CONTEXT(
       service_,
       asio::ssl::context::sslv23_client));
   if (certificate_filename_ || verify_path_) {
@@ -9,6 +9,7 @@
 
 #include <boost/network/protocol/http/algorithms/linearize.hpp>
 #include <iterator>
+#include <boost/network/detail/asio_compat.hpp>
 
 namespace boost { namespace network { namespace http { namespace impl {
 
@@ -27,7 +28,7 @@ namespace boost { namespace network { namespace http { namespace impl {
         typedef sync_connection_base_impl<Tag,version_major,version_minor> connection_base;
 
         http_sync_connection(resolver_type & resolver, resolver_function_type resolve)
-        : connection_base(), resolver_(resolver), resolve_(resolve), socket_(resolver.get_io_service()) { }
+        : connection_base(), resolver_(resolver), resolve_(resolve), socket_(BOOST_NETWORK_IO_SERVICE(resolver)) { }
 
         void init_socket(string_type const & hostname, string_type const & port) {
             connection_base::init_socket(socket_, resolver_, hostname, port, resolve_);
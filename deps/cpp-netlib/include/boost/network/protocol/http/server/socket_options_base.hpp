@@ -18,7 +18,7 @@ namespace boost { namespace network { namespace http {
         boost::optional<asio::socket_base::send_buffer_size> send_buffer_size;
         boost::optional<asio::socket_base::receive_low_watermark> receive_low_watermark;
         boost::optional<asio::socket_base::send_low_watermark> send_low_watermark;
-        asio::socket_base::non_blocking_io non_blocking_io;
+        bool non_blocking_io;
         asio::socket_base::linger linger;
 
         template <class Tag, class Handler>
@@ -40,7 +40,7 @@ namespace boost { namespace network { namespace http {
 
         void socket_options(boost::asio::ip::tcp::socket & socket) {
             boost::system::error_code ignored;
-            socket.io_control(non_blocking_io, ignored);
+            socket.non_blocking(non_blocking_io, ignored);
             socket.set_option(linger, ignored);
             if (receive_buffer_size) socket.set_option(*receive_buffer_size, ignored);
             if (receive_low_watermark) socket.set_option(*receive_low_watermark, ignored);
@@ -0,0 +1,55 @@
+//
+//  BodySink.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Receives a response body piece by piece as it is read from the socket, so that a body can be
+//  processed without being held in memory as a whole.
+
+#ifndef BODY_SINK_H_
+#define BODY_SINK_H_
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+class BodySink {
+public:
+    virtual ~BodySink() {}
+
+    // Length of the body from Content-Length.  May arrive after the first pieces have been written.
+    virtual void expectLength(boost::uint64_t) {}
+
+    // Content-Encoding of the body (empty if it isn't encoded).  Given once the headers have been read,
+    // which may also be after the first pieces have been written.
+    virtual void expectEncoding(const std::string&) {}
+
+    // The response failed before its headers could be read, so neither expectLength nor expectEncoding
+    // will follow.  Pieces already on their way are refused rather than waiting for the headers.
+    virtual void abandon(const std::string&) {}
+
+    // Consume the next piece of the body.  Returns false once the sink can't accept any more data.
+    virtual bool write(const char* data, std::size_t len) = 0;
+
+    // Called after the last piece of the body.  Returns false if the body was incomplete or invalid.
+    virtual bool finish() = 0;
+
+    // Description of the failure when write or finish returned false
+    virtual std::string error() const = 0;
+};
+
+// Collects the whole body into a string, for requests where nothing else takes the body
+class StringSink : public BodySink {
+public:
+    StringSink(std::string& body) : _body(body) {}
+
+    virtual bool write(const char* data, std::size_t len) { _body.append(data, len); return true; }
+    virtual bool finish() { return true; }
+    virtual std::string error() const { return std::string(); }
+
+private:
+    std::string& _body;
+};
+
+#endif // BODY_SINK_H_
@@ -0,0 +1,61 @@
+//
+//  BodySource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Supplies a request body piece by piece as it is written to the socket, so that a body can be
+//  sent without being held in memory as a whole.
+
+#ifndef BODY_SOURCE_H_
+#define BODY_SOURCE_H_
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+class BodySource {
+public:
+    static const boost::int64_t kUnknownLength = -1;  // Body is sent with chunked transfer encoding
+
+    virtual ~BodySource() {}
+
+    virtual boost::int64_t length() const = 0;
+
+    // Next piece of the body, valid until the next call.  len is 0 at the end of the body.
+    // Returns false if the body couldn't be read.
+    virtual bool next(const char*& data, std::size_t& len) = 0;
+
+    // Start the body again from the beginning, to send it again after a redirect.  Returns false if
+    // the source can't.
+    virtual bool rewind() { return false; }
+
+    // Sources backed by a file can send the rest of the body from the kernel to a plain socket
+    virtual bool canSendFile() const { return false; }
+    virtual bool sendFile(int) { return false; }
+
+    // Description of the failure when next or sendFile returned false
+    virtual std::string error() const = 0;
+};
+
+// Body already held in memory, sent as a single piece
+class StringSource : public BodySource {
+public:
+    StringSource(const std::string& body) : _body(body), _sent(false) {}
+
+    virtual boost::int64_t length() const { return static_cast<boost::int64_t>(_body.size()); }
+    virtual bool next(const char*& data, std::size_t& len) {
+        data = _body.data();
+        len = _sent ? 0 : _body.size();
+        _sent = true;
+        return true;
+    }
+    virtual bool rewind() { _sent = false; return true; }
+    virtual std::string error() const { return std::string(); }
+
+private:
+    const std::string& _body;
+    bool _sent;
+};
+
+#endif // BODY_SOURCE_H_
@@ -0,0 +1,90 @@
+//
+//  CacheRefresher.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Revalidates stale cache entries on background threads, so a request answered with a stale entry
+//  under stale-while-revalidate doesn't wait for the round trip.  Each refresh leads a RequestCoalescer
+//  flight: only one refresh of a request runs at a time, and identical requests made meanwhile wait
+//  for it rather than making their own.  Refreshes follow redirects as the requests themselves do.
+//
+//  A small fixed set of threads makes the refreshes, taking them from a bounded queue.  A refresh
+//  that finds the queue full is dropped, and the entry goes on being served stale until the next
+//  request for it starts another.
+
+#ifndef CACHE_REFRESHER_H_
+#define CACHE_REFRESHER_H_
+
+#include "HttpStreamClient.h"
+#include "ResponseCache.h"
+#include "RequestCoalescer.h"
+
+#include <deque>
+#include <set>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CacheRefresher {
+public:
+    static const int kThreads = 2;             // Threads making refreshes
+    static const std::size_t kMaxQueued = 64;  // Refreshes waiting for a thread before more are dropped
+    static const long kDefaultTimeout = 60;    // Seconds, for refreshes of requests without a timeout
+
+    // Created on first use, which must be on the main thread
+    static CacheRefresher& instance();
+
+    // Revalidate the stale entry cached under cacheKey, unless the same request is already being made.
+    // The request headers carry the entry's validators, and cacheRequestHeaders are the request as it's
+    // matched against Vary.  timeout is as for HttpStreamClient::setTimeout, except that 0 means
+    // kDefaultTimeout, so that a stalled server can't hold on to one of the threads for good.
+    void start(const std::string& url,
+               const HttpStreamClient::Headers& requestHeaders,
+               const HttpStreamClient::Headers& cacheRequestHeaders,
+               const std::string& cacheKey,
+               const ResponseCache::EntryPtr& cached,
+               bool decompress,
+               long timeout);
+
+    boost::uint64_t dropped() const;  // Refreshes not made because the queue was full
+
+private:
+    CacheRefresher();
+    ~CacheRefresher();  // Cancels refreshes that are still running, drops those queued, and waits for the threads
+
+    CacheRefresher(CacheRefresher const&);  // Don't Implement.
+    void operator=(CacheRefresher const&);  // Don't implement
+
+    struct Refresh {
+        Refresh() : decompress(false), timeout(0) {}
+
+        std::string url;
+        HttpStreamClient::Headers requestHeaders;
+        HttpStreamClient::Headers cacheRequestHeaders;
+        std::string cacheKey;
+        ResponseCache::EntryPtr cached;
+        bool decompress;
+        long timeout;
+        std::string flightKey;
+        RequestCoalescer::FlightPtr flight;
+        HttpStreamClient client;
+    };
+
+    void work();
+    void run(const boost::shared_ptr<Refresh>& refresh);
+
+    mutable boost::mutex _mutex;
+    boost::condition_variable _queued;
+    std::deque<boost::shared_ptr<Refresh> > _queue;
+    std::set<HttpStreamClient*> _running;  // Clients of the refreshes in progress, so they can be canceled
+    boost::uint64_t _dropped;
+    bool _stopping;
+    boost::thread_group _threads;
+};
+
+#endif // CACHE_REFRESHER_H_
@@ -0,0 +1,63 @@
+//
+//  ChunkSource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Request body written from Omnis a chunk at a time ($writeChunk on the worker) while the request
+//  is being sent.  Chunks are queued up to a limit once the request has started; beyond that the
+//  writer waits for the socket to take the queued chunks, so Omnis can't produce the body faster
+//  than the network sends it.  Chunks written before the request starts are all queued, so a body
+//  can also be written up front and sent with $run.  The body is sent with chunked transfer encoding.
+
+#ifndef CHUNK_SOURCE_H_
+#define CHUNK_SOURCE_H_
+
+#include "BodySource.h"
+
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class ChunkSource : public BodySource {
+public:
+    static const std::size_t kDefaultMaxQueued = 1024 * 1024;  // Bytes
+    
+    ChunkSource(std::size_t maxQueued = kDefaultMaxQueued);
+
+    // Seconds write waits for space before giving up, or 0 for the default of a minute
+    void setTimeout(long seconds);
+
+    // Main thread: queue the next chunk, waiting while the queue is full.  Returns false if the body
+    // has been ended or closed, or if the socket hasn't taken the queued chunks within the timeout;
+    // the body can't be completed then, so it's closed and the request fails.
+    bool write(const std::string& chunk);
+    
+    // Main thread: mark the end of the body once the queued chunks have been sent
+    bool end();
+    
+    // Stop taking chunks, releasing a writer waiting for space.  Called when the request finishes or
+    // is canceled; a body that hadn't been ended fails.
+    void close();
+
+    virtual boost::int64_t length() const { return kUnknownLength; }
+    virtual bool next(const char*& data, std::size_t& len);
+    virtual std::string error() const;
+
+private:
+    std::size_t _maxQueued;
+    long _timeout;
+    
+    mutable boost::mutex _mutex;
+    boost::condition_variable _changed;
+    std::deque<std::string> _chunks;  // Chunks waiting to be sent
+    std::string _sending;             // Chunk returned by the last call to next
+    std::size_t _queued;              // Bytes in _chunks
+    bool _started;
+    bool _ended;
+    bool _closed;
+    bool _timedOut;  // Closed by a writer that waited too long
+};
+
+#endif // CHUNK_SOURCE_H_
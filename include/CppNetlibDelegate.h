@@ -10,6 +10,13 @@
 #define CPPNETLIBWORKERDELEGATE_H_
 
 #include "Worker.h"
+#include "BodySink.h"
+#include "ChunkSource.h"
+#include "HttpStreamClient.h"
+#include "RecordStream.h"
+#include "RequestCoalescer.h"
+#include "RequestTimings.h"
+#include "SegmentedDownload.h"
 #include "OmnisTools.he"
 
 #undef nil  // WORKAROUND: nil is defined in a header and it conflicts with some Boost libraries
@@ -18,14 +25,58 @@
 
 class CppNetlibDelegate : public WorkerDelegate {
 public:
+    CppNetlibDelegate();
+    virtual ~CppNetlibDelegate();
+    
     virtual void init(OmnisTools::ParamMap&);
     virtual OmnisTools::ParamMap run(OmnisTools::ParamMap&);
     virtual void cancel();
+    virtual void queued();
+    virtual void delivered();
+    virtual bool partialResult(OmnisTools::ParamMap&);
+    virtual bool writeChunk(const std::string&);
+    virtual bool endChunks();
     
 private:
     boost::shared_ptr<EXTqlist> _listResult;
     boost::shared_ptr<EXTqlist> _headerResult;
-	void buildHeaderList(boost::network::http::client::response);
+    std::vector<boost::shared_ptr<EXTqlist> > _ownedLists;  // Nested lists of a parsed body
+	void buildHeaderList(const HttpStreamClient::Headers&);
+    boost::shared_ptr<EXTqlist> parseJsonBody(const std::string& body);
+    
+    boost::shared_ptr<RecordStream> _recordStream;  // Created in init when rows are streamed to $rows
+    boost::shared_ptr<ChunkSource> _chunkSource;    // Created in init when the body is written with $writeChunk
+    
+    // Streamed requests hand the body to a sink as it's read from the socket
+    bool _streamFailed;
+    boost::network::http::client::response streamRequest(const std::string& method,
+                                                          const boost::network::http::client::request& request,
+                                                          const std::string& body,
+                                                          const std::string& bodyType,
+                                                          BodySink& sink);
+    void streamBody(BodySink* sink, boost::iterator_range<char const*> const& range, boost::system::error_code const& ec);
+    
+    HttpStreamClient _streamClient;  // Makes requests with a file body, which cpp-netlib can't stream
+    long _timeout;                   // Seconds a connect, read or write may stall, or 0 to wait indefinitely
+    
+    boost::mutex _downloadMutex;  // Guards _download, which is canceled from the main thread
+    boost::shared_ptr<SegmentedDownload> _download;
+    
+    // Identical GETs wait for the one already in flight, and can be canceled while they wait
+    RequestCoalescer::Flight::Outcome waitForFlight(const RequestCoalescer::FlightPtr& flight, RequestCoalescer::Result& shared);
+    boost::mutex _flightMutex;  // Guards _flight and _flightInterrupted, which are set from the main thread by cancel
+    RequestCoalescer::FlightPtr _flight;
+    bool _flightInterrupted;
+    
+    // Phases of the request, kept and returned in the result unless timings are turned off
+    bool _recordTimings;
+    boost::shared_ptr<RequestTimings> _timings;  // Created on the main thread when the request is queued
+    boost::uint64_t _queuedAt;                   // RequestTimings::now() when it was queued, for the trace
+    
+    // Listed by $inflight from when it's queued until it's delivered
+    std::string _inflightMethod;
+    std::string _inflightUrl;
+    boost::uint64_t _inflightId;  // 0 until it's queued
 };
 
 #endif
@@ -0,0 +1,92 @@
+//
+//  DecompressSink.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Decodes a gzip, deflate or (when built with HTTPLIB_HAVE_BROTLI) brotli encoded body piece by piece
+//  and passes the decoded data on to another sink, so decompression composes with every other way a
+//  body can be consumed.  Bodies without a Content-Encoding are passed through untouched.
+
+#ifndef DECOMPRESS_SINK_H_
+#define DECOMPRESS_SINK_H_
+
+#include "BodySink.h"
+
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <zlib.h>
+
+#ifdef HTTPLIB_HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+class DecompressSink : public BodySink {
+public:
+    DecompressSink(BodySink& sink);
+    virtual ~DecompressSink();
+
+    // Accept-Encoding request header for the encodings that can be decoded
+    static const char* acceptEncoding();
+
+    // Seconds write waits for the encoding before failing, or 0 for the default of a minute
+    void setTimeout(long seconds) { _timeout = seconds; }
+
+    virtual void expectLength(boost::uint64_t length);
+    virtual void expectEncoding(const std::string& encoding);
+    virtual void abandon(const std::string& reason);
+    virtual bool write(const char* data, std::size_t len);
+    virtual bool finish();
+    virtual std::string error() const;
+
+    boost::uint64_t encodedBytes() const { return _encodedBytes; }
+    boost::uint64_t decodedBytes() const { return _decodedBytes; }
+
+    // Whether the body was encoded and has been decoded, so the response's Content-Encoding and
+    // Content-Length no longer describe it.  Only meaningful once finish has returned true.
+    bool decoded() const { return _codec == kZlib || _codec == kBrotli; }
+
+private:
+    enum Codec {
+        kUnknown,   // Waiting for the headers
+        kIdentity,
+        kZlib,
+        kBrotli
+    };
+
+    bool inflate(const char* data, std::size_t len);
+#ifdef HTTPLIB_HAVE_BROTLI
+    bool decodeBrotli(const char* data, std::size_t len);
+#endif
+    bool output(std::size_t len);
+    bool fail(const std::string& message);
+
+    BodySink& _sink;
+
+    boost::mutex _mutex;  // The encoding can arrive on another thread after the first pieces
+    boost::condition_variable _known;
+    long _timeout;
+    Codec _codec;
+    boost::uint64_t _length;
+    bool _haveLength;
+
+    z_stream _zlib;
+    bool _zlibOpen;
+    bool _zlibEnded;
+    bool _gzip;
+    bool _triedRaw;     // Content-Encoding: deflate, which some servers send without the zlib wrapper
+#ifdef HTTPLIB_HAVE_BROTLI
+    BrotliDecoderState* _brotli;
+    bool _brotliEnded;
+#endif
+
+    std::vector<char> _buffer;
+    boost::uint64_t _encodedBytes;
+    boost::uint64_t _decodedBytes;
+    std::string _error;
+};
+
+#endif // DECOMPRESS_SINK_H_
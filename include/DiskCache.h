@@ -0,0 +1,157 @@
+//
+//  DiskCache.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Second tier of the response cache, kept in a directory so that it survives a restart.  Entries
+//  missing from memory are looked up here, and everything stored in memory is also written here.
+//
+//  Entries are appended to segment files and found through a hash table in a memory-mapped index
+//  file, so opening the cache reads nothing but the index.  A revalidated entry only appends its
+//  new headers, pointing back at the body it already has.  A background thread keeps the segments
+//  under the size limit by dropping the oldest, and rewrites segments that are mostly replaced
+//  entries.  Only one process can use a directory at a time.
+//
+//  The lock only covers the index and the bookkeeping of the segments.  Records are read and written
+//  without it, each segment file having its own lock for its seeks and reads or writes: a store takes
+//  space at the end of the active segment under the lock, writes the record outside it, and points the
+//  index at the record under the lock again once it's on disk.  Compaction copies records the same
+//  way, swapping the index over only if the entry hasn't been replaced meanwhile.
+
+#ifndef DISK_CACHE_H_
+#define DISK_CACHE_H_
+
+#include "ResponseCache.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+
+class DiskCache {
+public:
+    static const boost::uint64_t kDefaultMaxBytes = 256 * 1024 * 1024;
+
+    struct Stats {
+        Stats() : reads(0), writes(0), compactions(0), entries(0), bytes(0), maxBytes(0) {}
+
+        boost::uint64_t reads;        // Entries loaded into memory
+        boost::uint64_t writes;       // Entries and revalidations written
+        boost::uint64_t compactions;  // Segments dropped or rewritten
+        boost::uint64_t entries;
+        boost::uint64_t bytes;        // Size of the segment files
+        boost::uint64_t maxBytes;
+    };
+
+    // Created on first use, which must be on the main thread
+    static DiskCache& instance();
+
+    // Keep the cache in directory (created if needed), or stop using the disk when it's empty.
+    // Returns false if the directory can't be used.
+    bool open(const std::string& directory, boost::uint64_t maxBytes, std::string& error);
+    void close();
+
+    // Entry stored under key, or an empty pointer
+    ResponseCache::EntryPtr load(const std::string& key);
+
+    void store(const std::string& key, const ResponseCache::EntryPtr& entry);
+
+    // Store an entry whose body hasn't changed since it was last stored (after a 304)
+    void refresh(const std::string& key, const ResponseCache::EntryPtr& entry);
+
+    void remove(const std::string& key);
+
+    Stats stats() const;
+
+private:
+    DiskCache();
+    ~DiskCache();
+
+    DiskCache(DiskCache const&);        // Don't Implement.
+    void operator=(DiskCache const&);   // Don't implement
+
+    struct IndexHeader;
+    struct Slot;
+
+    // An open segment file, shared with whoever is reading or writing it so that it stays open while
+    // they do it without the cache's lock
+    struct SegmentFile {
+        SegmentFile() : file(0) {}
+        ~SegmentFile();
+
+        boost::mutex mutex;  // Keeps each seek together with its read or write
+        std::FILE* file;
+    };
+    typedef boost::shared_ptr<SegmentFile> SegmentFilePtr;
+
+    struct Segment {
+        Segment() : size(0), live(0), writers(0) {}
+
+        SegmentFilePtr file;   // Opened when first read or written
+        boost::uint64_t size;  // Including space taken by records still being written
+        boost::uint64_t live;  // Bytes still referenced by the index
+        unsigned writers;      // Records being written, which keep the segment from being compacted
+    };
+
+    static bool writeIndex(const std::string& path, const IndexHeader& header, const std::vector<Slot>& slots, std::string& error);
+    bool openIndex(std::string& error);
+    bool mapIndex(const std::string& path, std::string& error);
+    void growIndex();
+    Slot* findSlot(boost::uint64_t hash, bool insert);
+    void loadSegments();
+    std::string segmentPath(boost::uint32_t id) const;
+    Segment* segment(boost::uint32_t id);
+    bool locate(const Slot& slot, SegmentFilePtr& record, SegmentFilePtr& body);
+    bool current(const Slot& written, boost::uint64_t generation) const;
+    void closeAll();
+
+    // Called without the lock
+    bool append(const std::string& key, const ResponseCache::Entry& entry, const Slot* bodyFrom,
+                boost::uint64_t generation, Slot& slot);
+    static bool readRecord(const Slot& slot, const SegmentFilePtr& record, const SegmentFilePtr& body,
+                           std::string& key, boost::shared_ptr<ResponseCache::Entry>* entry);
+    void storeEntry(const std::string& key, const ResponseCache::EntryPtr& entry, bool sameBody);
+
+    void update(Slot* slot, const Slot& written);
+    void release(const Slot& slot);
+    void erase(Slot* slot);
+
+    void compact();
+    bool compactStep(boost::unique_lock<boost::mutex>& lock);
+
+    mutable boost::mutex _mutex;
+    boost::condition_variable _work;
+    std::string _directory;
+    boost::uint64_t _maxBytes;
+    boost::uint64_t _segmentLimit;  // Size at which a new segment is started
+
+    boost::scoped_ptr<boost::interprocess::file_lock> _lock;
+    boost::scoped_ptr<boost::interprocess::file_mapping> _mapping;
+    boost::scoped_ptr<boost::interprocess::mapped_region> _region;
+    IndexHeader* _header;
+    Slot* _slots;
+
+    std::map<boost::uint32_t, Segment> _segments;
+    boost::uint32_t _active;  // Segment being appended to
+    boost::uint64_t _generation;  // Changed whenever the cache is closed, so work begun before is dropped
+
+    boost::uint64_t _reads;
+    boost::uint64_t _writes;
+    boost::uint64_t _compactions;
+
+    boost::thread _compactor;
+    bool _stopping;
+};
+
+#endif // DISK_CACHE_H_
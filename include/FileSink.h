@@ -0,0 +1,57 @@
+//
+//  FileSink.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Writes a streamed body straight to disk.  The body is written to "<path>.part" in large blocks
+//  and renamed to path once it is complete, so a failed download never leaves a truncated file
+//  under the final name.  When the length is known the file is preallocated up front.
+
+#ifndef FILE_SINK_H_
+#define FILE_SINK_H_
+
+#include "BodySink.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+// Reserve the space for a file of length bytes where the platform supports it
+bool preallocateFile(std::FILE* file, boost::uint64_t length, std::string& error);
+
+class FileSink : public BodySink {
+public:
+    FileSink(const std::string& path);
+    virtual ~FileSink();
+
+    virtual void expectLength(boost::uint64_t length);
+    virtual bool write(const char* data, std::size_t len);
+    virtual bool finish();
+    virtual std::string error() const { return _error; }
+
+    const std::string& path() const { return _path; }
+    boost::uint64_t bytes() const { return _bytes; }
+
+private:
+    bool flush();
+    bool fail(const std::string& message);
+
+    std::string _path;
+    std::string _partPath;
+    std::FILE* _file;
+
+    std::vector<char> _buffer;
+    std::size_t _used;
+    boost::uint64_t _bytes;
+
+    boost::mutex _lengthMutex;  // Length arrives on the worker thread while the client thread writes
+    boost::uint64_t _expected;
+    bool _haveExpected;
+
+    std::string _error;
+};
+
+#endif // FILE_SINK_H_
@@ -0,0 +1,46 @@
+//
+//  FileSource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Request body read from a file.  Plain connections send it with sendfile() where available;
+//  otherwise (TLS, Windows) it's written from large memory-mapped windows of the file, so it's
+//  never copied into a buffer of our own either way.
+
+#ifndef FILE_SOURCE_H_
+#define FILE_SOURCE_H_
+
+#include "BodySource.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+class FileSource : public BodySource {
+public:
+    FileSource(const std::string& path);
+    virtual ~FileSource();
+
+    virtual boost::int64_t length() const { return _length; }
+    virtual bool next(const char*& data, std::size_t& len);
+    virtual bool rewind();
+    virtual bool canSendFile() const;
+    virtual bool sendFile(int socket);
+    virtual std::string error() const { return _error; }
+
+private:
+    bool fail(const std::string& message);
+
+    std::string _path;
+    int _fd;
+    boost::int64_t _length;
+    boost::int64_t _offset;  // Bytes of the file sent so far
+
+    boost::scoped_ptr<boost::interprocess::file_mapping> _mapping;
+    boost::scoped_ptr<boost::interprocess::mapped_region> _region;
+
+    std::string _error;
+};
+
+#endif // FILE_SOURCE_H_
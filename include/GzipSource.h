@@ -0,0 +1,58 @@
+//
+//  GzipSource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Gzip compresses another body source as it is sent.  Compression runs on its own thread a few
+//  blocks ahead of the socket, so compressing the next block overlaps with sending the last one.
+//  The compressed length isn't known up front, so the body is sent with chunked transfer encoding.
+
+#ifndef GZIP_SOURCE_H_
+#define GZIP_SOURCE_H_
+
+#include "BodySource.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class GzipSource : public BodySource {
+public:
+    GzipSource(const boost::shared_ptr<BodySource>& source, int level);
+    virtual ~GzipSource();
+
+    virtual boost::int64_t length() const { return kUnknownLength; }
+    virtual bool next(const char*& data, std::size_t& len);
+    virtual std::string error() const;
+
+    boost::uint64_t inputBytes() const;
+    boost::uint64_t outputBytes() const;
+
+private:
+    void compress();
+    bool push(std::vector<char>& block);
+    void finish(const std::string& error);
+
+    boost::shared_ptr<BodySource> _source;
+    int _level;
+
+    mutable boost::mutex _mutex;
+    boost::condition_variable _changed;
+    std::deque<std::vector<char> > _ready;  // Compressed blocks waiting to be sent
+    std::vector<char> _sending;             // Block returned by the last call to next
+    bool _started;
+    bool _done;
+    bool _stopped;
+    boost::uint64_t _inputBytes;
+    boost::uint64_t _outputBytes;
+    std::string _error;
+
+    boost::thread _thread;
+};
+
+#endif // GZIP_SOURCE_H_
@@ -0,0 +1,94 @@
+//
+//  HttpStreamClient.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Minimal synchronous HTTP/1.1 client for requests whose body is streamed from a BodySource.
+//  cpp-netlib only sends bodies held in a string and doesn't expose its sockets, so requests with
+//  a file body are made here instead.  The request body is sent with sendfile() on plain
+//  connections when the source supports it, and the response body is handed to a BodySink as it
+//  is read.  Redirects are followed, up to five as with cpp-netlib.  With keepAlive the connection
+//  is kept open between requests to the same server, so a client can be used as a pooled connection.
+
+#ifndef HTTP_STREAM_CLIENT_H_
+#define HTTP_STREAM_CLIENT_H_
+
+#include "BodySink.h"
+#include "BodySource.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+class RequestTimings;
+
+class HttpStreamClient {
+public:
+    typedef std::vector<std::pair<std::string, std::string> > Headers;
+
+    struct Response {
+        Response() : status(0), sinkFailed(false) {}
+
+        int status;
+        Headers headers;
+        std::string url;  // Where the response came from, after any redirects
+        bool sinkFailed;  // The sink stopped accepting the body, so the rest of it wasn't read
+    };
+
+    HttpStreamClient(bool keepAlive = false);
+
+    // Make a request, sending the body from source (if any) and writing the response body to sink.
+    // The sink is not finished, and never sees the body of a redirect.  Throws std::exception if the
+    // request can't be made, or if a redirect needs the body sent again and the source can't rewind.
+    Response request(const std::string& method,
+                     const std::string& url,
+                     const Headers& headers,
+                     const std::string& contentType,
+                     BodySource* source,
+                     BodySink& sink);
+
+    // Abort the request in progress from another thread (or the next one, if none is in progress)
+    void cancel();
+
+    // Give up on connecting, or on a read or write that makes no progress, after seconds (0 waits
+    // for as long as it takes)
+    void setTimeout(long seconds) { _timeout = seconds; }
+
+    // Mark the phases of the requests that follow in timings (or stop marking them if it's null)
+    void setTimings(RequestTimings* timings) { _timings = timings; }
+
+private:
+    class Connection;
+    class SocketRegistration;  // Makes a connection's socket available to cancel while it's in use
+
+    Response follow(std::string method,
+                    std::string url,
+                    Headers headers,
+                    std::string contentType,
+                    BodySource* source,
+                    BodySink& sink);
+    Response send(const std::string& method,
+                  const std::string& url,
+                  const Headers& headers,
+                  const std::string& contentType,
+                  BodySource* source,
+                  BodySink& sink);
+    void checkCancelled();
+    void clearCancelled();
+
+    bool _keepAlive;
+    boost::shared_ptr<Connection> _connection;  // Idle connection kept for the next request
+
+    boost::mutex _mutex;
+    boost::asio::ip::tcp::socket* _socket;  // Socket of the request in progress, guarded by _mutex
+    bool _cancelled;
+    long _timeout;
+    RequestTimings* _timings;
+};
+
+#endif // HTTP_STREAM_CLIENT_H_
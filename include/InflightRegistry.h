@@ -0,0 +1,114 @@
+//
+//  InflightRegistry.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Registry of the requests that have been started and not yet delivered to Omnis, read with
+//  $inflight, so that outstanding requests can be seen when Omnis seems to hang.
+//
+//  A watchdog thread checks every request once a second and logs a warning (and counts a slow
+//  request in the metrics) the first time a request stays in a stage longer than that stage's
+//  threshold: queued, connecting (DNS, connect, TLS and sending the request), waiting for the
+//  first byte, receiving, or waiting to be delivered to Omnis.
+//
+//  The registry keeps its own record of when each request was queued and which stage it's in.  A
+//  request that keeps RequestTimings also has them read, which tells the connecting, waiting and
+//  receiving stages apart and gives the bytes moved; without them a running request is shown as
+//  connecting throughout.
+
+#ifndef INFLIGHT_REGISTRY_H_
+#define INFLIGHT_REGISTRY_H_
+
+#include "RequestTimings.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class InflightRegistry {
+public:
+    enum Stage { kQueued, kConnecting, kWaiting, kReceiving, kDelivering, kStageCount };
+
+    struct Request {
+        Request() : id(0), stage(kQueued), elapsed(0), stageElapsed(0), bytesIn(0), bytesOut(0), slow(false) {}
+
+        boost::uint64_t id;
+        std::string method;
+        std::string url;
+        Stage stage;
+        double elapsed;       // Milliseconds since it was queued
+        double stageElapsed;  // Milliseconds in its current stage
+        boost::uint64_t bytesIn;
+        boost::uint64_t bytesOut;
+        bool slow;            // Has gone over a stage's threshold
+    };
+
+    // Created on first use, which must be on the main thread
+    static InflightRegistry& instance();
+
+    static const char* stageName(Stage stage);
+    static bool parseStage(const std::string& name, Stage& stage);
+
+    // Main thread: track a request from when it's queued until it's delivered (marked in its
+    // timings, if it has them) or removed.  Returns the id to remove it with.
+    boost::uint64_t add(const std::string& method,
+                        const std::string& url,
+                        const boost::shared_ptr<const RequestTimings>& timings = boost::shared_ptr<const RequestTimings>());
+    void remove(boost::uint64_t id);
+
+    // Any thread: the request's work has begun
+    void start(boost::uint64_t id);
+
+    // Any thread: the request's work is done and its result is waiting to be delivered
+    void finish(boost::uint64_t id);
+
+    // Requests not yet delivered, oldest first
+    std::vector<Request> requests();
+
+    // Milliseconds a request may stay in a stage before it's reported; 0 never reports it
+    void setThreshold(Stage stage, double ms);
+    double threshold(Stage stage);
+
+private:
+    InflightRegistry();
+    ~InflightRegistry();
+
+    InflightRegistry(InflightRegistry const&);  // Don't Implement.
+    void operator=(InflightRegistry const&);    // Don't implement
+
+    struct Entry {
+        Entry() : queuedAt(0), stage(kQueued), since(0), reported(kStageCount) {}
+
+        std::string method;
+        std::string url;
+        boost::uint64_t queuedAt;  // RequestTimings::now() when it was added
+        Stage stage;               // kQueued, kConnecting once started, or kDelivering once finished
+        boost::uint64_t since;     // When it went into that stage
+        boost::shared_ptr<const RequestTimings> timings;  // Null unless the request keeps them
+        int reported;              // Stage last reported as slow, or kStageCount
+    };
+    typedef std::map<boost::uint64_t, Entry> Entries;
+
+    static Stage stage(const Entry& entry, boost::uint64_t& since);
+    static bool delivered(const Entry& entry);
+    Request describe(boost::uint64_t id, const Entry& entry, boost::uint64_t now);
+    void watch();
+
+    boost::mutex _mutex;
+    Entries _entries;  // By id, which increases, so oldest first
+    boost::uint64_t _nextId;
+    double _thresholds[kStageCount];
+
+    bool _stopping;
+    boost::condition_variable _wake;
+    boost::thread _watchdog;
+};
+
+#endif // INFLIGHT_REGISTRY_H_
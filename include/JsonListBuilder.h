@@ -0,0 +1,81 @@
+//
+//  JsonListBuilder.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Builds a document from JsonReader events and converts it into Omnis lists on the worker thread:
+//    - Objects become single row lists with a column per key
+//    - Arrays of objects become multi-row lists with a column per key
+//    - Other arrays become multi-row lists with a single "value" column
+//    - Nested objects and arrays become nested lists
+
+#ifndef JSON_LIST_BUILDER_H_
+#define JSON_LIST_BUILDER_H_
+
+#include "JsonReader.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <extcomp.he>
+
+struct JsonValue {
+    enum Type {
+        kNull,
+        kBoolean,
+        kInteger,
+        kNumber,
+        kString,
+        kArray,
+        kObject
+    };
+
+    JsonValue(Type t = kNull) : type(t), boolean(false), number(0) {}
+
+    Type type;
+    bool boolean;
+    double number;                  // kInteger and kNumber
+    std::string text;               // kString
+    std::vector<std::string> keys;  // kObject (parallel to items)
+    std::vector<JsonValue> items;   // kArray and kObject
+};
+
+// Write a value back out as compact JSON
+void writeJson(const JsonValue& value, std::string& out);
+
+// Append a string as a quoted and escaped JSON string
+void writeJsonString(const char* data, std::size_t len, std::string& out);
+
+class JsonListBuilder : public JsonHandler {
+public:
+    JsonListBuilder();
+
+    virtual void null();
+    virtual void boolean(bool b);
+    virtual void number(const std::string& text, bool isInteger);
+    virtual void string(const std::string& s);
+    virtual void key(const std::string& k);
+    virtual void startObject();
+    virtual void endObject();
+    virtual void startArray();
+    virtual void endArray();
+
+    const JsonValue& root() const { return _root; }
+
+    // Convert the document into a list.  The lists it needs are checked out of the ListPool in one
+    // go, and every list created (including nested lists) is added to owned to keep them alive with
+    // the result.  Returns an empty pointer if the pool can't supply them.
+    boost::shared_ptr<EXTqlist> toList(std::vector<boost::shared_ptr<EXTqlist> >& owned) const;
+
+private:
+    void add(const JsonValue& v);
+
+    JsonValue _root;
+    std::vector<JsonValue*> _stack;
+    std::string _key;
+};
+
+#endif // JSON_LIST_BUILDER_H_
@@ -0,0 +1,79 @@
+//
+//  JsonProjection.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Projects fields out of a streamed JSON document.  Paths are JSON Pointers ("/data/items") or
+//  simple JSONPath expressions ("$.data.items[*]", "$.owner.login", "$.tags[0]").
+//
+//  The records path addresses an array (each element is a record) or a single object.  Column
+//  paths are relative to the record; containers are returned as JSON text.
+
+#ifndef JSON_PROJECTION_H_
+#define JSON_PROJECTION_H_
+
+#include "Projection.h"
+#include "JsonReader.h"
+
+class JsonProjection : public Projection, private JsonHandler {
+public:
+    JsonProjection(const std::string& records, const std::vector<Column>& columns);
+
+    virtual bool write(const char* data, std::size_t len);
+    virtual bool finish();
+
+    // Split a JSON Pointer or JSONPath into segments (array indexes are kept as decimal text)
+    static bool parsePath(const std::string& path, std::vector<std::string>& segments);
+
+private:
+    struct Frame {
+        Frame(bool a) : isArray(a), index(0) {}
+
+        bool isArray;
+        long index;  // Index of the next element of an array
+    };
+
+    // Text of a container value that was projected, captured as its events arrive
+    struct Capture {
+        std::size_t column;
+        std::size_t depth;
+        std::string text;
+        std::vector<char> open;
+        bool comma;
+    };
+
+    // JsonHandler
+    virtual void null();
+    virtual void boolean(bool b);
+    virtual void number(const std::string& text, bool isInteger);
+    virtual void string(const std::string& s);
+    virtual void key(const std::string& k);
+    virtual void startObject();
+    virtual void endObject();
+    virtual void startArray();
+    virtual void endArray();
+
+    void scalar(const std::string* text, const std::string& json);
+    void startContainer(bool isArray);
+    void endContainer();
+    void beginValue(bool isContainer, bool isArray, const std::string* text);
+    void endValue();
+    bool matches(const std::vector<std::string>& path, std::size_t from) const;
+    void capture(const std::string& json, bool isContainer);
+
+    JsonReader _reader;
+
+    std::vector<std::string> _recordsPath;
+    std::vector<std::vector<std::string> > _columnPaths;
+
+    std::vector<Frame> _frames;      // Open containers
+    std::vector<std::string> _path;  // Path of the value being read (its depth is the size)
+    std::string _key;                // Pending key of the open object
+
+    std::size_t _recordsDepth;       // Depth of the records array while it's open
+    std::size_t _recordDepth;        // Depth of the current record while inside one
+    std::vector<Capture> _captures;
+};
+
+#endif // JSON_PROJECTION_H_
@@ -0,0 +1,110 @@
+//
+//  JsonReader.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Incremental (push) JSON reader.  Data can be fed in arbitrary chunks as it arrives from the
+//  socket and events are reported to a JsonHandler, so a document never has to be held in memory
+//  as a whole to be parsed.
+
+#ifndef JSON_READER_H_
+#define JSON_READER_H_
+
+#include <string>
+#include <vector>
+
+// Receives parse events from JsonReader
+class JsonHandler {
+public:
+    virtual ~JsonHandler() {}
+
+    virtual void null() = 0;
+    virtual void boolean(bool b) = 0;
+    virtual void number(const std::string& text, bool isInteger) = 0;  // Raw number text
+    virtual void string(const std::string& s) = 0;                     // Unescaped UTF-8
+    virtual void key(const std::string& k) = 0;
+    virtual void startObject() = 0;
+    virtual void endObject() = 0;
+    virtual void startArray() = 0;
+    virtual void endArray() = 0;
+};
+
+// Value of JSON number text, or of the longest number at its start (after any white space) as
+// strtod reads it.  The decimal point is always '.', whatever the C locale.
+double parseJsonNumber(const std::string& text);
+
+class JsonReader {
+public:
+    JsonReader(JsonHandler& handler);
+
+    // Parse the next chunk of the document.  Returns false once a syntax error has been found.
+    bool feed(const char* data, std::size_t len);
+
+    // Signal the end of the document.  Returns false if the document was incomplete or invalid.
+    bool finish();
+
+    // Reset to parse a new document with the same handler
+    void reset();
+
+    bool failed() const { return !_error.empty(); }
+    const std::string& error() const { return _error; }
+    bool done() const { return _state == kDone; }
+
+private:
+    enum State {
+        kValue,            // Expecting any value
+        kFirstValueOrEnd,  // After '['
+        kFirstKeyOrEnd,    // After '{'
+        kKey,              // After ',' in an object
+        kColon,            // After a key
+        kCommaOrEnd,       // After a value inside a container
+        kDone              // Top-level value complete
+    };
+
+    enum Token {
+        kNoToken,
+        kStringToken,
+        kNumberToken,
+        kLiteralToken
+    };
+
+    // Position in the number grammar of RFC 8259: -? (0 | [1-9][0-9]*) (. [0-9]+)? ([eE] [+-]? [0-9]+)?
+    enum NumberPart {
+        kMinus,           // After '-'
+        kZero,            // Integer part is '0'
+        kInteger,         // In the integer part
+        kPoint,           // After '.'
+        kFraction,        // In the fraction
+        kExponent,        // After 'e' or 'E'
+        kExponentSign,    // After the exponent's sign
+        kExponentDigits   // In the exponent
+    };
+
+    std::size_t scanString(const char* data, std::size_t len, std::size_t pos);
+    std::size_t scanNumber(const char* data, std::size_t len, std::size_t pos);
+    std::size_t scanLiteral(const char* data, std::size_t len, std::size_t pos, bool atEnd = false);
+    bool endNumber();
+    bool structural(char c);
+    void valueDone();
+    void appendCodePoint(unsigned long cp);
+    void unpairedSurrogate();
+    bool fail(const char* message);
+
+    JsonHandler& _handler;
+
+    State _state;
+    Token _token;
+    std::vector<char> _stack;  // '{' or '[' for each open container
+
+    std::string _text;         // Partial token text
+    bool _isKey;               // String token is an object key
+    int _escape;               // 0 = none, 1 = after '\', 2-5 = reading \uXXXX digits
+    unsigned long _unicode;    // \uXXXX being read
+    unsigned long _highSurrogate;  // \uD800-\uDBFF waiting for the low surrogate that follows it
+    NumberPart _numberPart;
+
+    std::string _error;
+};
+
+#endif // JSON_READER_H_
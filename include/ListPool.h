@@ -0,0 +1,71 @@
+//
+//  ListPool.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Omnis lists can be populated from a background thread, but they must be
+//  allocated on the main thread.  ListPool keeps a stock of lists that were
+//  allocated on the main thread (topped up by ThreadTimer) so that workers can
+//  check them out while running in the background.
+
+#ifndef LIST_POOL_H_
+#define LIST_POOL_H_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <extcomp.he>
+
+class ListPool {
+public:
+    static ListPool& instance();
+
+    // Main thread only: allocate lists until the pool is back at its target size
+    void replenish();
+
+    // Main thread only: free all pooled lists (used when the component is unloaded)
+    void drain();
+
+    // Any thread: take a list out of the pool.  When called from a background thread and the pool
+    // is empty this waits for the next timer tick to replenish it, for up to maxWait milliseconds,
+    // and returns an empty pointer if none arrives in that time (the timer isn't running, say).
+    boost::shared_ptr<EXTqlist> checkout();
+
+    // Any thread: take count lists out of the pool at once, appending them to lists.  A background
+    // thread waits until the pool holds them all (the next replenish allocates however many waiting
+    // checkouts need), for up to maxWait milliseconds.  Returns false, leaving lists as it was, if
+    // they don't arrive in that time.
+    bool checkout(std::size_t count, std::vector<boost::shared_ptr<EXTqlist> >& lists);
+
+    std::size_t available();
+    std::size_t target();
+    void setTarget(std::size_t t);
+    long maxWait();
+    void setMaxWait(long ms);
+
+private:
+    ListPool();
+    ~ListPool();
+
+    ListPool(ListPool const&);          // Don't Implement.
+    void operator=(ListPool const&);    // Don't implement
+
+    bool onMainThread();
+
+    std::vector<EXTqlist*> _lists;
+    std::size_t _target;
+    std::size_t _shortfall;  // Lists that checkouts had to wait for since the last replenish
+    std::size_t _waiting;    // Lists wanted by the checkouts waiting now
+    long _maxWait;           // Milliseconds a background checkout waits for a list
+
+    boost::thread::id _mainThread;
+    boost::mutex _mutex;
+    boost::condition_variable _replenished;
+};
+
+#endif // LIST_POOL_H_
@@ -0,0 +1,65 @@
+//
+//  ListSerializer.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Serialises an Omnis list into a request body on the worker thread.  Columns are read by type
+//  straight out of the list (character data is converted to UTF-8 in a reused buffer) rather than
+//  going through the ParamMap conversion in OmnisTools.
+//
+//  Formats:
+//    - json:   Array with an object per row
+//    - ndjson: Object per row, one per line
+//    - csv:    Header line of column names then a line per row (RFC 4180 quoting)
+
+#ifndef LIST_SERIALIZER_H_
+#define LIST_SERIALIZER_H_
+
+#include <string>
+#include <vector>
+
+#include <extcomp.he>
+
+class ListSerializer {
+public:
+    enum Format {
+        kJson,
+        kNdjson,
+        kCsv
+    };
+
+    // Read a body_format parameter.  Returns false for an unknown format.
+    static bool parseFormat(const std::string& name, Format& format);
+    static const char* contentType(Format format);
+
+    ListSerializer(Format format);
+
+    // Append the serialised list to out
+    void write(EXTqlist* list, std::string& out);
+    
+    // Serialise the list a row at a time: begin, writeRow for rows 1 to rowCnt in order, then end
+    void begin(EXTqlist* list, std::string& out);
+    void writeRow(EXTqlist* list, qlong row, std::string& out);
+    void end(std::string& out);
+
+private:
+    struct Column {
+        std::string name;
+        std::string key;  // Escaped JSON key including the ':'
+    };
+
+    void readColumns(EXTqlist* list, std::vector<Column>& columns);
+    void writeObject(EXTqlist* list, qlong row, const std::vector<Column>& columns, std::string& out);
+    void writeArray(EXTqlist* list, std::string& out);
+    void writeJsonValue(EXTfldval& val, std::string& out);
+    void writeCsvValue(EXTfldval& val, std::string& out);
+    void writeCsvText(const char* data, std::size_t len, std::string& out);
+    std::size_t readChars(EXTfldval& val, const char*& data);
+
+    Format _format;
+    std::vector<Column> _columns;  // Columns of the list being written
+    std::vector<qchar> _chars;  // Conversion buffer reused for every character value
+};
+
+#endif // LIST_SERIALIZER_H_
@@ -0,0 +1,35 @@
+//
+//  ListSource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Serialises an Omnis list body a batch of rows at a time as the socket takes it, so a large list
+//  is never held as one serialised string.  The length isn't known until the last row is written,
+//  so the body is sent with chunked transfer encoding.
+
+#ifndef LIST_SOURCE_H_
+#define LIST_SOURCE_H_
+
+#include "BodySource.h"
+#include "ListSerializer.h"
+
+#include <boost/shared_ptr.hpp>
+
+class ListSource : public BodySource {
+public:
+    ListSource(const boost::shared_ptr<EXTqlist>& list, ListSerializer::Format format);
+
+    virtual boost::int64_t length() const { return kUnknownLength; }
+    virtual bool next(const char*& data, std::size_t& len);
+    virtual std::string error() const { return std::string(); }
+
+private:
+    boost::shared_ptr<EXTqlist> _list;
+    ListSerializer _serializer;
+    qlong _row;      // Next row to write, 0 before the list has been started
+    bool _finished;
+    std::string _batch;
+};
+
+#endif // LIST_SOURCE_H_
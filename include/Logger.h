@@ -0,0 +1,136 @@
+//
+//  Logger.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Backend of the LOG_ macros.  Messages are queued on a ring owned by the thread that logs them,
+//  without taking a lock, and a background thread writes them out in time order to standard output
+//  or to a file that's rotated when it reaches its size limit.  A full ring drops the message
+//  rather than holding up the thread that logged it.
+//
+//  The level is checked before a message is formatted, and in builds without _DEBUG the TRACE and
+//  DEBUG messages from C++ are compiled out altogether (those logged from Omnis are still written).
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+class Logger {
+public:
+    enum Level { kTrace, kDebug, kInfo, kWarning, kError, kFatal, kOff };
+
+    static const boost::uint64_t kDefaultMaxBytes = 10 * 1024 * 1024;
+    static const int kDefaultMaxFiles = 5;
+
+    // Created on first use, which must be on the main thread
+    static Logger& instance();
+
+    static bool enabled(Level level) { return level >= _level; }
+    static Level level() { return static_cast<Level>(_level); }
+    static void setLevel(Level level) { _level = level; }
+
+    static const char* levelName(Level level);
+    static bool parseLevel(const std::string& name, Level& level);
+
+    // Any thread: queue a message to be written
+    void write(Level level, const std::string& message);
+
+    // Write to path (standard output if it's empty), keeping up to maxFiles older files of maxBytes each
+    bool setFile(const std::string& path, boost::uint64_t maxBytes, int maxFiles, std::string& error);
+
+    // Wait until everything queued so far has been written
+    void flush();
+
+    boost::uint64_t dropped();  // Messages lost to full rings
+
+private:
+    Logger();
+    ~Logger();
+
+    Logger(Logger const&);          // Don't Implement.
+    void operator=(Logger const&);  // Don't implement
+
+    struct Entry {
+        Entry() : level(kInfo) {}
+
+        Level level;
+        boost::posix_time::ptime time;
+        std::string message;
+    };
+
+    // Single producer (the thread that owns it), single consumer (the writer thread).  Each index
+    // is only written by one side.
+    struct Ring {
+        static const boost::uint32_t kSize = 1024;
+
+        Ring() : head(0), tail(0), dropped(0), retired(false) {}
+
+        Entry entries[kSize];
+        volatile boost::uint32_t head;  // Next entry the owner fills
+        volatile boost::uint32_t tail;  // Next entry the writer takes
+        volatile boost::uint32_t dropped;
+        bool retired;                   // The owner has exited, so it's deleted once it's empty
+    };
+
+    static void retire(Ring* ring);
+    static bool earlier(const Entry& a, const Entry& b);
+
+    Ring& ring();
+    void run();
+    void drain(std::vector<Entry>& entries);
+    void output(const std::vector<Entry>& entries);
+    void rotate();
+    void closeFile();
+
+    static volatile int _level;
+
+    boost::mutex _mutex;  // Guards the list of rings and the output, never taken when logging
+    boost::condition_variable _drained;
+    std::vector<Ring*> _rings;
+    boost::uint64_t _retiredDropped;
+    boost::uint64_t _flushRequested;
+    boost::uint64_t _flushed;
+
+    std::string _path;
+    std::FILE* _file;  // Standard output when no path is set
+    boost::uint64_t _fileBytes;
+    boost::uint64_t _maxBytes;
+    int _maxFiles;
+
+    bool _stopping;
+    boost::condition_variable _wake;
+    boost::thread _writer;
+    boost::thread_specific_ptr<Ring> _ring;  // Last, so this thread's ring is retired first
+};
+
+// A message being formatted, queued when it goes out of scope
+class LogMessage {
+public:
+    LogMessage(Logger::Level level) : _level(level) {}
+    ~LogMessage() { Logger::instance().write(_level, _stream.str()); }
+
+    std::ostream& stream() { return _stream; }
+
+private:
+    Logger::Level _level;
+    std::ostringstream _stream;
+};
+
+// Turns the stream expression in the LOG_ macros into void, so they can be the branch of a ?:
+struct LogVoidify {
+    void operator&(std::ostream&) {}
+};
+
+#endif // LOGGER_H_
@@ -0,0 +1,142 @@
+//
+//  Metrics.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Process-wide request counters and latency histograms, read with $metrics.
+//
+//  Counts are spread over kShards shards, each with its own lock.  A thread is given a shard (in
+//  turn) the first time it records, and records into it from then on, so threads seldom wait on one
+//  another.  Reading takes each shard's lock in turn and merges them, and resetting clears them,
+//  all but the queue depth, which is a gauge.
+//
+//  Latencies are kept in log-linear histograms (as HdrHistogram does): each power of two is split
+//  into 16 linear buckets, so any value is placed within 1/16 of itself.
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+class Metrics {
+public:
+    enum Counter {
+        kRequestsStarted,
+        kRequestsCompleted,  // With a response of any status
+        kRequestsFailed,     // Without a response
+        kBytesIn,            // Response bodies as received
+        kBytesOut,           // Request bodies
+        kTcpRetransmits,     // Segments retransmitted during requests, where TCP_INFO is sampled (see kTcpSampled)
+        kPoolHits,           // Lists checked out of the ListPool without waiting
+        kPoolMisses,
+        kSlowRequests,       // Reported by the in-flight watchdog for going over a stage's threshold
+        kQueueDepth,         // Requests started in the background and not yet delivered (a gauge, not reset)
+        kCounterCount
+    };
+
+    enum StatusClass { kStatus1xx, kStatus2xx, kStatus3xx, kStatus4xx, kStatus5xx, kStatusFailed, kStatusClassCount };
+
+    class Histogram {
+    public:
+        static const int kSubBucketBits = 4;
+        static const int kSubBuckets = 1 << kSubBucketBits;
+        static const int kMaxBits = 40;  // Values from 2^40 microseconds (12 days) share the last bucket
+        static const int kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+
+        Histogram();
+
+        void record(boost::uint64_t value);
+        void add(const Histogram& other);
+        void subtract(const Histogram& other);
+
+        boost::uint64_t count() const { return _count; }
+        boost::uint64_t sum() const { return _sum; }
+        double mean() const;
+        boost::uint64_t percentile(double percent) const;  // Highest value of the bucket the percentile falls in
+        boost::uint64_t max() const { return percentile(100.0); }
+
+        static int bucket(boost::uint64_t value);
+        static boost::uint64_t highestValue(int bucket);
+
+    private:
+        boost::uint64_t _counts[kBuckets];
+        boost::uint64_t _count;
+        boost::uint64_t _sum;
+    };
+
+    struct Snapshot {
+        Snapshot();
+
+        boost::int64_t counters[kCounterCount];
+        std::map<std::string, Histogram> hosts;       // Request latency by host
+        Histogram statuses[kStatusClassCount];        // Request latency by status class
+        Histogram deliveryLag;                        // From a worker completing to its result reaching Omnis
+        Histogram tcpRtt;                             // Smoothed round trip time of each sampled connection as its response finished
+    };
+
+    static const std::size_t kMaxHosts = 64;  // Hosts after these are counted together
+    static const char* kOtherHosts;
+
+    // The requests kTcpRetransmits and tcpRtt cover, as the reports label them.  Only the HttpStreamClient
+    // samples TCP_INFO (cpp-netlib's client doesn't expose its socket), and only on Linux.
+    static const char* kTcpSampled;
+
+    // Created on first use, which must be on the main thread
+    static Metrics& instance();
+
+    static const char* counterName(Counter counter);
+    static const char* statusClassName(StatusClass statusClass);
+    static StatusClass statusClass(int status);  // 0 for a request that failed
+
+    // Any thread: record into the calling thread's shard
+    void count(Counter counter, boost::int64_t amount = 1);
+    void recordLatency(const std::string& host, int status, boost::uint64_t micros);
+    void recordDeliveryLag(boost::uint64_t micros);
+    void recordRtt(boost::uint64_t micros);
+
+    Snapshot snapshot();
+    void reset();
+
+private:
+    Metrics();
+
+    Metrics(Metrics const&);          // Don't Implement.
+    void operator=(Metrics const&);   // Don't implement
+
+    struct Shard {
+        Shard();
+        ~Shard();
+
+        void clear();  // All but the queue depth
+
+        boost::mutex mutex;
+        boost::int64_t counters[kCounterCount];
+        Histogram* hosts[kMaxHosts + 1];               // Allocated as the shard first sees each host
+        Histogram statuses[kStatusClassCount];
+        Histogram deliveryLag;
+        Histogram tcpRtt;
+        std::map<std::string, std::size_t> hostSlots;  // The shard's own copy of the shared host slots
+    };
+
+    static const std::size_t kShards = 16;
+
+    Shard& shard();
+    std::size_t hostSlot(Shard& shard, const std::string& host);  // Called with the shard's lock held
+    void addTo(Snapshot& snapshot, const Shard& shard);
+
+    Shard _shards[kShards];
+    boost::thread_specific_ptr<std::size_t> _shard;  // The calling thread's shard
+    boost::mutex _mutex;                             // Guards the rest
+    std::size_t _nextShard;
+    std::vector<std::string> _hosts;                 // Host of each slot
+    std::map<std::string, std::size_t> _hostSlots;
+};
+
+#endif // METRICS_H_
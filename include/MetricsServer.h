@@ -0,0 +1,60 @@
+//
+//  MetricsServer.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Optional HTTP endpoint on the loopback interface, so that a scraper (such as a Prometheus node
+//  exporter) can read the request metrics of the process without any Omnis code running.  It serves
+//  GET /metrics in the Prometheus text format, and GET /inflight (the requests $inflight lists) as JSON.
+//
+//  It's served by cpp-netlib's async_server on a thread of its own, with one more thread for the
+//  handler, and is never started unless asked for.
+
+#ifndef METRICS_SERVER_H_
+#define METRICS_SERVER_H_
+
+#include "Metrics.h"
+#include "InflightRegistry.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+class MetricsServer {
+public:
+    // Created on first use, which must be on the main thread
+    static MetricsServer& instance();
+
+    // Listen on 127.0.0.1:port, replacing any earlier listener.  Returns false if the port can't be used.
+    bool start(int port, std::string& error);
+    void stop();
+    int port();  // 0 when not running
+
+    // Metrics in the Prometheus text exposition format
+    static std::string prometheus(const Metrics::Snapshot& snapshot);
+
+    // Requests in flight as a JSON array of objects
+    static std::string inflightJson(const std::vector<InflightRegistry::Request>& requests);
+
+private:
+    MetricsServer();
+    ~MetricsServer();
+
+    MetricsServer(MetricsServer const&);    // Don't Implement.
+    void operator=(MetricsServer const&);   // Don't implement
+
+    struct Listener;
+
+    void stopListener();
+
+    boost::mutex _mutex;
+    boost::scoped_ptr<Listener> _listener;
+    boost::thread _thread;
+    int _port;
+};
+
+#endif // METRICS_SERVER_H_
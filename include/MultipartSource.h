@@ -0,0 +1,58 @@
+//
+//  MultipartSource.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  multipart/form-data body built from a list of parts, each with a name and either an inline value
+//  or the path of a file to upload (plus optional filename and content_type).  The part headers are
+//  written up front, but file parts are read from disk as the socket takes them, so the whole body
+//  is never held in memory.  File sizes are read when the source is created, so the body is sent
+//  with a Content-Length.
+
+#ifndef MULTIPART_SOURCE_H_
+#define MULTIPART_SOURCE_H_
+
+#include "BodySource.h"
+#include "FileSource.h"
+#include "OmnisTools.he"
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+class MultipartSource : public BodySource {
+public:
+    // Inline values are moved out of the parts rather than copied
+    MultipartSource(std::vector<OmnisTools::ParamMap>& parts);
+
+    // Content-Type of the body, including its boundary
+    std::string contentType() const;
+
+    virtual boost::int64_t length() const { return _length; }
+    virtual bool next(const char*& data, std::size_t& len);
+    virtual std::string error() const { return _error; }
+
+private:
+    struct Piece {
+        Piece() : fileLength(0) {}
+        
+        std::string text;                    // Delimiter and headers, then an inline value
+        std::string path;                    // File sent after the text, if any
+        boost::int64_t fileLength;
+        boost::shared_ptr<FileSource> file;  // Opened when the piece is reached
+    };
+
+    void addPart(OmnisTools::ParamMap& part);
+    bool fail(const std::string& message);
+
+    std::string _boundary;
+    std::vector<Piece> _pieces;
+    std::size_t _piece;  // Piece being sent
+    bool _textSent;      // The text of the current piece has been sent
+    boost::int64_t _length;
+    std::string _error;
+};
+
+#endif // MULTIPART_SOURCE_H_
@@ -0,0 +1,74 @@
+//
+//  Projection.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Base for sinks that pick a handful of fields out of each record of a streamed document and
+//  write them straight into list rows, so neither the body nor a parsed tree is ever held in full.
+//
+//  The projection is described by a records path (where the records are in the document) and
+//  a list of columns, each with a name, a path relative to the record and an optional type
+//  (character, integer, number or boolean).
+
+#ifndef PROJECTION_H_
+#define PROJECTION_H_
+
+#include "BodySink.h"
+#include "OmnisTools.he"
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <extcomp.he>
+
+class Projection : public BodySink {
+public:
+    enum ColumnType {
+        kCharacter,
+        kInteger,
+        kNumber,
+        kBoolean
+    };
+
+    struct Column {
+        std::string name;
+        std::string path;
+        ColumnType type;
+    };
+
+    // Create a projection for format "json" or "xml" from the projection parameter rows.
+    // Returns an empty pointer and sets error if the format or any path is invalid.
+    static boost::shared_ptr<Projection> create(const std::string& format,
+                                                const std::string& records,
+                                                const std::vector<OmnisTools::ParamMap>& columns,
+                                                std::string& error);
+
+    virtual ~Projection() {}
+
+    virtual std::string error() const { return _error; }
+
+    // Result list, with one row per record
+    boost::shared_ptr<EXTqlist> list() { return _list; }
+    qlong rows() const { return _row; }
+
+protected:
+    Projection(const std::vector<Column>& columns);
+
+    void newRow();
+    void setCell(std::size_t col, const std::string& text);
+    bool filled(std::size_t col) const { return _filled[col]; }
+    bool fail(const std::string& message);
+
+    std::vector<Column> _columns;
+
+private:
+    boost::shared_ptr<EXTqlist> _list;
+    qlong _row;
+    std::vector<bool> _filled;  // Cells already set in the current row (the first match wins)
+    std::string _error;
+};
+
+#endif // PROJECTION_H_
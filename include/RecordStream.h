@@ -0,0 +1,103 @@
+//
+//  RecordStream.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Splits a streamed NDJSON or CSV body into records on the client thread and hands them to the
+//  main thread in batches of list rows while the response is still arriving.
+//
+//  Only a few batches are queued at a time.  When the queue is full write() waits for the main
+//  thread to take a batch, and since the body callback is synchronous the socket isn't read in
+//  the meantime, so memory stays flat however long the stream is.
+//
+//  Columns come from the CSV header line or the keys of the first NDJSON record.
+
+#ifndef RECORD_STREAM_H_
+#define RECORD_STREAM_H_
+
+#include "BodySink.h"
+#include "JsonListBuilder.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <extcomp.he>
+
+class RecordStream : public BodySink {
+public:
+    enum Format {
+        kNdjson,
+        kCsv
+    };
+
+    // Read a stream parameter ("ndjson" or "csv").  Returns false for an unknown format.
+    static bool parseFormat(const std::string& name, Format& format);
+
+    RecordStream(Format format, std::size_t batchSize, std::size_t maxBatches);
+
+    // Client thread
+    virtual bool write(const char* data, std::size_t len);
+    virtual bool finish();
+    virtual std::string error() const;
+
+    // Main thread: take the next complete batch, or an empty pointer if none is waiting
+    boost::shared_ptr<EXTqlist> takeBatch();
+
+    // Any thread: stop accepting data and release a writer waiting for space
+    void cancel();
+
+    qlong rows() const { return _rows; }
+
+private:
+    enum ColumnKind {
+        kCharacter,
+        kInteger,
+        kNumber,
+        kBoolean
+    };
+
+    struct Column {
+        std::string name;
+        ColumnKind kind;
+    };
+
+    bool line(const char* data, std::size_t len);
+    bool csv(const char* data, std::size_t len);
+    bool record(const std::vector<std::string>& fields);
+    bool record(const JsonValue& object);
+    void setCell(qshort col, const JsonValue& value);
+    bool newRow();
+    bool pushBatch();
+    bool fail(const std::string& message);
+
+    Format _format;
+    std::size_t _batchSize;
+    std::size_t _maxBatches;
+
+    std::vector<Column> _columns;
+    bool _haveColumns;
+
+    std::string _line;                // Partial NDJSON line carried over from the last chunk
+    std::string _field;               // CSV field being read
+    std::vector<std::string> _fields; // CSV record being read
+    bool _inQuotes;
+    bool _afterQuote;
+
+    boost::shared_ptr<EXTqlist> _batch;  // Batch being filled
+    qlong _batchRows;
+    qlong _rows;
+
+    std::deque<boost::shared_ptr<EXTqlist> > _batches;  // Complete batches waiting for the main thread
+    bool _cancelled;
+    std::string _error;
+    mutable boost::mutex _mutex;
+    boost::condition_variable _taken;
+};
+
+#endif // RECORD_STREAM_H_
@@ -0,0 +1,85 @@
+//
+//  RequestCoalescer.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Lets identical GETs that are in flight at the same time share one request.  The first request
+//  for a key leads the flight and makes the request; requests that join while it's in progress wait
+//  for the leader's result instead of making their own.  Every request in the flight gets the same
+//  immutable body rather than a copy of it.  If the leader fails, the others make their own requests.
+
+#ifndef REQUEST_COALESCER_H_
+#define REQUEST_COALESCER_H_
+
+#include "HttpStreamClient.h"
+
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class RequestCoalescer {
+public:
+    struct Result {
+        Result() : status(0) {}
+
+        int status;
+        HttpStreamClient::Headers headers;
+        boost::shared_ptr<const std::string> body;  // Shared by every request in the flight
+    };
+
+    class Flight {
+    public:
+        enum Outcome {
+            kShared,      // The leader's result was handed over
+            kFailed,      // The leader's request failed
+            kInterrupted  // The waiting request was canceled
+        };
+
+        Flight() : _done(false), _ok(false) {}
+
+        // Wait for the leader's result, or until interrupt is called with the same flag
+        Outcome wait(const bool& interrupted, Result& result);
+        void interrupt(bool& interrupted);
+
+    private:
+        friend class RequestCoalescer;
+
+        boost::mutex _mutex;
+        boost::condition_variable _finished;
+        bool _done;
+        bool _ok;
+        Result _result;
+    };
+    typedef boost::shared_ptr<Flight> FlightPtr;
+
+    // Created on first use, which must be on the main thread
+    static RequestCoalescer& instance();
+
+    // Requests are identical when their method, URL and headers all match
+    static std::string key(const std::string& method, const std::string& url, const HttpStreamClient::Headers& headers);
+
+    // Join the flight for key, or start one with the caller as its leader
+    FlightPtr join(const std::string& key, bool& leader);
+
+    // Leader: end the flight, handing result to the requests waiting on it (or failing them if it's null)
+    void finish(const std::string& key, const FlightPtr& flight, const Result* result);
+
+    boost::uint64_t coalesced() const;  // Requests that were answered by another's flight
+
+private:
+    RequestCoalescer() : _coalesced(0) {}
+
+    RequestCoalescer(RequestCoalescer const&);  // Don't Implement.
+    void operator=(RequestCoalescer const&);    // Don't implement
+
+    mutable boost::mutex _mutex;
+    std::map<std::string, FlightPtr> _flights;
+    boost::uint64_t _coalesced;
+};
+
+#endif // REQUEST_COALESCER_H_
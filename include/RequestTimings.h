@@ -0,0 +1,85 @@
+//
+//  RequestTimings.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Monotonic timestamps of the phases of one request, from being queued to its result reaching
+//  Omnis.  Phases a request doesn't go through (a reused connection has no DNS, connect or TLS) or
+//  that its client can't see (cpp-netlib doesn't report on its connection) are left unmarked.
+//
+//  Each phase is marked by whichever thread the request is on at the time, and the worker's own
+//  locks order those threads, so the timestamps aren't locked.  The bytes moved so far are kept
+//  alongside, for the in-flight registry's watchdog, which reads both without a lock (a value it
+//  reads may be a moment out of date).
+//
+//  On Linux the client also samples the kernel's view of the connection (TCP_INFO) as the response
+//  finishes, so a slow request can be put down to the server or to a lossy or congested link.
+
+#ifndef REQUEST_TIMINGS_H_
+#define REQUEST_TIMINGS_H_
+
+#include <boost/cstdint.hpp>
+
+class RequestTimings {
+public:
+    enum Phase {
+        kQueued,       // Handed to the worker
+        kStarted,      // Running on the worker thread
+        kDnsDone,
+        kConnected,
+        kTlsDone,
+        kRequestSent,
+        kFirstByte,    // Of the response
+        kLastByte,
+        kDelivered,    // Result passed to Omnis
+        kPhaseCount
+    };
+
+    // The connection as the response finished.  Not sampled on other platforms, for responses that
+    // didn't come through the HttpStreamClient, or if the kernel wouldn't report on the socket.
+    struct TcpInfo {
+        TcpInfo() : sampled(false), rtt(0), rttVar(0), retransmits(0), cwnd(0), deliveryRate(0) {}
+
+        bool sampled;
+        boost::uint32_t rtt;           // Smoothed round trip time, in microseconds
+        boost::uint32_t rttVar;        // Its variance, in microseconds
+        boost::uint32_t retransmits;   // Segments retransmitted over the life of the connection
+        boost::uint32_t cwnd;          // Congestion window, in segments
+        boost::uint64_t deliveryRate;  // Bytes per second, or 0 if the kernel doesn't report it (before 4.9)
+    };
+
+    RequestTimings();
+
+    // Microseconds on a clock that never goes backwards, from an arbitrary start
+    static boost::uint64_t now();
+    static const char* name(Phase phase);
+
+    void mark(Phase phase) { _at[phase] = now(); }
+    void markFirst(Phase phase) { if (!_at[phase]) mark(phase); }  // Keeps the earliest mark
+    bool marked(Phase phase) const { return _at[phase] != 0; }
+    boost::uint64_t at(Phase phase) const { return _at[phase]; }  // now() when marked
+
+    // Milliseconds from the first marked phase to this one
+    double elapsed(Phase phase) const;
+
+    // Last phase marked so far, or kPhaseCount if none is
+    Phase latest() const;
+
+    // Request and response body bytes moved so far (the response as received, before decompressing)
+    void addBytesOut(boost::uint64_t bytes) { _bytesOut += bytes; }
+    void addBytesIn(boost::uint64_t bytes) { _bytesIn += bytes; }
+    boost::uint64_t bytesOut() const { return _bytesOut; }
+    boost::uint64_t bytesIn() const { return _bytesIn; }
+
+    void setTcpInfo(const TcpInfo& info) { _tcpInfo = info; }
+    const TcpInfo& tcpInfo() const { return _tcpInfo; }
+
+private:
+    volatile boost::uint64_t _at[kPhaseCount];  // 0 until marked
+    volatile boost::uint64_t _bytesOut;
+    volatile boost::uint64_t _bytesIn;
+    TcpInfo _tcpInfo;
+};
+
+#endif // REQUEST_TIMINGS_H_
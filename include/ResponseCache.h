@@ -0,0 +1,178 @@
+//
+//  ResponseCache.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Process-wide cache of GET responses, bounded in bytes and evicted least recently used first.
+//  Entries are kept for as long as Cache-Control (max-age, no-cache, no-store) or Expires allows,
+//  or a tenth of their age since Last-Modified when neither is given.  A stale entry with an ETag or
+//  Last-Modified is revalidated with a conditional request, and reused as it is on a 304.  As a shared
+//  cache, it doesn't store private responses, nor responses to requests with Authorization unless
+//  they're marked public, s-maxage or must-revalidate.
+//
+//  A stale entry can still be used for a while after it expires: for as long as stale-while-revalidate
+//  allows it's returned at once while it's revalidated in the background, and for as long as
+//  stale-if-error allows it stands in for a response that fails (RFC 5861).  Requests can override both.
+//
+//  Once a cache directory has been opened, entries are also written to the DiskCache, and entries
+//  missing from memory are loaded from it.
+//
+//  Entries are spread over several shards by key, each with its own lock and its own share of the
+//  capacity, so workers looking up different URLs don't wait on each other.
+
+#ifndef RESPONSE_CACHE_H_
+#define RESPONSE_CACHE_H_
+
+#include "HttpStreamClient.h"
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+class ResponseCache {
+public:
+    static const std::size_t kDefaultCapacity = 32 * 1024 * 1024;  // Bytes
+
+    struct Entry {
+        Entry() : status(0), responseTime(0), expires(0), staleWhileRevalidate(0), staleIfError(0) {}
+
+        std::size_t size() const;
+        bool fresh(std::time_t now) const { return now < expires; }
+        bool hasValidator() const { return !etag.empty() || !lastModified.empty(); }
+        bool usableWhileRevalidating(std::time_t now) const { return now < expires + staleWhileRevalidate; }
+        bool usableOnError(std::time_t now) const { return now < expires + staleIfError; }
+
+        int status;
+        HttpStreamClient::Headers headers;
+        boost::shared_ptr<const std::string> body;  // Shared by every hit rather than copied
+        HttpStreamClient::Headers vary;             // Request headers named by Vary, with the values they were sent with
+        std::time_t responseTime;                   // When the response was received or last revalidated
+        std::time_t expires;                        // Fresh until
+        long staleWhileRevalidate;                  // Seconds past expires it may be used while it's revalidated
+        long staleIfError;                          // Seconds past expires it may be used when a request fails
+        std::string etag;
+        std::string lastModified;
+    };
+    typedef boost::shared_ptr<const Entry> EntryPtr;
+
+    // A request's own limits on using stale entries, in seconds, replacing the response's.  -1 keeps the response's.
+    struct StaleLimits {
+        StaleLimits() : whileRevalidate(-1), ifError(-1) {}
+
+        long whileRevalidate;
+        long ifError;
+    };
+
+    struct Stats {
+        Stats() : hits(0), misses(0), revalidations(0), stale(0), evictions(0), entries(0), bytes(0), capacity(0) {}
+
+        boost::uint64_t hits;           // Fresh entries served without a request
+        boost::uint64_t misses;         // Lookups that needed a request, including revalidations
+        boost::uint64_t revalidations;  // Stale entries reused after a 304
+        boost::uint64_t stale;          // Stale entries used while revalidating or in place of a failed request
+        boost::uint64_t evictions;
+        boost::uint64_t entries;
+        boost::uint64_t bytes;
+        boost::uint64_t capacity;
+    };
+
+    // Created on first use, which must be on the main thread
+    static ResponseCache& instance();
+
+    // Whether a request may be answered from the cache at all
+    static bool cacheable(const std::string& method, const HttpStreamClient::Headers& requestHeaders);
+
+    // Make an entry from a response, sharing its body, or an empty pointer if the response may not be stored
+    static EntryPtr makeEntry(int status,
+                              const HttpStreamClient::Headers& headers,
+                              const boost::shared_ptr<const std::string>& body,
+                              const HttpStreamClient::Headers& requestHeaders,
+                              std::time_t now);
+
+    // The entry refreshed by the headers of a 304 response, or an empty pointer if it may no longer be stored
+    static EntryPtr revalidate(const EntryPtr& entry,
+                               const HttpStreamClient::Headers& notModifiedHeaders,
+                               const HttpStreamClient::Headers& requestHeaders,
+                               std::time_t now);
+
+    // Add the conditional headers that revalidate entry, unless the request has its own
+    static void addValidators(const EntryPtr& entry, HttpStreamClient::Headers& requestHeaders);
+
+    static bool parseHttpDate(const std::string& text, std::time_t& time);
+    static std::string key(const std::string& method, const std::string& url);
+
+    // Cached entry for a request, fresh or stale.  Empty if there isn't one or it varies on headers
+    // the request doesn't match.  A fresh entry counts as a hit and anything else as a miss.  A stale
+    // entry is returned with the request's limits applied.
+    EntryPtr find(const std::string& key,
+                  const HttpStreamClient::Headers& requestHeaders,
+                  std::time_t now,
+                  const StaleLimits& limits = StaleLimits());
+
+    // Add or replace an entry, evicting the least recently used entries to make room.  Entries are
+    // also written to the disk cache when it's open.
+    void store(const std::string& key, const EntryPtr& entry);
+    
+    // Replace an entry refreshed by a 304, whose body is the one already stored
+    void refresh(const std::string& key, const EntryPtr& entry);
+    void remove(const std::string& key);
+
+    // Cache the response to a request made while cached (if any) was stale.  A 304 refreshes cached and
+    // returns the entry to use in its place; any other response is stored if it may be, and nothing is returned.
+    EntryPtr storeResponse(const std::string& key,
+                           const EntryPtr& cached,
+                           int status,
+                           const HttpStreamClient::Headers& headers,
+                           const boost::shared_ptr<const std::string>& body,
+                           const HttpStreamClient::Headers& requestHeaders,
+                           std::time_t now);
+
+    void countRevalidation(const std::string& key);
+    void countStale(const std::string& key);
+
+    // A capacity of 0 empties the cache and stores nothing more
+    void setCapacity(std::size_t bytes);
+    Stats stats() const;
+
+private:
+    ResponseCache();
+
+    ResponseCache(ResponseCache const&);  // Don't Implement.
+    void operator=(ResponseCache const&); // Don't implement
+
+    typedef std::list<std::pair<std::string, EntryPtr> > LruList;  // Most recently used first
+
+    struct Shard {
+        Shard() : bytes(0), capacity(0), hits(0), misses(0), revalidations(0), stale(0), evictions(0) {}
+
+        void evict(std::size_t limit);
+        void put(const std::string& key, const EntryPtr& entry);
+        void take(const std::string& key);
+
+        mutable boost::mutex mutex;
+        LruList lru;
+        std::map<std::string, LruList::iterator> index;
+        std::size_t bytes;
+        std::size_t capacity;
+        boost::uint64_t hits;
+        boost::uint64_t misses;
+        boost::uint64_t revalidations;
+        boost::uint64_t stale;
+        boost::uint64_t evictions;
+    };
+
+    static const std::size_t kShards = 16;
+
+    Shard& shard(const std::string& key);
+
+    Shard _shards[kShards];
+};
+
+#endif // RESPONSE_CACHE_H_
@@ -0,0 +1,106 @@
+//
+//  SegmentedDownload.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Downloads a file as byte ranges fetched over several connections at once.  A HEAD request checks
+//  that the server accepts ranges, following any redirects so that the ranges are fetched from where
+//  the file really is; if it doesn't, the file is downloaded over a single connection.  Only a 2xx
+//  response (206 for a range) is written to the file, anything else fails the download.
+//
+//  The file is preallocated as "<path>.part" and each connection writes its ranges in place.
+//  Connections are added one at a time while each new one still raises the total throughput by a
+//  useful share of the per-connection throughput, up to the given maximum.  Completed ranges are
+//  recorded in "<path>.part.state", so a failed or canceled download resumes from where it stopped
+//  when it is next requested (provided the file on the server hasn't changed).
+
+#ifndef SEGMENTED_DOWNLOAD_H_
+#define SEGMENTED_DOWNLOAD_H_
+
+#include "HttpStreamClient.h"
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class SegmentedDownload {
+public:
+    SegmentedDownload(const std::string& url,
+                      const HttpStreamClient::Headers& headers,
+                      const std::string& path,
+                      std::size_t maxConnections);
+
+    // Download the file.  Returns false if it failed or was canceled.
+    bool run();
+
+    // Abort the download from another thread.  Completed ranges are kept to resume from.
+    void cancel();
+
+    // Timeout of each connection (see HttpStreamClient::setTimeout)
+    void setTimeout(long seconds) { _timeout = seconds; }
+
+    int status() const { return _status; }
+    const HttpStreamClient::Headers& headers() const { return _headers; }
+    const std::string& path() const { return _path; }
+    boost::uint64_t bytes() const { return _length; }
+    std::size_t connections() const { return _clients.size(); }
+    std::string error() const;
+
+private:
+    struct Range {
+        Range(boost::uint64_t s = 0, boost::uint64_t e = 0) : start(s), end(e) {}
+
+        boost::uint64_t start;
+        boost::uint64_t end;  // Exclusive
+    };
+
+    class RangeSink;
+
+    boost::shared_ptr<HttpStreamClient> newClient();
+    bool single(HttpStreamClient& client);
+    bool prepareFile();
+    void loadState();
+    void saveState();
+    void markDone(const Range& range);
+    void addConnection(const boost::shared_ptr<HttpStreamClient>& client);
+    void fetch(boost::shared_ptr<HttpStreamClient> client);
+    bool fetchRange(HttpStreamClient& client, std::FILE* file, const Range& range, boost::uint64_t& written);
+    bool fail(const std::string& message);
+
+    std::string _url;
+    HttpStreamClient::Headers _requestHeaders;
+    std::string _path;
+    std::string _partPath;
+    std::string _statePath;
+    std::size_t _maxConnections;
+    long _timeout;
+
+    int _status;
+    HttpStreamClient::Headers _headers;
+    boost::uint64_t _length;
+    std::string _validator;  // ETag or Last-Modified, sent with If-Range
+
+    mutable boost::mutex _mutex;
+    boost::condition_variable _changed;
+    std::vector<Range> _done;     // Sorted and merged
+    std::deque<Range> _pending;   // Ranges not yet being fetched
+    std::size_t _active;          // Connections still fetching
+    std::size_t _failures;        // Failed ranges since the last one completed
+    boost::uint64_t _received;    // Bytes received by all connections
+    bool _failed;
+    bool _cancelled;
+    std::string _error;
+
+    std::vector<boost::shared_ptr<HttpStreamClient> > _clients;
+    boost::thread_group _threads;
+};
+
+#endif // SEGMENTED_DOWNLOAD_H_
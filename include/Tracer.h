@@ -0,0 +1,100 @@
+//
+//  Tracer.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Records timed spans of work (queue wait, DNS, connect, TLS, send, receive, parsing, converting
+//  results for Omnis, timer notifications and calls back into Omnis) while tracing is on, and writes
+//  them out in the Chrome Trace Event format, which chrome://tracing and Perfetto open as a timeline
+//  with a row per thread.
+//
+//  Spans go into a buffer of a fixed number of entries, the oldest overwritten once it's full.
+//  While tracing is off a span costs one check of a flag.
+
+#ifndef TRACER_H_
+#define TRACER_H_
+
+#include "RequestTimings.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+class Tracer {
+public:
+    static const std::size_t kDefaultCapacity = 100000;  // Spans
+
+    // Created on first use, which must be on the main thread
+    static Tracer& instance();
+
+    static bool enabled() { return _enabled; }
+
+    // Empty the buffer and record up to capacity spans.  The calling thread is named as the main thread.
+    void start(std::size_t capacity);
+    static void stop();
+
+    // Any thread: record a span between two times from RequestTimings::now()
+    void record(const char* name, const char* category, boost::uint64_t begin, boost::uint64_t end,
+                const std::string& detail = std::string());
+
+    // Spans recorded so far as Chrome Trace Event JSON
+    std::string json();
+    bool write(const std::string& path, std::string& error);
+
+private:
+    Tracer();
+
+    Tracer(Tracer const&);          // Don't Implement.
+    void operator=(Tracer const&);  // Don't implement
+
+    struct Span {
+        Span() : name(0), category(0), begin(0), end(0), thread(0) {}
+
+        const char* name;      // Literals, so nothing is copied but the detail
+        const char* category;
+        boost::uint64_t begin;
+        boost::uint64_t end;
+        int thread;
+        std::string detail;
+    };
+
+    int thread();
+
+    static volatile bool _enabled;
+
+    boost::mutex _mutex;
+    std::vector<Span> _spans;  // Circular once full
+    std::size_t _next;
+    boost::uint64_t _recorded;  // Including those overwritten
+    int _threads;
+    int _mainThread;
+    boost::thread_specific_ptr<int> _thread;
+};
+
+// Records the span from its construction to its destruction, if tracing was on when it began
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category)
+        : _name(name), _category(category), _begin(Tracer::enabled() ? RequestTimings::now() : 0) {}
+    TraceSpan(const char* name, const char* category, const std::string& detail)
+        : _name(name), _category(category), _begin(Tracer::enabled() ? RequestTimings::now() : 0), _detail(_begin ? detail : std::string()) {}
+    ~TraceSpan() {
+        if (_begin && Tracer::enabled())
+            Tracer::instance().record(_name, _category, _begin, RequestTimings::now(), _detail);
+    }
+
+private:
+    TraceSpan(TraceSpan const&);        // Don't Implement.
+    void operator=(TraceSpan const&);   // Don't implement
+
+    const char* _name;
+    const char* _category;
+    boost::uint64_t _begin;
+    std::string _detail;
+};
+
+#endif // TRACER_H_
@@ -45,6 +45,7 @@ public:
     
     bool complete();
     void setComplete(bool c);
+    boost::uint64_t completedAt();  // RequestTimings::now() when the work completed on its thread, or 0
     
     void cancel();
     bool cancelled();
@@ -82,6 +83,7 @@ private:
     bool _running;
     bool _complete;
     bool _cancelled;
+    boost::uint64_t _completedAt;
     
     boost::shared_mutex _runMutex;
     boost::shared_mutex _completeMutex;
@@ -97,9 +99,26 @@ private:
 // Worker Delegate
 class WorkerDelegate : public boost::enable_shared_from_this<WorkerDelegate> {
 public:
+    virtual ~WorkerDelegate() {}
+    
     virtual void init(OmnisTools::ParamMap&) = 0;
     virtual OmnisTools::ParamMap run(OmnisTools::ParamMap&) = 0;
     virtual void cancel() = 0;
+    
+    // Main thread: the work is about to be started on a thread, or run on this one
+    virtual void queued() {}
+    
+    // Main thread: the result has been passed to Omnis
+    virtual void delivered() {}
+    
+    // Main thread: results available before the work completes (e.g. rows of a streamed response).
+    // Returns false when there is nothing waiting.
+    virtual bool partialResult(OmnisTools::ParamMap&) { return false; }
+    
+    // Main thread: pieces of a request body written from Omnis while the request is sent.
+    // Return false when the delegate isn't taking a written body or the request has finished.
+    virtual bool writeChunk(const std::string&) { return false; }
+    virtual bool endChunks() { return false; }
 };
 
 #endif // WORKER_H_
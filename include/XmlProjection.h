@@ -0,0 +1,54 @@
+//
+//  XmlProjection.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Projects fields out of a streamed XML document using a small subset of XPath.
+//
+//  The records path is absolute ("/feed/entry") or matches at any depth ("//entry").  Column
+//  paths are relative to the record: "title", "author/name", "@id", "link/@href" or "." for
+//  the text of the record itself.  Names without a prefix also match prefixed elements.
+
+#ifndef XML_PROJECTION_H_
+#define XML_PROJECTION_H_
+
+#include "Projection.h"
+#include "XmlReader.h"
+
+class XmlProjection : public Projection, private XmlHandler {
+public:
+    XmlProjection(const std::string& records, const std::vector<Column>& columns);
+
+    virtual bool write(const char* data, std::size_t len);
+    virtual bool finish();
+
+private:
+    struct Capture {
+        std::size_t column;
+        std::size_t depth;
+        std::string text;
+    };
+
+    // XmlHandler
+    virtual void startElement(const std::string& name, const Attributes& attributes);
+    virtual void endElement(const std::string& name);
+    virtual void text(const std::string& text);
+
+    static bool nameMatches(const std::string& pattern, const std::string& name);
+    bool matches(const std::vector<std::string>& path, std::size_t from) const;
+    bool isRecord() const;
+
+    XmlReader _reader;
+
+    std::vector<std::string> _recordsPath;
+    bool _anyDepth;                                        // Records path started with "//"
+    std::vector<std::vector<std::string> > _columnPaths;   // Element path of each column
+    std::vector<std::string> _columnAttributes;            // Attribute of each column (or empty)
+
+    std::vector<std::string> _stack;  // Open elements
+    std::size_t _recordDepth;         // Depth of the current record while inside one
+    std::vector<Capture> _captures;
+};
+
+#endif // XML_PROJECTION_H_
@@ -0,0 +1,72 @@
+//
+//  XmlReader.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Incremental (push) XML reader in the same style as JsonReader.  Data can be fed in arbitrary
+//  chunks and elements and text are reported to an XmlHandler as they complete.  Comments,
+//  processing instructions and DOCTYPE declarations are skipped; DTDs aren't processed, so only
+//  the predefined and numeric entities are expanded.
+
+#ifndef XML_READER_H_
+#define XML_READER_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// Receives parse events from XmlReader
+class XmlHandler {
+public:
+    typedef std::vector<std::pair<std::string, std::string> > Attributes;
+
+    virtual ~XmlHandler() {}
+
+    virtual void startElement(const std::string& name, const Attributes& attributes) = 0;
+    virtual void endElement(const std::string& name) = 0;
+    virtual void text(const std::string& text) = 0;  // Unescaped UTF-8, may be reported in pieces
+};
+
+class XmlReader {
+public:
+    XmlReader(XmlHandler& handler);
+
+    // Parse the next chunk of the document.  Returns false once an error has been found.
+    bool feed(const char* data, std::size_t len);
+
+    // Signal the end of the document.  Returns false if the document was incomplete or invalid.
+    bool finish();
+
+    // Reset to parse a new document with the same handler
+    void reset();
+
+    bool failed() const { return !_error.empty(); }
+    const std::string& error() const { return _error; }
+
+private:
+    enum State {
+        kText,    // Character data between markup
+        kMarkup   // Between '<' and the '>' that closes it
+    };
+
+    void flushText();
+    bool markupComplete();
+    void markup();
+    void tag();
+    static void decode(const std::string& raw, std::string& out);
+    bool fail(const char* message);
+
+    XmlHandler& _handler;
+
+    State _state;
+    std::string _text;                // Raw character data since the last markup
+    std::string _markup;              // Markup being read, without the '<'
+    char _quote;                      // Quote character while inside an attribute value
+    std::vector<std::string> _stack;  // Open elements
+    bool _seenRoot;
+
+    std::string _error;
+};
+
+#endif // XML_READER_H_
@@ -0,0 +1,298 @@
+//
+//  HTTPlibDriver.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Loads the component into the headless Omnis host and makes requests through HTTPWorker objects,
+//  as an Omnis library would: $initialize with a row of parameters, then $start, with the result
+//  delivered to $completed by the timer.
+//
+//    httplib_driver --self-test
+//        Requests the component's own metrics endpoint with $run and $start, and checks the results
+//    httplib_driver [--requests N] [--concurrency C] URL
+//        Makes N GET requests, C at a time, and prints the rate and the latency from $start to
+//        $completed
+
+#include "OmnisHost.he"
+#include "OmnisTools.he"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+extern "C" qlong NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam, LPARAM lParam, EXTCompInfo* eci);
+
+using namespace OmnisTools;
+
+namespace {
+    // Resource and method ids of the component (see HTTPlib.cpp, NVObjHTTPWorker.cpp and Static.cpp)
+    const qlong cNVObjHTTPWorker = 1003;
+    const qlong cMethodInitialize = 4001,
+                cMethodRun        = 4002,
+                cMethodStart      = 4003;
+    const qlong cStaticMethodStartMetricsServer = 20016,
+                cStaticMethodStopMetricsServer  = 20017;
+
+    typedef boost::posix_time::ptime Time;
+
+    Time now() {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
+
+    // A request as the driver sees it, from $start to $completed
+    struct Request {
+        Request() : done(false), status(0) {}
+
+        Time started;
+        bool done;
+        long status;
+        std::string body;
+        double latency;  // Seconds
+    };
+
+    typedef std::map<qobjinst, Request> Requests;
+
+    // Status and body of the result row passed to $completed (or returned from $run)
+    void readResult(EXTfldval& row, Request& request) {
+        EXTqlist rowList, resultList;
+        EXTfldval resultVal, colVal;
+        if (!row.getList(&rowList, qfalse) || !rowList.getColValRef(1, 3, resultVal, qfalse))
+            return;
+        if (!resultVal.getList(&resultList, qfalse) || resultList.colCnt() < 3)
+            return;
+
+        resultList.getColValRef(1, 1, colVal, qfalse);
+        request.status = colVal.getLong();
+        resultList.getColValRef(1, 3, colVal, qfalse);
+        request.body = getStringFromEXTFldVal(colVal);
+    }
+
+    // Called for $completed, $canceled and $rows.  Objects aren't destroyed here, as they're still
+    // in the middle of the call.
+    void methodCalled(void* context, qobjinst inst, const std::string& method, EXTfldval* params, qlong paramCount) {
+        Requests& requests = *static_cast<Requests*>(context);
+        Requests::iterator it = requests.find(inst);
+        if (it == requests.end())
+            return;
+
+        Request& request = it->second;
+        if (method == "$completed" && paramCount == 1) {
+            readResult(params[0], request);
+        } else if (method != "$canceled") {
+            return;
+        }
+        request.done = true;
+        request.latency = (now() - request.started).total_microseconds() / 1e6;
+    }
+
+    // A row of request parameters for $initialize
+    void requestRow(EXTfldval& row, const std::string& url) {
+        EXTqlist list(listVlen);
+        str255 colName;
+        EXTfldval colVal;
+
+        colName = initStr255("url");
+        list.addCol(fftCharacter, dpDefault, 0, &colName);
+        colName = initStr255("method");
+        list.addCol(fftCharacter, dpDefault, 0, &colName);
+
+        list.insertRow();
+        list.getColValRef(1, 1, colVal, qtrue);
+        getEXTFldValFromString(colVal, url);
+        list.getColValRef(1, 2, colVal, qtrue);
+        getEXTFldValFromString(colVal, "GET");
+
+        row.setList(&list, qfalse, qtrue);
+    }
+
+    qobjinst newWorker(const std::string& url) {
+        qobjinst inst = OmnisHost::construct(cNVObjHTTPWorker);
+        if (!inst)
+            return 0;
+
+        EXTfldval row, ret;
+        requestRow(row, url);
+        OmnisHost::call(inst, cNVObjHTTPWorker, cMethodInitialize, &row, 1, &ret);
+        if (!getBoolFromEXTFldVal(ret)) {
+            OmnisHost::destruct(inst);
+            return 0;
+        }
+        return inst;
+    }
+
+    // Fire the timer, then destroy the objects whose requests have finished, moving the requests to
+    // finished.  Returns the number that finished.
+    std::size_t collect(Requests& requests, std::vector<Request>& finished) {
+        OmnisHost::runTimers(100);
+
+        std::size_t count = 0;
+        for (Requests::iterator it = requests.begin(); it != requests.end(); ) {
+            if (it->second.done) {
+                finished.push_back(it->second);
+                OmnisHost::destruct(it->first);
+                requests.erase(it++);
+                ++count;
+            } else {
+                ++it;
+            }
+        }
+        return count;
+    }
+
+    int fail(const std::string& message) {
+        std::fprintf(stderr, "FAIL: %s\n", message.c_str());
+        return 1;
+    }
+
+    int selfTest() {
+        // Serve metrics on a free loopback port, to have something to request
+        unsigned short port;
+        {
+            boost::asio::io_service service;
+            boost::asio::ip::tcp::acceptor acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+            port = acceptor.local_endpoint().port();
+        }
+        EXTfldval portVal, ret;
+        getEXTFldValFromInt(portVal, port);
+        OmnisHost::call(0, 0, cStaticMethodStartMetricsServer, &portVal, 1, &ret);
+        if (!getBoolFromEXTFldVal(ret))
+            return fail("$startMetricsServer");
+        std::string url = "http://127.0.0.1:" + boost::lexical_cast<std::string>(port) + "/metrics";
+
+        Requests requests;
+        OmnisHost::setMethodHandler(methodCalled, &requests);
+
+        // On the main thread with $run
+        qobjinst inst = newWorker(url);
+        if (!inst)
+            return fail("$initialize");
+        Request& runRequest = requests[inst];
+        runRequest.started = now();
+        OmnisHost::call(inst, cNVObjHTTPWorker, cMethodRun, 0, 0);
+        if (!runRequest.done)
+            return fail("$run didn't call $completed");
+        if (runRequest.status != 200)
+            return fail("$run status " + boost::lexical_cast<std::string>(runRequest.status));
+        if (runRequest.body.find("httplib_requests_started_total") == std::string::npos)
+            return fail("$run body:\n" + runRequest.body);
+        OmnisHost::destruct(inst);
+        requests.clear();
+
+        // In the background with $start, several at once
+        const std::size_t count = 8;
+        for (std::size_t i = 0; i < count; ++i) {
+            inst = newWorker(url);
+            if (!inst)
+                return fail("$initialize");
+            requests[inst].started = now();
+            OmnisHost::call(inst, cNVObjHTTPWorker, cMethodStart, 0, 0);
+        }
+        std::vector<Request> results;
+        Time lastProgress = now();
+        while (results.size() < count) {
+            if (collect(requests, results) > 0)
+                lastProgress = now();
+            else if ((now() - lastProgress).total_seconds() >= 30)
+                return fail("$start didn't call $completed");
+        }
+        for (std::vector<Request>::iterator it = results.begin(); it != results.end(); ++it) {
+            if (it->status != 200)
+                return fail("$start status " + boost::lexical_cast<std::string>(it->status));
+            if (it->body.find("httplib_requests_started_total") == std::string::npos)
+                return fail("$start body:\n" + it->body);
+        }
+
+        OmnisHost::call(0, 0, cStaticMethodStopMetricsServer, 0, 0);
+        OmnisHost::setMethodHandler(0, 0);
+        std::printf("OK: %lu requests\n", static_cast<unsigned long>(count + 1));
+        return 0;
+    }
+
+    int benchmark(const std::string& url, std::size_t count, std::size_t concurrency) {
+        Requests requests;
+        OmnisHost::setMethodHandler(methodCalled, &requests);
+
+        std::vector<Request> finished;
+        std::size_t started = 0;
+        Time begin = now(), lastProgress = begin;
+        while (finished.size() < count) {
+            while (started < count && requests.size() < concurrency) {
+                qobjinst inst = newWorker(url);
+                if (!inst)
+                    return fail("$initialize");
+                requests[inst].started = now();
+                OmnisHost::call(inst, cNVObjHTTPWorker, cMethodStart, 0, 0);
+                ++started;
+            }
+
+            if (collect(requests, finished) > 0)
+                lastProgress = now();
+            else if ((now() - lastProgress).total_seconds() >= 60)
+                return fail("no request completed in 60 seconds");
+        }
+        double elapsed = (now() - begin).total_microseconds() / 1e6;
+        OmnisHost::setMethodHandler(0, 0);
+
+        std::vector<double> latencies;
+        std::size_t failed = 0;
+        for (std::vector<Request>::iterator it = finished.begin(); it != finished.end(); ++it) {
+            if (it->status >= 200 && it->status < 400)
+                latencies.push_back(it->latency);
+            else
+                ++failed;
+        }
+
+        std::printf("%lu requests (%lu failed) in %.3f s: %.1f/s\n", static_cast<unsigned long>(count),
+                    static_cast<unsigned long>(failed), elapsed, count / elapsed);
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            std::size_t n = latencies.size();
+            std::printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+                        latencies[n / 2] * 1e3, latencies[n * 9 / 10] * 1e3, latencies[n * 99 / 100] * 1e3,
+                        latencies[n - 1] * 1e3);
+        }
+        return failed ? 1 : 0;
+    }
+
+    int usage() {
+        std::fprintf(stderr, "usage: httplib_driver --self-test\n"
+                             "       httplib_driver [--requests N] [--concurrency C] URL\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool test = false;
+    std::size_t count = 100, concurrency = 8;
+    std::string url;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--self-test") {
+            test = true;
+        } else if (arg == "--requests" && i + 1 < argc) {
+            count = std::strtoul(argv[++i], 0, 10);
+        } else if (arg == "--concurrency" && i + 1 < argc) {
+            concurrency = std::strtoul(argv[++i], 0, 10);
+        } else if (arg[0] != '-' && url.empty()) {
+            url = arg;
+        } else {
+            return usage();
+        }
+    }
+    if (!test && (url.empty() || count == 0 || concurrency == 0))
+        return usage();
+
+    OmnisHost::connect(NVObjWndProc);
+    int ret = test ? selfTest() : benchmark(url, count, concurrency);
+    OmnisHost::disconnect();
+    return ret;
+}
@@ -0,0 +1,316 @@
+//
+//  OmnisToolsBenchmark.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Micro-benchmarks of the OmnisTools conversions that every request and result goes through, run
+//  against the headless Omnis API (omnis/).  Each reports bytes or cells a second, and the heap
+//  allocations an iteration makes (allocs and alloc_bytes).
+//
+//  Strings are ASCII, mixed Unicode (1 to 4 byte UTF-8) or arbitrary bytes, from 100 B to 50 MB.
+//  Lists have 10 columns and 10 to 10,000 cells; rows stop at 400 cells, as Omnis lists can't have
+//  more columns than that.
+//
+//    omnistools_benchmark --benchmark_filter=String
+//    omnistools_benchmark --benchmark_filter='<kUnicode>/1048576'
+
+#include "OmnisTools.he"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <boost/lexical_cast.hpp>
+
+#include <benchmark/benchmark.h>
+
+using namespace OmnisTools;
+
+/**************************************************************************************************
+ **                                    ALLOCATIONS                                               **
+ **************************************************************************************************/
+
+// Replaces the global allocator, to count what the conversions (and the Omnis stub) allocate.  Every
+// form is replaced, so that nothing allocated here is freed by the library's allocator or the other
+// way round.
+namespace {
+    std::atomic<std::size_t> gAllocations(0), gAllocatedBytes(0);
+
+    void* countedAlloc(std::size_t size) {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+        gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+
+    // Not inlined into the operators, as GCC then pairs the free with the caller's new and warns
+    // (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    void countedFree(void* p) {
+        std::free(p);
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if (void* p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* p, std::size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    countedFree(p);
+}
+#endif
+
+namespace {
+    // Counts the allocations from construction (just before the timed loop) to destruction
+    class AllocationCounter {
+    public:
+        explicit AllocationCounter(benchmark::State& state)
+            : _state(state), _allocations(gAllocations.load()), _bytes(gAllocatedBytes.load()) {}
+
+        ~AllocationCounter() {
+            _state.counters["allocs"] = benchmark::Counter(static_cast<double>(gAllocations.load() - _allocations),
+                                                           benchmark::Counter::kAvgIterations);
+            _state.counters["alloc_bytes"] = benchmark::Counter(static_cast<double>(gAllocatedBytes.load() - _bytes),
+                                                                benchmark::Counter::kAvgIterations);
+        }
+
+    private:
+        benchmark::State& _state;
+        std::size_t _allocations;
+        std::size_t _bytes;
+    };
+
+/**************************************************************************************************
+ **                                      PAYLOADS                                                **
+ **************************************************************************************************/
+
+    enum Payload { kAscii, kUnicode, kBinary };
+
+    // bytes of text of the kind, cut at a character boundary
+    std::string payload(Payload kind, std::size_t bytes) {
+        std::string text;
+        text.reserve(bytes + 4);
+
+        if (kind == kBinary) {
+            boost::uint32_t seed = 2463534242u;
+            while (text.size() < bytes) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                text += static_cast<char>(seed & 0xFF);
+            }
+            return text;
+        }
+
+        // "Grüße, 東京 — naïve café ☕ 𝄞" mixes 1, 2, 3 and 4 byte characters
+        const char* pattern = (kind == kAscii)
+            ? "The quick brown fox jumps over the lazy dog 0123456789. "
+            : "Gr\xC3\xBC\xC3\x9F" "e, \xE6\x9D\xB1\xE4\xBA\xAC \xE2\x80\x94 na\xC3\xAF" "ve caf\xC3\xA9 \xE2\x98\x95 \xF0\x9D\x84\x9E ";
+        while (text.size() < bytes) {
+            text += pattern;
+        }
+        std::size_t end = bytes;
+        while (end > 0 && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80) {
+            --end;
+        }
+        text.resize(end);
+        return text;
+    }
+
+    // A row (one row of cells columns), or a list of cells / 10 rows of 10 columns.  Columns cycle
+    // through character, number, integer and boolean.
+    void cellList(EXTfldval& fVal, std::size_t cells, bool isRow) {
+        qshort columns = static_cast<qshort>(isRow ? cells : 10);
+        qlong rows = static_cast<qlong>(cells / columns);
+
+        EXTqlist list(listVlen);
+        str255 colName;
+        static const ffttype types[] = { fftCharacter, fftNumber, fftInteger, fftBoolean };
+        for (qshort col = 1; col <= columns; ++col) {
+            colName = initStr255(("col" + boost::lexical_cast<std::string>(col)).c_str());
+            list.addCol(types[(col - 1) % 4], types[(col - 1) % 4] == fftNumber ? dpFmask : dpDefault, 0, &colName);
+        }
+
+        EXTfldval colVal;
+        for (qlong row = 1; row <= rows; ++row) {
+            list.insertRow();
+            for (qshort col = 1; col <= columns; ++col) {
+                list.getColValRef(row, col, colVal, qtrue);
+                switch (types[(col - 1) % 4]) {
+                    case fftCharacter:
+                        getEXTFldValFromString(colVal, "value " + boost::lexical_cast<std::string>(row * col));
+                        break;
+                    case fftNumber:
+                        getEXTFldValFromDouble(colVal, row * col / 7.0);
+                        break;
+                    case fftInteger:
+                        getEXTFldValFromInt(colVal, static_cast<int>(row * col));
+                        break;
+                    default:
+                        getEXTFldValFromBool(colVal, (row + col) % 2 == 0);
+                        break;
+                }
+            }
+        }
+        fVal.setList(&list, qfalse, isRow ? qtrue : qfalse);
+    }
+
+/**************************************************************************************************
+ **                                     BENCHMARKS                                               **
+ **************************************************************************************************/
+
+    template <Payload kind>
+    void BM_getEXTFldValFromString(benchmark::State& state) {
+        std::string text = payload(kind, static_cast<std::size_t>(state.range(0)));
+        EXTfldval fVal;
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            getEXTFldValFromString(fVal, text);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+    }
+
+    template <Payload kind>
+    void BM_getStringFromEXTFldVal(benchmark::State& state) {
+        std::string text = payload(kind, static_cast<std::size_t>(state.range(0)));
+        EXTfldval fVal;
+        getEXTFldValFromString(fVal, text);
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            std::string converted = getStringFromEXTFldVal(fVal);
+            benchmark::DoNotOptimize(converted.data());
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+    }
+
+    template <Payload kind>
+    void BM_getWStringFromEXTFldVal(benchmark::State& state) {
+        std::string text = payload(kind, static_cast<std::size_t>(state.range(0)));
+        EXTfldval fVal;
+        getEXTFldValFromString(fVal, text);
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            std::wstring converted = getWStringFromEXTFldVal(fVal);
+            benchmark::DoNotOptimize(converted.data());
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+    }
+
+    // Character values for text, and binary values for bytes
+    template <Payload kind>
+    void BM_getAnyFromEXTFldVal(benchmark::State& state) {
+        std::string text = payload(kind, static_cast<std::size_t>(state.range(0)));
+        EXTfldval fVal;
+        if (kind == kBinary) {
+            std::vector<unsigned char> bytes(text.begin(), text.end());
+            getEXTFldValFromBinaryVector(fVal, bytes);
+        } else {
+            getEXTFldValFromString(fVal, text);
+        }
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            boost::any converted = getAnyFromEXTFldVal(fVal);
+            benchmark::DoNotOptimize(converted.empty());
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+    }
+
+    void BM_getAnyFromEXTFldVal_list(benchmark::State& state) {
+        std::size_t cells = static_cast<std::size_t>(state.range(0));
+        EXTfldval fVal;
+        cellList(fVal, cells, false);
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            boost::any converted = getAnyFromEXTFldVal(fVal);
+            benchmark::DoNotOptimize(converted.empty());
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cells));
+    }
+
+    void BM_getParamsFromRow(benchmark::State& state) {
+        std::size_t cells = static_cast<std::size_t>(state.range(0));
+        EXTfldval fVal;
+        cellList(fVal, cells, true);
+
+        AllocationCounter allocations(state);
+        for (auto _ : state) {
+            ParamMap params;
+            getParamsFromRow(0, fVal, params);
+            benchmark::DoNotOptimize(params.size());
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cells));
+    }
+
+    // 100 B, 10 KB, 1 MB and 50 MB
+    void payloadSizes(benchmark::internal::Benchmark* b) {
+        b->Arg(100)->Arg(10 << 10)->Arg(1 << 20)->Arg(50 << 20);
+        b->Unit(benchmark::kMicrosecond);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_getEXTFldValFromString, kAscii)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getEXTFldValFromString, kUnicode)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getEXTFldValFromString, kBinary)->Apply(payloadSizes);
+
+BENCHMARK_TEMPLATE(BM_getStringFromEXTFldVal, kAscii)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getStringFromEXTFldVal, kUnicode)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getStringFromEXTFldVal, kBinary)->Apply(payloadSizes);
+
+BENCHMARK_TEMPLATE(BM_getWStringFromEXTFldVal, kAscii)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getWStringFromEXTFldVal, kUnicode)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getWStringFromEXTFldVal, kBinary)->Apply(payloadSizes);
+
+BENCHMARK_TEMPLATE(BM_getAnyFromEXTFldVal, kAscii)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getAnyFromEXTFldVal, kUnicode)->Apply(payloadSizes);
+BENCHMARK_TEMPLATE(BM_getAnyFromEXTFldVal, kBinary)->Apply(payloadSizes);
+
+BENCHMARK(BM_getAnyFromEXTFldVal_list)->Arg(10)->Arg(100)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_getParamsFromRow)->Arg(10)->Arg(100)->Arg(400)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,15 @@
+// Copyright 2011 Dean Michael Berris (dberris@google.com).
+// Copyright 2011 Google, Inc.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// The compiled part of the cpp-netlib client, as in cpp-netlib's libs/network/src/client.cpp,
+// which deps/cpp-netlib doesn't include.
+
+#ifdef BOOST_NETWORK_NO_LIB
+#undef BOOST_NETWORK_NO_LIB
+#endif
+
+#include <boost/network/protocol/http/client/connection/normal_delegate.ipp>
+#include <boost/network/protocol/http/client/connection/ssl_delegate.ipp>
@@ -0,0 +1,10 @@
+// Copyright 2010 Dean Michael Berris.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// The compiled part of the cpp-netlib server, as in cpp-netlib's
+// libs/network/src/server_request_parsers_impl.cpp, which deps/cpp-netlib doesn't include.
+
+#define BOOST_SPIRIT_UNICODE
+#include <boost/network/protocol/http/server/impl/parsers.ipp>
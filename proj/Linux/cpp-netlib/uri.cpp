@@ -0,0 +1,159 @@
+// Copyright 2009, 2010, 2011, 2012 Dean Michael Berris, Jeroen Habraken, Glyn Matthews.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// The URI parser behind boost::network::uri::uri, which cpp-netlib compiles into its uri library
+// (libs/network/src/uri/uri.cpp) and deps/cpp-netlib doesn't include.  This follows the RFC 3986
+// grammar of that parser with plain loops rather than Spirit: an absolute URI, with the scheme,
+// user info, host, port, path, query and fragment found as ranges of the string without their
+// delimiters.
+
+#include <boost/network/uri/uri.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace boost {
+namespace network {
+namespace uri {
+namespace detail {
+namespace {
+typedef std::string::const_iterator iterator;
+typedef iterator_range<iterator> range;
+
+bool is_unreserved(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || std::strchr("-._~", c);
+}
+
+bool is_sub_delim(char c) {
+    return std::strchr("!$&'()*+,;=", c) != 0;
+}
+
+// Skips a percent-encoded octet at it, if there is one
+bool skip_pct_encoded(iterator &it, iterator last) {
+    if (*it != '%')
+        return true;
+    if (last - it < 3 || !std::isxdigit(static_cast<unsigned char>(it[1])) ||
+        !std::isxdigit(static_cast<unsigned char>(it[2])))
+        return false;
+    it += 2;
+    return true;
+}
+
+// Skips the characters of the set allowed in a part (besides unreserved, percent-encoded and
+// sub-delims), up to the first that ends it.  Returns false on a character that's in neither.
+bool skip_part(iterator &it, iterator last, const char *allowed, const char *ends) {
+    for (; it != last; ++it) {
+        char c = *it;
+        if (c != '\0' && std::strchr(ends, c))
+            return true;
+        if (c == '%') {
+            if (!skip_pct_encoded(it, last))
+                return false;
+        } else if (!is_unreserved(c) && !is_sub_delim(c) && !(c != '\0' && std::strchr(allowed, c))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse_authority(iterator first, iterator last, hierarchical_part<iterator> &hier_part) {
+    // user info, up to the last '@'
+    iterator host_begin = first;
+    for (iterator it = first; it != last; ++it) {
+        if (*it == '@')
+            host_begin = it + 1;
+    }
+    if (host_begin != first) {
+        iterator it = first;
+        if (!skip_part(it, host_begin - 1, ":", "") || it != host_begin - 1)
+            return false;
+        hier_part.user_info = range(first, host_begin - 1);
+    }
+
+    // host: an IP literal in brackets, or a name or IPv4 address
+    iterator it = host_begin;
+    if (it != last && *it == '[') {
+        it = std::find(it, last, ']');
+        if (it == last)
+            return false;
+        for (iterator c = host_begin + 1; c != it; ++c) {
+            if (!std::isxdigit(static_cast<unsigned char>(*c)) && !std::strchr(":.vV", *c) &&
+                !is_unreserved(*c) && !is_sub_delim(*c))
+                return false;
+        }
+        ++it;
+    } else if (!skip_part(it, last, "", ":")) {
+        return false;
+    }
+    hier_part.host = range(host_begin, it);
+
+    // port
+    if (it != last) {
+        if (*it != ':')
+            return false;
+        iterator port_begin = ++it;
+        for (; it != last; ++it) {
+            if (!std::isdigit(static_cast<unsigned char>(*it)))
+                return false;
+        }
+        hier_part.port = range(port_begin, last);
+    }
+    return true;
+}
+} // namespace
+
+bool parse(std::string::const_iterator first,
+           std::string::const_iterator last,
+           uri_parts<std::string::const_iterator> &parts) {
+    // scheme ":"
+    iterator it = first;
+    if (it == last || !std::isalpha(static_cast<unsigned char>(*it)))
+        return false;
+    while (it != last && (std::isalnum(static_cast<unsigned char>(*it)) || std::strchr("+-.", *it))) {
+        ++it;
+    }
+    if (it == last || *it != ':')
+        return false;
+    parts.scheme = range(first, it);
+    ++it;
+
+    // "//" authority, then the path
+    if (last - it >= 2 && it[0] == '/' && it[1] == '/') {
+        iterator authority_begin = it + 2;
+        iterator authority_end = authority_begin;
+        while (authority_end != last && !std::strchr("/?#", *authority_end)) {
+            ++authority_end;
+        }
+        if (!parse_authority(authority_begin, authority_end, parts.hier_part))
+            return false;
+        it = authority_end;
+    }
+    iterator path_begin = it;
+    if (!skip_part(it, last, ":@/", "?#"))
+        return false;
+    parts.hier_part.path = range(path_begin, it);
+
+    // "?" query
+    if (it != last && *it == '?') {
+        iterator query_begin = ++it;
+        if (!skip_part(it, last, ":@/?", "#"))
+            return false;
+        parts.query = range(query_begin, it);
+    }
+
+    // "#" fragment
+    if (it != last && *it == '#') {
+        iterator fragment_begin = ++it;
+        if (!skip_part(it, last, ":@/?", ""))
+            return false;
+        parts.fragment = range(fragment_begin, it);
+    }
+    return it == last;
+}
+} // namespace detail
+} // namespace uri
+} // namespace network
+} // namespace boost
@@ -0,0 +1,1041 @@
+//
+//  OmnisStub.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "extcomp.he"
+#include "chrbasic.he"
+#include "OmnisHost.he"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/thread.hpp>
+
+typedef std::vector<qchar> Chars;
+
+struct qfldvalData {
+    qfldvalData() : type(fftCharacter), subType(dpDefault), null(false), number(0), integer(0), boolean(1), list(0), object(0) {
+        std::memset(&date, 0, sizeof(date));
+    }
+    qfldvalData(const qfldvalData& other);
+    qfldvalData& operator=(const qfldvalData& other);
+    ~qfldvalData();
+
+    void reset(ffttype newType, qshort newSubType);  // The empty value of a type
+    qlistData& listData();                           // Created when first needed
+
+    ffttype type;
+    qshort subType;
+    bool null;
+    Chars chars;                // Character and constant
+    qreal number;
+    qlong integer;
+    qshort boolean;             // 2 for true, 1 for false
+    std::vector<qbyte> binary;  // Binary and picture
+    qlistData* list;            // List and row
+    datestamptype date;
+    qobjinst object;
+};
+
+struct qlistData {
+    struct Column {
+        ffttype type;
+        qshort subType;
+        Chars name;
+    };
+    typedef std::vector<qfldvalData> Row;
+
+    Row newRow() const;
+
+    std::vector<Column> columns;
+    std::deque<Row> rows;  // A deque, so appending a row leaves references to the cells of the others valid
+};
+
+/**************************************************************************************************
+ **                                   CHARACTERS                                                 **
+ **************************************************************************************************/
+
+namespace {
+    const qchar kReplacement = 0xFFFD;
+
+    // Next code point of UTF-8, or the byte itself if it doesn't start a valid sequence
+    qchar decodeUtf8(const qbyte*& in, const qbyte* end)
+    {
+        qbyte first = *in++;
+        if (first < 0x80)
+            return first;
+
+        int extra = (first >= 0xF0 && first < 0xF5) ? 3 : (first >= 0xE0) ? 2 : (first >= 0xC2) ? 1 : -1;
+        if (extra < 0 || end - in < extra || first >= 0xF5)
+            return first;
+
+        qchar c = first & (0x3F >> extra);
+        for (int i = 0; i < extra; ++i) {
+            if ((in[i] & 0xC0) != 0x80)
+                return first;
+            c = (c << 6) | (in[i] & 0x3F);
+        }
+        static const qchar minimum[] = { 0, 0x80, 0x800, 0x10000 };
+        if (c < minimum[extra] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            return first;
+
+        in += extra;
+        return c;
+    }
+
+    // Returns bytes written (at most 4)
+    int encodeUtf8(qchar c, qbyte* out)
+    {
+        if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            c = kReplacement;
+
+        if (c < 0x80) {
+            out[0] = static_cast<qbyte>(c);
+            return 1;
+        } else if (c < 0x800) {
+            out[0] = static_cast<qbyte>(0xC0 | (c >> 6));
+            out[1] = static_cast<qbyte>(0x80 | (c & 0x3F));
+            return 2;
+        } else if (c < 0x10000) {
+            out[0] = static_cast<qbyte>(0xE0 | (c >> 12));
+            out[1] = static_cast<qbyte>(0x80 | ((c >> 6) & 0x3F));
+            out[2] = static_cast<qbyte>(0x80 | (c & 0x3F));
+            return 3;
+        }
+        out[0] = static_cast<qbyte>(0xF0 | (c >> 18));
+        out[1] = static_cast<qbyte>(0x80 | ((c >> 12) & 0x3F));
+        out[2] = static_cast<qbyte>(0x80 | ((c >> 6) & 0x3F));
+        out[3] = static_cast<qbyte>(0x80 | (c & 0x3F));
+        return 4;
+    }
+
+    void appendAscii(Chars& chars, const char* text)
+    {
+        while (*text) {
+            chars.push_back(static_cast<qbyte>(*text++));
+        }
+    }
+
+    std::string toUtf8(const qchar* chars, qlong length)
+    {
+        std::string utf8;
+        qbyte encoded[4];
+        for (qlong i = 0; i < length; ++i) {
+            utf8.append(reinterpret_cast<char*>(encoded), encodeUtf8(chars[i], encoded));
+        }
+        return utf8;
+    }
+}
+
+qlong CHRunicode::charToUtf8(qchar* chars, qlong length, qbyte* utf8)
+{
+    // Each character is read before its bytes are written, so utf8 can be chars itself
+    qlong written = 0;
+    for (qlong i = 0; i < length; ++i) {
+        qchar c = chars[i];
+        written += encodeUtf8(c, utf8 + written);
+    }
+    return written;
+}
+
+qlong CHRunicode::utf8ToChar(qbyte* utf8, qlong length, qchar* chars)
+{
+    const qbyte* in = utf8;
+    const qbyte* end = utf8 + length;
+    qlong written = 0;
+    while (in < end) {
+        chars[written++] = decodeUtf8(in, end);
+    }
+    return written;
+}
+
+CHRconvToUtf16::CHRconvToUtf16(qbyte* utf8, qlong length)
+{
+    const qbyte* in = utf8;
+    const qbyte* end = utf8 + length;
+    _data.reserve(length + 1);
+    while (in < end) {
+        qchar c = decodeUtf8(in, end);
+        if (c >= 0x10000) {
+            _data.push_back(static_cast<UChar>(0xD800 + ((c - 0x10000) >> 10)));
+            _data.push_back(static_cast<UChar>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+        } else {
+            _data.push_back(static_cast<UChar>(c));
+        }
+    }
+    _data.push_back(0);
+}
+
+CHRconvFromUtf16::CHRconvFromUtf16(UChar* utf16, qlong length)
+{
+    qbyte encoded[4];
+    _data.reserve(length * 3 + 1);
+    for (qlong i = 0; i < length; ++i) {
+        qchar c = utf16[i];
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < length && utf16[i + 1] >= 0xDC00 && utf16[i + 1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (utf16[++i] - 0xDC00);
+        }
+        _data.insert(_data.end(), encoded, encoded + encodeUtf8(c, encoded));
+    }
+    _data.push_back(0);
+}
+
+CHRconvToUtf32FromChar::CHRconvToUtf32FromChar(qchar* chars, qlong length, qbool) : _data(chars, chars + length)
+{
+    _data.push_back(0);
+}
+
+CHRconvFromUtf32ToChar::CHRconvFromUtf32ToChar(U32Char* utf32, qlong length, qbool) : _data(utf32, utf32 + length)
+{
+    _data.push_back(0);
+}
+
+void strxxx::assign(const qchar* chars, qlong len)
+{
+    len = std::max<qlong>(0, std::min<qlong>(len, _capacity));
+    if (len > 0 && chars && chars != _chars)
+        std::memmove(_chars, chars, len * sizeof(qchar));
+    _length = static_cast<qshort>(len);
+    _chars[len] = 0;
+}
+
+void strxxx::setUtf8(qbyte* utf8, qlong len)
+{
+    std::vector<qchar> chars(len + 1);
+    assign(&chars[0], CHRunicode::utf8ToChar(utf8, len, &chars[0]));
+}
+
+void strxxx::concat(strxxx& other)
+{
+    qlong len = std::min<qlong>(other._length, _capacity - _length);
+    std::memmove(_chars + _length, other._chars, len * sizeof(qchar));
+    _length = static_cast<qshort>(_length + len);
+    _chars[_length] = 0;
+}
+
+/**************************************************************************************************
+ **                                     VALUES                                                   **
+ **************************************************************************************************/
+
+qfldvalData::qfldvalData(const qfldvalData& other)
+    : type(other.type), subType(other.subType), null(other.null), chars(other.chars), number(other.number),
+      integer(other.integer), boolean(other.boolean), binary(other.binary), list(0), date(other.date), object(other.object)
+{
+    if (other.list)
+        list = new qlistData(*other.list);
+}
+
+qfldvalData& qfldvalData::operator=(const qfldvalData& other)
+{
+    if (this != &other) {
+        qfldvalData copy(other);
+        std::swap(type, copy.type);
+        std::swap(subType, copy.subType);
+        std::swap(null, copy.null);
+        chars.swap(copy.chars);
+        std::swap(number, copy.number);
+        std::swap(integer, copy.integer);
+        std::swap(boolean, copy.boolean);
+        binary.swap(copy.binary);
+        std::swap(list, copy.list);
+        std::swap(date, copy.date);
+        std::swap(object, copy.object);
+    }
+    return *this;
+}
+
+qfldvalData::~qfldvalData()
+{
+    delete list;
+}
+
+void qfldvalData::reset(ffttype newType, qshort newSubType)
+{
+    type = newType;
+    subType = newSubType;
+    null = false;
+    chars.clear();
+    number = 0;
+    integer = 0;
+    boolean = 1;
+    binary.clear();
+    delete list;
+    list = 0;
+    std::memset(&date, 0, sizeof(date));
+    object = 0;
+}
+
+qlistData& qfldvalData::listData()
+{
+    if (!list)
+        list = new qlistData();
+    return *list;
+}
+
+qlistData::Row qlistData::newRow() const
+{
+    Row row(columns.size());
+    for (std::size_t col = 0; col < columns.size(); ++col) {
+        row[col].reset(columns[col].type, columns[col].subType);
+    }
+    return row;
+}
+
+namespace {
+    // The value as text, as Omnis converts it for a character field
+    Chars text(const qfldvalData& data)
+    {
+        Chars chars;
+        if (data.null)
+            return chars;
+
+        char buffer[64];
+        switch (data.type) {
+            case fftCharacter:
+            case fftConstant:
+                return data.chars;
+            case fftInteger:
+                std::sprintf(buffer, "%d", data.integer);
+                appendAscii(chars, buffer);
+                break;
+            case fftNumber:
+                if (data.subType == dpFmask || data.subType < 0 || data.subType > 14)
+                    std::sprintf(buffer, "%.15g", data.number);
+                else
+                    std::sprintf(buffer, "%.*f", static_cast<int>(data.subType), data.number);
+                appendAscii(chars, buffer);
+                break;
+            case fftBoolean:
+                appendAscii(chars, data.boolean == 2 ? "kTrue" : "kFalse");
+                break;
+            case fftDate:
+                std::sprintf(buffer, "%04d-%02d-%02d %02d:%02d:%02d", data.date.mYear, data.date.mMonth, data.date.mDay,
+                             data.date.mHour, data.date.mMin, data.date.mSec);
+                appendAscii(chars, buffer);
+                break;
+            case fftBinary:
+            case fftPicture:
+                chars.assign(data.binary.begin(), data.binary.end());  // Each byte as a Latin-1 character
+                break;
+            default:
+                break;
+        }
+        return chars;
+    }
+
+    std::string asciiText(const qfldvalData& data)
+    {
+        Chars chars = text(data);
+        return chars.empty() ? std::string() : toUtf8(&chars[0], static_cast<qlong>(chars.size()));
+    }
+}
+
+EXTfldval::EXTfldval() : _data(new qfldvalData()), _owned(true)
+{ }
+
+EXTfldval::EXTfldval(qfldval fldval) : _data(fldval), _owned(false)
+{ }
+
+EXTfldval::EXTfldval(const EXTfldval& other) : _data(new qfldvalData(*other._data)), _owned(true)
+{ }
+
+// Assigns the value, to the cell or parameter this refers to if it isn't its own
+EXTfldval& EXTfldval::operator=(const EXTfldval& other)
+{
+    *_data = *other._data;
+    return *this;
+}
+
+EXTfldval::~EXTfldval()
+{
+    if (_owned)
+        delete _data;
+}
+
+void EXTfldval::setFldVal(qfldval fldval)
+{
+    if (_owned)
+        delete _data;
+    _data = fldval;
+    _owned = false;
+}
+
+void EXTfldval::getType(ffttype& type, qshort* subType)
+{
+    type = _data->type;
+    if (subType)
+        *subType = _data->subType;
+}
+
+qbool EXTfldval::isNull()
+{
+    return _data->null ? qtrue : qfalse;
+}
+
+void EXTfldval::setNull(ffttype type, qshort subType)
+{
+    _data->reset(type, subType);
+    _data->null = true;
+}
+
+void EXTfldval::setEmpty(ffttype type, qshort subType)
+{
+    _data->reset(type, subType);
+}
+
+qlong EXTfldval::getLong()
+{
+    if (_data->null)
+        return 0;
+
+    switch (_data->type) {
+        case fftInteger:
+            return _data->integer;
+        case fftNumber:
+            return static_cast<qlong>(_data->number);
+        case fftBoolean:
+            return _data->boolean == 2 ? 1 : 0;
+        case fftCharacter:
+        case fftConstant:
+            return static_cast<qlong>(std::strtol(asciiText(*_data).c_str(), 0, 10));
+        default:
+            return 0;
+    }
+}
+
+void EXTfldval::setLong(qlong value)
+{
+    _data->reset(fftInteger, dpDefault);
+    _data->integer = value;
+}
+
+void EXTfldval::getNum(qreal& value, qshort& dp)
+{
+    dp = dpDefault;
+    value = 0;
+    if (_data->null)
+        return;
+
+    switch (_data->type) {
+        case fftNumber:
+            value = _data->number;
+            dp = _data->subType;
+            break;
+        case fftInteger:
+            value = _data->integer;
+            break;
+        case fftBoolean:
+            value = _data->boolean == 2 ? 1 : 0;
+            break;
+        case fftCharacter:
+        case fftConstant:
+            value = std::strtod(asciiText(*_data).c_str(), 0);
+            dp = dpFmask;
+            break;
+        default:
+            break;
+    }
+}
+
+void EXTfldval::setNum(qreal value, qshort dp)
+{
+    _data->reset(fftNumber, dp);
+    _data->number = value;
+}
+
+qshort EXTfldval::getBool()
+{
+    if (_data->null)
+        return 0;
+
+    switch (_data->type) {
+        case fftBoolean:
+            return _data->boolean;
+        case fftInteger:
+        case fftNumber:
+            return getLong() != 0 || _data->number != 0 ? 2 : 1;
+        case fftCharacter:
+        case fftConstant: {
+            std::string value = asciiText(*_data);
+            for (std::string::iterator it = value.begin(); it != value.end(); ++it) {
+                *it = static_cast<char>(std::tolower(static_cast<unsigned char>(*it)));
+            }
+            return (value == "1" || value == "true" || value == "yes" || value == "ktrue") ? 2 : 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+void EXTfldval::setBool(qshort value)
+{
+    _data->reset(fftBoolean, dpDefault);
+    _data->boolean = value;
+}
+
+strxxx& EXTfldval::getChar()
+{
+    Chars chars = text(*_data);
+    _chars.assign(chars.empty() ? 0 : &chars[0], static_cast<qlong>(chars.size()));
+    return _chars;
+}
+
+void EXTfldval::getChar(qlong maxLength, qchar* chars, qlong& length, qbool)
+{
+    if (_data->type == fftCharacter && !_data->null) {
+        length = std::min<qlong>(maxLength, static_cast<qlong>(_data->chars.size()));
+        if (length > 0)
+            std::memcpy(chars, &_data->chars[0], length * sizeof(qchar));
+        return;
+    }
+
+    Chars converted = text(*_data);
+    length = std::min<qlong>(maxLength, static_cast<qlong>(converted.size()));
+    if (length > 0)
+        std::memcpy(chars, &converted[0], length * sizeof(qchar));
+}
+
+void EXTfldval::setChar(strxxx& chars, qshort dp)
+{
+    setChar(chars.cString(), chars.length(), dp);
+}
+
+void EXTfldval::setChar(qchar* chars, qlong length, qshort dp)
+{
+    _data->reset(fftCharacter, dp);
+    _data->chars.assign(chars, chars + std::max<qlong>(length, 0));
+}
+
+void EXTfldval::setConstant(strxxx& name)
+{
+    _data->reset(fftConstant, dpDefault);
+    _data->chars.assign(name.cString(), name.cString() + name.length());
+}
+
+qlong EXTfldval::getBinLen()
+{
+    if (_data->null)
+        return 0;
+
+    switch (_data->type) {
+        case fftBinary:
+        case fftPicture:
+            return static_cast<qlong>(_data->binary.size());
+        case fftCharacter:
+        case fftConstant:
+            return static_cast<qlong>(_data->chars.size());
+        default:
+            return static_cast<qlong>(text(*_data).size());
+    }
+}
+
+void EXTfldval::getBinary(qlong maxLength, qbyte* data, qlong& length)
+{
+    length = 0;
+    if (_data->null || (_data->type != fftBinary && _data->type != fftPicture))
+        return;
+
+    length = std::min<qlong>(maxLength, static_cast<qlong>(_data->binary.size()));
+    if (length > 0)
+        std::memcpy(data, &_data->binary[0], length);
+}
+
+void EXTfldval::setBinary(ffttype type, qbyte* data, qlong length, qshort dp)
+{
+    _data->reset(type, dp);
+    if (length > 0)
+        _data->binary.assign(data, data + length);
+}
+
+EXTqlist* EXTfldval::getList(qbool canChange)
+{
+    EXTqlist* list = new EXTqlist();
+    getList(list, canChange);
+    return list;
+}
+
+qbool EXTfldval::getList(EXTqlist* list, qbool canChange, qbool)
+{
+    if (_data->type != fftList && _data->type != fftRow)
+        return qfalse;
+
+    if (list->_owned)
+        delete list->_data;
+    if (canChange) {
+        list->_data = new qlistData(_data->listData());
+        list->_owned = true;
+    } else {
+        list->_data = &_data->listData();
+        list->_owned = false;
+    }
+    return qtrue;
+}
+
+void EXTfldval::setList(EXTqlist* list, qbool dispose, qbool isRow)
+{
+    // A disposed list's rows are taken rather than copied.  The EXTqlist itself is left (empty) to
+    // its owner, as the component holds some of them in shared_ptrs.
+    qlistData* data;
+    if (dispose && list->_owned) {
+        data = list->_data;
+        list->_data = new qlistData();
+    } else {
+        data = new qlistData(*list->_data);
+    }
+
+    _data->reset(isRow ? fftRow : fftList, dpDefault);
+    _data->list = data;
+}
+
+void EXTfldval::getDate(datestamptype& date, qshort)
+{
+    if (_data->type == fftDate && !_data->null)
+        date = _data->date;
+    else
+        std::memset(&date, 0, sizeof(date));
+}
+
+void EXTfldval::setDate(datestamptype& date, qshort subType)
+{
+    _data->reset(fftDate, subType);
+    _data->date = date;
+}
+
+qobjinst EXTfldval::getObjInst(qbool)
+{
+    return _data->type == fftObject ? _data->object : 0;
+}
+
+qobjinst EXTfldval::getObjRef()
+{
+    return (_data->type == fftObjref || _data->type == fftObject) ? _data->object : 0;
+}
+
+void EXTfldval::setObjInst(qobjinst inst, qbool)
+{
+    _data->reset(fftObject, dpDefault);
+    _data->object = inst;
+}
+
+/**************************************************************************************************
+ **                                      LISTS                                                   **
+ **************************************************************************************************/
+
+EXTqlist::EXTqlist(qshort) : _data(new qlistData()), _owned(true)
+{ }
+
+EXTqlist::EXTqlist(const EXTqlist& other) : _data(new qlistData(*other._data)), _owned(true)
+{ }
+
+EXTqlist& EXTqlist::operator=(const EXTqlist& other)
+{
+    if (this != &other)
+        *_data = *other._data;
+    return *this;
+}
+
+EXTqlist::~EXTqlist()
+{
+    if (_owned)
+        delete _data;
+}
+
+qlong EXTqlist::rowCnt()
+{
+    return static_cast<qlong>(_data->rows.size());
+}
+
+qshort EXTqlist::colCnt()
+{
+    return static_cast<qshort>(_data->columns.size());
+}
+
+void EXTqlist::addCol(ffttype type, qshort subType, qlong, str255* name)
+{
+    qlistData::Column column;
+    column.type = type;
+    column.subType = subType;
+    if (name)
+        column.name.assign(name->cString(), name->cString() + name->length());
+    _data->columns.push_back(column);
+
+    for (std::deque<qlistData::Row>::iterator row = _data->rows.begin(); row != _data->rows.end(); ++row) {
+        row->push_back(qfldvalData());
+        row->back().reset(type, subType);
+    }
+}
+
+void EXTqlist::getCol(qshort col, qbool, str255& name)
+{
+    if (col < 1 || col > colCnt()) {
+        name.assign(0, 0);
+        return;
+    }
+    const Chars& chars = _data->columns[col - 1].name;
+    name.assign(chars.empty() ? 0 : &chars[0], static_cast<qlong>(chars.size()));
+}
+
+qlong EXTqlist::insertRow(qlong row)
+{
+    if (row <= 0 || row > rowCnt()) {
+        _data->rows.push_back(_data->newRow());
+        return rowCnt();
+    }
+    _data->rows.insert(_data->rows.begin() + (row - 1), _data->newRow());
+    return row;
+}
+
+void EXTqlist::deleteRow(qlong row)
+{
+    if (row >= 1 && row <= rowCnt())
+        _data->rows.erase(_data->rows.begin() + (row - 1));
+}
+
+void EXTqlist::setFinalRow(qlong rows)
+{
+    rows = std::max<qlong>(rows, 0);
+    while (rowCnt() > rows) {
+        _data->rows.pop_back();
+    }
+    while (rowCnt() < rows) {
+        _data->rows.push_back(_data->newRow());
+    }
+}
+
+void EXTqlist::clear(qshort)
+{
+    _data->columns.clear();
+    _data->rows.clear();
+}
+
+qbool EXTqlist::getColValRef(qlong row, qshort col, EXTfldval& fldval, qbool)
+{
+    if (row < 1 || row > rowCnt() || col < 1 || col > colCnt())
+        return qfalse;
+
+    fldval.setFldVal(&_data->rows[row - 1][col - 1]);
+    return qtrue;
+}
+
+/**************************************************************************************************
+ **                                   HEADLESS HOST                                              **
+ **************************************************************************************************/
+
+void* gInstLib = 0;
+
+namespace {
+    struct Timer {
+        WNDtimerProc proc;
+        long interval;  // Milliseconds
+        boost::posix_time::ptime due;
+    };
+
+    struct Host {
+        Host() : proc(0), handler(0), context(0), lastInstance(0), lastTimer(0),
+                 started(boost::posix_time::microsec_clock::universal_time()) {}
+
+        ComponentProc proc;
+        OmnisHost::MethodHandler handler;
+        void* context;
+
+        long lastInstance;
+        std::map<qobjinst, qlong> instances;                    // Class of each object the host created
+        std::map<std::pair<void*, LPARAM>, void*> objects;      // The component's object for each instance
+
+        UINT lastTimer;
+        std::map<UINT, Timer> timers;
+        boost::posix_time::ptime started;
+    };
+
+    Host& host()
+    {
+        static Host theHost;
+        return theHost;
+    }
+}
+
+void ECOsetupCallbacks(HWND, EXTCompInfo*)
+{ }
+
+qlong ECOgetId(EXTCompInfo* eci)
+{
+    return eci->mMethodId;
+}
+
+qshort ECOgetParamCount(EXTCompInfo* eci)
+{
+    return static_cast<qshort>(eci->mParams.size());
+}
+
+EXTParamInfo* ECOfindParamNum(EXTCompInfo* eci, qlong paramNum)
+{
+    if (paramNum < 1 || paramNum > static_cast<qlong>(eci->mParams.size()))
+        return 0;
+    return &eci->mParams[paramNum - 1];
+}
+
+void ECOaddParam(EXTCompInfo* eci, EXTfldval* value, qlong, qlong, qlong, qlong, qlong)
+{
+    eci->mReturn = *value;
+}
+
+qbool ECOdoMethod(qobjinst inst, strxxx* name, EXTfldval* params, qlong paramCount)
+{
+    Host& h = host();
+    if (h.handler)
+        h.handler(h.context, inst, toUtf8(name->cString(), name->length()), params, paramCount);
+    return qtrue;
+}
+
+qlong WNDdefWindowProc(HWND, LPARAM, WPARAM, LPARAM, EXTCompInfo*)
+{
+    return 0;
+}
+
+qlong ECOreturnMethods(void*, EXTCompInfo*, ECOmethodEvent*, qlong count)
+{
+    return count;
+}
+
+qlong ECOreturnProperties(void*, EXTCompInfo*, ECOproperty*, qlong count)
+{
+    return count;
+}
+
+qlong ECOreturnObjects(void*, EXTCompInfo*, ECOobject*, qlong count)
+{
+    return count;
+}
+
+qlong ECOreturnConstants(void*, EXTCompInfo*, qlong first, qlong last)
+{
+    return last - first + 1;
+}
+
+qlong ECOreturnCompInfo(void*, EXTCompInfo*, qlong, qlong)
+{
+    return qtrue;
+}
+
+qlong ECOreturnVersion(qlong major, qlong minor)
+{
+    return major * 100 + minor;
+}
+
+void* ECOfindNVObject(void* omnisInstance, LPARAM objPtr)
+{
+    std::map<std::pair<void*, LPARAM>, void*>& objects = host().objects;
+    std::map<std::pair<void*, LPARAM>, void*>::iterator it = objects.find(std::make_pair(omnisInstance, objPtr));
+    return it == objects.end() ? 0 : it->second;
+}
+
+void ECOinsertNVObject(void* omnisInstance, LPARAM objPtr, void* obj)
+{
+    host().objects[std::make_pair(omnisInstance, objPtr)] = obj;
+}
+
+void* ECOremoveNVObject(void* omnisInstance, LPARAM objPtr)
+{
+    std::map<std::pair<void*, LPARAM>, void*>& objects = host().objects;
+    std::map<std::pair<void*, LPARAM>, void*>::iterator it = objects.find(std::make_pair(omnisInstance, objPtr));
+    if (it == objects.end())
+        return 0;
+    void* obj = it->second;
+    objects.erase(it);
+    return obj;
+}
+
+// There are no Omnis subclasses of the component's objects
+qobjinst ECOgetNVObject(qobjinst inst)
+{
+    return inst;
+}
+
+qobjinst EXTobjinst(EXTCompInfo* eci)
+{
+    return OmnisHost::construct(eci->mCompId);
+}
+
+FARPROC WNDmakeTimerProc(WNDtimerProc proc, void*)
+{
+    return reinterpret_cast<FARPROC>(proc);
+}
+
+void WNDdisposeTimerProc(FARPROC)
+{ }
+
+UINT WNDsetTimer(HWND, UINT idTimer, UINT elapse, FARPROC proc)
+{
+    Host& h = host();
+    if (idTimer == 0)
+        idTimer = ++h.lastTimer;
+
+    Timer& timer = h.timers[idTimer];
+    timer.proc = reinterpret_cast<WNDtimerProc>(proc);
+    timer.interval = static_cast<long>(elapse);
+    timer.due = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timer.interval);
+    return idTimer;
+}
+
+void WNDkillTimer(HWND, UINT idTimer)
+{
+    host().timers.erase(idTimer);
+}
+
+void RESloadString(void*, qlong, strxxx& string)
+{
+    string.assign(0, 0);
+}
+
+void* MEMmalloc(qlong size)
+{
+    return std::malloc(static_cast<std::size_t>(size));
+}
+
+void MEMmovel(const void* from, void* to, qlong size)
+{
+    std::memmove(to, from, static_cast<std::size_t>(size));
+}
+
+void OMstrcpy(qchar* to, const qchar* from)
+{
+    while ((*to++ = *from++) != 0) {}
+}
+
+qbool stringToQlong(strxxx& string, qlong& value)
+{
+    std::string text = toUtf8(string.cString(), string.length());
+    if (text.empty())
+        return qfalse;
+
+    char* end = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != 0 || parsed < INT_MIN || parsed > INT_MAX)
+        return qfalse;
+
+    value = static_cast<qlong>(parsed);
+    return qtrue;
+}
+
+qlong OmnisHost::connect(ComponentProc proc)
+{
+    host().proc = proc;
+    EXTCompInfo eci;
+    eci.mOmnisInstance = &host();
+    return proc(0, ECM_CONNECT, 0, 0, &eci);
+}
+
+void OmnisHost::disconnect()
+{
+    Host& h = host();
+    if (!h.proc)
+        return;
+
+    EXTCompInfo eci;
+    eci.mOmnisInstance = &h;
+    h.proc(0, ECM_DISCONNECT, 0, 0, &eci);
+    h.proc = 0;
+}
+
+qobjinst OmnisHost::construct(qlong compId)
+{
+    Host& h = host();
+    if (!h.proc)
+        return 0;
+
+    qobjinst inst = reinterpret_cast<qobjinst>(++h.lastInstance);  // A handle only, never dereferenced
+    EXTCompInfo eci;
+    eci.mCompId = compId;
+    eci.mOmnisInstance = &h;
+    if (!h.proc(0, ECM_OBJCONSTRUCT, 0, reinterpret_cast<LPARAM>(inst), &eci))
+        return 0;
+
+    h.instances[inst] = compId;
+    return inst;
+}
+
+void OmnisHost::destruct(qobjinst inst)
+{
+    Host& h = host();
+    std::map<qobjinst, qlong>::iterator it = h.instances.find(inst);
+    if (!h.proc || it == h.instances.end())
+        return;
+
+    EXTCompInfo eci;
+    eci.mCompId = it->second;
+    eci.mOmnisInstance = &h;
+    h.instances.erase(it);
+    h.proc(0, ECM_OBJDESTRUCT, ECM_WPARAM_OBJINFO, reinterpret_cast<LPARAM>(inst), &eci);
+}
+
+qlong OmnisHost::call(qobjinst inst, qlong compId, qlong methodId, EXTfldval* params, qlong paramCount, EXTfldval* result)
+{
+    Host& h = host();
+    if (!h.proc)
+        return 0;
+
+    EXTCompInfo eci;
+    eci.mCompId = compId;
+    eci.mOmnisInstance = &h;
+    eci.mMethodId = methodId;
+    for (qlong i = 0; i < paramCount; ++i) {
+        EXTParamInfo param;
+        param.mData = params[i].getFldVal();
+        eci.mParams.push_back(param);
+    }
+
+    qlong ret = h.proc(0, ECM_METHODCALL, 0, reinterpret_cast<LPARAM>(inst), &eci);
+    if (result)
+        *result = eci.mReturn;
+    return ret;
+}
+
+void OmnisHost::setMethodHandler(MethodHandler handler, void* context)
+{
+    host().handler = handler;
+    host().context = context;
+}
+
+bool OmnisHost::runTimers(long waitMs)
+{
+    Host& h = host();
+    if (h.timers.empty())
+        return false;
+
+    using boost::posix_time::ptime;
+    ptime next = h.timers.begin()->second.due;
+    for (std::map<UINT, Timer>::iterator it = h.timers.begin(); it != h.timers.end(); ++it) {
+        next = std::min(next, it->second.due);
+    }
+    ptime now = boost::posix_time::microsec_clock::universal_time();
+    ptime until = std::min(next, now + boost::posix_time::milliseconds(waitMs));
+    if (until > now) {
+        boost::this_thread::sleep(until - now);
+        now = boost::posix_time::microsec_clock::universal_time();
+    }
+
+    // A timer's procedure may set or kill timers, so each is looked up again before it's fired
+    std::vector<UINT> due;
+    for (std::map<UINT, Timer>::iterator it = h.timers.begin(); it != h.timers.end(); ++it) {
+        if (it->second.due <= now)
+            due.push_back(it->first);
+    }
+    qulong time = static_cast<qulong>((now - h.started).total_milliseconds());
+    for (std::vector<UINT>::iterator id = due.begin(); id != due.end(); ++id) {
+        std::map<UINT, Timer>::iterator it = h.timers.find(*id);
+        if (it == h.timers.end())
+            continue;
+        it->second.due = now + boost::posix_time::milliseconds(it->second.interval);
+        it->second.proc(0, 0, *id, time);
+    }
+    return true;
+}
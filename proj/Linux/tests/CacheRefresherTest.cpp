@@ -0,0 +1,211 @@
+//
+//  CacheRefresherTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "CacheRefresher.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <ctime>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    HttpStreamClient::Headers headers(const std::string& name, const std::string& value) {
+        return HttpStreamClient::Headers(1, std::make_pair(name, value));
+    }
+
+    // An entry that went stale a minute ago, and may be served for a while yet as it's revalidated
+    ResponseCache::EntryPtr staleEntry(const std::string& body) {
+        HttpStreamClient::Headers response = headers("Cache-Control", "max-age=10, stale-while-revalidate=3600");
+        response.push_back(std::make_pair(std::string("ETag"), std::string("\"v1\"")));
+        return ResponseCache::makeEntry(200, response, boost::make_shared<std::string>(body), HttpStreamClient::Headers(),
+                                        std::time(0) - 70);
+    }
+
+    // Revalidates the entry cached under the URL's key, as a request answered with it would
+    void refresh(const std::string& url, const ResponseCache::EntryPtr& cached) {
+        HttpStreamClient::Headers request;
+        if (cached)
+            ResponseCache::addValidators(cached, request);
+        CacheRefresher::instance().start(url, request, HttpStreamClient::Headers(), ResponseCache::key("GET", url),
+                                         cached, false, 5);
+    }
+
+    // Waits up to five seconds for the server to have received count requests
+    bool waitForRequests(const TestServer& server, std::size_t count) {
+        for (int i = 0; i < 250; ++i) {
+            if (server.requests().size() >= count)
+                return true;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        }
+        return false;
+    }
+
+    // Waits up to five seconds for the entry cached for url to be fresh
+    ResponseCache::EntryPtr waitForFresh(const std::string& url) {
+        for (int i = 0; i < 250; ++i) {
+            ResponseCache::EntryPtr entry = ResponseCache::instance().find(ResponseCache::key("GET", url),
+                                                                           HttpStreamClient::Headers(), std::time(0));
+            if (entry && entry->fresh(std::time(0)))
+                return entry;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        }
+        return ResponseCache::EntryPtr();
+    }
+
+    std::string notModified(const TestServer::Request&) {
+        return TestServer::response(304, "", "Cache-Control: max-age=100\r\nETag: \"v1\"\r\n");
+    }
+
+    std::string moved(const TestServer::Request& request) {
+        if (request.target == "/old")
+            return TestServer::redirect(302, "/new");
+        return TestServer::response(200, "new body", "Cache-Control: max-age=100\r\n");
+    }
+
+    // Holds every response until it's opened, so that refreshes stay in progress
+    class Gate {
+    public:
+        Gate() : _open(false) {}
+
+        std::string respond(const TestServer::Request&) {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            while (!_open) {
+                _opened.wait(lock);
+            }
+            return TestServer::response(200, "body", "Cache-Control: no-store\r\n");
+        }
+
+        void open() {
+            boost::mutex::scoped_lock lock(_mutex);
+            _open = true;
+            _opened.notify_all();
+        }
+
+    private:
+        boost::mutex _mutex;
+        boost::condition_variable _opened;
+        bool _open;
+    };
+
+    // Opens the gate when the test ends, however it ends, so that the server (made before it) can be stopped
+    struct Opener {
+        explicit Opener(Gate& gate) : _gate(gate) {}
+        ~Opener() { _gate.open(); }
+
+        Gate& _gate;
+    };
+
+    std::string revalidatable(const TestServer::Request&) {
+        return TestServer::response(200, "revalidatable body", "Cache-Control: max-age=0, stale-while-revalidate=60\r\nETag: \"v1\"\r\n");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(CacheRefresherTest)
+
+BOOST_AUTO_TEST_CASE(notModifiedRefreshesTheEntry) {
+    TestServer server(notModified);
+    std::string url = server.url("/revalidated");
+    ResponseCache::EntryPtr cached = staleEntry("cached body");
+    ResponseCache::instance().store(ResponseCache::key("GET", url), cached);
+
+    refresh(url, cached);
+    ResponseCache::EntryPtr refreshed = waitForFresh(url);
+    BOOST_REQUIRE(refreshed);
+    BOOST_CHECK_EQUAL(*refreshed->body, "cached body");
+
+    std::vector<TestServer::Request> requests = server.requests();
+    BOOST_REQUIRE_EQUAL(requests.size(), 1u);
+    BOOST_CHECK_EQUAL(requests[0].header("If-None-Match"), "\"v1\"");
+    ResponseCache::instance().remove(ResponseCache::key("GET", url));
+}
+
+BOOST_AUTO_TEST_CASE(refreshesFollowRedirects) {
+    TestServer server(moved);
+    std::string url = server.url("/old");
+    ResponseCache::EntryPtr cached = staleEntry("old body");
+    ResponseCache::instance().store(ResponseCache::key("GET", url), cached);
+
+    refresh(url, cached);
+    ResponseCache::EntryPtr refreshed = waitForFresh(url);
+    BOOST_REQUIRE(refreshed);
+    BOOST_CHECK_EQUAL(*refreshed->body, "new body");  // Kept under the URL that was requested, as the request itself would
+
+    std::vector<TestServer::Request> requests = server.requests();
+    BOOST_REQUIRE_EQUAL(requests.size(), 2u);
+    BOOST_CHECK_EQUAL(requests[1].target, "/new");
+    ResponseCache::instance().remove(ResponseCache::key("GET", url));
+}
+
+BOOST_AUTO_TEST_CASE(identicalRefreshesAreMadeOnce) {
+    Gate gate;
+    TestServer server(boost::bind(&Gate::respond, &gate, _1));
+    Opener opener(gate);
+    std::string url = server.url("/once");
+
+    refresh(url, ResponseCache::EntryPtr());
+    BOOST_REQUIRE(waitForRequests(server, 1));
+    refresh(url, ResponseCache::EntryPtr());
+    refresh(url, ResponseCache::EntryPtr());
+
+    gate.open();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    BOOST_CHECK_EQUAL(server.requests().size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(refreshesBeyondTheQueueAreDropped) {
+    Gate gate;
+    TestServer server(boost::bind(&Gate::respond, &gate, _1));
+    Opener opener(gate);
+    CacheRefresher& refresher = CacheRefresher::instance();
+    boost::uint64_t before = refresher.dropped();
+
+    // Every thread is kept busy, and then the queue is filled
+    for (int i = 0; i < CacheRefresher::kThreads; ++i) {
+        refresh(server.url("/busy/" + boost::lexical_cast<std::string>(i)), ResponseCache::EntryPtr());
+    }
+    BOOST_REQUIRE(waitForRequests(server, CacheRefresher::kThreads));
+    for (std::size_t i = 0; i < CacheRefresher::kMaxQueued + 3; ++i) {
+        refresh(server.url("/queued/" + boost::lexical_cast<std::string>(i)), ResponseCache::EntryPtr());
+    }
+    BOOST_CHECK(refresher.dropped() == before + 3);
+
+    // The queued refreshes are all made once the threads are free
+    gate.open();
+    std::size_t made = CacheRefresher::kThreads + CacheRefresher::kMaxQueued;
+    BOOST_CHECK(waitForRequests(server, made));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    BOOST_CHECK_EQUAL(server.requests().size(), made);
+}
+
+BOOST_AUTO_TEST_CASE(delegateServesStaleEntriesWhileRefreshing) {
+    TestServer server(revalidatable);
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/stale-while-revalidate");
+    params["cache"] = true;
+    params["timeout"] = 5;
+
+    DelegateResult first = runDelegate(params);
+    BOOST_CHECK_EQUAL(first.body, "revalidatable body");
+    DelegateResult second = runDelegate(params);  // Stale at once, so answered from the cache and refreshed
+    BOOST_CHECK_EQUAL(second.status, 200);
+    BOOST_CHECK_EQUAL(second.body, "revalidatable body");
+
+    BOOST_REQUIRE(waitForRequests(server, 2));
+    BOOST_CHECK_EQUAL(server.requests()[1].header("If-None-Match"), "\"v1\"");
+    ResponseCache::instance().remove(ResponseCache::key("GET", server.url("/stale-while-revalidate")));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+//
+//  ChunkSourceTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ChunkSource.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // The next piece of the body as a string, or "(failed)"
+    std::string nextPiece(ChunkSource& source) {
+        const char* data;
+        std::size_t len;
+        if (!source.next(data, len))
+            return "(failed)";
+        return std::string(data, len);
+    }
+
+    void writeChunk(ChunkSource* source, std::string chunk, bool* written) {
+        *written = source->write(chunk);
+    }
+
+    long millisecondsSince(const boost::posix_time::ptime& start) {
+        return static_cast<long>((boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds());
+    }
+
+    std::string echo(const TestServer::Request& request) {
+        return TestServer::response(200, request.body, "X-Chunked: " + std::string(request.chunked ? "yes" : "no") + "\r\n");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(ChunkSourceTest)
+
+BOOST_AUTO_TEST_CASE(sendsChunksWrittenUpFrontInOrder) {
+    ChunkSource source(4);  // Chunks written before the request starts aren't held to the limit
+    BOOST_CHECK(source.length() == BodySource::kUnknownLength);
+    BOOST_CHECK(source.write("first "));
+    BOOST_CHECK(source.write(""));  // Ignored, as an empty piece would end the body
+    BOOST_CHECK(source.write("second"));
+    BOOST_CHECK(source.end());
+
+    BOOST_CHECK_EQUAL(nextPiece(source), "first ");
+    BOOST_CHECK_EQUAL(nextPiece(source), "second");
+    BOOST_CHECK_EQUAL(nextPiece(source), "");
+    BOOST_CHECK(source.error().empty());
+}
+
+BOOST_AUTO_TEST_CASE(refusesChunksOnceEndedOrClosed) {
+    ChunkSource ended;
+    BOOST_CHECK(ended.end());
+    BOOST_CHECK(!ended.write("late"));
+    BOOST_CHECK(!ended.end());
+
+    ChunkSource closed;
+    closed.close();
+    BOOST_CHECK(!closed.write("late"));
+    BOOST_CHECK(!closed.end());
+}
+
+BOOST_AUTO_TEST_CASE(failsIfClosedBeforeTheEnd) {
+    ChunkSource source;
+    BOOST_CHECK(source.write("partial"));
+    source.close();
+
+    BOOST_CHECK_EQUAL(nextPiece(source), "partial");
+    BOOST_CHECK_EQUAL(nextPiece(source), "(failed)");
+    BOOST_CHECK_EQUAL(source.error(), "Request body was closed before $endChunks");
+}
+
+BOOST_AUTO_TEST_CASE(writerWaitsForTheSocketOnceStarted) {
+    ChunkSource source(8);
+    BOOST_CHECK(source.write("12345678"));
+    BOOST_CHECK_EQUAL(nextPiece(source), "12345678");  // Starts the request
+    BOOST_CHECK(source.write("abcdef"));
+
+    bool written = false;
+    boost::thread writer(boost::bind(writeChunk, &source, std::string("ghijkl"), &written));
+    BOOST_CHECK(!writer.timed_join(boost::posix_time::milliseconds(200)));  // The queue is full
+
+    BOOST_CHECK_EQUAL(nextPiece(source), "abcdef");
+    BOOST_CHECK(writer.timed_join(boost::posix_time::seconds(5)));
+    BOOST_CHECK(written);
+    BOOST_CHECK_EQUAL(nextPiece(source), "ghijkl");
+}
+
+BOOST_AUTO_TEST_CASE(writerGivesUpOnAStalledSocket) {
+    ChunkSource source(8);
+    source.setTimeout(1);
+    BOOST_CHECK(source.write("12345678"));
+    BOOST_CHECK_EQUAL(nextPiece(source), "12345678");
+    BOOST_CHECK(source.write("abcdef"));
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    BOOST_CHECK(!source.write("ghijkl"));
+    long waited = millisecondsSince(start);
+    BOOST_CHECK(waited >= 900 && waited < 5000);
+    BOOST_CHECK_EQUAL(source.error(), "Timed out waiting to send the request body");
+
+    // The body can't be completed, so the request fails once the queued chunks are sent
+    BOOST_CHECK(!source.end());
+    BOOST_CHECK_EQUAL(nextPiece(source), "abcdef");
+    BOOST_CHECK_EQUAL(nextPiece(source), "(failed)");
+}
+
+BOOST_AUTO_TEST_CASE(closeReleasesAWaitingWriter) {
+    ChunkSource source(8);
+    BOOST_CHECK(source.write("12345678"));
+    BOOST_CHECK_EQUAL(nextPiece(source), "12345678");
+    BOOST_CHECK(source.write("abcdef"));
+
+    bool written = true;
+    boost::thread writer(boost::bind(writeChunk, &source, std::string("ghijkl"), &written));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    source.close();
+    BOOST_CHECK(writer.timed_join(boost::posix_time::seconds(5)));
+    BOOST_CHECK(!written);
+}
+
+BOOST_AUTO_TEST_CASE(delegateSendsTheChunksAsAChunkedBody) {
+    TestServer server(echo);
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/upload");
+    params["method"] = std::string("POST");
+    params["body_chunks"] = true;
+    params["timeout"] = 5;
+
+    CppNetlibDelegate delegate;
+    delegate.init(params);
+    BOOST_CHECK(delegate.writeChunk("written "));
+    BOOST_CHECK(delegate.writeChunk("with $writeChunk"));
+    BOOST_CHECK(delegate.endChunks());
+    delegate.queued();
+    OmnisTools::ParamMap result = delegate.run(params);
+    DelegateResult outcome = readResult(result);
+    delegate.delivered();
+
+    BOOST_REQUIRE(outcome.ran);
+    BOOST_CHECK_EQUAL(outcome.status, 200);
+    BOOST_CHECK_EQUAL(outcome.body, "written with $writeChunk");
+    BOOST_CHECK_EQUAL(outcome.header("X-Chunked"), "yes");
+
+    // The source is closed once the request has finished
+    BOOST_CHECK(!delegate.writeChunk("late"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
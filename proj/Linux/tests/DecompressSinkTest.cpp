@@ -0,0 +1,247 @@
+//
+//  DecompressSinkTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "DecompressSink.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <zlib.h>
+
+using namespace TestSupport;
+
+namespace {
+    std::string text() {
+        std::string body;
+        for (int i = 0; i < 5000; ++i) {
+            body += "line " + boost::lexical_cast<std::string>(i) + " of the body\n";
+        }
+        return body;
+    }
+
+    // data compressed with zlib's windowBits: 15 + 16 for gzip, 15 for zlib and -15 for raw deflate
+    std::string compress(const std::string& data, int windowBits) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+
+        std::string out(deflateBound(&stream, static_cast<uLong>(data.size())) + 32, '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+
+    // Records the length it's told as well as the body
+    class LengthSink : public StringSink {
+    public:
+        LengthSink(std::string& body) : StringSink(body), length(0), haveLength(false) {}
+
+        virtual void expectLength(boost::uint64_t len) { length = len; haveLength = true; }
+
+        boost::uint64_t length;
+        bool haveLength;
+    };
+
+    void writeOnce(DecompressSink* sink, const std::string* data, bool* written) {
+        *written = sink->write(data->data(), data->size());
+    }
+
+    void expectLater(DecompressSink* sink, const std::string& encoding) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        sink->expectEncoding(encoding);
+    }
+
+    std::string gzipped(const std::string* body, const TestServer::Request&) {
+        return TestServer::response(200, compress(*body, 15 + 16), "Content-Encoding: gzip\r\n");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(DecompressSinkTest)
+
+BOOST_AUTO_TEST_CASE(passesIdentityBodiesThroughWithTheirLength) {
+    std::string body;
+    LengthSink out(body);
+    DecompressSink sink(out);
+    sink.expectLength(11);
+    sink.expectEncoding("");
+
+    BOOST_CHECK(writeInPieces(sink, "hello world", 3));
+    BOOST_CHECK(sink.finish());
+    BOOST_CHECK_EQUAL(body, "hello world");
+    BOOST_CHECK(out.haveLength);
+    BOOST_CHECK(out.length == 11);
+    BOOST_CHECK(!sink.decoded());
+}
+
+BOOST_AUTO_TEST_CASE(decodesGzipInPieces) {
+    std::string expected = text();
+    std::string encoded = compress(expected, 15 + 16);
+
+    std::string body;
+    LengthSink out(body);
+    DecompressSink sink(out);
+    sink.expectLength(encoded.size());
+    sink.expectEncoding("gzip");
+
+    BOOST_CHECK(writeInPieces(sink, encoded, 7));
+    BOOST_CHECK(sink.finish());
+    BOOST_CHECK(body == expected);
+    BOOST_CHECK(!out.haveLength);  // The encoded length doesn't describe the decoded body
+    BOOST_CHECK(sink.decoded());
+    BOOST_CHECK(sink.encodedBytes() == encoded.size());
+    BOOST_CHECK(sink.decodedBytes() == expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(decodesDeflateWithAndWithoutTheZlibWrapper) {
+    std::string expected = text();
+
+    std::string wrapped;
+    StringSink wrappedOut(wrapped);
+    DecompressSink zlibSink(wrappedOut);
+    zlibSink.expectEncoding("deflate");
+    BOOST_CHECK(writeInPieces(zlibSink, compress(expected, 15), 1024));
+    BOOST_CHECK(zlibSink.finish());
+    BOOST_CHECK(wrapped == expected);
+
+    std::string raw;
+    StringSink rawOut(raw);
+    DecompressSink rawSink(rawOut);
+    rawSink.expectEncoding("Deflate ");
+    BOOST_CHECK(writeInPieces(rawSink, compress(expected, -15), 1024));
+    BOOST_CHECK(rawSink.finish());
+    BOOST_CHECK(raw == expected);
+}
+
+BOOST_AUTO_TEST_CASE(decodesConcatenatedGzipMembers) {
+    std::string body;
+    StringSink out(body);
+    DecompressSink sink(out);
+    sink.expectEncoding("x-gzip");
+
+    BOOST_CHECK(writeInPieces(sink, compress("first ", 15 + 16) + compress("second", 15 + 16), 5));
+    BOOST_CHECK(sink.finish());
+    BOOST_CHECK_EQUAL(body, "first second");
+}
+
+BOOST_AUTO_TEST_CASE(failsOnTruncatedOrCorruptBodies) {
+    std::string encoded = compress(text(), 15 + 16);
+
+    std::string truncatedBody;
+    StringSink truncatedOut(truncatedBody);
+    DecompressSink truncated(truncatedOut);
+    truncated.expectEncoding("gzip");
+    BOOST_CHECK(truncated.write(encoded.data(), encoded.size() / 2));
+    BOOST_CHECK(!truncated.finish());
+    BOOST_CHECK_EQUAL(truncated.error(), "Compressed body is truncated");
+
+    std::string corruptBody;
+    StringSink corruptOut(corruptBody);
+    DecompressSink corrupt(corruptOut);
+    corrupt.expectEncoding("gzip");
+    BOOST_CHECK(!corrupt.write("not gzip at all", 15));
+    BOOST_CHECK(!corrupt.finish());
+    BOOST_CHECK(corrupt.error().find("Unable to decompress body") == 0);
+}
+
+BOOST_AUTO_TEST_CASE(refusesUnsupportedEncodings) {
+    std::string body;
+    StringSink out(body);
+    DecompressSink sink(out);
+    sink.expectEncoding("compress");
+
+    BOOST_CHECK(!sink.write("data", 4));
+    BOOST_CHECK_EQUAL(sink.error(), "Unsupported Content-Encoding: compress");
+    BOOST_CHECK(body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(writeWaitsForTheEncoding) {
+    std::string expected = "decoded once the headers arrive";
+    std::string encoded = compress(expected, 15 + 16);
+
+    std::string body;
+    StringSink out(body);
+    DecompressSink sink(out);
+    boost::thread headers(boost::bind(expectLater, &sink, "gzip"));
+
+    BOOST_CHECK(sink.write(encoded.data(), encoded.size()));
+    headers.join();
+    BOOST_CHECK(sink.finish());
+    BOOST_CHECK_EQUAL(body, expected);
+}
+
+BOOST_AUTO_TEST_CASE(writeGivesUpWhenTheHeadersNeverArrive) {
+    std::string body;
+    StringSink out(body);
+    DecompressSink sink(out);
+    sink.setTimeout(1);
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    BOOST_CHECK(!sink.write("data", 4));
+    long waited = (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds();
+    BOOST_CHECK(waited >= 900 && waited < 5000);
+    BOOST_CHECK_EQUAL(sink.error(), "Timed out waiting for the response headers");
+    BOOST_CHECK(body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(abandonReleasesAWaitingWrite) {
+    std::string body;
+    StringSink out(body);
+    DecompressSink sink(out);
+
+    std::string data = "data";
+    bool written = true;
+    boost::thread writer(boost::bind(writeOnce, &sink, &data, &written));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    sink.abandon("Connection refused");
+    BOOST_CHECK(writer.timed_join(boost::posix_time::seconds(5)));
+
+    BOOST_CHECK(!written);
+    BOOST_CHECK_EQUAL(sink.error(), "Connection refused");
+    BOOST_CHECK(body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(decodedResponsesDropTheirEncodingHeaders) {
+    std::string expected = text();
+    TestServer server(boost::bind(gzipped, &expected, _1));
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/text");
+    DelegateResult result = runDelegate(params);
+
+    BOOST_REQUIRE(result.ran);
+    BOOST_CHECK_EQUAL(result.status, 200);
+    BOOST_CHECK(result.body == expected);
+    BOOST_CHECK(!result.hasHeader("Content-Encoding"));
+    BOOST_CHECK_EQUAL(result.header("Content-Length"), boost::lexical_cast<std::string>(expected.size()));
+}
+
+BOOST_AUTO_TEST_CASE(undecodedResponsesKeepTheirEncodingHeaders) {
+    std::string expected = text();
+    TestServer server(boost::bind(gzipped, &expected, _1));
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/text");
+    params["decompress"] = false;
+    DelegateResult result = runDelegate(params);
+
+    BOOST_REQUIRE(result.ran);
+    BOOST_CHECK_EQUAL(result.header("Content-Encoding"), "gzip");
+    BOOST_CHECK_EQUAL(result.header("Content-Length"), boost::lexical_cast<std::string>(compress(expected, 15 + 16).size()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,84 @@
+//
+//  DelegateRunner.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Makes a request through CppNetlibDelegate as an HTTPWorker does (init, queued, run and delivered,
+//  all on the calling thread) and reads back the result row.
+
+#ifndef DELEGATE_RUNNER_H_
+#define DELEGATE_RUNNER_H_
+
+#include "CppNetlibDelegate.h"
+#include "TestSupport.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace TestSupport {
+    struct DelegateResult {
+        DelegateResult() : ran(false), status(0) {}
+
+        bool ran;  // Whether run returned a result row at all
+        int status;
+        std::map<std::string, std::string> headers;  // Keyed by the header name as the server sent it
+        std::string body;
+
+        // Value of a header, or empty if the response didn't have it
+        std::string header(const std::string& name) const {
+            std::map<std::string, std::string>::const_iterator it = headers.find(name);
+            return (it == headers.end()) ? std::string() : it->second;
+        }
+
+        bool hasHeader(const std::string& name) const { return headers.find(name) != headers.end(); }
+    };
+
+    // Reads the status, headers and (text) body of a result row
+    inline DelegateResult readResult(OmnisTools::ParamMap& result) {
+        DelegateResult outcome;
+        OmnisTools::ParamMap::iterator it = result.find("Result");
+        boost::shared_ptr<EXTqlist>* list = (it == result.end()) ? 0 : boost::any_cast<boost::shared_ptr<EXTqlist> >(&it->second);
+        if (!list || !*list || (*list)->rowCnt() < 1)
+            return outcome;
+
+        outcome.ran = true;
+        outcome.status = cellInt(**list, 1, 1);
+
+        EXTfldval colVal;
+        (*list)->getColValRef(1, 2, colVal, qfalse);
+        std::auto_ptr<EXTqlist> headers(colVal.getList(qfalse));
+        if (headers.get()) {
+            for (qshort col = 1; col <= headers->colCnt(); ++col) {
+                outcome.headers[columnName(*headers, col)] = cellString(*headers, 1, col);
+            }
+        }
+
+        if ((*list)->colCnt() >= 3 && columnName(**list, 3) == "body") {
+            outcome.body = cellString(**list, 1, 3);
+        }
+        return outcome;
+    }
+
+    // Makes the request described by params (url, method, headers and so on, as in $initialize)
+    inline DelegateResult runDelegate(OmnisTools::ParamMap params) {
+        CppNetlibDelegate delegate;
+        delegate.init(params);
+        delegate.queued();
+        OmnisTools::ParamMap result = delegate.run(params);
+        DelegateResult outcome = readResult(result);
+        delegate.delivered();
+        return outcome;
+    }
+
+    // A headers parameter of a single header
+    inline std::vector<OmnisTools::ParamMap> headerParam(const std::string& name, const std::string& value) {
+        OmnisTools::ParamMap header;
+        header["key"] = name;
+        header["value"] = value;
+        return std::vector<OmnisTools::ParamMap>(1, header);
+    }
+}
+
+#endif // DELEGATE_RUNNER_H_
@@ -0,0 +1,195 @@
+//
+//  DiskCacheTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "DiskCache.h"
+#include "TestSupport.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    ResponseCache::EntryPtr entry(const std::string& body, const std::string& etag = "\"v1\"") {
+        boost::shared_ptr<ResponseCache::Entry> made = boost::make_shared<ResponseCache::Entry>();
+        made->status = 200;
+        made->headers.push_back(std::make_pair(std::string("Content-Type"), std::string("text/plain")));
+        made->vary.push_back(std::make_pair(std::string("Accept-Language"), std::string("en")));
+        made->body = boost::make_shared<std::string>(body);
+        made->responseTime = 1400000000;
+        made->expires = 1400000060;
+        made->staleWhileRevalidate = 5;
+        made->staleIfError = 10;
+        made->etag = etag;
+        return made;
+    }
+
+    std::string bodyOf(const ResponseCache::EntryPtr& loaded) {
+        return (loaded && loaded->body) ? *loaded->body : "(missing)";
+    }
+
+    // Opens the disk cache in a new directory for a test, and closes it again afterwards
+    struct OpenCache {
+        OpenCache(boost::uint64_t maxBytes = 0) : cache(DiskCache::instance()) {
+            std::string error;
+            BOOST_REQUIRE_MESSAGE(cache.open(dir.path(), maxBytes, error), error);
+        }
+        ~OpenCache() { cache.close(); }
+
+        TempDir dir;
+        DiskCache& cache;
+    };
+
+    // Stores and loads its own keys, counting the loads that didn't return what was stored
+    void storeAndLoad(int thread, int count, int* wrong) {
+        DiskCache& cache = DiskCache::instance();
+        for (int i = 0; i < count; ++i) {
+            std::string key = "GET http://test/" + boost::lexical_cast<std::string>(thread) + "/" + boost::lexical_cast<std::string>(i % 50);
+            std::string body(1000 + (i % 7) * 1000, static_cast<char>('a' + thread));
+            body += key;
+            cache.store(key, entry(body));
+            ResponseCache::EntryPtr loaded = cache.load(key);
+            if (loaded && *loaded->body != body)
+                ++*wrong;  // Missing is allowed, as compaction can drop it, but never another body
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(DiskCacheTest)
+
+BOOST_AUTO_TEST_CASE(storesAndLoadsEntries) {
+    OpenCache open;
+    open.cache.store("GET http://test/a", entry("first body"));
+
+    ResponseCache::EntryPtr loaded = open.cache.load("GET http://test/a");
+    BOOST_REQUIRE(loaded);
+    BOOST_CHECK_EQUAL(bodyOf(loaded), "first body");
+    BOOST_CHECK_EQUAL(loaded->status, 200);
+    BOOST_CHECK_EQUAL(loaded->etag, "\"v1\"");
+    BOOST_CHECK(loaded->expires == 1400000060);
+    BOOST_CHECK_EQUAL(loaded->staleWhileRevalidate, 5);
+    BOOST_CHECK_EQUAL(loaded->staleIfError, 10);
+    BOOST_REQUIRE_EQUAL(loaded->headers.size(), 1u);
+    BOOST_CHECK_EQUAL(loaded->headers[0].second, "text/plain");
+    BOOST_REQUIRE_EQUAL(loaded->vary.size(), 1u);
+    BOOST_CHECK_EQUAL(loaded->vary[0].first, "Accept-Language");
+
+    BOOST_CHECK(!open.cache.load("GET http://test/missing"));
+    DiskCache::Stats stats = open.cache.stats();
+    BOOST_CHECK(stats.entries == 1);
+    BOOST_CHECK(stats.writes == 1);
+    BOOST_CHECK(stats.reads == 1);
+}
+
+BOOST_AUTO_TEST_CASE(replacesAndRemovesEntries) {
+    OpenCache open;
+    open.cache.store("GET http://test/a", entry("old"));
+    open.cache.store("GET http://test/a", entry("new"));
+    BOOST_CHECK_EQUAL(bodyOf(open.cache.load("GET http://test/a")), "new");
+    BOOST_CHECK(open.cache.stats().entries == 1);
+
+    open.cache.remove("GET http://test/a");
+    BOOST_CHECK(!open.cache.load("GET http://test/a"));
+    BOOST_CHECK(open.cache.stats().entries == 0);
+}
+
+BOOST_AUTO_TEST_CASE(refreshKeepsTheBodyItAlreadyHas) {
+    OpenCache open;
+    std::string body(100 * 1024, 'b');
+    open.cache.store("GET http://test/big", entry(body));
+    boost::uint64_t before = open.cache.stats().bytes;
+
+    open.cache.refresh("GET http://test/big", entry(body, "\"v2\""));
+    BOOST_CHECK(open.cache.stats().bytes - before < 1024);  // Only the new headers were written
+
+    ResponseCache::EntryPtr loaded = open.cache.load("GET http://test/big");
+    BOOST_REQUIRE(loaded);
+    BOOST_CHECK_EQUAL(loaded->etag, "\"v2\"");
+    BOOST_CHECK(*loaded->body == body);
+}
+
+BOOST_AUTO_TEST_CASE(entriesSurviveReopening) {
+    TempDir dir;
+    DiskCache& cache = DiskCache::instance();
+    std::string error;
+    BOOST_REQUIRE(cache.open(dir.path(), 0, error));
+    cache.store("GET http://test/kept", entry("kept body"));
+    cache.close();
+
+    BOOST_CHECK(!cache.load("GET http://test/kept"));  // Closed
+    BOOST_REQUIRE(cache.open(dir.path(), 0, error));
+    BOOST_CHECK_EQUAL(bodyOf(cache.load("GET http://test/kept")), "kept body");
+    cache.close();
+}
+
+BOOST_AUTO_TEST_CASE(bodiesLargerThanASegmentArentKept) {
+    OpenCache open(8 * 1024 * 1024);  // 1 MB segments
+    open.cache.store("GET http://test/huge", entry("small"));
+    open.cache.store("GET http://test/huge", entry(std::string(2 * 1024 * 1024, 'h')));
+    BOOST_CHECK(!open.cache.load("GET http://test/huge"));  // Nor the out of date one
+}
+
+BOOST_AUTO_TEST_CASE(indexGrowsAsEntriesAreAdded) {
+    OpenCache open;
+    for (int i = 0; i < 5000; ++i) {
+        open.cache.store("GET http://test/" + boost::lexical_cast<std::string>(i), entry(boost::lexical_cast<std::string>(i)));
+    }
+    BOOST_CHECK(open.cache.stats().entries == 5000);
+    BOOST_CHECK_EQUAL(bodyOf(open.cache.load("GET http://test/0")), "0");
+    BOOST_CHECK_EQUAL(bodyOf(open.cache.load("GET http://test/4999")), "4999");
+}
+
+BOOST_AUTO_TEST_CASE(compactionKeepsTheCacheUnderItsLimit) {
+    OpenCache open(8 * 1024 * 1024);
+    for (int i = 0; i < 200; ++i) {
+        open.cache.store("GET http://test/" + boost::lexical_cast<std::string>(i), entry(std::string(100 * 1024, 'c')));
+    }
+
+    // The compactor runs in the background
+    for (int i = 0; i < 100 && open.cache.stats().bytes > 8 * 1024 * 1024; ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    }
+    DiskCache::Stats stats = open.cache.stats();
+    BOOST_CHECK(stats.bytes <= 8 * 1024 * 1024);
+    BOOST_CHECK(stats.compactions > 0);
+    BOOST_CHECK(!open.cache.load("GET http://test/0"));  // The oldest went first
+    BOOST_CHECK(*open.cache.load("GET http://test/199")->body == std::string(100 * 1024, 'c'));
+}
+
+BOOST_AUTO_TEST_CASE(concurrentStoresAndLoadsDontMixUpEntries) {
+    OpenCache open(8 * 1024 * 1024);  // Small enough to be compacting while they run
+    const int threads = 8;
+    int wrong[threads] = { 0 };
+    boost::thread_group group;
+    for (int t = 0; t < threads; ++t) {
+        group.create_thread(boost::bind(storeAndLoad, t, 500, &wrong[t]));
+    }
+    group.join_all();
+
+    for (int t = 0; t < threads; ++t) {
+        BOOST_CHECK_EQUAL(wrong[t], 0);
+    }
+
+    // Whatever is left is intact
+    for (int t = 0; t < threads; ++t) {
+        for (int i = 450; i < 500; ++i) {
+            std::string key = "GET http://test/" + boost::lexical_cast<std::string>(t) + "/" + boost::lexical_cast<std::string>(i % 50);
+            ResponseCache::EntryPtr loaded = open.cache.load(key);
+            if (loaded) {
+                BOOST_CHECK(loaded->body->size() > key.size());
+                BOOST_CHECK(boost::ends_with(*loaded->body, key));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,122 @@
+//
+//  FileSinkTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "FileSink.h"
+#include "TestSupport.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // Bytes that aren't the same from one block to the next
+    std::string body(std::size_t length) {
+        std::string data(length, '\0');
+        for (std::size_t i = 0; i < length; ++i) {
+            data[i] = static_cast<char>((i * 31 + i / 7) & 0xFF);
+        }
+        return data;
+    }
+
+    struct Directory {
+        TempDir dir;
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(FileSinkTest, Directory)
+
+BOOST_AUTO_TEST_CASE(bodyIsRenamedIntoPlaceWhenFinished) {
+    std::string data = body(3 * 1024 * 1024 + 123);  // Direct writes of whole blocks as well as buffered ones
+
+    std::size_t pieces[] = { 1000, 1024 * 1024, 2 * 1024 * 1024 + 5 };
+    for (std::size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        std::string path = dir.file("download" + boost::lexical_cast<std::string>(p) + ".bin");
+        FileSink sink(path);
+        sink.expectLength(data.size());
+        BOOST_REQUIRE(writeInPieces(sink, data, pieces[p]));
+        BOOST_CHECK(!fileExists(path));  // Written under the .part name until finished
+        BOOST_CHECK(fileExists(path + ".part"));
+
+        BOOST_REQUIRE_MESSAGE(sink.finish(), sink.error());
+        BOOST_CHECK_EQUAL(sink.bytes(), data.size());
+        BOOST_CHECK(!fileExists(path + ".part"));
+        BOOST_CHECK(readFile(path) == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(existingFileIsReplaced) {
+    std::string path = dir.file("existing.txt");
+    {
+        FileSink sink(path);
+        BOOST_REQUIRE(sink.write("old contents", 12) && sink.finish());
+    }
+    FileSink sink(path);
+    BOOST_REQUIRE(sink.write("new", 3) && sink.finish());
+    BOOST_CHECK_EQUAL(readFile(path), "new");
+}
+
+BOOST_AUTO_TEST_CASE(emptyBody) {
+    std::string path = dir.file("empty");
+    FileSink sink(path);
+    sink.expectLength(0);
+    BOOST_REQUIRE(sink.finish());
+    BOOST_CHECK(fileExists(path));
+    BOOST_CHECK_EQUAL(readFile(path), "");
+}
+
+BOOST_AUTO_TEST_CASE(wrongLengthLeavesNothingBehind) {
+    std::string path = dir.file("short.bin");
+    {
+        FileSink sink(path);
+        sink.expectLength(100);
+        BOOST_REQUIRE(sink.write("0123456789", 10));
+        BOOST_CHECK(!sink.finish());
+        BOOST_CHECK(!sink.error().empty());
+    }
+    BOOST_CHECK(!fileExists(path));
+    BOOST_CHECK(!fileExists(path + ".part"));
+
+    FileSink sink(path);
+    sink.expectLength(5);
+    BOOST_REQUIRE(sink.write("0123456789", 10));
+    BOOST_CHECK(!sink.finish());
+    BOOST_CHECK(!fileExists(path));
+}
+
+BOOST_AUTO_TEST_CASE(unfinishedSinkRemovesThePartialFile) {
+    std::string path = dir.file("abandoned.bin");
+    {
+        boost::scoped_ptr<FileSink> sink(new FileSink(path));
+        BOOST_REQUIRE(sink->write("partial", 7));
+        BOOST_CHECK(fileExists(path + ".part"));
+    }
+    BOOST_CHECK(!fileExists(path + ".part"));
+    BOOST_CHECK(!fileExists(path));
+}
+
+BOOST_AUTO_TEST_CASE(unwritableDirectoryFails) {
+    FileSink sink(dir.file("missing/file.bin"));
+    BOOST_CHECK(!sink.error().empty());
+    BOOST_CHECK(!sink.write("x", 1));
+    BOOST_CHECK(!sink.finish());
+}
+
+BOOST_AUTO_TEST_CASE(preallocation) {
+    std::string path = dir.file("preallocated.bin");
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    BOOST_REQUIRE(file);
+    std::string error;
+    BOOST_CHECK_MESSAGE(preallocateFile(file, 1 << 20, error), error);
+    std::fclose(file);
+    struct stat info;
+    BOOST_REQUIRE(stat(path.c_str(), &info) == 0);
+    BOOST_CHECK_EQUAL(info.st_size, 1 << 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+//
+//  GzipSourceTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "GzipSource.h"
+#include "DecompressSink.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // Hands out the body in pieces of the given size, failing after failAfter pieces if that's set
+    class PieceSource : public BodySource {
+    public:
+        PieceSource(const std::string& body, std::size_t piece, std::size_t failAfter = 0)
+            : _body(body), _piece(piece), _pos(0), _pieces(0), _failAfter(failAfter) {}
+
+        virtual boost::int64_t length() const { return static_cast<boost::int64_t>(_body.size()); }
+        virtual bool next(const char*& data, std::size_t& len) {
+            if (_failAfter && _pieces == _failAfter)
+                return false;
+            ++_pieces;
+            data = _body.data() + _pos;
+            len = std::min(_piece, _body.size() - _pos);
+            _pos += len;
+            return true;
+        }
+        virtual std::string error() const { return "Unable to read body"; }
+
+    private:
+        std::string _body;
+        std::size_t _piece;
+        std::size_t _pos;
+        std::size_t _pieces;
+        std::size_t _failAfter;
+    };
+
+    // Varied enough not to compress to nothing, and several compressed blocks long
+    std::string text(std::size_t lines) {
+        std::string body;
+        for (std::size_t i = 0; i < lines; ++i) {
+            body += boost::lexical_cast<std::string>(i * 2654435761u) + " line of the request body\n";
+        }
+        return body;
+    }
+
+    // Reads the whole source.  Returns false if it failed.
+    bool drain(BodySource& source, std::string& out, std::size_t& pieces) {
+        pieces = 0;
+        for (;;) {
+            const char* data;
+            std::size_t len;
+            if (!source.next(data, len))
+                return false;
+            if (len == 0)
+                return true;
+            out.append(data, len);
+            ++pieces;
+        }
+    }
+
+    std::string gunzip(const std::string& encoded) {
+        std::string decoded;
+        StringSink out(decoded);
+        DecompressSink sink(out);
+        sink.expectEncoding("gzip");
+        if (!sink.write(encoded.data(), encoded.size()) || !sink.finish())
+            return "(invalid: " + sink.error() + ")";
+        return decoded;
+    }
+
+    // Answers with what was received, decompressed if it was gzipped
+    std::string echoDecoded(const TestServer::Request& request) {
+        std::string body = (request.header("Content-Encoding") == "gzip") ? gunzip(request.body) : request.body;
+        return TestServer::response(200, body, "X-Chunked: " + std::string(request.chunked ? "yes" : "no") + "\r\n");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(GzipSourceTest)
+
+BOOST_AUTO_TEST_CASE(compressesTheSourceToGzip) {
+    std::string body = text(100);
+    GzipSource source(boost::make_shared<PieceSource>(body, 100), 6);
+    BOOST_CHECK(source.length() == BodySource::kUnknownLength);
+
+    std::string encoded;
+    std::size_t pieces;
+    BOOST_REQUIRE(drain(source, encoded, pieces));
+    BOOST_CHECK(encoded.size() < body.size());
+    BOOST_CHECK(gunzip(encoded) == body);
+    BOOST_CHECK(source.inputBytes() == body.size());
+    BOOST_CHECK(source.outputBytes() == encoded.size());
+    BOOST_CHECK(source.error().empty());
+}
+
+BOOST_AUTO_TEST_CASE(sendsLargeBodiesInSeveralBlocks) {
+    std::string body = text(200000);  // Over 7 MB, which level 1 doesn't get into a single 256 KB block
+    GzipSource source(boost::make_shared<PieceSource>(body, 64 * 1024), 1);
+
+    std::string encoded;
+    std::size_t pieces;
+    BOOST_REQUIRE(drain(source, encoded, pieces));
+    BOOST_CHECK(pieces > 1);
+    BOOST_CHECK(gunzip(encoded) == body);
+}
+
+BOOST_AUTO_TEST_CASE(compressesAnEmptyBody) {
+    GzipSource source(boost::make_shared<PieceSource>(std::string(), 10), 0);  // Out of range levels use the default
+
+    std::string encoded;
+    std::size_t pieces;
+    BOOST_REQUIRE(drain(source, encoded, pieces));
+    BOOST_CHECK(!encoded.empty());  // Still a gzip header and trailer
+    BOOST_CHECK_EQUAL(gunzip(encoded), "");
+}
+
+BOOST_AUTO_TEST_CASE(failsWhenTheSourceFails) {
+    GzipSource source(boost::make_shared<PieceSource>(text(1000), 100, 3), 6);
+
+    std::string encoded;
+    std::size_t pieces;
+    BOOST_CHECK(!drain(source, encoded, pieces));
+    BOOST_CHECK_EQUAL(source.error(), "Unable to read body");
+    BOOST_CHECK(source.inputBytes() == 300);
+}
+
+BOOST_AUTO_TEST_CASE(canBeDestroyedBeforeTheBodyIsSent) {
+    // The compression thread is blocked with a full queue, and is released by the destructor
+    std::string body = text(400000);
+    {
+        GzipSource source(boost::make_shared<PieceSource>(body, 64 * 1024), 1);
+        const char* data;
+        std::size_t len;
+        BOOST_REQUIRE(source.next(data, len));
+        BOOST_CHECK(len > 0);
+    }
+    BOOST_CHECK(true);
+}
+
+BOOST_AUTO_TEST_CASE(compressedBodiesAreSentChunked) {
+    TestServer server(echoDecoded);
+    std::string body = text(5000);
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/upload");
+    params["method"] = std::string("POST");
+    params["body"] = body;
+    params["compress_body"] = true;
+    DelegateResult result = runDelegate(params);
+
+    BOOST_REQUIRE(result.ran);
+    BOOST_CHECK_EQUAL(result.status, 200);
+    BOOST_CHECK(result.body == body);
+    BOOST_CHECK_EQUAL(result.header("X-Chunked"), "yes");
+
+    std::vector<TestServer::Request> requests = server.requests();
+    BOOST_REQUIRE_EQUAL(requests.size(), 1u);
+    BOOST_CHECK_EQUAL(requests[0].header("Content-Encoding"), "gzip");
+    BOOST_CHECK(requests[0].body.size() < body.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,286 @@
+//
+//  HttpStreamClientTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "HttpStreamClient.h"
+#include "FileSource.h"
+#include "Metrics.h"
+#include "RequestTimings.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <fstream>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    typedef std::map<std::string, std::string> Routes;
+
+    // Answers each target with its route's response, or 404
+    std::string route(const Routes* routes, const TestServer::Request& request) {
+        Routes::const_iterator it = routes->find(request.target);
+        return (it == routes->end()) ? TestServer::response(404, "missing") : it->second;
+    }
+
+    // Answers with the method, Content-Type and body of the request
+    std::string echo(const TestServer::Request& request) {
+        return TestServer::response(200, request.method + " " + request.header("Content-Type") + " " + request.body);
+    }
+
+    std::string slow(const TestServer::Request&) {
+        boost::this_thread::sleep(boost::posix_time::seconds(3));
+        return TestServer::response(200, "late");
+    }
+
+    // A body that can only be sent once, like one written with $writeChunk
+    class OnceSource : public BodySource {
+    public:
+        OnceSource() : _sent(false) {}
+
+        virtual boost::int64_t length() const { return 4; }
+        virtual bool next(const char*& data, std::size_t& len) {
+            data = "once";
+            len = _sent ? 0 : 4;
+            _sent = true;
+            return true;
+        }
+        virtual std::string error() const { return std::string(); }
+
+    private:
+        bool _sent;
+    };
+
+    void cancelLater(HttpStreamClient* client) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+        client->cancel();
+    }
+
+    double secondsSince(boost::posix_time::ptime start) {
+        return (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds() / 1000.0;
+    }
+
+    HttpStreamClient::Response get(HttpStreamClient& client, const std::string& url, std::string& body,
+                                   const HttpStreamClient::Headers& headers = HttpStreamClient::Headers()) {
+        body.clear();
+        StringSink sink(body);
+        return client.request("GET", url, headers, std::string(), 0, sink);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(HttpStreamClientTest)
+
+BOOST_AUTO_TEST_CASE(redirectsAreFollowedToTheEnd) {
+    Routes routes;
+    TestServer server(boost::bind(route, &routes, _1));
+    routes["/a"] = TestServer::redirect(302, "/dir/b?x=1");
+    routes["/dir/b?x=1"] = TestServer::redirect(301, "c");  // Relative to /dir/
+    routes["/dir/c"] = TestServer::redirect(308, server.url("/final"));
+    routes["/final"] = TestServer::response(200, "arrived");
+
+    HttpStreamClient client;
+    std::string body;
+    HttpStreamClient::Response response = get(client, server.url("/a"), body);
+    BOOST_CHECK_EQUAL(response.status, 200);
+    BOOST_CHECK_EQUAL(body, "arrived");  // None of the redirect bodies
+    BOOST_CHECK_EQUAL(response.url, server.url("/final"));
+    BOOST_CHECK_EQUAL(server.requests().size(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(redirectsAreLimited) {
+    Routes routes;
+    TestServer server(boost::bind(route, &routes, _1));
+    routes["/loop"] = TestServer::redirect(302, "/loop");
+
+    HttpStreamClient client;
+    std::string body;
+    BOOST_CHECK_THROW(get(client, server.url("/loop"), body), std::exception);
+    BOOST_CHECK_EQUAL(server.requests().size(), 6u);  // The request and five redirects
+    BOOST_CHECK(body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(redirectWithoutLocationIsTheResponse) {
+    Routes routes;
+    TestServer server(boost::bind(route, &routes, _1));
+    routes["/moved"] = TestServer::response(302, "nowhere to go");
+    routes["/multiple"] = TestServer::response(300, "choices", "Location: /moved\r\n");
+
+    HttpStreamClient client;
+    std::string body;
+    BOOST_CHECK_EQUAL(get(client, server.url("/moved"), body).status, 302);
+    BOOST_CHECK_EQUAL(body, "nowhere to go");
+    BOOST_CHECK_EQUAL(get(client, server.url("/multiple"), body).status, 300);
+    BOOST_CHECK_EQUAL(body, "choices");
+}
+
+// 303, and 301 or 302 after a POST, are followed with a GET without the body
+BOOST_AUTO_TEST_CASE(redirectsThatBecomeGets) {
+    Routes routes;
+    TestServer server(boost::bind(echo, _1));
+    int statuses[] = { 301, 302, 303 };
+    for (int i = 0; i < 3; ++i) {
+        TestServer redirector(boost::bind(TestServer::redirect, statuses[i], server.url("/echo")));
+        std::string payload = "name=value", body;
+        StringSource source(payload);
+        StringSink sink(body);
+        HttpStreamClient client;
+        HttpStreamClient::Response response = client.request("POST", redirector.url("/form"), HttpStreamClient::Headers(),
+                                                             "application/x-www-form-urlencoded", &source, sink);
+        BOOST_CHECK_EQUAL(response.status, 200);
+        BOOST_CHECK_EQUAL(body, "GET  ");
+        BOOST_CHECK_EQUAL(redirector.requests().at(0).body, payload);
+    }
+
+    // 303 after a PUT too, but a 301 or 302 keeps the PUT
+    TestServer seeOther(boost::bind(TestServer::redirect, 303, server.url("/echo")));
+    TestServer found(boost::bind(TestServer::redirect, 302, server.url("/echo")));
+    std::string payload = "data", body;
+    {
+        StringSource source(payload);
+        StringSink sink(body);
+        HttpStreamClient().request("PUT", seeOther.url("/"), HttpStreamClient::Headers(), "text/plain", &source, sink);
+        BOOST_CHECK_EQUAL(body, "GET  ");
+    }
+    body.clear();
+    {
+        StringSource source(payload);
+        StringSink sink(body);
+        HttpStreamClient().request("PUT", found.url("/"), HttpStreamClient::Headers(), "text/plain", &source, sink);
+        BOOST_CHECK_EQUAL(body, "PUT text/plain data");
+    }
+}
+
+// 307 and 308 keep the method and send the body again
+BOOST_AUTO_TEST_CASE(redirectsThatResendTheBody) {
+    TestServer server(boost::bind(echo, _1));
+    TempDir dir;
+    std::string path = dir.file("body.txt");
+    {
+        std::ofstream out(path.c_str());
+        out << "from a file";
+    }
+
+    int statuses[] = { 307, 308 };
+    for (int i = 0; i < 2; ++i) {
+        TestServer redirector(boost::bind(TestServer::redirect, statuses[i], server.url("/echo")));
+        std::string payload = "{\"a\":1}", body;
+        StringSource source(payload);
+        StringSink sink(body);
+        HttpStreamClient client;
+        client.setTimeout(5);
+        client.request("POST", redirector.url("/"), HttpStreamClient::Headers(), "application/json", &source, sink);
+        BOOST_CHECK_EQUAL(body, "POST application/json {\"a\":1}");
+
+        // A file body is sent with sendfile both times, on a socket left blocking for it
+        body.clear();
+        FileSource file(path);
+        client.request("PUT", redirector.url("/"), HttpStreamClient::Headers(), "text/plain", &file, sink);
+        BOOST_CHECK_EQUAL(body, "PUT text/plain from a file");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bodyThatCantBeSentAgainFails) {
+    TestServer server(boost::bind(echo, _1));
+    TestServer redirector(boost::bind(TestServer::redirect, 307, server.url("/echo")));
+
+    OnceSource source;
+    std::string body;
+    StringSink sink(body);
+    HttpStreamClient client;
+    BOOST_CHECK_THROW(client.request("POST", redirector.url("/"), HttpStreamClient::Headers(), "text/plain", &source, sink),
+                      std::exception);
+    BOOST_CHECK(server.requests().empty());
+    BOOST_CHECK(body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(credentialsStayWithTheirServer) {
+    TestServer other(boost::bind(echo, _1));
+    Routes routes;
+    TestServer server(boost::bind(route, &routes, _1));
+    routes["/same"] = TestServer::redirect(302, "/here");
+    routes["/here"] = TestServer::response(200, "here");
+    routes["/away"] = TestServer::redirect(302, other.url("/there"));
+
+    HttpStreamClient::Headers headers;
+    headers.push_back(std::make_pair(std::string("Authorization"), std::string("Bearer secret")));
+    headers.push_back(std::make_pair(std::string("Cookie"), std::string("session=1")));
+    headers.push_back(std::make_pair(std::string("X-Trace"), std::string("abc")));
+
+    HttpStreamClient client;
+    std::string body;
+    get(client, server.url("/same"), body, headers);
+    BOOST_CHECK_EQUAL(server.requests().at(1).header("Authorization"), "Bearer secret");
+
+    get(client, server.url("/away"), body, headers);
+    TestServer::Request there = other.requests().at(0);
+    BOOST_CHECK_EQUAL(there.header("Authorization"), "");
+    BOOST_CHECK_EQUAL(there.header("Cookie"), "");
+    BOOST_CHECK_EQUAL(there.header("X-Trace"), "abc");
+}
+
+BOOST_AUTO_TEST_CASE(stalledReadTimesOut) {
+    TestServer server(boost::bind(slow, _1));
+    HttpStreamClient client;
+    client.setTimeout(1);
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    std::string body;
+    BOOST_CHECK_THROW(get(client, server.url("/"), body), std::exception);
+    BOOST_CHECK_LT(secondsSince(start), 2.5);
+}
+
+BOOST_AUTO_TEST_CASE(timeoutIsPerOperation) {
+    TestServer server(boost::bind(echo, _1));
+    HttpStreamClient client;
+    client.setTimeout(1);
+    std::string body;
+    for (int i = 0; i < 3; ++i) {
+        BOOST_CHECK_EQUAL(get(client, server.url("/"), body).status, 200);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cancelStopsOneRequest) {
+    TestServer server(boost::bind(slow, _1));
+    TestServer fast(boost::bind(echo, _1));
+    HttpStreamClient client;
+    std::string body;
+
+    // Before the request starts
+    client.cancel();
+    BOOST_CHECK_THROW(get(client, fast.url("/"), body), std::exception);
+    BOOST_CHECK_EQUAL(get(client, fast.url("/"), body).status, 200);
+
+    // While it waits for the response
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    boost::thread canceller(boost::bind(cancelLater, &client));
+    BOOST_CHECK_THROW(get(client, server.url("/"), body), std::exception);
+    canceller.join();
+    BOOST_CHECK_LT(secondsSince(start), 2.5);
+    BOOST_CHECK_EQUAL(get(client, fast.url("/"), body).status, 200);
+}
+
+#ifdef __linux__
+BOOST_AUTO_TEST_CASE(connectionIsSampledAsTheResponseFinishes) {
+    TestServer server(boost::bind(echo, _1));
+    RequestTimings timings;
+    HttpStreamClient client;
+    client.setTimings(&timings);
+    boost::uint64_t before = Metrics::instance().snapshot().tcpRtt.count();
+
+    std::string body;
+    BOOST_CHECK_EQUAL(get(client, server.url("/"), body).status, 200);
+    BOOST_CHECK(timings.tcpInfo().sampled);
+    BOOST_CHECK(timings.tcpInfo().cwnd > 0);
+    BOOST_CHECK(timings.tcpInfo().retransmits == 0);  // Not on loopback
+    BOOST_CHECK(Metrics::instance().snapshot().tcpRtt.count() > before);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,209 @@
+//
+//  InflightRegistryTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "InflightRegistry.h"
+#include "DelegateRunner.h"
+#include "Metrics.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // The registry's description of a request, or one with an id of 0 if it isn't listed
+    InflightRegistry::Request find(boost::uint64_t id) {
+        std::vector<InflightRegistry::Request> requests = InflightRegistry::instance().requests();
+        for (std::size_t i = 0; i < requests.size(); ++i) {
+            if (requests[i].id == id)
+                return requests[i];
+        }
+        return InflightRegistry::Request();
+    }
+
+    // Waits up to five seconds for a request to the URL to be listed in the stage
+    bool waitForStage(const std::string& url, InflightRegistry::Stage stage) {
+        for (int i = 0; i < 250; ++i) {
+            std::vector<InflightRegistry::Request> requests = InflightRegistry::instance().requests();
+            for (std::size_t r = 0; r < requests.size(); ++r) {
+                if (requests[r].url == url && requests[r].stage == stage)
+                    return true;
+            }
+            boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        }
+        return false;
+    }
+
+    bool listed(const std::string& url) {
+        std::vector<InflightRegistry::Request> requests = InflightRegistry::instance().requests();
+        for (std::size_t i = 0; i < requests.size(); ++i) {
+            if (requests[i].url == url)
+                return true;
+        }
+        return false;
+    }
+
+    // Holds every response until it's opened, so that requests stay in flight
+    class Gate {
+    public:
+        Gate() : _open(false) {}
+
+        std::string respond(const TestServer::Request&) {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            while (!_open) {
+                _opened.wait(lock);
+            }
+            return TestServer::response(200, "body");
+        }
+
+        void open() {
+            boost::mutex::scoped_lock lock(_mutex);
+            _open = true;
+            _opened.notify_all();
+        }
+
+    private:
+        boost::mutex _mutex;
+        boost::condition_variable _opened;
+        bool _open;
+    };
+
+    // Opens the gate when the test ends, however it ends, so that the server (made before it) can be stopped
+    struct Opener {
+        explicit Opener(Gate& gate) : _gate(gate) {}
+        ~Opener() { _gate.open(); }
+
+        Gate& _gate;
+    };
+
+    void fetch(OmnisTools::ParamMap params, DelegateResult* result) {
+        *result = runDelegate(params);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(InflightRegistryTest)
+
+BOOST_AUTO_TEST_CASE(stagesHaveNames) {
+    BOOST_CHECK_EQUAL(InflightRegistry::stageName(InflightRegistry::kWaiting), "waiting");
+    InflightRegistry::Stage stage = InflightRegistry::kQueued;
+    BOOST_CHECK(InflightRegistry::parseStage("Receiving", stage));
+    BOOST_CHECK_EQUAL(stage, InflightRegistry::kReceiving);
+    BOOST_CHECK(!InflightRegistry::parseStage("sleeping", stage));
+}
+
+BOOST_AUTO_TEST_CASE(tracksRequestsWithoutTimings) {
+    InflightRegistry& registry = InflightRegistry::instance();
+    boost::uint64_t id = registry.add("GET", "http://test/untimed");
+
+    InflightRegistry::Request request = find(id);
+    BOOST_REQUIRE(request.id == id);
+    BOOST_CHECK_EQUAL(request.method, "GET");
+    BOOST_CHECK_EQUAL(request.stage, InflightRegistry::kQueued);
+    BOOST_CHECK(!request.slow);
+
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    registry.start(id);
+    request = find(id);
+    BOOST_CHECK_EQUAL(request.stage, InflightRegistry::kConnecting);
+    BOOST_CHECK(request.elapsed >= 20);
+    BOOST_CHECK(request.stageElapsed < request.elapsed);
+    BOOST_CHECK(request.bytesIn == 0);
+
+    registry.finish(id);
+    BOOST_CHECK_EQUAL(find(id).stage, InflightRegistry::kDelivering);
+    registry.start(id);  // Too late to go back
+    BOOST_CHECK_EQUAL(find(id).stage, InflightRegistry::kDelivering);
+
+    registry.remove(id);
+    BOOST_CHECK(find(id).id == 0);
+}
+
+BOOST_AUTO_TEST_CASE(timingsShowFinerStages) {
+    InflightRegistry& registry = InflightRegistry::instance();
+    boost::shared_ptr<RequestTimings> timings = boost::make_shared<RequestTimings>();
+    boost::uint64_t id = registry.add("POST", "http://test/timed", timings);
+    registry.start(id);
+    BOOST_CHECK_EQUAL(find(id).stage, InflightRegistry::kConnecting);
+
+    timings->mark(RequestTimings::kRequestSent);
+    timings->addBytesOut(10);
+    BOOST_CHECK_EQUAL(find(id).stage, InflightRegistry::kWaiting);
+    timings->mark(RequestTimings::kFirstByte);
+    timings->addBytesIn(200);
+    InflightRegistry::Request request = find(id);
+    BOOST_CHECK_EQUAL(request.stage, InflightRegistry::kReceiving);
+    BOOST_CHECK(request.bytesIn == 200);
+    BOOST_CHECK(request.bytesOut == 10);
+
+    timings->mark(RequestTimings::kLastByte);
+    BOOST_CHECK_EQUAL(find(id).stage, InflightRegistry::kDelivering);
+    timings->mark(RequestTimings::kDelivered);
+    BOOST_CHECK(find(id).id == 0);  // No longer listed, though it hasn't been removed
+    registry.remove(id);
+}
+
+BOOST_AUTO_TEST_CASE(watchdogReportsSlowRequests) {
+    InflightRegistry& registry = InflightRegistry::instance();
+    double threshold = registry.threshold(InflightRegistry::kQueued);
+    registry.setThreshold(InflightRegistry::kQueued, 1);
+    boost::int64_t before = Metrics::instance().snapshot().counters[Metrics::kSlowRequests];
+
+    boost::uint64_t id = registry.add("GET", "http://test/slow");
+    bool slow = false;
+    for (int i = 0; i < 150 && !slow; ++i) {  // The watchdog looks once a second
+        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        slow = find(id).slow;
+    }
+    registry.remove(id);
+    registry.setThreshold(InflightRegistry::kQueued, threshold);
+
+    BOOST_CHECK(slow);
+    BOOST_CHECK(Metrics::instance().snapshot().counters[Metrics::kSlowRequests] > before);
+}
+
+BOOST_AUTO_TEST_CASE(delegateListsRequestsUntilDelivered) {
+    Gate gate;
+    TestServer server(boost::bind(&Gate::respond, &gate, _1));
+    Opener opener(gate);
+
+    // With timings, a streamed request is seen waiting for the response
+    OmnisTools::ParamMap timed;
+    timed["url"] = server.url("/timed");
+    timed["method"] = std::string("POST");
+    timed["body"] = std::string("request body");
+    timed["compress_body"] = true;
+    DelegateResult timedResult;
+    boost::thread timedRequest(boost::bind(fetch, timed, &timedResult));
+
+    // Without them, the request is seen running
+    OmnisTools::ParamMap untimed;
+    untimed["url"] = server.url("/untimed");
+    untimed["method"] = std::string("POST");
+    untimed["body"] = std::string("request body");
+    untimed["compress_body"] = true;
+    untimed["timings"] = false;
+    DelegateResult untimedResult;
+    boost::thread untimedRequest(boost::bind(fetch, untimed, &untimedResult));
+
+    BOOST_CHECK(waitForStage(server.url("/timed"), InflightRegistry::kWaiting));
+    BOOST_CHECK(waitForStage(server.url("/untimed"), InflightRegistry::kConnecting));
+
+    gate.open();
+    timedRequest.join();
+    untimedRequest.join();
+    BOOST_CHECK_EQUAL(timedResult.status, 200);
+    BOOST_CHECK_EQUAL(untimedResult.status, 200);
+    BOOST_CHECK(!listed(server.url("/timed")));
+    BOOST_CHECK(!listed(server.url("/untimed")));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
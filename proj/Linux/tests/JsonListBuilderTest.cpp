@@ -0,0 +1,229 @@
+//
+//  JsonListBuilderTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "JsonListBuilder.h"
+#include "JsonReader.h"
+#include "ListPool.h"
+#include "OmnisTools.he"
+
+#include <clocale>
+#include <cstdlib>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace OmnisTools;
+
+namespace {
+    // Parses a whole document in one piece, or split at every byte
+    bool parse(const std::string& json, JsonListBuilder& builder, bool byteAtATime = false) {
+        JsonReader reader(builder);
+        if (byteAtATime) {
+            for (std::size_t i = 0; i < json.size(); ++i) {
+                if (!reader.feed(json.data() + i, 1))
+                    return false;
+            }
+        } else if (!reader.feed(json.data(), json.size())) {
+            return false;
+        }
+        return reader.finish();
+    }
+
+    bool valid(const std::string& json) {
+        JsonListBuilder whole, split;
+        return parse(json, whole) && parse(json, split, true);
+    }
+
+    std::string stringValue(const std::string& json, bool byteAtATime = false) {
+        JsonListBuilder builder;
+        BOOST_REQUIRE(parse(json, builder, byteAtATime));
+        BOOST_REQUIRE_EQUAL(builder.root().type, JsonValue::kString);
+        return builder.root().text;
+    }
+
+    double numberValue(const std::string& json) {
+        JsonListBuilder builder;
+        BOOST_REQUIRE(parse(json, builder));
+        return builder.root().number;
+    }
+
+    // The list in a cell of a list
+    void nestedList(EXTqlist& list, qlong row, qshort col, EXTqlist& nested) {
+        EXTfldval colVal;
+        list.getColValRef(row, col, colVal, qfalse);
+        BOOST_REQUIRE(colVal.getList(&nested, qfalse));
+    }
+
+    // Converts on a background thread, as a worker does
+    void convert(const JsonListBuilder& builder, std::vector<boost::shared_ptr<EXTqlist> >& owned, boost::shared_ptr<EXTqlist>& list) {
+        list = builder.toList(owned);
+    }
+
+    // A list pool that is empty until a test replenishes it, restored afterwards
+    struct EmptyPool {
+        EmptyPool() : pool(ListPool::instance()), target(pool.target()), maxWait(pool.maxWait()) {
+            pool.drain();
+            pool.setTarget(0);
+        }
+        ~EmptyPool() {
+            pool.drain();
+            pool.setTarget(target);
+            pool.setMaxWait(maxWait);
+        }
+
+        ListPool& pool;
+        std::size_t target;
+        long maxWait;
+    };
+}
+
+BOOST_AUTO_TEST_SUITE(JsonListBuilderTest)
+
+BOOST_AUTO_TEST_CASE(numbersFollowTheGrammar) {
+    const char* good[] = { "0", "-0", "1", "-12", "0.5", "-0.5", "1e5", "1E+5", "1e-5", "12.5e10", "[1,-2,3.5e1]" };
+    for (std::size_t i = 0; i < sizeof(good) / sizeof(good[0]); ++i) {
+        BOOST_CHECK_MESSAGE(valid(good[i]), good[i]);
+    }
+
+    const char* bad[] = { "1-2+3", "[1-2]", "01", "[01]", "-", "[-]", "1.", "[1.]", ".5", "1e", "1e+", "[1e]",
+                          "+1", "1.e5", "--1", "1..2", "[1ee5]", "0x10" };
+    for (std::size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        BOOST_CHECK_MESSAGE(!valid(bad[i]), bad[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(numbersAreReadExactly) {
+    const char* texts[] = { "0.1", "-2.5", "1e-7", "123456789012345678901234567890", "1.7976931348623157e308",
+                            "4.9e-324", "0.30000000000000004", "9007199254740993", "123.456e-2" };
+    for (std::size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+        BOOST_CHECK_EQUAL(numberValue(texts[i]), std::strtod(texts[i], 0));  // The test runs in the C locale
+    }
+    BOOST_CHECK_EQUAL(parseJsonNumber(" 42abc"), 42.0);
+    BOOST_CHECK_EQUAL(parseJsonNumber("abc"), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(numbersIgnoreTheLocale) {
+    const char* locales[] = { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8" };
+    const char* set = 0;
+    for (std::size_t i = 0; !set && i < sizeof(locales) / sizeof(locales[0]); ++i) {
+        set = std::setlocale(LC_NUMERIC, locales[i]);
+    }
+    if (!set) {
+        BOOST_TEST_MESSAGE("No locale with a decimal comma is installed");
+        return;
+    }
+
+    double value = numberValue("1.5");
+    double large = numberValue("1.23456789012345678e300");
+    std::setlocale(LC_NUMERIC, "C");
+    BOOST_CHECK_EQUAL(value, 1.5);
+    BOOST_CHECK_EQUAL(large, 1.23456789012345678e300);
+}
+
+BOOST_AUTO_TEST_CASE(surrogatePairsAreJoined) {
+    BOOST_CHECK_EQUAL(stringValue("\"\\ud834\\udd1e\""), "\xF0\x9D\x84\x9E");
+    BOOST_CHECK_EQUAL(stringValue("\"\\ud834\\udd1e\"", true), "\xF0\x9D\x84\x9E");
+}
+
+BOOST_AUTO_TEST_CASE(unpairedSurrogatesBecomeReplacementCharacters) {
+    const std::string replacement = "\xEF\xBF\xBD";
+    for (int split = 0; split < 2; ++split) {
+        bool byteAtATime = (split == 1);
+        BOOST_CHECK_EQUAL(stringValue("\"a\\ud834\"", byteAtATime), "a" + replacement);
+        BOOST_CHECK_EQUAL(stringValue("\"\\ud834b\"", byteAtATime), replacement + "b");
+        BOOST_CHECK_EQUAL(stringValue("\"\\ud834\\n\"", byteAtATime), replacement + "\n");
+        BOOST_CHECK_EQUAL(stringValue("\"\\ud834\\u0041\"", byteAtATime), replacement + "A");
+        BOOST_CHECK_EQUAL(stringValue("\"\\ud834\\ud834\\udd1e\"", byteAtATime), replacement + "\xF0\x9D\x84\x9E");
+        BOOST_CHECK_EQUAL(stringValue("\"\\udd1e\"", byteAtATime), replacement);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(malformedDocumentsAreRejected) {
+    const char* bad[] = { "", "{", "[1,]", "{\"a\"}", "{\"a\":}", "{\"a\" 1}", "[1 2]", "tru", "nul", "\"abc", "\"\\x\"",
+                          "\"\\u12G4\"", "[1]]", "{} {}", "{\"a\":1,}" };
+    for (std::size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        BOOST_CHECK_MESSAGE(!valid(bad[i]), bad[i]);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(nestedListsAreCheckedOutTogether, EmptyPool) {
+    // 1 list for the array, and 1 for each object's nested object: more than one replenish tick's worth
+    std::string json = "[";
+    for (int i = 0; i < 100; ++i) {
+        json += (i ? "," : "");
+        json += "{\"id\":" + boost::lexical_cast<std::string>(i) + ",\"tags\":{\"even\":" + (i % 2 ? "false" : "true") + "}}";
+    }
+    json += "]";
+    JsonListBuilder builder;
+    BOOST_REQUIRE(parse(json, builder));
+
+    pool.setMaxWait(10000);
+    std::vector<boost::shared_ptr<EXTqlist> > owned;
+    boost::shared_ptr<EXTqlist> list;
+    boost::thread worker(boost::bind(convert, boost::cref(builder), boost::ref(owned), boost::ref(list)));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    pool.replenish();  // Once, as the timer would
+    BOOST_REQUIRE(worker.timed_join(boost::posix_time::seconds(10)));
+
+    BOOST_REQUIRE(list);
+    BOOST_CHECK_EQUAL(owned.size(), 101u);
+    BOOST_REQUIRE_EQUAL(list->rowCnt(), 100);
+    BOOST_REQUIRE_EQUAL(list->colCnt(), 2);
+
+    EXTfldval colVal;
+    EXTqlist tags;
+    for (qlong row = 1; row <= 100; row += 33) {
+        list->getColValRef(row, 1, colVal, qfalse);
+        BOOST_CHECK_EQUAL(getIntFromEXTFldVal(colVal), row - 1);
+        nestedList(*list, row, 2, tags);
+        tags.getColValRef(1, 1, colVal, qfalse);
+        BOOST_CHECK_EQUAL(getBoolFromEXTFldVal(colVal), (row - 1) % 2 == 0);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(conversionFailsWhenThePoolRunsDry, EmptyPool) {
+    JsonListBuilder builder;
+    BOOST_REQUIRE(parse("{\"a\":[1,2],\"b\":{\"c\":true}}", builder));
+
+    pool.setMaxWait(200);
+    std::vector<boost::shared_ptr<EXTqlist> > owned;
+    boost::shared_ptr<EXTqlist> list(new EXTqlist(listVlen));
+    boost::thread worker(boost::bind(convert, boost::cref(builder), boost::ref(owned), boost::ref(list)));
+    BOOST_REQUIRE(worker.timed_join(boost::posix_time::seconds(10)));
+
+    BOOST_CHECK(!list);
+    BOOST_CHECK(owned.empty());
+}
+
+BOOST_AUTO_TEST_CASE(documentsBecomeLists) {
+    JsonListBuilder builder;
+    BOOST_REQUIRE(parse("{\"name\":\"x\",\"n\":2.5,\"items\":[1,2,3],\"none\":null}", builder));
+
+    std::vector<boost::shared_ptr<EXTqlist> > owned;
+    boost::shared_ptr<EXTqlist> list = builder.toList(owned);
+    BOOST_REQUIRE(list);
+    BOOST_CHECK_EQUAL(owned.size(), 2u);
+    BOOST_REQUIRE_EQUAL(list->rowCnt(), 1);
+    BOOST_REQUIRE_EQUAL(list->colCnt(), 4);
+
+    EXTfldval colVal;
+    list->getColValRef(1, 1, colVal, qfalse);
+    BOOST_CHECK_EQUAL(getStringFromEXTFldVal(colVal), "x");
+    list->getColValRef(1, 2, colVal, qfalse);
+    BOOST_CHECK_EQUAL(getDoubleFromEXTFldVal(colVal), 2.5);
+
+    EXTqlist items;
+    nestedList(*list, 1, 3, items);
+    BOOST_REQUIRE_EQUAL(items.rowCnt(), 3);
+    items.getColValRef(3, 1, colVal, qfalse);
+    BOOST_CHECK_EQUAL(getIntFromEXTFldVal(colVal), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
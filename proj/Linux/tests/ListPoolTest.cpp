@@ -0,0 +1,78 @@
+//
+//  ListPoolTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  The pool is only replenished when a test calls replenish(), as the timer isn't run here.
+//
+
+#include "ListPool.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+    // An empty pool that won't grow by itself, restored to its defaults afterwards
+    struct EmptyPool {
+        EmptyPool() : pool(ListPool::instance()), target(pool.target()), maxWait(pool.maxWait()) {
+            pool.drain();
+            pool.setTarget(0);
+            pool.setMaxWait(200);
+        }
+        ~EmptyPool() {
+            pool.drain();
+            pool.setTarget(target);
+            pool.setMaxWait(maxWait);
+        }
+
+        ListPool& pool;
+        std::size_t target;
+        long maxWait;
+    };
+
+    void checkoutInto(boost::shared_ptr<EXTqlist>& list) {
+        list = ListPool::instance().checkout();
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(ListPoolTest, EmptyPool)
+
+BOOST_AUTO_TEST_CASE(mainThreadAllocatesWhenEmpty) {
+    BOOST_CHECK(pool.checkout());
+}
+
+BOOST_AUTO_TEST_CASE(backgroundCheckoutFailsWhenNeverReplenished) {
+    boost::shared_ptr<EXTqlist> list(new EXTqlist(listVlen));
+    boost::thread worker(boost::bind(checkoutInto, boost::ref(list)));
+    BOOST_REQUIRE(worker.timed_join(boost::posix_time::seconds(10)));
+    BOOST_CHECK(!list);
+}
+
+BOOST_AUTO_TEST_CASE(backgroundCheckoutWaitsForReplenish) {
+    pool.setMaxWait(10000);
+    boost::shared_ptr<EXTqlist> list;
+    boost::thread worker(boost::bind(checkoutInto, boost::ref(list)));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+    // The waiting checkout is counted as a shortfall, so the empty pool's target grows to meet it
+    pool.replenish();
+    BOOST_REQUIRE(worker.timed_join(boost::posix_time::seconds(10)));
+    BOOST_CHECK(list);
+    BOOST_CHECK_GE(pool.target(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(backgroundCheckoutTakesPooledList) {
+    pool.setTarget(2);
+    pool.replenish();
+    BOOST_REQUIRE_EQUAL(pool.available(), 2u);
+
+    boost::shared_ptr<EXTqlist> list;
+    boost::thread worker(boost::bind(checkoutInto, boost::ref(list)));
+    BOOST_REQUIRE(worker.timed_join(boost::posix_time::seconds(10)));
+    BOOST_CHECK(list);
+    BOOST_CHECK_EQUAL(pool.available(), 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
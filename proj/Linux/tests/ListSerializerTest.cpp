@@ -0,0 +1,176 @@
+//
+//  ListSerializerTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ListSerializer.h"
+#include "ListSource.h"
+#include "OmnisTools.he"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace OmnisTools;
+
+namespace {
+    void addColumn(EXTqlist& list, ffttype type, const char* name) {
+        str255 colName = initStr255(name);
+        list.addCol(type, type == fftNumber ? dpFmask : dpDefault, 0, &colName);
+    }
+
+    // Columns name (character), count (integer), price (number), active (boolean) and tags (list),
+    // with a row per name.  The second row's cells are null.
+    boost::shared_ptr<EXTqlist> productList(const std::vector<std::string>& names) {
+        boost::shared_ptr<EXTqlist> list(new EXTqlist(listVlen));
+        addColumn(*list, fftCharacter, "name");
+        addColumn(*list, fftInteger, "count");
+        addColumn(*list, fftNumber, "price");
+        addColumn(*list, fftBoolean, "active");
+        addColumn(*list, fftList, "tags");
+
+        EXTfldval colVal;
+        for (qlong row = 1; row <= static_cast<qlong>(names.size()); ++row) {
+            list->insertRow();
+            list->getColValRef(row, 1, colVal, qtrue);
+            getEXTFldValFromString(colVal, names[row - 1]);
+            if (row == 2) {
+                for (qshort col = 2; col <= 5; ++col) {
+                    list->getColValRef(row, col, colVal, qtrue);
+                    colVal.setNull(col == 5 ? fftList : fftInteger, dpDefault);
+                }
+                continue;
+            }
+
+            list->getColValRef(row, 2, colVal, qtrue);
+            getEXTFldValFromInt(colVal, static_cast<int>(row * 10));
+            list->getColValRef(row, 3, colVal, qtrue);
+            getEXTFldValFromDouble(colVal, row + 0.25);
+            list->getColValRef(row, 4, colVal, qtrue);
+            getEXTFldValFromBool(colVal, row % 2 == 1);
+
+            EXTqlist tags(listVlen);
+            addColumn(tags, fftCharacter, "tag");
+            tags.insertRow();
+            EXTfldval tagVal;
+            tags.getColValRef(1, 1, tagVal, qtrue);
+            getEXTFldValFromString(tagVal, "t" + boost::lexical_cast<std::string>(row));
+            list->getColValRef(row, 5, colVal, qtrue);
+            colVal.setList(&tags, qfalse);
+        }
+        return list;
+    }
+
+    std::vector<std::string> names() {
+        std::vector<std::string> n;
+        n.push_back("plain");
+        n.push_back("caf\xC3\xA9, \"quoted\"");
+        n.push_back("line\nbreak\\");
+        return n;
+    }
+
+    std::string serialize(ListSerializer::Format format, EXTqlist& list) {
+        std::string out;
+        ListSerializer(format).write(&list, out);
+        return out;
+    }
+
+    // The body a ListSource sends, batch by batch
+    std::string drain(ListSource& source) {
+        std::string body;
+        const char* data;
+        std::size_t len;
+        while (source.next(data, len) && len > 0) {
+            body.append(data, len);
+        }
+        return body;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(ListSerializerTest)
+
+BOOST_AUTO_TEST_CASE(formatsAreParsed) {
+    ListSerializer::Format format = ListSerializer::kCsv;
+    BOOST_CHECK(ListSerializer::parseFormat("", format) && format == ListSerializer::kJson);
+    BOOST_CHECK(ListSerializer::parseFormat("NDJSON", format) && format == ListSerializer::kNdjson);
+    BOOST_CHECK(ListSerializer::parseFormat("csv", format) && format == ListSerializer::kCsv);
+    BOOST_CHECK(!ListSerializer::parseFormat("xml", format));
+    BOOST_CHECK_EQUAL(ListSerializer::contentType(ListSerializer::kNdjson), "application/x-ndjson");
+}
+
+BOOST_AUTO_TEST_CASE(json) {
+    boost::shared_ptr<EXTqlist> list = productList(names());
+    BOOST_CHECK_EQUAL(serialize(ListSerializer::kJson, *list),
+        "[{\"name\":\"plain\",\"count\":10,\"price\":1.25,\"active\":true,\"tags\":[{\"tag\":\"t1\"}]},"
+        "{\"name\":\"caf\xC3\xA9, \\\"quoted\\\"\",\"count\":null,\"price\":null,\"active\":null,\"tags\":null},"
+        "{\"name\":\"line\\nbreak\\\\\",\"count\":30,\"price\":3.25,\"active\":true,\"tags\":[{\"tag\":\"t3\"}]}]");
+}
+
+BOOST_AUTO_TEST_CASE(ndjson) {
+    boost::shared_ptr<EXTqlist> list = productList(names());
+    std::string out = serialize(ListSerializer::kNdjson, *list);
+    BOOST_CHECK_EQUAL(std::count(out.begin(), out.end(), '\n'), 3);
+    BOOST_CHECK_EQUAL(out.substr(0, out.find('\n')),
+                      "{\"name\":\"plain\",\"count\":10,\"price\":1.25,\"active\":true,\"tags\":[{\"tag\":\"t1\"}]}");
+}
+
+BOOST_AUTO_TEST_CASE(csv) {
+    boost::shared_ptr<EXTqlist> list = productList(names());
+    BOOST_CHECK_EQUAL(serialize(ListSerializer::kCsv, *list),
+        "name,count,price,active,tags\r\n"
+        "plain,10,1.25,true,\"[{\"\"tag\"\":\"\"t1\"\"}]\"\r\n"
+        "\"caf\xC3\xA9, \"\"quoted\"\"\",,,,\r\n"
+        "\"line\nbreak\\\",30,3.25,true,\"[{\"\"tag\"\":\"\"t3\"\"}]\"\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(emptyList) {
+    EXTqlist list(listVlen);
+    addColumn(list, fftCharacter, "name");
+    BOOST_CHECK_EQUAL(serialize(ListSerializer::kJson, list), "[]");
+    BOOST_CHECK_EQUAL(serialize(ListSerializer::kNdjson, list), "");
+    BOOST_CHECK_EQUAL(serialize(ListSerializer::kCsv, list), "name\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(rowAtATimeMatchesWhole) {
+    boost::shared_ptr<EXTqlist> list = productList(names());
+    ListSerializer::Format formats[] = { ListSerializer::kJson, ListSerializer::kNdjson, ListSerializer::kCsv };
+    for (std::size_t f = 0; f < 3; ++f) {
+        ListSerializer serializer(formats[f]);
+        std::string out;
+        serializer.begin(list.get(), out);
+        for (qlong row = 1; row <= list->rowCnt(); ++row) {
+            serializer.writeRow(list.get(), row, out);
+        }
+        serializer.end(out);
+        BOOST_CHECK_EQUAL(out, serialize(formats[f], *list));
+    }
+}
+
+// A list bigger than a ListSource batch is sent in several batches that add up to the whole
+BOOST_AUTO_TEST_CASE(listSourceBatches) {
+    std::vector<std::string> many;
+    for (int i = 0; i < 5000; ++i) {
+        many.push_back("row " + boost::lexical_cast<std::string>(i) + std::string(20, 'x'));
+    }
+    boost::shared_ptr<EXTqlist> list = productList(many);
+
+    ListSource source(list, ListSerializer::kJson);
+    BOOST_CHECK(source.length() == BodySource::kUnknownLength);
+
+    std::size_t batches = 0;
+    std::string body;
+    const char* data;
+    std::size_t len;
+    while (source.next(data, len) && len > 0) {
+        body.append(data, len);
+        ++batches;
+    }
+    BOOST_CHECK_GT(batches, 1u);
+    BOOST_CHECK_EQUAL(body, serialize(ListSerializer::kJson, *list));
+
+    ListSource csv(list, ListSerializer::kCsv);
+    BOOST_CHECK_EQUAL(drain(csv), serialize(ListSerializer::kCsv, *list));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
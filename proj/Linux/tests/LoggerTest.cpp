@@ -0,0 +1,165 @@
+//
+//  LoggerTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Logging.he"
+#include "TestSupport.h"
+
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // Logs to a file in a new directory for a test, and back to standard output afterwards
+    struct LogToFile {
+        LogToFile(boost::uint64_t maxBytes = Logger::kDefaultMaxBytes, int maxFiles = Logger::kDefaultMaxFiles)
+            : path(dir.file("http.log")) {
+            std::string error;
+            BOOST_REQUIRE_MESSAGE(Logger::instance().setFile(path, maxBytes, maxFiles, error), error);
+        }
+        ~LogToFile() {
+            Logger::instance().flush();
+            std::string error;
+            Logger::instance().setFile("", Logger::kDefaultMaxBytes, Logger::kDefaultMaxFiles, error);
+            Logger::setLevel(Logger::kInfo);
+        }
+
+        std::vector<std::string> lines() {
+            Logger::instance().flush();
+            std::string text = readFile(path);
+            std::vector<std::string> split;
+            if (!text.empty()) {
+                boost::split(split, text, boost::is_any_of("\n"));
+                split.pop_back();  // After the last newline
+            }
+            return split;
+        }
+
+        TempDir dir;
+        std::string path;
+    };
+
+    int evaluated = 0;
+
+    std::string counted(const std::string& text) {
+        ++evaluated;
+        return text;
+    }
+
+    void logNumbered(int thread, int count) {
+        for (int i = 0; i < count; ++i) {
+            LOG_INFO << "thread " << thread << " message " << i;
+        }
+    }
+
+    // The number at the end of a line
+    int lastNumber(const std::string& line) {
+        return boost::lexical_cast<int>(line.substr(line.rfind(' ') + 1));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(LoggerTest)
+
+BOOST_AUTO_TEST_CASE(parsesLevelNames) {
+    Logger::Level level = Logger::kOff;
+    BOOST_CHECK(Logger::parseLevel("debug", level));
+    BOOST_CHECK_EQUAL(level, Logger::kDebug);
+    BOOST_CHECK(Logger::parseLevel("Warn", level));
+    BOOST_CHECK_EQUAL(level, Logger::kWarning);
+    BOOST_CHECK(Logger::parseLevel("OFF", level));
+    BOOST_CHECK_EQUAL(level, Logger::kOff);
+    BOOST_CHECK(!Logger::parseLevel("loud", level));
+    BOOST_CHECK_EQUAL(Logger::levelName(Logger::kError), "ERROR");
+}
+
+BOOST_AUTO_TEST_CASE(writesTimestampedLines) {
+    LogToFile log;
+    LOG_INFO << "first " << 1;
+    LOG_ERROR << "second";
+
+    std::vector<std::string> lines = log.lines();
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+    BOOST_CHECK(boost::ends_with(lines[0], " [INFO] first 1"));
+    BOOST_CHECK(boost::ends_with(lines[1], " [ERROR] second"));
+    BOOST_CHECK_EQUAL(lines[0].find(" [INFO]"), 26u);  // "YYYY-MM-DD HH:MM:SS.uuuuuu"
+}
+
+BOOST_AUTO_TEST_CASE(messagesBelowTheLevelArentFormatted) {
+    LogToFile log;
+    Logger::setLevel(Logger::kWarning);
+    evaluated = 0;
+    LOG_INFO << counted("hidden");
+    LOG_WARNING << counted("shown");
+    BOOST_CHECK_EQUAL(evaluated, 1);
+
+    std::vector<std::string> lines = log.lines();
+    BOOST_REQUIRE_EQUAL(lines.size(), 1u);
+    BOOST_CHECK(boost::ends_with(lines[0], "[WARNING] shown"));
+}
+
+BOOST_AUTO_TEST_CASE(messagesFromManyThreadsAreAllWrittenOrLost) {
+    LogToFile log;
+    boost::uint64_t droppedBefore = Logger::instance().dropped();
+
+    const int threads = 4;
+    const int count = 3000;  // More than a ring holds, so some may be dropped if the writer falls behind
+    boost::thread_group group;
+    for (int t = 0; t < threads; ++t) {
+        group.create_thread(boost::bind(logNumbered, t, count));
+    }
+    group.join_all();
+
+    std::vector<std::string> lines = log.lines();
+    boost::uint64_t dropped = Logger::instance().dropped() - droppedBefore;
+    BOOST_CHECK(lines.size() + dropped == static_cast<std::size_t>(threads * count));
+
+    // Each thread's messages stay in the order they were logged
+    std::vector<int> last(threads, -1);
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        std::size_t at = lines[i].find("thread ");
+        BOOST_REQUIRE(at != std::string::npos);
+        int thread = lines[i][at + 7] - '0';
+        int number = lastNumber(lines[i]);
+        BOOST_CHECK(number > last[thread]);
+        last[thread] = number;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rotatesFilesAtTheirLimit) {
+    LogToFile log(1000, 2);
+    for (int i = 0; i < 100; ++i) {
+        LOG_INFO << "rotated message " << i;
+        if (i % 10 == 9)
+            Logger::instance().flush();  // So that none are dropped
+    }
+    Logger::instance().flush();
+
+    BOOST_CHECK(fileExists(log.path + ".1"));
+    BOOST_CHECK(fileExists(log.path + ".2"));
+    BOOST_CHECK(!fileExists(log.path + ".3"));
+    BOOST_CHECK(readFile(log.path + ".1").size() < 1100);  // One line over at most
+
+    // The newest are in the current file, and the oldest have gone
+    std::vector<std::string> lines = log.lines();
+    BOOST_REQUIRE(!lines.empty());
+    BOOST_CHECK_EQUAL(lastNumber(lines.back()), 99);
+    BOOST_CHECK(readFile(log.path + ".2").find("rotated message 0\n") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(rejectsAFileItCantOpen) {
+    TempDir dir;
+    std::string error;
+    BOOST_CHECK(!Logger::instance().setFile(dir.file("missing/http.log"), 1000, 1, error));
+    BOOST_CHECK_EQUAL(error, "Unable to open log file " + dir.file("missing/http.log"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+//
+//  MetricsServerTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "MetricsServer.h"
+#include "HttpStreamClient.h"
+#include "JsonListBuilder.h"
+#include "RequestTimings.h"
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+    // A port nothing is listening on just now
+    int freePort() {
+        boost::asio::io_service service;
+        boost::asio::ip::tcp::acceptor acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        return acceptor.local_endpoint().port();
+    }
+
+    // Starts the server on a free port for a test, and stops it afterwards
+    struct Serving {
+        Serving() : port(freePort()) {
+            std::string error;
+            BOOST_REQUIRE_MESSAGE(MetricsServer::instance().start(port, error), error);
+        }
+        ~Serving() { MetricsServer::instance().stop(); }
+
+        // Status and body of a request to the server
+        int fetch(const std::string& method, const std::string& path, std::string& body) {
+            StringSink sink(body);
+            HttpStreamClient client;
+            client.setTimeout(5);
+            std::string url = "http://127.0.0.1:" + boost::lexical_cast<std::string>(port) + path;
+            return client.request(method, url, HttpStreamClient::Headers(), std::string(), 0, sink).status;
+        }
+
+        int port;
+    };
+
+    bool contains(const std::string& text, const std::string& part) {
+        return text.find(part) != std::string::npos;
+    }
+
+    JsonValue parse(const std::string& json) {
+        JsonListBuilder builder;
+        JsonReader reader(builder);
+        bool parsed = reader.feed(json.data(), json.size()) && reader.finish();
+        BOOST_REQUIRE_MESSAGE(parsed, reader.error());
+        return builder.root();
+    }
+
+    const JsonValue* member(const JsonValue& object, const std::string& key) {
+        for (std::size_t i = 0; i < object.keys.size(); ++i) {
+            if (object.keys[i] == key)
+                return &object.items[i];
+        }
+        return 0;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(MetricsServerTest)
+
+BOOST_AUTO_TEST_CASE(writesCountersAndGauges) {
+    Metrics::Snapshot snapshot;
+    snapshot.counters[Metrics::kRequestsStarted] = 12;
+    snapshot.counters[Metrics::kQueueDepth] = 3;
+    std::string text = MetricsServer::prometheus(snapshot);
+
+    BOOST_CHECK(contains(text, "# TYPE httplib_requests_started_total counter\nhttplib_requests_started_total 12\n"));
+    BOOST_CHECK(contains(text, "# TYPE httplib_queue_depth gauge\nhttplib_queue_depth 3\n"));
+    BOOST_CHECK(!contains(text, "httplib_queue_depth_total"));
+    BOOST_CHECK(contains(text, "# HELP httplib_requests_started_total "));
+
+    // The TCP figures say which requests they cover
+    BOOST_CHECK(contains(text, "# HELP httplib_tcp_retransmits_total TCP segments retransmitted since the last $resetMetrics. "
+                               "Sampled from TCP_INFO for streamed requests (Linux) only, not those made through cpp-netlib.\n"));
+    BOOST_CHECK(contains(text, "# HELP httplib_tcp_rtt_seconds Smoothed TCP round trip time"));
+    BOOST_CHECK(contains(text, "for streamed requests (Linux) only, not those made through cpp-netlib.\n# TYPE httplib_tcp_rtt_seconds summary\n"));
+}
+
+BOOST_AUTO_TEST_CASE(writesHistogramsAsSummariesInSeconds) {
+    Metrics::Snapshot snapshot;
+    for (int i = 0; i < 10; ++i) {
+        snapshot.hosts["api.test"].record(2000);  // 2 ms
+    }
+    snapshot.hosts["odd \"host\"\\\n"].record(1);
+    std::string text = MetricsServer::prometheus(snapshot);
+
+    BOOST_CHECK(contains(text, "httplib_request_duration_seconds{host=\"api.test\",quantile=\"0.5\"} 0.002"));
+    BOOST_CHECK(contains(text, "httplib_request_duration_seconds_sum{host=\"api.test\"} 0.02\n"));
+    BOOST_CHECK(contains(text, "httplib_request_duration_seconds_count{host=\"api.test\"} 10\n"));
+    BOOST_CHECK(contains(text, "{host=\"odd \\\"host\\\"\\\\\\n\",quantile=\"0.99\"}"));
+    BOOST_CHECK(contains(text, "httplib_request_duration_by_status_seconds_count{status=\"2xx\"} 0\n"));
+    BOOST_CHECK(contains(text, "httplib_delivery_lag_seconds_count 0\n"));
+    BOOST_CHECK(contains(text, "httplib_tcp_rtt_seconds{quantile=\"0.5\"} 0\n"));
+}
+
+BOOST_AUTO_TEST_CASE(writesInflightRequestsAsJson) {
+    std::vector<InflightRegistry::Request> requests(2);
+    requests[0].id = 7;
+    requests[0].method = "GET";
+    requests[0].url = "http://test/\"quoted\"";
+    requests[0].stage = InflightRegistry::kReceiving;
+    requests[0].elapsed = 1500;
+    requests[0].bytesIn = 100;
+    requests[0].slow = true;
+    requests[1].id = 8;
+
+    JsonValue json = parse(MetricsServer::inflightJson(requests));
+    BOOST_REQUIRE_EQUAL(json.type, JsonValue::kArray);
+    BOOST_REQUIRE_EQUAL(json.items.size(), 2u);
+    const JsonValue& first = json.items[0];
+    BOOST_CHECK_EQUAL(member(first, "id")->number, 7);
+    BOOST_CHECK_EQUAL(member(first, "url")->text, "http://test/\"quoted\"");
+    BOOST_CHECK_EQUAL(member(first, "stage")->text, "receiving");
+    BOOST_CHECK_EQUAL(member(first, "elapsed_ms")->number, 1500);
+    BOOST_CHECK_EQUAL(member(first, "bytes_in")->number, 100);
+    BOOST_CHECK(member(first, "slow")->boolean);
+    BOOST_CHECK(!member(json.items[1], "slow")->boolean);
+
+    BOOST_CHECK_EQUAL(parse(MetricsServer::inflightJson(std::vector<InflightRegistry::Request>())).items.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(servesMetricsAndInflightRequests) {
+    Serving serving;
+    BOOST_CHECK_EQUAL(MetricsServer::instance().port(), serving.port);
+    Metrics::instance().count(Metrics::kRequestsStarted);
+
+    std::string metrics;
+    BOOST_CHECK_EQUAL(serving.fetch("GET", "/metrics?name=ignored", metrics), 200);
+    BOOST_CHECK(contains(metrics, "# TYPE httplib_requests_started_total counter\n"));
+
+    boost::uint64_t id = InflightRegistry::instance().add("GET", "http://test/inflight", boost::make_shared<RequestTimings>());
+    std::string inflight;
+    BOOST_CHECK_EQUAL(serving.fetch("GET", "/inflight", inflight), 200);
+    InflightRegistry::instance().remove(id);
+    BOOST_CHECK(contains(inflight, "\"url\":\"http://test/inflight\""));
+
+    std::string body;
+    BOOST_CHECK_EQUAL(serving.fetch("GET", "/elsewhere", body), 404);
+    BOOST_CHECK_EQUAL(serving.fetch("DELETE", "/metrics", body), 405);
+}
+
+BOOST_AUTO_TEST_CASE(stopsListening) {
+    int port;
+    {
+        Serving serving;
+        port = serving.port;
+    }
+    BOOST_CHECK_EQUAL(MetricsServer::instance().port(), 0);
+
+    boost::asio::io_service service;
+    boost::asio::ip::tcp::socket socket(service);
+    boost::system::error_code error;
+    socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(port)), error);
+    BOOST_CHECK(error);
+}
+
+BOOST_AUTO_TEST_CASE(rejectsPortsItCantUse) {
+    std::string error;
+    BOOST_CHECK(!MetricsServer::instance().start(0, error));
+    BOOST_CHECK_EQUAL(error, "Invalid metrics port 0");
+    BOOST_CHECK(!MetricsServer::instance().start(70000, error));
+
+    boost::asio::io_service service;
+    boost::asio::ip::tcp::acceptor taken(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    int port = taken.local_endpoint().port();
+    BOOST_CHECK(!MetricsServer::instance().start(port, error));
+    BOOST_CHECK(error.find("Unable to listen on port " + boost::lexical_cast<std::string>(port)) == 0);
+    BOOST_CHECK_EQUAL(MetricsServer::instance().port(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+//
+//  MetricsTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Metrics.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+    void record(int thread, int count) {
+        Metrics& metrics = Metrics::instance();
+        std::string host = "host" + boost::lexical_cast<std::string>(thread % 3) + ".test";
+        for (int i = 0; i < count; ++i) {
+            metrics.count(Metrics::kRequestsStarted);
+            metrics.count(Metrics::kBytesIn, 10);
+            metrics.recordLatency(host, 200, 1000 + i);
+        }
+    }
+
+    // Reads while the others record, counting the snapshots that went backwards
+    void read(int snapshots, int* backwards) {
+        boost::int64_t last = 0;
+        for (int i = 0; i < snapshots; ++i) {
+            boost::int64_t started = Metrics::instance().snapshot().counters[Metrics::kRequestsStarted];
+            if (started < last)
+                ++*backwards;
+            last = started;
+            boost::this_thread::yield();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(MetricsTest)
+
+BOOST_AUTO_TEST_CASE(histogramBucketsHoldValuesWithinASixteenth) {
+    BOOST_CHECK_EQUAL(Metrics::Histogram::bucket(0), 0);
+    BOOST_CHECK_EQUAL(Metrics::Histogram::bucket(31), 31);
+    BOOST_CHECK(Metrics::Histogram::highestValue(Metrics::Histogram::bucket(31)) == 31);
+
+    boost::uint64_t values[] = { 32, 100, 1000, 123456, 987654321 };
+    for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        boost::uint64_t highest = Metrics::Histogram::highestValue(Metrics::Histogram::bucket(values[i]));
+        BOOST_CHECK(highest >= values[i]);
+        BOOST_CHECK(highest - values[i] <= values[i] / 16);
+    }
+    BOOST_CHECK_EQUAL(Metrics::Histogram::bucket(boost::uint64_t(1) << 50), Metrics::Histogram::kBuckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE(histogramsGivePercentiles) {
+    Metrics::Histogram histogram;
+    BOOST_CHECK(histogram.percentile(50) == 0);
+    for (boost::uint64_t i = 1; i <= 100; ++i) {
+        histogram.record(i);
+    }
+    BOOST_CHECK(histogram.count() == 100);
+    BOOST_CHECK(histogram.sum() == 5050);
+    BOOST_CHECK_CLOSE(histogram.mean(), 50.5, 0.001);
+    BOOST_CHECK(histogram.percentile(50) >= 50 && histogram.percentile(50) <= 53);
+    BOOST_CHECK(histogram.max() >= 100 && histogram.max() <= 103);
+
+    Metrics::Histogram other;
+    other.record(1000);
+    histogram.add(other);
+    BOOST_CHECK(histogram.count() == 101);
+    histogram.subtract(other);
+    BOOST_CHECK(histogram.count() == 100);
+    BOOST_CHECK(histogram.max() <= 103);
+}
+
+BOOST_AUTO_TEST_CASE(statusesFallIntoClasses) {
+    BOOST_CHECK_EQUAL(Metrics::statusClass(204), Metrics::kStatus2xx);
+    BOOST_CHECK_EQUAL(Metrics::statusClass(404), Metrics::kStatus4xx);
+    BOOST_CHECK_EQUAL(Metrics::statusClass(0), Metrics::kStatusFailed);
+    BOOST_CHECK_EQUAL(Metrics::statusClassName(Metrics::kStatus5xx), "5xx");
+    BOOST_CHECK_EQUAL(Metrics::counterName(Metrics::kQueueDepth), "queue_depth");
+}
+
+BOOST_AUTO_TEST_CASE(resetClearsAllButTheQueueDepth) {
+    Metrics& metrics = Metrics::instance();
+    metrics.reset();
+    boost::int64_t depth = metrics.snapshot().counters[Metrics::kQueueDepth];
+
+    metrics.count(Metrics::kRequestsCompleted, 3);
+    metrics.count(Metrics::kQueueDepth, 2);
+    metrics.recordLatency("reset.test", 200, 5000);
+    metrics.recordDeliveryLag(100);
+    metrics.recordRtt(2000);
+
+    Metrics::Snapshot before = metrics.snapshot();
+    BOOST_CHECK(before.counters[Metrics::kRequestsCompleted] == 3);
+    BOOST_CHECK(before.counters[Metrics::kQueueDepth] == depth + 2);
+    BOOST_CHECK(before.hosts["reset.test"].count() == 1);
+    BOOST_CHECK(before.statuses[Metrics::kStatus2xx].count() == 1);
+    BOOST_CHECK(before.deliveryLag.count() == 1);
+    BOOST_CHECK(before.tcpRtt.count() == 1);
+
+    metrics.reset();
+    Metrics::Snapshot after = metrics.snapshot();
+    BOOST_CHECK(after.counters[Metrics::kRequestsCompleted] == 0);
+    BOOST_CHECK(after.counters[Metrics::kQueueDepth] == depth + 2);
+    BOOST_CHECK(after.hosts.find("reset.test") == after.hosts.end());
+    BOOST_CHECK(after.statuses[Metrics::kStatus2xx].count() == 0);
+    BOOST_CHECK(after.deliveryLag.count() == 0);
+    BOOST_CHECK(after.tcpRtt.count() == 0);
+
+    metrics.count(Metrics::kQueueDepth, -2);
+}
+
+BOOST_AUTO_TEST_CASE(hostsBeyondTheLimitAreCountedTogether) {
+    Metrics& metrics = Metrics::instance();
+    metrics.reset();
+    for (std::size_t i = 0; i < Metrics::kMaxHosts + 10; ++i) {
+        metrics.recordLatency("many" + boost::lexical_cast<std::string>(i) + ".test", 200, 100);
+    }
+
+    Metrics::Snapshot snapshot = metrics.snapshot();
+    BOOST_CHECK(snapshot.hosts.size() <= Metrics::kMaxHosts + 1);
+    BOOST_REQUIRE(snapshot.hosts.find(Metrics::kOtherHosts) != snapshot.hosts.end());
+    BOOST_CHECK(snapshot.hosts[Metrics::kOtherHosts].count() >= 10);
+    BOOST_CHECK(snapshot.statuses[Metrics::kStatus2xx].count() == Metrics::kMaxHosts + 10);
+}
+
+BOOST_AUTO_TEST_CASE(concurrentRecordingIsAllCounted) {
+    Metrics& metrics = Metrics::instance();
+    metrics.reset();
+
+    int backwards = 0;
+    boost::thread reader(boost::bind(read, 200, &backwards));
+
+    const int threads = 8;
+    const int count = 20000;
+    boost::thread_group group;
+    for (int t = 0; t < threads; ++t) {
+        group.create_thread(boost::bind(record, t, count));
+    }
+    group.join_all();
+    reader.join();
+
+    Metrics::Snapshot snapshot = metrics.snapshot();
+    BOOST_CHECK(snapshot.counters[Metrics::kRequestsStarted] == threads * count);
+    BOOST_CHECK(snapshot.counters[Metrics::kBytesIn] == threads * count * 10);
+    BOOST_CHECK(snapshot.statuses[Metrics::kStatus2xx].count() == static_cast<boost::uint64_t>(threads * count));
+    boost::uint64_t hosts = 0;  // Under their own names, or counted together if the slots have run out
+    for (std::map<std::string, Metrics::Histogram>::iterator it = snapshot.hosts.begin(); it != snapshot.hosts.end(); ++it) {
+        hosts += it->second.count();
+    }
+    BOOST_CHECK(hosts == static_cast<boost::uint64_t>(threads * count));
+    BOOST_CHECK_EQUAL(backwards, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
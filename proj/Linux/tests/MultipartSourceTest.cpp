@@ -0,0 +1,186 @@
+//
+//  MultipartSourceTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "MultipartSource.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    OmnisTools::ParamMap valuePart(const std::string& name, const std::string& value) {
+        OmnisTools::ParamMap part;
+        part["name"] = name;
+        part["value"] = value;
+        return part;
+    }
+
+    OmnisTools::ParamMap filePart(const std::string& name, const std::string& path) {
+        OmnisTools::ParamMap part;
+        part["name"] = name;
+        part["path"] = path;
+        return part;
+    }
+
+    // Reads the whole body.  Returns "(failed)" if the source fails.
+    std::string drain(BodySource& source) {
+        std::string body;
+        for (;;) {
+            const char* data;
+            std::size_t len;
+            if (!source.next(data, len))
+                return "(failed)";
+            if (len == 0)
+                return body;
+            body.append(data, len);
+        }
+    }
+
+    std::string boundary(const MultipartSource& source) {
+        std::string type = source.contentType();
+        return type.substr(type.find("boundary=") + 9);
+    }
+
+    std::string echo(const TestServer::Request& request) {
+        return TestServer::response(200, request.header("Content-Type") + "\n" + request.header("Content-Length") + "\n" + request.body);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(MultipartSourceTest)
+
+BOOST_AUTO_TEST_CASE(writesInlineValuesAsFormData) {
+    std::vector<OmnisTools::ParamMap> parts;
+    parts.push_back(valuePart("title", "Report"));
+    OmnisTools::ParamMap typed = valuePart("data", "{\"a\":1}");
+    typed["content_type"] = std::string("application/json");
+    typed["filename"] = std::string("data.json");
+    parts.push_back(typed);
+
+    MultipartSource source(parts);
+    BOOST_REQUIRE(source.error().empty());
+    BOOST_CHECK(boost::starts_with(source.contentType(), "multipart/form-data; boundary=----HTTPlibBoundary"));
+
+    std::string b = boundary(source);
+    std::string expected = "--" + b + "\r\nContent-Disposition: form-data; name=\"title\"\r\n\r\nReport\r\n"
+                           "--" + b + "\r\nContent-Disposition: form-data; name=\"data\"; filename=\"data.json\"\r\n"
+                           "Content-Type: application/json\r\n\r\n{\"a\":1}\r\n"
+                           "--" + b + "--\r\n";
+    BOOST_CHECK_EQUAL(drain(source), expected);
+    BOOST_CHECK(source.length() == static_cast<boost::int64_t>(expected.size()));
+}
+
+BOOST_AUTO_TEST_CASE(takesBinaryValues) {
+    std::vector<OmnisTools::ParamMap> parts;
+    OmnisTools::ParamMap part;
+    part["name"] = std::string("bytes");
+    const unsigned char bytes[] = { 0, 1, 0xFF, '\r', '\n' };
+    part["value"] = std::vector<unsigned char>(bytes, bytes + sizeof(bytes));
+    parts.push_back(part);
+
+    MultipartSource source(parts);
+    std::string body = drain(source);
+    BOOST_CHECK(body.find("\r\n\r\n" + std::string(reinterpret_cast<const char*>(bytes), sizeof(bytes)) + "\r\n--") != std::string::npos);
+    BOOST_CHECK(source.length() == static_cast<boost::int64_t>(body.size()));
+}
+
+BOOST_AUTO_TEST_CASE(readsFilePartsFromDisk) {
+    TempDir dir;
+    std::string content(300 * 1024, 'x');
+    content += "end of file";
+    writeFile(dir.file("upload.bin"), content);
+
+    std::vector<OmnisTools::ParamMap> parts;
+    parts.push_back(filePart("file", dir.file("upload.bin")));
+
+    MultipartSource source(parts);
+    BOOST_REQUIRE(source.error().empty());
+    std::string body = drain(source);
+    BOOST_CHECK(body.find("name=\"file\"; filename=\"upload.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n") != std::string::npos);
+    BOOST_CHECK(body.find(content + "\r\n--" + boundary(source) + "--\r\n") != std::string::npos);
+    BOOST_CHECK(source.length() == static_cast<boost::int64_t>(body.size()));
+}
+
+BOOST_AUTO_TEST_CASE(quotesNames) {
+    std::vector<OmnisTools::ParamMap> parts;
+    parts.push_back(valuePart("say \"hi\"\r\n", "x"));
+
+    MultipartSource source(parts);
+    BOOST_CHECK(drain(source).find("name=\"say %22hi%22%0D%0A\"") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(rejectsInvalidParts) {
+    std::vector<OmnisTools::ParamMap> unnamed(1, valuePart("", "x"));
+    BOOST_CHECK_EQUAL(MultipartSource(unnamed).error(), "Multipart part has no name");
+
+    std::vector<OmnisTools::ParamMap> empty(1, OmnisTools::ParamMap());
+    empty[0]["name"] = std::string("empty");
+    BOOST_CHECK_EQUAL(MultipartSource(empty).error(), "Multipart part empty needs one of value and path");
+
+    TempDir dir;
+    writeFile(dir.file("a.txt"), "a");
+    std::vector<OmnisTools::ParamMap> both(1, filePart("both", dir.file("a.txt")));
+    both[0]["value"] = std::string("x");
+    BOOST_CHECK_EQUAL(MultipartSource(both).error(), "Multipart part both needs one of value and path");
+
+    std::vector<OmnisTools::ParamMap> missing(1, filePart("missing", dir.file("missing.txt")));
+    MultipartSource source(missing);
+    BOOST_CHECK(!source.error().empty());
+    BOOST_CHECK_EQUAL(drain(source), "(failed)");
+}
+
+BOOST_AUTO_TEST_CASE(failsIfAFileChangesSizeBeforeItsSent) {
+    TempDir dir;
+    writeFile(dir.file("growing.txt"), "short");
+
+    std::vector<OmnisTools::ParamMap> parts;
+    parts.push_back(filePart("file", dir.file("growing.txt")));
+    MultipartSource source(parts);
+    BOOST_REQUIRE(source.error().empty());
+
+    writeFile(dir.file("growing.txt"), "rather longer now");
+    BOOST_CHECK_EQUAL(drain(source), "(failed)");
+    BOOST_CHECK_EQUAL(source.error(), "File changed size while uploading: " + dir.file("growing.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(delegateSendsTheFormWithItsLength) {
+    TestServer server(echo);
+    TempDir dir;
+    writeFile(dir.file("notes.txt"), "file content");
+
+    std::vector<OmnisTools::ParamMap> parts;
+    parts.push_back(valuePart("title", "Report"));
+    parts.push_back(filePart("notes", dir.file("notes.txt")));
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/form");
+    params["method"] = std::string("POST");
+    params["body_type"] = std::string("text/plain");  // Replaced by the multipart type
+    params["multipart"] = parts;
+    DelegateResult result = runDelegate(params);
+
+    BOOST_REQUIRE(result.ran);
+    BOOST_CHECK_EQUAL(result.status, 200);
+    std::vector<std::string> lines;
+    boost::split(lines, result.body, boost::is_any_of("\n"));
+    BOOST_REQUIRE(lines.size() > 2);
+    BOOST_CHECK(boost::starts_with(lines[0], "multipart/form-data; boundary="));
+    std::string body = result.body.substr(lines[0].size() + lines[1].size() + 2);
+    BOOST_CHECK_EQUAL(lines[1], boost::lexical_cast<std::string>(body.size()));
+    BOOST_CHECK(body.find("name=\"title\"\r\n\r\nReport\r\n") != std::string::npos);
+    BOOST_CHECK(body.find("filename=\"notes.txt\"\r\nContent-Type: application/octet-stream\r\n\r\nfile content\r\n") != std::string::npos);
+
+    std::vector<TestServer::Request> requests = server.requests();
+    BOOST_REQUIRE_EQUAL(requests.size(), 1u);
+    BOOST_CHECK(!requests[0].chunked);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
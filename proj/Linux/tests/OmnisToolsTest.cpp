@@ -0,0 +1,69 @@
+//
+//  OmnisToolsTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "OmnisTools.he"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace OmnisTools;
+
+namespace {
+    // A list of rows rows with the columns name (character) and size (integer)
+    void sizeList(EXTfldval& fVal, qlong rows, bool isRow) {
+        EXTqlist list(listVlen);
+        str255 colName;
+        colName = initStr255("name");
+        list.addCol(fftCharacter, dpDefault, 0, &colName);
+        colName = initStr255("size");
+        list.addCol(fftInteger, dpDefault, 0, &colName);
+
+        EXTfldval colVal;
+        for (qlong row = 1; row <= rows; ++row) {
+            list.insertRow();
+            list.getColValRef(row, 1, colVal, qtrue);
+            getEXTFldValFromString(colVal, "item" + boost::lexical_cast<std::string>(row));
+            list.getColValRef(row, 2, colVal, qtrue);
+            getEXTFldValFromInt(colVal, static_cast<int>(row * 10));
+        }
+        fVal.setList(&list, qfalse, isRow ? qtrue : qfalse);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(OmnisToolsTest)
+
+BOOST_AUTO_TEST_CASE(getAnyFromEXTFldValReadsEveryRowAndColumn) {
+    EXTfldval fVal;
+    sizeList(fVal, 3, false);
+
+    std::vector<ParamMap> rows = boost::any_cast<std::vector<ParamMap> >(getAnyFromEXTFldVal(fVal));
+    BOOST_REQUIRE_EQUAL(rows.size(), 3u);
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(rows[i].size(), 2u);
+        BOOST_CHECK_EQUAL(boost::any_cast<std::string>(rows[i]["name"]), "item" + boost::lexical_cast<std::string>(i + 1));
+        BOOST_CHECK_EQUAL(boost::any_cast<int>(rows[i]["size"]), static_cast<int>((i + 1) * 10));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(getAnyFromEXTFldValReadsARow) {
+    EXTfldval fVal;
+    sizeList(fVal, 1, true);
+
+    std::vector<ParamMap> rows = boost::any_cast<std::vector<ParamMap> >(getAnyFromEXTFldVal(fVal));
+    BOOST_REQUIRE_EQUAL(rows.size(), 1u);
+    BOOST_CHECK_EQUAL(boost::any_cast<std::string>(rows[0]["name"]), "item1");
+    BOOST_CHECK_EQUAL(boost::any_cast<int>(rows[0]["size"]), 10);
+}
+
+BOOST_AUTO_TEST_CASE(getAnyFromEXTFldValReadsAnEmptyList) {
+    EXTfldval fVal;
+    sizeList(fVal, 0, false);
+
+    BOOST_CHECK(boost::any_cast<std::vector<ParamMap> >(getAnyFromEXTFldVal(fVal)).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+//
+//  ProjectionTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Projection.h"
+#include "TestSupport.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace OmnisTools;
+using namespace TestSupport;
+
+namespace {
+    // A projection parameter row
+    ParamMap column(const std::string& name, const std::string& path, const std::string& type = std::string()) {
+        ParamMap row;
+        row["name"] = name;
+        row["path"] = path;
+        if (!type.empty())
+            row["type"] = type;
+        return row;
+    }
+
+    const char* kJson =
+        "{\"total\": 3, \"data\": {\"items\": ["
+        "  {\"id\": 1, \"name\": \"caf\\u00e9\", \"price\": 2.5, \"active\": true, \"tags\": [\"a\", {\"b\": null}]},"
+        "  {\"name\": \"second\", \"id\": 2, \"owner\": {\"login\": \"bob\"}, \"active\": false},"
+        "  {\"id\": 3, \"price\": -1e2, \"extra\": [[1, 2], {\"id\": 99}]}"
+        "]}}";
+
+    const char* kXml =
+        "<?xml version=\"1.0\"?>\n"
+        "<feed xmlns:a=\"urn:a\">"
+        "  <entry id=\"1\"><title>First &amp; best</title><a:author><name>Ann</name></a:author><link href=\"http://x/1\"/></entry>"
+        "  <entry id=\"2\"><title><![CDATA[<second>]]></title><!-- comment --><count>7</count></entry>"
+        "  <other><entry id=\"3\"><title>nested</title></entry></other>"
+        "</feed>";
+}
+
+BOOST_AUTO_TEST_SUITE(ProjectionTest)
+
+BOOST_AUTO_TEST_CASE(jsonRecordsAreProjectedWhateverThePieces) {
+    std::vector<ParamMap> columns;
+    columns.push_back(column("id", "/id", "integer"));
+    columns.push_back(column("name", "$.name"));
+    columns.push_back(column("price", "$.price", "number"));
+    columns.push_back(column("active", "/active", "boolean"));
+    columns.push_back(column("login", "$.owner.login"));
+    columns.push_back(column("tags", "$['tags']"));
+
+    std::size_t pieces[] = { 1, 7, 4096 };
+    for (std::size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        std::string error;
+        boost::shared_ptr<Projection> projection = Projection::create("json", "$.data.items[*]", columns, error);
+        BOOST_REQUIRE_MESSAGE(projection, error);
+        BOOST_REQUIRE(writeInPieces(*projection, kJson, pieces[p]));
+        BOOST_REQUIRE(projection->finish());
+
+        EXTqlist& list = *projection->list();
+        BOOST_REQUIRE_EQUAL(list.rowCnt(), 3);
+        BOOST_REQUIRE_EQUAL(list.colCnt(), 6);
+        BOOST_CHECK_EQUAL(cellInt(list, 1, 1), 1);
+        BOOST_CHECK_EQUAL(cellString(list, 1, 2), "caf\xC3\xA9");
+        BOOST_CHECK_EQUAL(cellNumber(list, 1, 3), 2.5);
+        BOOST_CHECK(cellBool(list, 1, 4));
+        BOOST_CHECK_EQUAL(cellString(list, 1, 6), "[\"a\",{\"b\":null}]");
+        BOOST_CHECK_EQUAL(cellInt(list, 2, 1), 2);
+        BOOST_CHECK_EQUAL(cellString(list, 2, 2), "second");
+        BOOST_CHECK(!cellBool(list, 2, 4));
+        BOOST_CHECK_EQUAL(cellString(list, 2, 5), "bob");
+        BOOST_CHECK_EQUAL(cellInt(list, 3, 1), 3);  // Not the id of the nested object
+        BOOST_CHECK_EQUAL(cellNumber(list, 3, 3), -100.0);
+        BOOST_CHECK_EQUAL(cellString(list, 3, 2), "");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jsonSingleObjectRecord) {
+    std::vector<ParamMap> columns;
+    columns.push_back(column("total", "$.total", "integer"));
+    std::string error;
+    boost::shared_ptr<Projection> projection = Projection::create("json", "", columns, error);
+    BOOST_REQUIRE_MESSAGE(projection, error);
+    BOOST_REQUIRE(writeInPieces(*projection, kJson, 5));
+    BOOST_REQUIRE(projection->finish());
+    BOOST_REQUIRE_EQUAL(projection->list()->rowCnt(), 1);
+    BOOST_CHECK_EQUAL(cellInt(*projection->list(), 1, 1), 3);
+}
+
+BOOST_AUTO_TEST_CASE(xmlRecordsAreProjectedWhateverThePieces) {
+    std::vector<ParamMap> columns;
+    columns.push_back(column("id", "@id", "integer"));
+    columns.push_back(column("title", "title"));
+    columns.push_back(column("author", "author/name"));
+    columns.push_back(column("href", "link/@href"));
+    columns.push_back(column("count", "count", "number"));
+
+    std::size_t pieces[] = { 1, 13, 4096 };
+    for (std::size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        std::string error;
+        boost::shared_ptr<Projection> projection = Projection::create("xml", "//entry", columns, error);
+        BOOST_REQUIRE_MESSAGE(projection, error);
+        BOOST_REQUIRE(writeInPieces(*projection, kXml, pieces[p]));
+        BOOST_REQUIRE(projection->finish());
+
+        EXTqlist& list = *projection->list();
+        BOOST_REQUIRE_EQUAL(list.rowCnt(), 3);
+        BOOST_CHECK_EQUAL(cellInt(list, 1, 1), 1);
+        BOOST_CHECK_EQUAL(cellString(list, 1, 2), "First & best");
+        BOOST_CHECK_EQUAL(cellString(list, 1, 3), "Ann");
+        BOOST_CHECK_EQUAL(cellString(list, 1, 4), "http://x/1");
+        BOOST_CHECK_EQUAL(cellString(list, 2, 2), "<second>");
+        BOOST_CHECK_EQUAL(cellNumber(list, 2, 5), 7.0);
+        BOOST_CHECK_EQUAL(cellString(list, 3, 2), "nested");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(xmlAbsoluteRecordsPath) {
+    std::vector<ParamMap> columns;
+    columns.push_back(column("id", "@id"));
+    std::string error;
+    boost::shared_ptr<Projection> projection = Projection::create("xml", "/feed/entry", columns, error);
+    BOOST_REQUIRE_MESSAGE(projection, error);
+    BOOST_REQUIRE(writeInPieces(*projection, kXml, 4096));
+    BOOST_REQUIRE(projection->finish());
+    BOOST_CHECK_EQUAL(projection->list()->rowCnt(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(invalidProjectionsAreRejected) {
+    std::vector<ParamMap> columns;
+    std::string error;
+    BOOST_CHECK(!Projection::create("json", "$.items[*]", columns, error));
+    BOOST_CHECK(!error.empty());
+
+    columns.push_back(column("id", "id", "date"));
+    BOOST_CHECK(!Projection::create("json", "$.items[*]", columns, error));
+
+    columns.clear();
+    columns.push_back(column("id", "id"));
+    BOOST_CHECK(!Projection::create("json", "$.items[*]", columns, error));  // Not a JSON path
+    BOOST_CHECK(!Projection::create("xml", "entry", columns, error));      // Not an XML path
+
+    columns.clear();
+    columns.push_back(column("id", "$.id"));
+    BOOST_CHECK(!Projection::create("csv", "", columns, error));
+    BOOST_CHECK(!Projection::create("json", "$.items[", columns, error));
+    BOOST_CHECK(!Projection::create("json", "$..id", columns, error));
+}
+
+BOOST_AUTO_TEST_CASE(malformedBodiesFail) {
+    std::vector<ParamMap> columns;
+    columns.push_back(column("id", "$.id", "integer"));
+    std::string error;
+
+    boost::shared_ptr<Projection> json = Projection::create("json", "$.items[*]", columns, error);
+    BOOST_REQUIRE(json);
+    std::string invalid = "{\"items\": [{\"id\": 1}, {\"id\": }]}";
+    bool ok = json->write(invalid.data(), invalid.size()) && json->finish();
+    BOOST_CHECK(!ok);
+    BOOST_CHECK(!json->error().empty());
+    BOOST_CHECK_EQUAL(json->rows(), 2);  // Rows projected before the failure are kept
+
+    boost::shared_ptr<Projection> xml = Projection::create("xml", "//entry", columns, error);
+    BOOST_REQUIRE(xml);
+    std::string truncated = "<feed><entry><id>1</id></entry><entry><id>2";
+    ok = xml->write(truncated.data(), truncated.size()) && xml->finish();
+    BOOST_CHECK(!ok);
+    BOOST_CHECK(!xml->error().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,177 @@
+//
+//  RecordStreamTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Records are written on the test's thread, which the list pool treats as the main thread, so
+//  batches are allocated without waiting for the timer.
+//
+
+#include "RecordStream.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    std::vector<boost::shared_ptr<EXTqlist> > takeAll(RecordStream& stream) {
+        std::vector<boost::shared_ptr<EXTqlist> > batches;
+        while (boost::shared_ptr<EXTqlist> batch = stream.takeBatch()) {
+            batches.push_back(batch);
+        }
+        return batches;
+    }
+
+    // Takes batches as a main thread would until rows have arrived, counting them into taken
+    void takeRows(RecordStream* stream, qlong rows, qlong* taken) {
+        while (*taken < rows) {
+            if (boost::shared_ptr<EXTqlist> batch = stream->takeBatch()) {
+                *taken += batch->rowCnt();
+            } else {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+            }
+        }
+    }
+
+    void cancelLater(RecordStream* stream) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        stream->cancel();
+    }
+
+    const char* kNdjson =
+        "{\"id\": 1, \"name\": \"one\", \"price\": 1.5, \"ok\": true}\n"
+        "\n"
+        "{\"name\": \"two\", \"id\": 2, \"extra\": 0, \"ok\": false, \"price\": null}\r\n"
+        "{\"id\": 3, \"name\": {\"nested\": [1]}, \"price\": 3}\n"
+        "{\"id\": 4, \"name\": \"four\\u00e9\", \"price\": -4e1, \"ok\": true}";
+}
+
+BOOST_AUTO_TEST_SUITE(RecordStreamTest)
+
+BOOST_AUTO_TEST_CASE(formatsAreParsed) {
+    RecordStream::Format format;
+    BOOST_CHECK(RecordStream::parseFormat("NDJSON", format) && format == RecordStream::kNdjson);
+    BOOST_CHECK(RecordStream::parseFormat("csv", format) && format == RecordStream::kCsv);
+    BOOST_CHECK(!RecordStream::parseFormat("json", format));
+}
+
+BOOST_AUTO_TEST_CASE(ndjsonBatchesWhateverThePieces) {
+    std::size_t pieces[] = { 1, 9, 4096 };
+    for (std::size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        RecordStream stream(RecordStream::kNdjson, 3, 10);
+        BOOST_REQUIRE(writeInPieces(stream, kNdjson, pieces[p]));
+        BOOST_REQUIRE_MESSAGE(stream.finish(), stream.error());
+        BOOST_CHECK_EQUAL(stream.rows(), 4);
+
+        std::vector<boost::shared_ptr<EXTqlist> > batches = takeAll(stream);
+        BOOST_REQUIRE_EQUAL(batches.size(), 2u);
+        EXTqlist& first = *batches[0];
+        EXTqlist& second = *batches[1];
+        BOOST_REQUIRE_EQUAL(first.rowCnt(), 3);
+        BOOST_REQUIRE_EQUAL(second.rowCnt(), 1);
+
+        // Columns and their types come from the first record
+        BOOST_REQUIRE_EQUAL(first.colCnt(), 4);
+        BOOST_CHECK_EQUAL(columnName(first, 2), "name");
+        BOOST_CHECK_EQUAL(cellInt(first, 1, 1), 1);
+        BOOST_CHECK_EQUAL(cellNumber(first, 1, 3), 1.5);
+        BOOST_CHECK(cellBool(first, 1, 4));
+        BOOST_CHECK_EQUAL(cellInt(first, 2, 1), 2);  // Keys in another order
+        BOOST_CHECK_EQUAL(cellString(first, 2, 2), "two");
+        BOOST_CHECK(!cellBool(first, 2, 4));
+        BOOST_CHECK_EQUAL(cellString(first, 3, 2), "{\"nested\":[1]}");
+        BOOST_CHECK_EQUAL(cellNumber(first, 3, 3), 3.0);
+        BOOST_CHECK_EQUAL(cellString(second, 1, 2), "four\xC3\xA9");
+        BOOST_CHECK_EQUAL(cellNumber(second, 1, 3), -40.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(csvBatchesWhateverThePieces) {
+    std::string csv =
+        "id,name,note\r\n"
+        "1,plain,\"with, comma\"\r\n"
+        "2,\"say \"\"hi\"\"\",\"two\r\nlines\"\r\n"
+        "\r\n"
+        "3,short\r\n"
+        "4,last,no newline";
+
+    std::size_t pieces[] = { 1, 5, 4096 };
+    for (std::size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        RecordStream stream(RecordStream::kCsv, 2, 10);
+        BOOST_REQUIRE(writeInPieces(stream, csv, pieces[p]));
+        BOOST_REQUIRE_MESSAGE(stream.finish(), stream.error());
+        BOOST_CHECK_EQUAL(stream.rows(), 4);
+
+        std::vector<boost::shared_ptr<EXTqlist> > batches = takeAll(stream);
+        BOOST_REQUIRE_EQUAL(batches.size(), 2u);
+        EXTqlist& first = *batches[0];
+        EXTqlist& second = *batches[1];
+        BOOST_REQUIRE_EQUAL(first.colCnt(), 3);
+        BOOST_CHECK_EQUAL(columnName(first, 3), "note");
+        BOOST_CHECK_EQUAL(cellString(first, 1, 3), "with, comma");
+        BOOST_CHECK_EQUAL(cellString(first, 2, 2), "say \"hi\"");
+        BOOST_CHECK_EQUAL(cellString(first, 2, 3), "two\r\nlines");
+        BOOST_CHECK_EQUAL(cellString(second, 1, 2), "short");
+        BOOST_CHECK_EQUAL(cellString(second, 1, 3), "");
+        BOOST_CHECK_EQUAL(cellString(second, 2, 3), "no newline");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(takeBatchIsEmptyUntilABatchIsFull) {
+    RecordStream stream(RecordStream::kNdjson, 2, 10);
+    BOOST_REQUIRE(stream.write("{\"a\": 1}\n", 9));
+    BOOST_CHECK(!stream.takeBatch());
+    BOOST_REQUIRE(stream.write("{\"a\": 2}\n", 9));
+    boost::shared_ptr<EXTqlist> batch = stream.takeBatch();
+    BOOST_REQUIRE(batch);
+    BOOST_CHECK_EQUAL(batch->rowCnt(), 2);
+    BOOST_CHECK(!stream.takeBatch());
+}
+
+// With one batch queued at a time the writer waits for each to be taken
+BOOST_AUTO_TEST_CASE(writerWaitsForTheMainThread) {
+    RecordStream stream(RecordStream::kNdjson, 1, 1);
+    qlong taken = 0;
+    boost::thread mainThread(boost::bind(takeRows, &stream, 20, &taken));
+
+    std::string body;
+    for (int i = 0; i < 20; ++i) {
+        body += "{\"a\": 1}\n";
+    }
+    BOOST_CHECK(stream.write(body.data(), body.size()));
+    BOOST_CHECK(stream.finish());
+    BOOST_REQUIRE(mainThread.timed_join(boost::posix_time::seconds(10)));
+    BOOST_CHECK_EQUAL(taken, 20);
+}
+
+BOOST_AUTO_TEST_CASE(cancelReleasesAWaitingWriter) {
+    RecordStream stream(RecordStream::kCsv, 1, 1);
+    boost::thread canceller(boost::bind(cancelLater, &stream));
+
+    std::string body = "a\n1\n2\n3\n";  // The second row can't be queued until the first is taken
+    BOOST_CHECK(!stream.write(body.data(), body.size()));
+    canceller.join();
+    BOOST_CHECK(!stream.takeBatch());
+    BOOST_CHECK(!stream.write("4\n", 2));
+}
+
+BOOST_AUTO_TEST_CASE(invalidRecordsFail) {
+    RecordStream ndjson(RecordStream::kNdjson, 10, 10);
+    BOOST_CHECK(!ndjson.write("{\"a\": 1}\n{\"a\": \n", 16));
+    BOOST_CHECK(!ndjson.error().empty());
+    BOOST_CHECK(!ndjson.write("{\"a\": 2}\n", 9));  // Nothing more is accepted
+
+    RecordStream array(RecordStream::kNdjson, 10, 10);
+    BOOST_CHECK(!array.write("[1, 2]\n", 7));
+
+    RecordStream csv(RecordStream::kCsv, 10, 10);
+    BOOST_CHECK(csv.write("a,b\n1,\"open\n", 12));
+    BOOST_CHECK(!csv.finish());
+    BOOST_CHECK_EQUAL(csv.error(), "Unterminated quoted CSV field");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,207 @@
+//
+//  RequestCoalescerTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "RequestCoalescer.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    HttpStreamClient::Headers headers(const std::string& name, const std::string& value) {
+        return HttpStreamClient::Headers(1, std::make_pair(name, value));
+    }
+
+    void waitOn(RequestCoalescer::FlightPtr flight, const bool* interrupted, RequestCoalescer::Flight::Outcome* outcome,
+                RequestCoalescer::Result* result) {
+        *outcome = flight->wait(*interrupted, *result);
+    }
+
+    // Holds every response until it's opened, so that requests can be made to overlap
+    class Gate {
+    public:
+        Gate() : _open(false) {}
+
+        std::string respond(const TestServer::Request& request) {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            while (!_open) {
+                _opened.wait(lock);
+            }
+            return TestServer::response(200, "shared body for " + request.target);
+        }
+
+        void open() {
+            boost::mutex::scoped_lock lock(_mutex);
+            _open = true;
+            _opened.notify_all();
+        }
+
+    private:
+        boost::mutex _mutex;
+        boost::condition_variable _opened;
+        bool _open;
+    };
+
+    void fetch(OmnisTools::ParamMap params, DelegateResult* result) {
+        *result = runDelegate(params);
+    }
+
+    // Waits up to five seconds for the coalescer to have answered count more requests from another's flight
+    bool waitForJoins(boost::uint64_t before, boost::uint64_t count) {
+        for (int i = 0; i < 250; ++i) {
+            if (RequestCoalescer::instance().coalesced() >= before + count)
+                return true;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        }
+        return false;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(RequestCoalescerTest)
+
+BOOST_AUTO_TEST_CASE(keysIncludeTheMethodUrlAndHeaders) {
+    HttpStreamClient::Headers none;
+    BOOST_CHECK_EQUAL(RequestCoalescer::key("get", "http://test/a", none), "GET http://test/a");
+    BOOST_CHECK_EQUAL(RequestCoalescer::key("GET", "http://test/a", headers("Accept", "text/plain")),
+                      "GET http://test/a\naccept: text/plain");
+    BOOST_CHECK(RequestCoalescer::key("GET", "http://test/a", headers("Accept", "text/plain")) ==
+                RequestCoalescer::key("GET", "http://test/a", headers("ACCEPT", "text/plain")));
+    BOOST_CHECK(RequestCoalescer::key("GET", "http://test/a", headers("Accept", "text/plain")) !=
+                RequestCoalescer::key("GET", "http://test/a", headers("Accept", "text/html")));
+    BOOST_CHECK(RequestCoalescer::key("GET", "http://test/a", none) != RequestCoalescer::key("GET", "http://test/b", none));
+}
+
+BOOST_AUTO_TEST_CASE(joinersShareTheLeadersResult) {
+    RequestCoalescer& coalescer = RequestCoalescer::instance();
+    boost::uint64_t before = coalescer.coalesced();
+
+    bool leader = false;
+    RequestCoalescer::FlightPtr flight = coalescer.join("GET http://test/shared", leader);
+    BOOST_CHECK(leader);
+    bool joined = true;
+    BOOST_CHECK(coalescer.join("GET http://test/shared", joined) == flight);
+    BOOST_CHECK(!joined);
+    BOOST_CHECK(coalescer.coalesced() == before + 1);
+
+    bool interrupted = false;
+    RequestCoalescer::Flight::Outcome outcome = RequestCoalescer::Flight::kInterrupted;
+    RequestCoalescer::Result shared;
+    boost::thread waiter(boost::bind(waitOn, flight, &interrupted, &outcome, &shared));
+    BOOST_CHECK(!waiter.timed_join(boost::posix_time::milliseconds(100)));  // Waiting for the leader
+
+    RequestCoalescer::Result result;
+    result.status = 200;
+    result.headers = headers("Content-Type", "text/plain");
+    result.body = boost::make_shared<std::string>("the body");
+    coalescer.finish("GET http://test/shared", flight, &result);
+
+    BOOST_REQUIRE(waiter.timed_join(boost::posix_time::seconds(5)));
+    BOOST_CHECK_EQUAL(outcome, RequestCoalescer::Flight::kShared);
+    BOOST_CHECK_EQUAL(shared.status, 200);
+    BOOST_CHECK_EQUAL(shared.headers.size(), 1u);
+    BOOST_CHECK(shared.body == result.body);  // The same body, not a copy
+
+    // The flight has ended, so the next request leads a new one
+    bool next = false;
+    RequestCoalescer::FlightPtr another = coalescer.join("GET http://test/shared", next);
+    BOOST_CHECK(next);
+    BOOST_CHECK(another != flight);
+    coalescer.finish("GET http://test/shared", another, 0);
+}
+
+BOOST_AUTO_TEST_CASE(joinersAreToldIfTheLeaderFails) {
+    RequestCoalescer& coalescer = RequestCoalescer::instance();
+    bool leader = false;
+    RequestCoalescer::FlightPtr flight = coalescer.join("GET http://test/failed", leader);
+    BOOST_REQUIRE(leader);
+    bool joined = true;
+    coalescer.join("GET http://test/failed", joined);
+    coalescer.finish("GET http://test/failed", flight, 0);
+
+    // Including those that only wait once it has finished
+    bool interrupted = false;
+    RequestCoalescer::Result shared;
+    BOOST_CHECK_EQUAL(flight->wait(interrupted, shared), RequestCoalescer::Flight::kFailed);
+    BOOST_CHECK(!shared.body);
+}
+
+BOOST_AUTO_TEST_CASE(waitingRequestsCanBeInterrupted) {
+    RequestCoalescer& coalescer = RequestCoalescer::instance();
+    bool leader = false;
+    RequestCoalescer::FlightPtr flight = coalescer.join("GET http://test/interrupted", leader);
+    BOOST_REQUIRE(leader);
+
+    bool interrupted = false;
+    RequestCoalescer::Flight::Outcome outcome = RequestCoalescer::Flight::kShared;
+    RequestCoalescer::Result shared;
+    boost::thread waiter(boost::bind(waitOn, flight, &interrupted, &outcome, &shared));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    flight->interrupt(interrupted);
+
+    BOOST_REQUIRE(waiter.timed_join(boost::posix_time::seconds(5)));
+    BOOST_CHECK_EQUAL(outcome, RequestCoalescer::Flight::kInterrupted);
+    coalescer.finish("GET http://test/interrupted", flight, 0);
+}
+
+BOOST_AUTO_TEST_CASE(delegateMakesOneRequestForIdenticalGets) {
+    Gate gate;
+    TestServer server(boost::bind(&Gate::respond, &gate, _1));
+    boost::uint64_t before = RequestCoalescer::instance().coalesced();
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/coalesced");
+    params["timeout"] = 10;
+    const int requests = 4;
+    DelegateResult results[requests];
+    boost::thread_group group;
+    for (int i = 0; i < requests; ++i) {
+        group.create_thread(boost::bind(fetch, params, &results[i]));
+    }
+
+    // Released once all but the leader are waiting on its flight
+    BOOST_CHECK(waitForJoins(before, requests - 1));
+    gate.open();
+    group.join_all();
+
+    for (int i = 0; i < requests; ++i) {
+        BOOST_CHECK(results[i].ran);
+        BOOST_CHECK_EQUAL(results[i].status, 200);
+        BOOST_CHECK_EQUAL(results[i].body, "shared body for /coalesced");
+    }
+    BOOST_CHECK_EQUAL(server.requests().size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(delegateRequestsCanOptOut) {
+    Gate gate;
+    gate.open();
+    TestServer server(boost::bind(&Gate::respond, &gate, _1));
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/separate");
+    params["coalesce"] = false;
+    const int requests = 3;
+    DelegateResult results[requests];
+    boost::thread_group group;
+    for (int i = 0; i < requests; ++i) {
+        group.create_thread(boost::bind(fetch, params, &results[i]));
+    }
+    group.join_all();
+
+    for (int i = 0; i < requests; ++i) {
+        BOOST_CHECK_EQUAL(results[i].body, "shared body for /separate");
+    }
+    BOOST_CHECK_EQUAL(server.requests().size(), 3u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,155 @@
+//
+//  RequestTimingsTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "RequestTimings.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    std::string hello(const TestServer::Request&) {
+        return TestServer::response(200, "hello");
+    }
+
+    // Makes the request as an HTTPWorker does and returns the timings it kept, if any
+    boost::shared_ptr<RequestTimings> timingsOf(OmnisTools::ParamMap params) {
+        CppNetlibDelegate delegate;
+        delegate.init(params);
+        delegate.queued();
+        OmnisTools::ParamMap result = delegate.run(params);
+        delegate.delivered();
+
+        OmnisTools::ParamMap::iterator it = result.find("Timings");
+        if (it == result.end())
+            return boost::shared_ptr<RequestTimings>();
+        return boost::any_cast<boost::shared_ptr<RequestTimings> >(it->second);
+    }
+
+    // Whether every marked phase is at or after the one marked before it
+    bool inOrder(const RequestTimings& timings) {
+        boost::uint64_t last = 0;
+        for (int i = 0; i < RequestTimings::kPhaseCount; ++i) {
+            RequestTimings::Phase phase = static_cast<RequestTimings::Phase>(i);
+            if (timings.marked(phase)) {
+                if (timings.at(phase) < last)
+                    return false;
+                last = timings.at(phase);
+            }
+        }
+        return true;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(RequestTimingsTest)
+
+BOOST_AUTO_TEST_CASE(clockMovesForwardInMicroseconds) {
+    boost::uint64_t before = RequestTimings::now();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    boost::uint64_t after = RequestTimings::now();
+    BOOST_CHECK(after - before >= 20000);
+    BOOST_CHECK(after - before < 5000000);
+}
+
+BOOST_AUTO_TEST_CASE(phasesHaveColumnNames) {
+    BOOST_CHECK_EQUAL(RequestTimings::name(RequestTimings::kQueued), "queued");
+    BOOST_CHECK_EQUAL(RequestTimings::name(RequestTimings::kDnsDone), "dns");
+    BOOST_CHECK_EQUAL(RequestTimings::name(RequestTimings::kFirstByte), "first_byte");
+    BOOST_CHECK_EQUAL(RequestTimings::name(RequestTimings::kDelivered), "delivered");
+}
+
+BOOST_AUTO_TEST_CASE(phasesAreTimedFromTheFirstMarked) {
+    RequestTimings timings;
+    BOOST_CHECK(timings.latest() == RequestTimings::kPhaseCount);
+    BOOST_CHECK_EQUAL(timings.elapsed(RequestTimings::kStarted), 0.0);
+
+    timings.mark(RequestTimings::kStarted);  // kQueued is never marked, so this is the origin
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    timings.mark(RequestTimings::kFirstByte);
+
+    BOOST_CHECK(!timings.marked(RequestTimings::kQueued));
+    BOOST_CHECK_EQUAL(timings.elapsed(RequestTimings::kStarted), 0.0);
+    BOOST_CHECK(timings.elapsed(RequestTimings::kFirstByte) >= 20.0);
+    BOOST_CHECK(timings.latest() == RequestTimings::kFirstByte);
+}
+
+BOOST_AUTO_TEST_CASE(markFirstKeepsTheEarliestMark) {
+    RequestTimings timings;
+    timings.markFirst(RequestTimings::kLastByte);
+    boost::uint64_t first = timings.at(RequestTimings::kLastByte);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+    timings.markFirst(RequestTimings::kLastByte);
+    BOOST_CHECK(timings.at(RequestTimings::kLastByte) == first);
+
+    timings.mark(RequestTimings::kLastByte);  // Whereas mark moves it
+    BOOST_CHECK(timings.at(RequestTimings::kLastByte) > first);
+}
+
+BOOST_AUTO_TEST_CASE(bytesAreCounted) {
+    RequestTimings timings;
+    timings.addBytesOut(10);
+    timings.addBytesOut(5);
+    timings.addBytesIn(100);
+    BOOST_CHECK(timings.bytesOut() == 15);
+    BOOST_CHECK(timings.bytesIn() == 100);
+    BOOST_CHECK(!timings.tcpInfo().sampled);
+}
+
+BOOST_AUTO_TEST_CASE(delegateTimesStreamedRequests) {
+    TestServer server(hello);
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/streamed");
+    params["method"] = std::string("POST");
+    params["body"] = std::string("request body");
+    params["compress_body"] = true;  // Sent with the HttpStreamClient, which sees the connection
+
+    boost::shared_ptr<RequestTimings> timings = timingsOf(params);
+    BOOST_REQUIRE(timings);
+    BOOST_CHECK(timings->marked(RequestTimings::kQueued));
+    BOOST_CHECK(timings->marked(RequestTimings::kStarted));
+    BOOST_CHECK(timings->marked(RequestTimings::kDnsDone));
+    BOOST_CHECK(timings->marked(RequestTimings::kConnected));
+    BOOST_CHECK(!timings->marked(RequestTimings::kTlsDone));  // Plain HTTP
+    BOOST_CHECK(timings->marked(RequestTimings::kRequestSent));
+    BOOST_CHECK(timings->marked(RequestTimings::kFirstByte));
+    BOOST_CHECK(timings->marked(RequestTimings::kLastByte));
+    BOOST_CHECK(!timings->marked(RequestTimings::kDelivered));  // Marked as the worker hands the result over
+    BOOST_CHECK(inOrder(*timings));
+    BOOST_CHECK(timings->bytesIn() == 5);
+}
+
+BOOST_AUTO_TEST_CASE(delegateTimesCppNetlibRequests) {
+    TestServer server(hello);
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/plain");
+    params["coalesce"] = false;
+
+    boost::shared_ptr<RequestTimings> timings = timingsOf(params);
+    BOOST_REQUIRE(timings);
+    BOOST_CHECK(timings->marked(RequestTimings::kQueued));
+    BOOST_CHECK(timings->marked(RequestTimings::kStarted));
+    BOOST_CHECK(!timings->marked(RequestTimings::kConnected));  // cpp-netlib doesn't report on its connection
+    BOOST_CHECK(timings->marked(RequestTimings::kFirstByte));
+    BOOST_CHECK(timings->marked(RequestTimings::kLastByte));
+    BOOST_CHECK(inOrder(*timings));
+}
+
+BOOST_AUTO_TEST_CASE(delegateLeavesTimingsOutIfAsked) {
+    TestServer server(hello);
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/untimed");
+    params["timings"] = false;
+    BOOST_CHECK(!timingsOf(params));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,212 @@
+//
+//  ResponseCacheTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ResponseCache.h"
+#include "DelegateRunner.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    const std::time_t kNow = 1400000000;  // Tue, 13 May 2014 16:53:20 GMT
+
+    HttpStreamClient::Headers headers(const std::string& name, const std::string& value) {
+        return HttpStreamClient::Headers(1, std::make_pair(name, value));
+    }
+
+    HttpStreamClient::Headers& add(HttpStreamClient::Headers& list, const std::string& name, const std::string& value) {
+        list.push_back(std::make_pair(name, value));
+        return list;
+    }
+
+    ResponseCache::EntryPtr entryFor(const HttpStreamClient::Headers& response,
+                                     const HttpStreamClient::Headers& request = HttpStreamClient::Headers(),
+                                     int status = 200) {
+        return ResponseCache::makeEntry(status, response, boost::make_shared<std::string>("body"), request, kNow);
+    }
+
+    // Answers every request with the same body and Cache-Control
+    std::string cacheable(const std::string* cacheControl, const TestServer::Request&) {
+        return TestServer::response(200, "shared body", "Cache-Control: " + *cacheControl + "\r\n");
+    }
+
+    // Makes the same request twice with the cache, and returns the number that reached the server
+    std::size_t fetchTwice(const std::string& path, const std::string& cacheControl, const std::string& authorization) {
+        TestServer server(boost::bind(cacheable, &cacheControl, _1));
+        for (int i = 0; i < 2; ++i) {
+            OmnisTools::ParamMap params;
+            params["url"] = server.url(path);
+            params["cache"] = true;
+            params["coalesce"] = false;
+            if (!authorization.empty())
+                params["headers"] = headerParam("Authorization", authorization);
+            DelegateResult result = runDelegate(params);
+            BOOST_CHECK_EQUAL(result.status, 200);
+            BOOST_CHECK_EQUAL(result.body, "shared body");
+        }
+        return server.requests().size();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(ResponseCacheTest)
+
+BOOST_AUTO_TEST_CASE(parsesTheThreeHttpDateFormats) {
+    std::time_t time = 0;
+    BOOST_CHECK(ResponseCache::parseHttpDate("Tue, 13 May 2014 16:53:20 GMT", time));
+    BOOST_CHECK(time == kNow);
+    BOOST_CHECK(ResponseCache::parseHttpDate("Tuesday, 13-May-14 16:53:20 GMT", time));
+    BOOST_CHECK(time == kNow);
+    BOOST_CHECK(ResponseCache::parseHttpDate("Tue May 13 16:53:20 2014", time));
+    BOOST_CHECK(time == kNow);
+    BOOST_CHECK(!ResponseCache::parseHttpDate("yesterday", time));
+}
+
+BOOST_AUTO_TEST_CASE(onlyPlainGetsAreCacheable) {
+    HttpStreamClient::Headers none;
+    BOOST_CHECK(ResponseCache::cacheable("GET", none));
+    BOOST_CHECK(!ResponseCache::cacheable("POST", none));
+    BOOST_CHECK(!ResponseCache::cacheable("GET", headers("Range", "bytes=0-9")));
+    BOOST_CHECK(!ResponseCache::cacheable("GET", headers("If-None-Match", "\"v1\"")));
+    BOOST_CHECK(!ResponseCache::cacheable("GET", headers("Cache-Control", "no-store")));
+}
+
+BOOST_AUTO_TEST_CASE(freshnessComesFromMaxAgeExpiresOrLastModified) {
+    ResponseCache::EntryPtr maxAge = entryFor(headers("Cache-Control", "max-age=60"));
+    BOOST_REQUIRE(maxAge);
+    BOOST_CHECK(maxAge->expires == kNow + 60);
+
+    HttpStreamClient::Headers aged = headers("Cache-Control", "max-age=60");
+    ResponseCache::EntryPtr withAge = entryFor(add(aged, "Age", "20"));
+    BOOST_REQUIRE(withAge);
+    BOOST_CHECK(withAge->expires == kNow + 40);
+
+    HttpStreamClient::Headers dated = headers("Date", "Tue, 13 May 2014 16:53:20 GMT");
+    ResponseCache::EntryPtr expires = entryFor(add(dated, "Expires", "Tue, 13 May 2014 16:55:20 GMT"));
+    BOOST_REQUIRE(expires);
+    BOOST_CHECK(expires->expires == kNow + 120);
+
+    // A tenth of the 1000 seconds since it was modified
+    HttpStreamClient::Headers modified = headers("Date", "Tue, 13 May 2014 16:53:20 GMT");
+    ResponseCache::EntryPtr heuristic = entryFor(add(modified, "Last-Modified", "Tue, 13 May 2014 16:36:40 GMT"));
+    BOOST_REQUIRE(heuristic);
+    BOOST_CHECK(heuristic->expires == kNow + 100);
+}
+
+BOOST_AUTO_TEST_CASE(someResponsesArentStored) {
+    BOOST_CHECK(!entryFor(headers("Cache-Control", "no-store, max-age=60")));
+    BOOST_CHECK(!entryFor(headers("Cache-Control", "max-age=60"), HttpStreamClient::Headers(), 500));
+    HttpStreamClient::Headers varyAll = headers("Cache-Control", "max-age=60");
+    BOOST_CHECK(!entryFor(add(varyAll, "Vary", "*")));
+    BOOST_CHECK(!entryFor(HttpStreamClient::Headers()));  // Stale at once, and nothing to revalidate it with
+
+    // Kept to be revalidated every time
+    HttpStreamClient::Headers noCache = headers("Cache-Control", "no-cache");
+    ResponseCache::EntryPtr revalidated = entryFor(add(noCache, "ETag", "\"v1\""));
+    BOOST_REQUIRE(revalidated);
+    BOOST_CHECK(!revalidated->fresh(kNow));
+}
+
+BOOST_AUTO_TEST_CASE(privateResponsesArentStored) {
+    BOOST_CHECK(!entryFor(headers("Cache-Control", "private, max-age=60")));
+    BOOST_CHECK(!entryFor(headers("Cache-Control", "max-age=60, private=\"Set-Cookie\"")));
+    BOOST_CHECK(entryFor(headers("Cache-Control", "public, max-age=60")));
+}
+
+BOOST_AUTO_TEST_CASE(authorisedResponsesAreOnlyStoredIfMarkedShareable) {
+    HttpStreamClient::Headers authorised = headers("Authorization", "Bearer secret");
+
+    BOOST_CHECK(!entryFor(headers("Cache-Control", "max-age=60"), authorised));
+    BOOST_CHECK(entryFor(headers("Cache-Control", "public, max-age=60"), authorised));
+    BOOST_CHECK(entryFor(headers("Cache-Control", "max-age=60, s-maxage=60"), authorised));
+    BOOST_CHECK(entryFor(headers("Cache-Control", "max-age=60, must-revalidate"), authorised));
+
+    // Nor kept when a 304 to an authorised request doesn't allow it
+    HttpStreamClient::Headers response = headers("Cache-Control", "max-age=0, public");
+    ResponseCache::EntryPtr entry = entryFor(add(response, "ETag", "\"v1\""));
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK(!ResponseCache::revalidate(entry, headers("Cache-Control", "max-age=60"), authorised, kNow));
+}
+
+BOOST_AUTO_TEST_CASE(entriesVaryOnTheirRequestHeaders) {
+    HttpStreamClient::Headers response = headers("Cache-Control", "max-age=60");
+    add(response, "Vary", "Accept-Language");
+    ResponseCache::EntryPtr entry = entryFor(response, headers("Accept-Language", "en"));
+    BOOST_REQUIRE(entry);
+
+    ResponseCache& cache = ResponseCache::instance();
+    std::string key = ResponseCache::key("get", "http://test/vary");
+    BOOST_CHECK_EQUAL(key, "GET http://test/vary");
+    cache.store(key, entry);
+    BOOST_CHECK(cache.find(key, headers("Accept-Language", "en"), kNow));
+    BOOST_CHECK(!cache.find(key, headers("Accept-Language", "fr"), kNow));
+    cache.remove(key);
+    BOOST_CHECK(!cache.find(key, headers("Accept-Language", "en"), kNow));
+}
+
+BOOST_AUTO_TEST_CASE(staleEntriesAreRevalidatedAndRefreshedBy304) {
+    HttpStreamClient::Headers response = headers("Cache-Control", "max-age=10");
+    add(response, "ETag", "\"v1\"");
+    ResponseCache& cache = ResponseCache::instance();
+    std::string key = ResponseCache::key("GET", "http://test/revalidate");
+    cache.store(key, entryFor(response));
+
+    ResponseCache::Stats before = cache.stats();
+    ResponseCache::EntryPtr stale = cache.find(key, HttpStreamClient::Headers(), kNow + 20);
+    BOOST_REQUIRE(stale);
+    BOOST_CHECK(!stale->fresh(kNow + 20));
+    BOOST_CHECK(cache.stats().misses == before.misses + 1);
+
+    HttpStreamClient::Headers request;
+    ResponseCache::addValidators(stale, request);
+    BOOST_CHECK_EQUAL(request.size(), 1u);
+    BOOST_CHECK_EQUAL(request[0].second, "\"v1\"");
+
+    ResponseCache::EntryPtr reused = cache.storeResponse(key, stale, 304, headers("Cache-Control", "max-age=100"),
+                                                         boost::shared_ptr<const std::string>(), request, kNow + 20);
+    BOOST_REQUIRE(reused);
+    BOOST_CHECK_EQUAL(*reused->body, "body");
+    BOOST_CHECK(reused->expires == kNow + 120);
+    BOOST_CHECK(cache.stats().revalidations == before.revalidations + 1);
+
+    BOOST_CHECK(cache.find(key, HttpStreamClient::Headers(), kNow + 30));
+    BOOST_CHECK(cache.stats().hits == before.hits + 1);
+    cache.remove(key);
+}
+
+BOOST_AUTO_TEST_CASE(requestsCanOverrideStaleLimits) {
+    HttpStreamClient::Headers response = headers("Cache-Control", "max-age=10, stale-while-revalidate=30");
+    ResponseCache& cache = ResponseCache::instance();
+    std::string key = ResponseCache::key("GET", "http://test/stale");
+    cache.store(key, entryFor(response));
+
+    ResponseCache::EntryPtr stale = cache.find(key, HttpStreamClient::Headers(), kNow + 20);
+    BOOST_REQUIRE(stale);
+    BOOST_CHECK(stale->usableWhileRevalidating(kNow + 20));
+
+    ResponseCache::StaleLimits limits;
+    limits.whileRevalidate = 5;
+    limits.ifError = 60;
+    ResponseCache::EntryPtr limited = cache.find(key, HttpStreamClient::Headers(), kNow + 20, limits);
+    BOOST_REQUIRE(limited);
+    BOOST_CHECK(!limited->usableWhileRevalidating(kNow + 20));
+    BOOST_CHECK(limited->usableOnError(kNow + 20));
+    cache.remove(key);
+}
+
+BOOST_AUTO_TEST_CASE(delegateDoesntShareAuthorisedResponses) {
+    BOOST_CHECK_EQUAL(fetchTwice("/shared", "max-age=60", ""), 1u);
+    BOOST_CHECK_EQUAL(fetchTwice("/private", "private, max-age=60", ""), 2u);
+    BOOST_CHECK_EQUAL(fetchTwice("/authorised", "max-age=60", "Bearer secret"), 2u);
+    BOOST_CHECK_EQUAL(fetchTwice("/public", "public, max-age=60", "Bearer secret"), 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+//
+//  SegmentedDownloadTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "SegmentedDownload.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <cstdio>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    const std::size_t kFileSize = 5 * 1024 * 1024 + 17;  // Big enough to be split into ranges
+
+    std::string fileContent() {
+        std::string content(kFileSize, '\0');
+        for (std::size_t i = 0; i < content.size(); ++i) {
+            content[i] = static_cast<char>((i * 7 + i / 4096) & 0xFF);
+        }
+        return content;
+    }
+
+    // Serves the file at /file, answering ranges if ranges is set, and redirects /moved to it
+    std::string serveFile(const std::string* content, bool ranges, const TestServer::Request& request) {
+        if (request.target == "/moved") {
+            return TestServer::redirect(302, "/file");
+        }
+        if (request.target != "/file") {
+            return TestServer::response(404, "not found");
+        }
+
+        std::string headers = "ETag: \"v1\"\r\n";
+        if (ranges) {
+            headers += "Accept-Ranges: bytes\r\n";
+        }
+        if (request.method == "HEAD") {
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + boost::lexical_cast<std::string>(content->size())
+                   + "\r\nConnection: close\r\n" + headers + "\r\n";
+        }
+
+        std::string range = request.header("Range");
+        if (ranges && boost::starts_with(range, "bytes=")) {
+            std::size_t dash = range.find('-');
+            std::size_t start = boost::lexical_cast<std::size_t>(range.substr(6, dash - 6));
+            std::size_t end = boost::lexical_cast<std::size_t>(range.substr(dash + 1));
+            headers += "Content-Range: bytes " + boost::lexical_cast<std::string>(start) + "-"
+                       + boost::lexical_cast<std::string>(end) + "/" + boost::lexical_cast<std::string>(content->size()) + "\r\n";
+            return TestServer::response(206, content->substr(start, end - start + 1), headers);
+        }
+        return TestServer::response(200, *content, headers);
+    }
+
+    std::size_t requestsFor(const TestServer& server, const std::string& method, const std::string& target) {
+        std::vector<TestServer::Request> requests = server.requests();
+        std::size_t count = 0;
+        for (std::vector<TestServer::Request>::iterator it = requests.begin(); it != requests.end(); ++it) {
+            if (it->method == method && it->target == target)
+                ++count;
+        }
+        return count;
+    }
+
+    struct Directory {
+        TempDir dir;
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(SegmentedDownloadTest, Directory)
+
+BOOST_AUTO_TEST_CASE(rangesAreFetchedFromWhereTheRedirectLeads) {
+    std::string content = fileContent();
+    TestServer server(boost::bind(serveFile, &content, true, _1));
+    std::string path = dir.file("segmented.bin");
+
+    SegmentedDownload download(server.url("/moved"), HttpStreamClient::Headers(), path, 4);
+    BOOST_REQUIRE_MESSAGE(download.run(), download.error());
+    BOOST_CHECK_EQUAL(download.status(), 200);
+    BOOST_CHECK_GE(download.connections(), 2u);
+    BOOST_CHECK(readFile(path) == content);
+    BOOST_CHECK(!fileExists(path + ".part"));
+    BOOST_CHECK(!fileExists(path + ".part.state"));
+
+    BOOST_CHECK_EQUAL(requestsFor(server, "HEAD", "/moved"), 1u);
+    BOOST_CHECK_EQUAL(requestsFor(server, "GET", "/moved"), 0u);
+    BOOST_CHECK_GT(requestsFor(server, "GET", "/file"), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(singleDownloadFollowsTheRedirect) {
+    std::string content = fileContent();
+    TestServer server(boost::bind(serveFile, &content, false, _1));
+    std::string path = dir.file("single.bin");
+
+    SegmentedDownload download(server.url("/moved"), HttpStreamClient::Headers(), path, 4);
+    BOOST_REQUIRE_MESSAGE(download.run(), download.error());
+    BOOST_CHECK_EQUAL(download.status(), 200);
+    BOOST_CHECK_EQUAL(download.bytes(), content.size());
+    BOOST_CHECK(readFile(path) == content);
+}
+
+BOOST_AUTO_TEST_CASE(errorResponsesAreNotWrittenAsTheFile) {
+    std::string content = fileContent();
+    TestServer server(boost::bind(serveFile, &content, true, _1));
+    std::string path = dir.file("missing.bin");
+
+    SegmentedDownload download(server.url("/missing"), HttpStreamClient::Headers(), path, 4);
+    BOOST_CHECK(!download.run());
+    BOOST_CHECK_EQUAL(download.status(), 404);
+    BOOST_CHECK(!download.error().empty());
+    BOOST_CHECK(!fileExists(path));
+    BOOST_CHECK(!fileExists(path + ".part"));
+}
+
+// A redirect that can't be followed is a failure, not the file
+BOOST_AUTO_TEST_CASE(redirectWithoutLocationFails) {
+    TestServer server(boost::bind(TestServer::response, 302, "elsewhere", std::string()));
+    std::string path = dir.file("redirected.bin");
+
+    SegmentedDownload download(server.url("/file"), HttpStreamClient::Headers(), path, 4);
+    BOOST_CHECK(!download.run());
+    BOOST_CHECK_EQUAL(download.status(), 302);
+    BOOST_CHECK(!fileExists(path));
+}
+
+BOOST_AUTO_TEST_CASE(cancelBeforeRunning) {
+    std::string content = fileContent();
+    TestServer server(boost::bind(serveFile, &content, true, _1));
+    std::string path = dir.file("canceled.bin");
+
+    SegmentedDownload download(server.url("/file"), HttpStreamClient::Headers(), path, 4);
+    download.cancel();
+    BOOST_CHECK(!download.run());
+    BOOST_CHECK(server.requests().empty());
+    BOOST_CHECK(!fileExists(path));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
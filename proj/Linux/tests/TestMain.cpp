@@ -0,0 +1,26 @@
+//
+//  TestMain.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  The unit tests, one Boost.Test suite per file in this directory.  The component is loaded into
+//  the headless Omnis host for the whole run, as the tests call into it as Omnis would.
+//
+//    httplib_tests --run_test=OmnisToolsTest
+
+#define BOOST_TEST_MODULE HTTPlib
+#include <boost/test/unit_test.hpp>
+
+#include "OmnisHost.he"
+
+extern "C" qlong NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam, LPARAM lParam, EXTCompInfo* eci);
+
+namespace {
+    struct ComponentLoaded {
+        ComponentLoaded() { OmnisHost::connect(NVObjWndProc); }
+        ~ComponentLoaded() { OmnisHost::disconnect(); }
+    };
+}
+
+BOOST_GLOBAL_FIXTURE(ComponentLoaded);
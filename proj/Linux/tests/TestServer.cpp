@@ -0,0 +1,163 @@
+//
+//  TestServer.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "TestServer.h"
+
+#include <cstdlib>
+#include <istream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+using boost::asio::ip::tcp;
+
+namespace TestSupport {
+    namespace {
+        std::string readLine(tcp::socket& socket, boost::asio::streambuf& buffer) {
+            boost::asio::read_until(socket, buffer, "\r\n");
+            std::istream in(&buffer);
+            std::string line;
+            std::getline(in, line);
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            return line;
+        }
+
+        std::string readBytes(tcp::socket& socket, boost::asio::streambuf& buffer, std::size_t length) {
+            if (buffer.size() < length)
+                boost::asio::read(socket, buffer, boost::asio::transfer_exactly(length - buffer.size()));
+            std::string bytes(boost::asio::buffer_cast<const char*>(buffer.data()), length);
+            buffer.consume(length);
+            return bytes;
+        }
+
+        const char* reason(int status) {
+            switch (status) {
+                case 200: return "OK";
+                case 206: return "Partial Content";
+                case 301: return "Moved Permanently";
+                case 302: return "Found";
+                case 303: return "See Other";
+                case 304: return "Not Modified";
+                case 307: return "Temporary Redirect";
+                case 308: return "Permanent Redirect";
+                case 404: return "Not Found";
+                default: return "Status";
+            }
+        }
+    }
+
+    std::string TestServer::Request::header(const std::string& name) const {
+        for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+            if (boost::iequals(it->first, name))
+                return it->second;
+        }
+        return std::string();
+    }
+
+    TestServer::TestServer(const Handler& handler)
+        : _handler(handler), _acceptor(_ioService, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+          _port(_acceptor.local_endpoint().port()), _stopping(false)
+    {
+        _acceptThread = boost::thread(boost::bind(&TestServer::accept, this));
+    }
+
+    TestServer::~TestServer() {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _stopping = true;
+        }
+
+        // Wake the accept with a connection of its own
+        boost::system::error_code ec;
+        tcp::socket wake(_ioService);
+        wake.connect(_acceptor.local_endpoint(), ec);
+        _acceptThread.join();
+        _connections.join_all();
+    }
+
+    std::string TestServer::url(const std::string& target) const {
+        return "http://127.0.0.1:" + boost::lexical_cast<std::string>(_port) + target;
+    }
+
+    std::vector<TestServer::Request> TestServer::requests() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _requests;
+    }
+
+    std::string TestServer::response(int status, const std::string& body, const std::string& headers) {
+        return "HTTP/1.1 " + boost::lexical_cast<std::string>(status) + " " + reason(status) + "\r\n"
+               + "Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n"
+               + "Connection: close\r\n" + headers + "\r\n" + body;
+    }
+
+    std::string TestServer::redirect(int status, const std::string& location) {
+        return response(status, "Moved to " + location, "Location: " + location + "\r\n");
+    }
+
+    void TestServer::accept() {
+        for (;;) {
+            boost::shared_ptr<tcp::socket> socket(new tcp::socket(_ioService));
+            boost::system::error_code ec;
+            _acceptor.accept(*socket, ec);
+
+            boost::mutex::scoped_lock lock(_mutex);
+            if (_stopping)
+                return;
+            if (!ec)
+                _connections.create_thread(boost::bind(&TestServer::serve, this, socket));
+        }
+    }
+
+    void TestServer::serve(boost::shared_ptr<tcp::socket> socket) {
+        try {
+            boost::asio::streambuf buffer;
+            Request request;
+            std::string line = readLine(*socket, buffer);
+            std::vector<std::string> parts;
+            boost::split(parts, line, boost::is_any_of(" "));
+            if (parts.size() < 3)
+                return;
+            request.method = parts[0];
+            request.target = parts[1];
+
+            while (!(line = readLine(*socket, buffer)).empty()) {
+                std::string::size_type colon = line.find(':');
+                if (colon != std::string::npos)
+                    request.headers.push_back(std::make_pair(boost::trim_copy(line.substr(0, colon)),
+                                                             boost::trim_copy(line.substr(colon + 1))));
+            }
+
+            request.chunked = boost::icontains(request.header("Transfer-Encoding"), "chunked");
+            if (request.chunked) {
+                for (;;) {
+                    std::size_t size = std::strtoul(readLine(*socket, buffer).c_str(), 0, 16);
+                    if (size == 0) {
+                        while (!readLine(*socket, buffer).empty()) {}
+                        break;
+                    }
+                    request.body += readBytes(*socket, buffer, size);
+                    readLine(*socket, buffer);
+                }
+            } else if (!request.header("Content-Length").empty()) {
+                request.body = readBytes(*socket, buffer, boost::lexical_cast<std::size_t>(request.header("Content-Length")));
+            }
+
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                _requests.push_back(request);
+            }
+
+            boost::asio::write(*socket, boost::asio::buffer(_handler(request)));
+            boost::system::error_code ec;
+            socket->shutdown(tcp::socket::shutdown_both, ec);
+        } catch (const std::exception&) {
+            // The client went away
+        }
+    }
+}
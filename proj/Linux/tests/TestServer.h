@@ -0,0 +1,71 @@
+//
+//  TestServer.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  A loopback HTTP/1.1 server for the unit tests.  Each connection is served on its own thread: the
+//  request is read (with a Content-Length or chunked body), passed to the handler, and the handler's
+//  response written back as it is before the connection is closed.
+
+#ifndef TEST_SERVER_H_
+#define TEST_SERVER_H_
+
+#include "HttpStreamClient.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace TestSupport {
+    class TestServer {
+    public:
+        struct Request {
+            std::string method;
+            std::string target;
+            HttpStreamClient::Headers headers;
+            std::string body;
+            bool chunked;
+
+            // Value of the header, or empty if the request doesn't have it
+            std::string header(const std::string& name) const;
+        };
+
+        // Returns the whole response, status line and all
+        typedef boost::function<std::string (const Request&)> Handler;
+
+        explicit TestServer(const Handler& handler);
+        ~TestServer();
+
+        unsigned short port() const { return _port; }
+        std::string url(const std::string& target) const;
+
+        // Requests received so far, in the order they were read
+        std::vector<Request> requests() const;
+
+        // A response that closes the connection.  headers are "Name: value" lines, each ending in CRLF.
+        static std::string response(int status, const std::string& body, const std::string& headers = std::string());
+        static std::string redirect(int status, const std::string& location);
+
+    private:
+        void accept();
+        void serve(boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
+
+        Handler _handler;
+        boost::asio::io_service _ioService;
+        boost::asio::ip::tcp::acceptor _acceptor;
+        unsigned short _port;
+
+        mutable boost::mutex _mutex;
+        std::vector<Request> _requests;
+        bool _stopping;
+
+        boost::thread_group _connections;
+        boost::thread _acceptThread;
+    };
+}
+
+#endif // TEST_SERVER_H_
@@ -0,0 +1,109 @@
+//
+//  TestSupport.h
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+//  Helpers shared by the unit tests
+
+#ifndef TEST_SUPPORT_H_
+#define TEST_SUPPORT_H_
+
+#include "BodySink.h"
+#include "OmnisTools.he"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <ftw.h>
+#include <sys/stat.h>
+
+namespace TestSupport {
+    // Write data to a sink in pieces of at most piece bytes, as a socket might deliver it
+    inline bool writeInPieces(BodySink& sink, const std::string& data, std::size_t piece) {
+        for (std::size_t pos = 0; pos < data.size(); pos += piece) {
+            if (!sink.write(data.data() + pos, std::min(piece, data.size() - pos)))
+                return false;
+        }
+        return true;
+    }
+
+    // Values of the cells of a list
+    inline std::string cellString(EXTqlist& list, qlong row, qshort col) {
+        EXTfldval colVal;
+        list.getColValRef(row, col, colVal, qfalse);
+        return OmnisTools::getStringFromEXTFldVal(colVal);
+    }
+
+    inline int cellInt(EXTqlist& list, qlong row, qshort col) {
+        EXTfldval colVal;
+        list.getColValRef(row, col, colVal, qfalse);
+        return OmnisTools::getIntFromEXTFldVal(colVal);
+    }
+
+    inline double cellNumber(EXTqlist& list, qlong row, qshort col) {
+        EXTfldval colVal;
+        list.getColValRef(row, col, colVal, qfalse);
+        return OmnisTools::getDoubleFromEXTFldVal(colVal);
+    }
+
+    inline bool cellBool(EXTqlist& list, qlong row, qshort col) {
+        EXTfldval colVal;
+        list.getColValRef(row, col, colVal, qfalse);
+        return OmnisTools::getBoolFromEXTFldVal(colVal);
+    }
+
+    inline std::string columnName(EXTqlist& list, qshort col) {
+        str255 name;
+        list.getCol(col, qfalse, name);
+        EXTfldval nameVal;
+        nameVal.setChar(name);
+        return OmnisTools::getStringFromEXTFldVal(nameVal);
+    }
+
+    // A new directory under /tmp, removed with everything in it when this is destroyed
+    class TempDir {
+    public:
+        TempDir() {
+            char name[] = "/tmp/httplib_test.XXXXXX";
+            if (mkdtemp(name))
+                _path = name;
+        }
+
+        ~TempDir() {
+            if (!_path.empty())
+                nftw(_path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+
+        const std::string& path() const { return _path; }
+        std::string file(const std::string& name) const { return _path + "/" + name; }
+
+    private:
+        static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+            return std::remove(path);
+        }
+
+        std::string _path;
+    };
+
+    inline bool fileExists(const std::string& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0;
+    }
+
+    inline std::string readFile(const std::string& path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    inline void writeFile(const std::string& path, const std::string& content) {
+        std::ofstream out(path.c_str(), std::ios::binary);
+        out << content;
+    }
+}
+
+#endif // TEST_SUPPORT_H_
@@ -0,0 +1,207 @@
+//
+//  TracerTest.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Tracer.h"
+#include "DelegateRunner.h"
+#include "JsonListBuilder.h"
+#include "TestServer.h"
+#include "TestSupport.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace TestSupport;
+
+namespace {
+    // Stops tracing when the test ends, however it ends
+    struct Tracing {
+        explicit Tracing(std::size_t capacity = Tracer::kDefaultCapacity) { Tracer::instance().start(capacity); }
+        ~Tracing() { Tracer::stop(); }
+    };
+
+    JsonValue parse(const std::string& json) {
+        JsonListBuilder builder;
+        JsonReader reader(builder);
+        bool parsed = reader.feed(json.data(), json.size()) && reader.finish();
+        BOOST_REQUIRE_MESSAGE(parsed, reader.error());
+        return builder.root();
+    }
+
+    const JsonValue* member(const JsonValue& object, const std::string& key) {
+        for (std::size_t i = 0; i < object.keys.size(); ++i) {
+            if (object.keys[i] == key)
+                return &object.items[i];
+        }
+        return 0;
+    }
+
+    std::string text(const JsonValue& object, const std::string& key) {
+        const JsonValue* value = member(object, key);
+        return value ? value->text : "(missing)";
+    }
+
+    double number(const JsonValue& object, const std::string& key) {
+        const JsonValue* value = member(object, key);
+        return value ? value->number : -1;
+    }
+
+    // The trace's events of one phase ("X" for spans, "M" for thread names)
+    std::vector<JsonValue> events(const JsonValue& trace, const std::string& phase) {
+        std::vector<JsonValue> found;
+        const JsonValue* all = member(trace, "traceEvents");
+        BOOST_REQUIRE(all);
+        for (std::size_t i = 0; i < all->items.size(); ++i) {
+            if (text(all->items[i], "ph") == phase)
+                found.push_back(all->items[i]);
+        }
+        return found;
+    }
+
+    bool hasSpan(const JsonValue& trace, const std::string& name) {
+        std::vector<JsonValue> spans = events(trace, "X");
+        for (std::size_t i = 0; i < spans.size(); ++i) {
+            if (text(spans[i], "name") == name)
+                return true;
+        }
+        return false;
+    }
+
+    void recordElsewhere() {
+        Tracer::instance().record("elsewhere", "test", 100, 200);
+    }
+
+    std::string hello(const TestServer::Request&) {
+        return TestServer::response(200, "hello");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(TracerTest)
+
+BOOST_AUTO_TEST_CASE(nothingIsRecordedWhileStopped) {
+    {
+        Tracing tracing;
+    }
+    BOOST_CHECK(!Tracer::enabled());
+    {
+        TraceSpan span("ignored", "test");
+    }
+
+    JsonValue trace = parse(Tracer::instance().json());
+    BOOST_CHECK(events(trace, "X").empty());
+    const JsonValue* other = member(trace, "otherData");
+    BOOST_REQUIRE(other);
+    BOOST_CHECK_EQUAL(number(*other, "recorded"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(spansAreWrittenAsCompleteEvents) {
+    Tracing tracing;
+    BOOST_CHECK(Tracer::enabled());
+    Tracer::instance().record("connect", "http", 1000, 1250, "host \"quoted\"");
+    Tracer::instance().record("backwards", "http", 2000, 1000);
+
+    JsonValue trace = parse(Tracer::instance().json());
+    std::vector<JsonValue> spans = events(trace, "X");
+    BOOST_REQUIRE_EQUAL(spans.size(), 2u);
+    BOOST_CHECK_EQUAL(text(spans[0], "name"), "connect");
+    BOOST_CHECK_EQUAL(text(spans[0], "cat"), "http");
+    BOOST_CHECK_EQUAL(number(spans[0], "ts"), 1000);
+    BOOST_CHECK_EQUAL(number(spans[0], "dur"), 250);
+    const JsonValue* args = member(spans[0], "args");
+    BOOST_REQUIRE(args);
+    BOOST_CHECK_EQUAL(text(*args, "detail"), "host \"quoted\"");
+    BOOST_CHECK_EQUAL(number(spans[1], "dur"), 0);  // An end before the beginning is taken as the beginning
+    BOOST_CHECK(!member(spans[1], "args"));
+
+    // The thread that started tracing is named as the main thread, and the spans are on its row
+    std::vector<JsonValue> names = events(trace, "M");
+    bool named = false;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        const JsonValue* name = member(names[i], "args");
+        if (name && text(*name, "name") == "Omnis main thread")
+            named = number(names[i], "tid") == number(spans[0], "tid");
+    }
+    BOOST_CHECK(named);
+}
+
+BOOST_AUTO_TEST_CASE(scopedSpansAreRecorded) {
+    Tracing tracing;
+    {
+        TraceSpan span("scoped", "test", "with detail");
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    }
+
+    std::vector<JsonValue> spans = events(parse(Tracer::instance().json()), "X");
+    BOOST_REQUIRE_EQUAL(spans.size(), 1u);
+    BOOST_CHECK_EQUAL(text(spans[0], "name"), "scoped");
+    BOOST_CHECK(number(spans[0], "dur") >= 5000);
+}
+
+BOOST_AUTO_TEST_CASE(theOldestSpansAreOverwritten) {
+    Tracing tracing(3);
+    const char* names[] = { "one", "two", "three", "four", "five" };
+    for (int i = 0; i < 5; ++i) {
+        Tracer::instance().record(names[i], "test", i * 10, i * 10 + 5);
+    }
+
+    JsonValue trace = parse(Tracer::instance().json());
+    const JsonValue* other = member(trace, "otherData");
+    BOOST_REQUIRE(other);
+    BOOST_CHECK_EQUAL(number(*other, "recorded"), 5);
+    BOOST_CHECK_EQUAL(number(*other, "dropped"), 2);
+
+    std::vector<JsonValue> spans = events(trace, "X");
+    BOOST_REQUIRE_EQUAL(spans.size(), 3u);
+    BOOST_CHECK_EQUAL(text(spans[0], "name"), "three");
+    BOOST_CHECK_EQUAL(text(spans[2], "name"), "five");
+}
+
+BOOST_AUTO_TEST_CASE(eachThreadHasItsOwnRow) {
+    Tracing tracing;
+    Tracer::instance().record("here", "test", 0, 10);
+    boost::thread other(recordElsewhere);
+    other.join();
+
+    std::vector<JsonValue> spans = events(parse(Tracer::instance().json()), "X");
+    BOOST_REQUIRE_EQUAL(spans.size(), 2u);
+    BOOST_CHECK(number(spans[0], "tid") != number(spans[1], "tid"));
+}
+
+BOOST_AUTO_TEST_CASE(writesTheTraceToAFile) {
+    Tracing tracing;
+    Tracer::instance().record("written", "test", 0, 10);
+
+    TempDir dir;
+    std::string error;
+    BOOST_REQUIRE(Tracer::instance().write(dir.file("trace.json"), error));
+    BOOST_CHECK(hasSpan(parse(readFile(dir.file("trace.json"))), "written"));
+
+    BOOST_CHECK(!Tracer::instance().write(dir.file("missing/trace.json"), error));
+    BOOST_CHECK_EQUAL(error, "Unable to open trace file " + dir.file("missing/trace.json"));
+}
+
+BOOST_AUTO_TEST_CASE(delegateRecordsThePhasesOfARequest) {
+    TestServer server(hello);
+    Tracing tracing;
+
+    OmnisTools::ParamMap params;
+    params["url"] = server.url("/traced");
+    params["method"] = std::string("POST");
+    params["body"] = std::string("request body");
+    params["compress_body"] = true;  // Sent with the HttpStreamClient, which sees the connection
+    DelegateResult result = runDelegate(params);
+    BOOST_CHECK_EQUAL(result.status, 200);
+
+    JsonValue trace = parse(Tracer::instance().json());
+    BOOST_CHECK(hasSpan(trace, "queue wait"));
+    BOOST_CHECK(hasSpan(trace, "dns"));
+    BOOST_CHECK(hasSpan(trace, "connect"));
+    BOOST_CHECK(hasSpan(trace, "send"));
+    BOOST_CHECK(hasSpan(trace, "receive"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,166 @@
+//
+//  CacheRefresher.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "CacheRefresher.h"
+#include "DecompressSink.h"
+#include "Logging.he"
+
+#include <ctime>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+CacheRefresher& CacheRefresher::instance()
+{
+    static CacheRefresher theInst;
+
+    return theInst;
+}
+
+CacheRefresher::CacheRefresher() : _dropped(0), _stopping(false)
+{
+    RequestCoalescer::instance();  // Refreshes finish their flights, so the coalescer has to outlive this
+    for (int i = 0; i < kThreads; ++i) {
+        _threads.create_thread(boost::bind(&CacheRefresher::work, this));
+    }
+}
+
+CacheRefresher::~CacheRefresher()
+{
+    std::deque<boost::shared_ptr<Refresh> > queued;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopping = true;
+        queued.swap(_queue);
+        for (std::set<HttpStreamClient*>::iterator it = _running.begin(); it != _running.end(); ++it) {
+            (*it)->cancel();
+        }
+    }
+    _queued.notify_all();
+    _threads.join_all();
+
+    for (std::deque<boost::shared_ptr<Refresh> >::iterator it = queued.begin(); it != queued.end(); ++it) {
+        RequestCoalescer::instance().finish((*it)->flightKey, (*it)->flight, 0);
+    }
+}
+
+void CacheRefresher::start(const std::string& url,
+                           const HttpStreamClient::Headers& requestHeaders,
+                           const HttpStreamClient::Headers& cacheRequestHeaders,
+                           const std::string& cacheKey,
+                           const ResponseCache::EntryPtr& cached,
+                           bool decompress,
+                           long timeout)
+{
+    boost::shared_ptr<Refresh> refresh = boost::make_shared<Refresh>();
+    refresh->flightKey = RequestCoalescer::key("GET", url, requestHeaders);
+
+    bool leader = false;
+    refresh->flight = RequestCoalescer::instance().join(refresh->flightKey, leader);
+    if (!leader) {
+        return;  // Already being fetched, and the cache is updated when it arrives
+    }
+
+    refresh->url = url;
+    refresh->requestHeaders = requestHeaders;
+    refresh->cacheRequestHeaders = cacheRequestHeaders;
+    refresh->cacheKey = cacheKey;
+    refresh->cached = cached;
+    refresh->decompress = decompress;
+    refresh->timeout = (timeout > 0) ? timeout : kDefaultTimeout;
+
+    bool full = false;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!_stopping && _queue.size() < kMaxQueued) {
+            _queue.push_back(refresh);
+            _queued.notify_one();
+            return;
+        }
+        if (!_stopping) {
+            ++_dropped;
+            full = true;
+        }
+    }
+
+    if (full) {
+        LOG_WARNING << "Cache refresh queue is full, not refreshing " << url;
+    }
+    RequestCoalescer::instance().finish(refresh->flightKey, refresh->flight, 0);
+}
+
+boost::uint64_t CacheRefresher::dropped() const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _dropped;
+}
+
+void CacheRefresher::work()
+{
+    for (;;) {
+        boost::shared_ptr<Refresh> refresh;
+        {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            while (_queue.empty() && !_stopping) {
+                _queued.wait(lock);
+            }
+            if (_stopping)
+                return;
+
+            refresh = _queue.front();
+            _queue.pop_front();
+            _running.insert(&refresh->client);
+        }
+
+        run(refresh);
+
+        boost::mutex::scoped_lock lock(_mutex);
+        _running.erase(&refresh->client);
+    }
+}
+
+void CacheRefresher::run(const boost::shared_ptr<Refresh>& refresh)
+{
+    RequestCoalescer::Result result;
+    bool ok = false;
+    try {
+        std::string body;
+        StringSink bodyText(body);
+        DecompressSink decoder(bodyText);
+        decoder.setTimeout(refresh->timeout);
+        BodySink& sink = refresh->decompress ? static_cast<BodySink&>(decoder) : static_cast<BodySink&>(bodyText);
+
+        refresh->client.setTimeout(refresh->timeout);
+        HttpStreamClient::Response response = refresh->client.request("GET", refresh->url, refresh->requestHeaders,
+                                                                      std::string(), 0, sink);
+        if (response.sinkFailed || !sink.finish()) {
+            LOG_WARNING << "Unable to refresh cached response for " << refresh->url << ": " << sink.error();
+        } else {
+            boost::shared_ptr<std::string> owned = boost::make_shared<std::string>();
+            owned->swap(body);
+
+            result.status = response.status;
+            result.headers = response.headers;
+            result.body = owned;
+
+            ResponseCache::EntryPtr reused = ResponseCache::instance().storeResponse(refresh->cacheKey, refresh->cached,
+                                                                                     response.status, response.headers, owned,
+                                                                                     refresh->cacheRequestHeaders, std::time(0));
+            if (reused) {
+                result.status = reused->status;
+                result.headers = reused->headers;
+                result.body = reused->body;
+            }
+            ok = true;
+        }
+    } catch (std::exception& e) {
+        LOG_WARNING << "Unable to refresh cached response for " << refresh->url << ": " << e.what();
+    }
+
+    RequestCoalescer::instance().finish(refresh->flightKey, refresh->flight, ok ? &result : 0);
+}
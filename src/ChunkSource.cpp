@@ -0,0 +1,100 @@
+//
+//  ChunkSource.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ChunkSource.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/thread_time.hpp>
+
+static const long kDefaultTimeout = 60;  // Seconds a writer waits for space without a timeout
+
+ChunkSource::ChunkSource(std::size_t maxQueued)
+    : _maxQueued(maxQueued), _timeout(0), _queued(0), _started(false), _ended(false), _closed(false), _timedOut(false)
+{ }
+
+void ChunkSource::setTimeout(long seconds) {
+    boost::mutex::scoped_lock lock(_mutex);
+    _timeout = seconds;
+}
+
+bool ChunkSource::write(const std::string& chunk) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    
+    // A chunk larger than the limit is still taken once the queue has drained.  The writer is the
+    // main thread, so it doesn't wait longer than the timeout for a socket that has stalled.
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(_timeout > 0 ? _timeout : kDefaultTimeout);
+    while (_started && !_closed && _queued > 0 && _queued + chunk.size() > _maxQueued) {
+        if (!_changed.timed_wait(lock, deadline) && !_closed && _queued + chunk.size() > _maxQueued) {
+            _closed = true;
+            _timedOut = true;
+            _changed.notify_all();
+        }
+    }
+    
+    if (_ended || _closed) {
+        return false;
+    }
+    
+    if (!chunk.empty()) {  // An empty piece would end the body
+        _chunks.push_back(chunk);
+        _queued += chunk.size();
+        _changed.notify_all();
+    }
+    return true;
+}
+
+bool ChunkSource::end() {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_ended || _closed) {
+        return false;
+    }
+    
+    _ended = true;
+    _changed.notify_all();
+    return true;
+}
+
+void ChunkSource::close() {
+    boost::mutex::scoped_lock lock(_mutex);
+    _closed = true;
+    _changed.notify_all();
+}
+
+std::string ChunkSource::error() const {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_timedOut) {
+        return "Timed out waiting to send the request body";
+    }
+    if (_closed && !_ended) {
+        return "Request body was closed before $endChunks";
+    }
+    return std::string();
+}
+
+bool ChunkSource::next(const char*& data, std::size_t& len) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    _started = true;
+    
+    while (_chunks.empty() && !_ended && !_closed) {
+        _changed.wait(lock);
+    }
+    
+    data = 0;
+    len = 0;
+    if (_chunks.empty()) {
+        return _ended;
+    }
+    
+    _sending.swap(_chunks.front());
+    _chunks.pop_front();
+    _queued -= _sending.size();
+    _changed.notify_all();
+    
+    data = _sending.data();
+    len = _sending.size();
+    return true;
+}
@@ -7,55 +7,486 @@
 //
 
 #include "CppNetlibDelegate.h"
+#include "ListPool.h"
+#include "JsonListBuilder.h"
+#include "Projection.h"
+#include "ListSerializer.h"
+#include "ListSource.h"
+#include "MultipartSource.h"
+#include "FileSink.h"
+#include "FileSource.h"
+#include "SegmentedDownload.h"
+#include "DecompressSink.h"
+#include "GzipSource.h"
+#include "ResponseCache.h"
+#include "RequestCoalescer.h"
+#include "CacheRefresher.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "InflightRegistry.h"
 
+#include <ctime>
 #include <vector>
 #include <string>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 
 using namespace OmnisTools;
 
-void CppNetlibDelegate::init(OmnisTools::ParamMap&)
+static const std::size_t kDefaultBatchSize = 500;  // Rows per $rows call when streaming records
+static const std::size_t kDefaultMaxBatches = 4;    // Batches waiting for the main thread before reading pauses
+
+// Read a positive count parameter
+static std::size_t readCount(const boost::any& value, std::size_t defaultCount)
+{
+    double count = 0;
+    if (const int* i = boost::any_cast<int>(&value))
+        count = *i;
+    else if (const double* d = boost::any_cast<double>(&value))
+        count = *d;
+    
+    return (count >= 1) ? static_cast<std::size_t>(count) : defaultCount;
+}
+
+// Read a boolean parameter
+static bool readFlag(const boost::any& value, bool defaultFlag)
+{
+    if (const bool* b = boost::any_cast<bool>(&value))
+        return *b;
+    else if (const int* i = boost::any_cast<int>(&value))
+        return *i != 0;
+    else if (const double* d = boost::any_cast<double>(&value))
+        return *d != 0;
+    
+    return defaultFlag;
+}
+
+// Value of a header, or empty if it isn't present
+static std::string findHeader(const HttpStreamClient::Headers& headers, const char* name)
+{
+    for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (boost::iequals(it->first, name))
+            return it->second;
+    }
+    return std::string();
+}
+
+// Once the body has been decoded, its Content-Encoding is gone and Content-Length is the decoded size
+static void rewriteDecodedHeaders(HttpStreamClient::Headers& headers, boost::uint64_t decodedBytes)
+{
+    for (HttpStreamClient::Headers::iterator it = headers.begin(); it != headers.end(); ) {
+        if (boost::iequals(it->first, "Content-Encoding")) {
+            it = headers.erase(it);
+        } else {
+            if (boost::iequals(it->first, "Content-Length"))
+                it->second = boost::lexical_cast<std::string>(decodedBytes);
+            ++it;
+        }
+    }
+}
+
+// Host (and port) of a URL, as metrics are kept by it
+static std::string urlHost(const std::string& url)
+{
+    std::string::size_type start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    std::string::size_type end = url.find_first_of("/?#", start);
+    std::string authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    std::string::size_type at = authority.rfind('@');
+    return boost::to_lower_copy(at == std::string::npos ? authority : authority.substr(at + 1));
+}
+
+// Counts a request in the metrics when it starts, and its outcome and latency however it finishes
+class MetricsRecorder {
+public:
+    MetricsRecorder() : status(0), bytesIn(0), bytesOut(0), _start(RequestTimings::now()) {
+        Metrics::instance().count(Metrics::kRequestsStarted);
+    }
+    ~MetricsRecorder() {
+        Metrics& metrics = Metrics::instance();
+        metrics.count(status ? Metrics::kRequestsCompleted : Metrics::kRequestsFailed);
+        if (bytesIn)
+            metrics.count(Metrics::kBytesIn, bytesIn);
+        if (bytesOut)
+            metrics.count(Metrics::kBytesOut, bytesOut);
+        if (!url.empty())
+            metrics.recordLatency(urlHost(url), status, RequestTimings::now() - _start);
+    }
+    
+    std::string url;
+    int status;                // 0 until there is a response
+    boost::int64_t bytesIn;    // Response body as received, unless it came from the cache or another request
+    boost::int64_t bytesOut;   // Request body, unless it's sent by the HttpStreamClient (which counts its own)
+    
+private:
+    boost::uint64_t _start;
+};
+
+// Closes the chunk source however the request finishes, so a later $writeChunk fails rather than
+// waiting for a request that is no longer sending
+class ChunkSourceCloser {
+public:
+    ChunkSourceCloser(const boost::shared_ptr<ChunkSource>& source) : _source(source) {}
+    ~ChunkSourceCloser() {
+        if (_source)
+            _source->close();
+    }
+    
+private:
+    boost::shared_ptr<ChunkSource> _source;
+};
+
+// Ends a flight of identical requests however its leader finishes.  Unless the leader's result was
+// published, the requests waiting on it are told it failed and make their own.
+class FlightLeader {
+public:
+    FlightLeader(const RequestCoalescer::FlightPtr& flight, const std::string& key) : _flight(flight), _key(key) {}
+    ~FlightLeader() {
+        if (_flight)
+            RequestCoalescer::instance().finish(_key, _flight, 0);
+    }
+    
+    void publish(const RequestCoalescer::Result& result) {
+        if (_flight)
+            RequestCoalescer::instance().finish(_key, _flight, &result);
+        _flight.reset();
+    }
+    
+private:
+    RequestCoalescer::FlightPtr _flight;
+    std::string _key;
+};
+
+// Moves a request to the delivering stage of the in-flight registry however its work finishes
+class InflightFinisher {
+public:
+    InflightFinisher(boost::uint64_t id) : _id(id) {}
+    ~InflightFinisher() {
+        if (_id)
+            InflightRegistry::instance().finish(_id);
+    }
+    
+private:
+    boost::uint64_t _id;
+};
+
+CppNetlibDelegate::CppNetlibDelegate() : _streamFailed(false), _timeout(0), _flightInterrupted(false), _recordTimings(true), _queuedAt(0), _inflightId(0)
+{ }
+
+CppNetlibDelegate::~CppNetlibDelegate()
+{
+    if (_inflightId) {
+        InflightRegistry::instance().remove(_inflightId);
+    }
+}
+
+void CppNetlibDelegate::init(OmnisTools::ParamMap& params)
 {
     // DEV NOTE: Lists can be populated in a background object, but must be allocated on the main thread.
-    _listResult = boost::shared_ptr<EXTqlist>(new EXTqlist(listVlen));
-	_headerResult = boost::shared_ptr<EXTqlist>(new EXTqlist(listVlen));
+    //           Result lists are checked out of the ListPool (allocated on the main thread) when the request runs.
+    
+    // The record stream is created here, before the thread starts, since the main thread takes batches from it
+    OmnisTools::ParamMap::iterator it = params.find("stream");
+    if (it != params.end()) {
+        RecordStream::Format format;
+        const std::string* name = boost::any_cast<std::string>(&it->second);
+        if (name && RecordStream::parseFormat(*name, format)) {
+            std::size_t batchSize = kDefaultBatchSize, maxBatches = kDefaultMaxBatches;
+            if ((it = params.find("batch_size")) != params.end())
+                batchSize = readCount(it->second, kDefaultBatchSize);
+            if ((it = params.find("max_batches")) != params.end())
+                maxBatches = readCount(it->second, kDefaultMaxBatches);
+            
+            _recordStream = boost::make_shared<RecordStream>(format, batchSize, maxBatches);
+        } else {
+            LOG_ERROR << "Unknown stream format";
+        }
+    }
+    
+    // Likewise the chunk source, since the main thread writes the body into it
+    it = params.find("body_chunks");
+    if (it != params.end() && readFlag(it->second, false)) {
+        std::size_t maxQueued = ChunkSource::kDefaultMaxQueued;
+        if ((it = params.find("chunk_buffer")) != params.end())
+            maxQueued = readCount(it->second, ChunkSource::kDefaultMaxQueued);
+        
+        _chunkSource = boost::make_shared<ChunkSource>(maxQueued);
+    }
+    
+    // The response cache is shared by every worker, so make sure it's created here rather than on a worker thread
+    it = params.find("cache");
+    if (it != params.end() && readFlag(it->second, false)) {
+        ResponseCache::instance();
+        CacheRefresher::instance();
+    }
+    
+    // As is the coalescer, unless this request has opted out of it
+    it = params.find("coalesce");
+    if (it == params.end() || readFlag(it->second, true)) {
+        RequestCoalescer::instance();
+    }
+    _flightInterrupted = false;
+    
+    it = params.find("timings");
+    _recordTimings = (it == params.end() || readFlag(it->second, true));
+    
+    // The timeout holds for requests made by the HttpStreamClient; cpp-netlib's client doesn't have one
+    it = params.find("timeout");
+    _timeout = (it == params.end()) ? 0 : static_cast<long>(readCount(it->second, 0));
+    if (_chunkSource) {
+        _chunkSource->setTimeout(_timeout);  // $writeChunk doesn't wait on a stalled socket for longer than this
+    }
+    
+    // The in-flight registry lists the request by its method and URL
+    InflightRegistry::instance();
+    _inflightMethod = "GET";
+    _inflightUrl.clear();
+    for (it = params.begin(); it != params.end(); ++it) {
+        const std::string* value = boost::any_cast<std::string>(&it->second);
+        if (value && boost::iequals(it->first, "method")) {
+            _inflightMethod = boost::to_upper_copy(*value);
+        } else if (value && boost::iequals(it->first, "url")) {
+            _inflightUrl = *value;
+        }
+    }
+}
+
+void CppNetlibDelegate::queued()
+{
+    _queuedAt = RequestTimings::now();
+    if (_recordTimings) {
+        _timings = boost::make_shared<RequestTimings>();
+        _timings->mark(RequestTimings::kQueued);
+    } else {
+        _timings.reset();
+    }
+    
+    InflightRegistry& registry = InflightRegistry::instance();
+    if (_inflightId) {
+        registry.remove(_inflightId);
+    }
+    _inflightId = registry.add(_inflightMethod, _inflightUrl, _timings);
+}
+
+void CppNetlibDelegate::delivered()
+{
+    _ownedLists.clear();  // The result, nested lists and all, has been handed to Omnis
+    
+    if (_inflightId) {
+        InflightRegistry::instance().remove(_inflightId);
+        _inflightId = 0;
+    }
 }
 
 void CppNetlibDelegate::cancel()
 {
+    if (_recordStream) {
+        _recordStream->cancel();  // Releases the client thread if it's waiting for batches to be taken
+    }
+    if (_chunkSource) {
+        _chunkSource->close();  // Releases the main thread if it's waiting to write a chunk
+    }
+    _streamClient.cancel();
+    
+    {
+        boost::mutex::scoped_lock lock(_downloadMutex);
+        if (_download) {
+            _download->cancel();
+        }
+    }
+    
+    if (_inflightId) {
+        InflightRegistry::instance().remove(_inflightId);  // Omnis is told it's canceled, so it's no longer outstanding
+    }
+    
+    boost::mutex::scoped_lock lock(_flightMutex);
+    if (_flight) {
+        _flight->interrupt(_flightInterrupted);  // Releases the client thread if it's waiting for another request
+    } else {
+        _flightInterrupted = true;
+    }
+}
+
+RequestCoalescer::Flight::Outcome CppNetlibDelegate::waitForFlight(const RequestCoalescer::FlightPtr& flight, RequestCoalescer::Result& shared)
+{
+    {
+        boost::mutex::scoped_lock lock(_flightMutex);
+        if (_flightInterrupted)
+            return RequestCoalescer::Flight::kInterrupted;
+        _flight = flight;
+    }
+    
+    RequestCoalescer::Flight::Outcome outcome = flight->wait(_flightInterrupted, shared);
+    
+    boost::mutex::scoped_lock lock(_flightMutex);
+    _flight.reset();
+    return outcome;
+}
+
+bool CppNetlibDelegate::partialResult(OmnisTools::ParamMap& result)
+{
+    if (!_recordStream) {
+        return false;
+    }
+    
+    boost::shared_ptr<EXTqlist> batch = _recordStream->takeBatch();
+    if (!batch) {
+        return false;
+    }
+    
+    result["Result"] = batch;
+    return true;
+}
+
+bool CppNetlibDelegate::writeChunk(const std::string& chunk)
+{
+    return _chunkSource && _chunkSource->write(chunk);
 }
 
-void CppNetlibDelegate::buildHeaderList(boost::network::http::client::response response_)
+bool CppNetlibDelegate::endChunks()
+{
+    return _chunkSource && _chunkSource->end();
+}
+
+// Collect the headers of a cpp-netlib response
+static HttpStreamClient::Headers responseHeaders(boost::network::http::client::response response_)
 {
 	using namespace boost::network;
 	typedef headers_range<http::client::response>::type response_headers;
 	typedef boost::range_iterator<response_headers>::type iterator;
     
-	std::string name;
-	std::string value;
+    HttpStreamClient::Headers headers;
+	response_headers headers_ = http::headers(response_);
+	for (iterator it = headers_.begin(); it != headers_.end(); ++it) 
+	{
+		headers.push_back(std::make_pair(it->first, it->second));
+	}
+    return headers;
+}
+
+void CppNetlibDelegate::buildHeaderList(const HttpStreamClient::Headers& headers_)
+{
+	typedef HttpStreamClient::Headers::const_iterator iterator;
+    
     str255 colName;
 	EXTfldval colVal;
     int col = 0;
     
-	response_headers headers_ = http::headers(response_);
 	for (iterator it = headers_.begin(); it != headers_.end(); ++it) 
 	{
-		name = it->first;
-		colName = initStr255(name.c_str());
+		colName = initStr255(it->first.c_str());
         _headerResult->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
 	}
     
 	_headerResult->insertRow();
 	for (iterator it = headers_.begin(); it != headers_.end(); ++it) 
 	{
-		value = it->second;
 	    _headerResult->getColValRef(1,col+1,colVal,qtrue);
-        getEXTFldValFromString(colVal,value);
+        getEXTFldValFromString(colVal,it->second);
 		col++;
 	}
 }
 
+// Parse a JSON body into a list on the worker thread.  Returns an empty pointer if the body isn't valid JSON.
+boost::shared_ptr<EXTqlist> CppNetlibDelegate::parseJsonBody(const std::string& body)
+{
+    TraceSpan span("parse", "worker");
+    JsonListBuilder builder;
+    JsonReader reader(builder);
+    if (!reader.feed(body.data(), body.size()) || !reader.finish()) {
+        LOG_ERROR << "Unable to parse JSON body: " << reader.error();
+        return boost::shared_ptr<EXTqlist>();
+    }
+    
+    _ownedLists.clear();  // From an earlier run of this worker
+    boost::shared_ptr<EXTqlist> list = builder.toList(_ownedLists);
+    if (!list) {
+        LOG_ERROR << "Unable to parse JSON body: no lists available from the list pool";
+    }
+    return list;
+}
+
+// Streamed requests are made as HTTP/1.0.  cpp-netlib hands the raw body to a body callback without
+// decoding chunked transfer encoding, and HTTP/1.0 responses are never chunked.
+typedef boost::network::http::basic_client<boost::network::http::client::tag_type, 1, 0> stream_client;
+
+// Called on the client's io thread for each piece of the body.  The call is synchronous, so the
+// socket isn't read again until the sink has dealt with the data.
+void CppNetlibDelegate::streamBody(BodySink* sink, boost::iterator_range<char const*> const& range, boost::system::error_code const&)
+{
+    if (!_streamFailed && !boost::empty(range)) {
+        _streamFailed = !sink->write(boost::begin(range), boost::size(range));
+        if (_timings) {
+            _timings->addBytesIn(boost::size(range));
+        }
+    }
+}
+
+boost::network::http::client::response CppNetlibDelegate::streamRequest(const std::string& method,
+                                                                        const boost::network::http::client::request& request,
+                                                                        const std::string& body,
+                                                                        const std::string& bodyType,
+                                                                        BodySink& sink)
+{
+    using namespace boost::network;
+    
+    stream_client::options options;
+    options.follow_redirects(true)
+           .cache_resolved(true);
+    
+    stream_client client_(options);
+    stream_client::body_callback_function_type callback = boost::bind(&CppNetlibDelegate::streamBody, this, &sink, _1, _2);
+    
+    _streamFailed = false;
+    http::client::response response_;
+    if (boost::iequals(method, "POST"))
+        response_ = client_.post(request, body, bodyType, callback);
+    else if (boost::iequals(method, "PUT"))
+        response_ = client_.put(request, body, bodyType, callback);
+    else if (boost::iequals(method, "DELETE"))
+        response_ = client_.delete_(request, callback);
+    else
+        response_ = client_.get(request, callback);
+    
+    // Headers are available before the body, so the sink can be told the length and encoding while it's streaming
+    typedef headers_range<http::client::response>::type response_headers;
+    typedef boost::range_iterator<response_headers>::type iterator;
+    std::string encoding;
+    try {
+        response_headers headers_ = http::headers(response_);
+        if (_timings) {
+            _timings->markFirst(RequestTimings::kFirstByte);
+        }
+        for (iterator it = headers_.begin(); it != headers_.end(); ++it) {
+            if (boost::iequals(it->first, "Content-Length")) {
+                try {
+                    sink.expectLength(boost::lexical_cast<boost::uint64_t>(boost::trim_copy(it->second)));
+                } catch (const boost::bad_lexical_cast&) {
+                    LOG_DEBUG << "Invalid Content-Length: " << it->second;
+                }
+            } else if (boost::iequals(it->first, "Content-Encoding")) {
+                encoding = it->second;
+            }
+        }
+    } catch (std::exception& e) {
+        // The body callback may already be waiting on the io thread for headers that won't come
+        sink.abandon(e.what());
+        throw;
+    }
+    sink.expectEncoding(encoding);
+    
+    // The destination is set once the connection has reached the end of the body (or throws if it failed)
+    http::destination(response_);
+    
+    if (!_streamFailed) {
+        _streamFailed = !sink.finish();
+    }
+    return response_;
+}
+
 OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params) 
 {
     // TODO: Consider using streaming body to indicate download success
@@ -64,6 +495,20 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
     using namespace boost::network;
     
     OmnisTools::ParamMap result;
+    ChunkSourceCloser chunkSourceCloser(_chunkSource);
+    MetricsRecorder metrics;
+    InflightFinisher inflightFinisher(_inflightId);
+    if (_inflightId) {
+        InflightRegistry::instance().start(_inflightId);
+    }
+    if (_timings) {
+        _timings->mark(RequestTimings::kStarted);
+    }
+    if (Tracer::enabled() && _queuedAt) {
+        Tracer::instance().record("queue wait", "worker", _queuedAt, RequestTimings::now());
+    }
+    _streamClient.setTimings(_timings.get());
+    _streamClient.setTimeout(_timeout);
     
 	str255 colName;
 	EXTfldval colVal;
@@ -75,6 +520,22 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
     std::vector<OmnisTools::ParamMap> headers;
     std::string requestBody;
     std::string requestBodyType;
+    boost::shared_ptr<EXTqlist> requestList;
+    std::string requestBodyFormat;
+    std::string requestBodyFile;
+    bool requestBodyChunked = false;
+    std::vector<OmnisTools::ParamMap> multipartParts;
+    std::string parse;
+    std::string records;
+    std::vector<OmnisTools::ParamMap> projectionColumns;
+    std::string destinationPath;
+    std::size_t segments = 1;
+    bool decompress = true;
+    bool useCache = false;
+    ResponseCache::StaleLimits staleLimits;
+    bool coalesce = true;
+    bool compressBody = false;
+    std::size_t compressLevel = 0;
     
     for (OmnisTools::ParamMap::iterator it = params.begin(); it != params.end(); ++it) {
         try {
@@ -91,7 +552,60 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
                 requestBodyType = boost::any_cast<std::string>(it->second);
             }
             else if (boost::iequals(it->first, "body")) {
-                requestBody = boost::any_cast<std::string>(it->second);
+                // A list body is passed through as a copy of the list and serialised below
+                boost::shared_ptr<EXTqlist>* list = boost::any_cast<boost::shared_ptr<EXTqlist> >(&it->second);
+                if (list)
+                    requestList = *list;
+                else
+                    requestBody = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "body_file")) {
+                requestBodyFile = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "multipart")) {
+                multipartParts = boost::any_cast<std::vector<OmnisTools::ParamMap> >(it->second);
+            }
+            else if (boost::iequals(it->first, "body_chunked")) {
+                requestBodyChunked = readFlag(it->second, false);
+            }
+            else if (boost::iequals(it->first, "body_format")) {
+                requestBodyFormat = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "parse")) {
+                parse = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "records")) {
+                records = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "destination_path")) {
+                destinationPath = boost::any_cast<std::string>(it->second);
+            }
+            else if (boost::iequals(it->first, "compress_body")) {
+                compressBody = readFlag(it->second, false);
+            }
+            else if (boost::iequals(it->first, "compress_level")) {
+                compressLevel = readCount(it->second, 0);
+            }
+            else if (boost::iequals(it->first, "cache")) {
+                useCache = readFlag(it->second, false);
+            }
+            else if (boost::iequals(it->first, "stale_while_revalidate")) {
+                staleLimits.whileRevalidate = static_cast<long>(readCount(it->second, 0));
+            }
+            else if (boost::iequals(it->first, "stale_if_error")) {
+                staleLimits.ifError = static_cast<long>(readCount(it->second, 0));
+            }
+            else if (boost::iequals(it->first, "coalesce")) {
+                coalesce = readFlag(it->second, true);
+            }
+            else if (boost::iequals(it->first, "decompress")) {
+                decompress = readFlag(it->second, true);
+            }
+            else if (boost::iequals(it->first, "segments")) {
+                segments = readCount(it->second, 1);
+            }
+            else if (boost::iequals(it->first, "projection")) {
+                projectionColumns = boost::any_cast<std::vector<OmnisTools::ParamMap> > (it->second);
             }
         } catch (const boost::bad_any_cast& e ) {
             LOG_ERROR << "Unable to cast parameter";
@@ -103,17 +617,81 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
         LOG_ERROR << "URL is empty";
         return result;
     }
+    metrics.url = url;
     
-	try {
-        http::client::options options;
-        options.follow_redirects(true)
-               .cache_resolved(true);
+    // File bodies are sent from disk as the socket takes them rather than read into memory
+    boost::shared_ptr<BodySource> bodySource;
+    if (!requestBodyFile.empty()) {
+        if (requestList || !requestBody.empty()) {
+            LOG_ERROR << "Only one of body and body_file can be used";
+            return result;
+        }
         
-		http::client::request request_(url);
+        bodySource = boost::make_shared<FileSource>(requestBodyFile);
+        if (!bodySource->error().empty()) {
+            LOG_ERROR << bodySource->error();
+            return result;
+        }
+    }
+    
+    // A body written with $writeChunk is sent as Omnis writes it
+    if (_chunkSource) {
+        if (requestList || !requestBody.empty() || bodySource) {
+            LOG_ERROR << "Only one of body, body_file and body_chunks can be used";
+            return result;
+        }
+        bodySource = _chunkSource;
+    }
+    
+    // Multipart bodies are written part by part as they're sent, with file parts read from disk
+    if (!multipartParts.empty()) {
+        if (requestList || !requestBody.empty() || bodySource) {
+            LOG_ERROR << "Only one of body, body_file, body_chunks and multipart can be used";
+            return result;
+        }
         
-        std::string headKey, headValue;
-        for (std::vector<OmnisTools::ParamMap>::iterator head = headers.begin(); head != headers.end(); ++head) {
-            // Extract valid keys
+        boost::shared_ptr<MultipartSource> multipart = boost::make_shared<MultipartSource>(boost::ref(multipartParts));
+        if (!multipart->error().empty()) {
+            LOG_ERROR << "Invalid multipart body: " << multipart->error();
+            return result;
+        }
+        requestBodyType = multipart->contentType();  // Carries the boundary, so it replaces any body_type
+        bodySource = multipart;
+    }
+    
+    // Serialise a list body here rather than as a character string on the main thread.  A chunked
+    // list body is serialised a batch of rows at a time as it's sent.
+    if (requestList) {
+        ListSerializer::Format format;
+        if (!ListSerializer::parseFormat(requestBodyFormat, format)) {
+            LOG_ERROR << "Unknown body format: " << requestBodyFormat;
+            return result;
+        }
+        
+        if (requestBodyChunked)
+            bodySource = boost::make_shared<ListSource>(requestList, format);
+        else
+            ListSerializer(format).write(requestList.get(), requestBody);
+        if (requestBodyType.empty())
+            requestBodyType = ListSerializer::contentType(format);
+    }
+    
+    // Projections pick fields out of the body as it streams in, so the full body is never held
+    boost::shared_ptr<Projection> projection;
+    if (!projectionColumns.empty()) {
+        std::string error;
+        projection = Projection::create(parse, records, projectionColumns, error);
+        if (!projection) {
+            LOG_ERROR << "Invalid projection: " << error;
+            return result;
+        }
+    }
+    
+    // Extract valid header keys
+    HttpStreamClient::Headers requestHeaders;
+    std::string headKey, headValue;
+    for (std::vector<OmnisTools::ParamMap>::iterator head = headers.begin(); head != headers.end(); ++head) {
+        try {
             for (OmnisTools::ParamMap::iterator item = head->begin(); item != head->end(); ++item) {
                 if (boost::iequals(item->first, "key")) {
                     headKey = boost::any_cast<std::string>(item->second);
@@ -121,7 +699,128 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
                     headValue = boost::any_cast<std::string>(item->second);
                 }
             }
-            request_ << header(headKey, headValue);
+        } catch (const boost::bad_any_cast& e) {
+            LOG_ERROR << "Unable to cast header";
+        }
+        requestHeaders.push_back(std::make_pair(headKey, headValue));
+    }
+    
+    // Large downloads can be fetched as several ranges at once, over as many as segments connections
+    boost::shared_ptr<SegmentedDownload> download;
+    if (!destinationPath.empty() && segments > 1 && boost::iequals(method, "GET") && !projection && !_recordStream && !bodySource) {
+        download = boost::make_shared<SegmentedDownload>(url, requestHeaders, destinationPath, segments);
+        download->setTimeout(_timeout);
+        
+        boost::mutex::scoped_lock lock(_downloadMutex);
+        _download = download;
+    }
+    
+    // Compressed bodies are gzipped as they're sent, and sent chunked since their length isn't known up front
+    if (compressBody && (bodySource || !requestBody.empty())) {
+        if (!bodySource)
+            bodySource = boost::make_shared<StringSource>(requestBody);
+        bodySource = boost::make_shared<GzipSource>(bodySource, static_cast<int>(compressLevel));
+        requestHeaders.push_back(std::make_pair(std::string("Content-Encoding"), std::string("gzip")));
+    }
+    
+    // Ask for a compressed body, unless the caller has chosen the encodings (ranges are never compressed)
+    if (decompress && !download && findHeader(requestHeaders, "Accept-Encoding").empty()) {
+        requestHeaders.push_back(std::make_pair(std::string("Accept-Encoding"), std::string(DecompressSink::acceptEncoding())));
+    }
+    
+    // Downloads are written straight to disk rather than held in memory
+    boost::shared_ptr<FileSink> fileSink;
+    if (!destinationPath.empty() && !download) {
+        fileSink = boost::make_shared<FileSink>(destinationPath);
+        if (!fileSink->error().empty()) {
+            LOG_ERROR << fileSink->error();
+            return result;
+        }
+    }
+    
+    // Only one sink can take the body as it arrives
+    int sinks = (projection ? 1 : 0) + (_recordStream ? 1 : 0) + (fileSink ? 1 : 0);
+    if (sinks > 1) {
+        LOG_ERROR << "Only one of projection, stream and destination_path can be used";
+        return result;
+    }
+    
+    BodySink* sink = 0;
+    if (projection)
+        sink = projection.get();
+    else if (_recordStream)
+        sink = _recordStream.get();
+    else if (fileSink)
+        sink = fileSink.get();
+    
+    // Compressed bodies are decoded piece by piece on the way to the sink (or the body text).  Bodies
+    // from the cache or another request in flight are shared rather than copied into the body text.
+    std::string body_;
+    StringSink bodyText(body_);
+    boost::shared_ptr<const std::string> sharedBody;
+    boost::shared_ptr<DecompressSink> decoder;
+    if (decompress && !download) {
+        decoder = boost::make_shared<DecompressSink>(boost::ref(sink ? *sink : static_cast<BodySink&>(bodyText)));
+        decoder->setTimeout(_timeout);
+    }
+    BodySink* receiver = decoder ? decoder.get() : sink;
+    
+    // Plain GETs can be answered from the response cache.  A fresh entry is used without a request;
+    // a stale one is revalidated with a conditional request and reused if the server answers 304.
+    // Within its stale-while-revalidate time a stale entry is used at once and revalidated in the
+    // background, and within its stale-if-error time it's used if the request fails.
+    useCache = useCache && !sink && !download && !bodySource && ResponseCache::cacheable(method, requestHeaders);
+    std::string cacheKey;
+    HttpStreamClient::Headers cacheRequestHeaders;  // The request as it's matched against Vary, without validators
+    ResponseCache::EntryPtr cached;
+    std::time_t requestTime = std::time(0);
+    if (useCache) {
+        cacheKey = ResponseCache::key(method, url);
+        cacheRequestHeaders = requestHeaders;
+        cached = ResponseCache::instance().find(cacheKey, requestHeaders, requestTime, staleLimits);
+        if (cached && !cached->fresh(requestTime)) {
+            ResponseCache::addValidators(cached, requestHeaders);
+        }
+    }
+    bool fromCache = false;
+    bool cacheAnswers = cached && (cached->fresh(requestTime) || cached->usableWhileRevalidating(requestTime));
+    
+    // Identical plain GETs made while one is already in flight wait for its result rather than making
+    // their own request.  If it fails, they go on to make their own.
+    coalesce = coalesce && boost::iequals(method, "GET") && !sink && !download && !bodySource && !cacheAnswers;
+    std::string flightKey;
+    RequestCoalescer::FlightPtr flight;
+    bool leader = false;
+    RequestCoalescer::Result shared;
+    bool coalesced = false;
+    if (coalesce) {
+        flightKey = RequestCoalescer::key(method, url, requestHeaders);
+        flight = RequestCoalescer::instance().join(flightKey, leader);
+        if (!leader) {
+            RequestCoalescer::Flight::Outcome outcome = waitForFlight(flight, shared);
+            if (outcome == RequestCoalescer::Flight::kInterrupted)
+                return result;
+            coalesced = (outcome == RequestCoalescer::Flight::kShared);
+        }
+    }
+    FlightLeader flightLeader(leader ? flight : RequestCoalescer::FlightPtr(), flightKey);
+    
+    ListPool& pool = ListPool::instance();
+    _listResult = pool.checkout();
+    _headerResult = pool.checkout();
+    if (!_listResult || !_headerResult) {
+        LOG_ERROR << "No result lists available from the list pool";
+        return result;
+    }
+    
+	try {
+        http::client::options options;
+        options.follow_redirects(true)
+               .cache_resolved(true);
+        
+		http::client::request request_(url);
+        for (HttpStreamClient::Headers::iterator head = requestHeaders.begin(); head != requestHeaders.end(); ++head) {
+            request_ << header(head->first, head->second);
         }
 
 		http::client client_(options);
@@ -133,33 +832,176 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
             
             // GET, POST PUT, and DELETE -- Body Available
             http::client::response response_;
-            if (boost::iequals(method, "GET")) 
-                response_ = client_.get(request_);
-            else if (boost::iequals(method, "POST"))
-                if (requestBodyType.empty())
-                    response_ = client_.post(request_, requestBody);
-                else
-                    response_ = client_.post(request_, requestBody, requestBodyType);
-            else if (boost::iequals(method, "PUT")) 
-                if (requestBodyType.empty())
-                    response_ = client_.put(request_, requestBody);
-                else
-                    response_ = client_.put(request_, requestBody, requestBodyType);
-            else if (boost::iequals(method, "DELETE")) 
-                response_ = client_.delete_(request_);
+            HttpStreamClient::Headers responseHeaders_;
+            if (download) {
+                // The download reports its own result, from the HEAD request or the single GET it fell back to
+                _streamFailed = !download->run();
+                status = download->status();
+                responseHeaders_ = download->headers();
+            } else if (bodySource) {
+                // The body is read from its source (and compressed) as it's sent, and the response goes to the sink (if any)
+                HttpStreamClient::Response streamed = _streamClient.request(method, url, requestHeaders, requestBodyType,
+                                                                            bodySource.get(), receiver ? *receiver : bodyText);
+                _streamFailed = streamed.sinkFailed || (receiver && !receiver->finish());
+                status = streamed.status;
+                responseHeaders_ = streamed.headers;
+                if (decoder && !_streamFailed && decoder->decoded()) {
+                    rewriteDecodedHeaders(responseHeaders_, decoder->decodedBytes());
+                }
+            } else if (cacheAnswers) {
+                // Fresh in the cache, so there's no request at all (or only one in the background)
+                status = cached->status;
+                responseHeaders_ = cached->headers;
+                sharedBody = cached->body;
+                fromCache = true;
+                if (!cached->fresh(requestTime)) {
+                    ResponseCache::instance().countStale(cacheKey);
+                    CacheRefresher::instance().start(url, requestHeaders, cacheRequestHeaders, cacheKey, cached, decompress, _timeout);
+                }
+            } else if (coalesced) {
+                // Answered by the identical request that was already in flight
+                status = shared.status;
+                responseHeaders_ = shared.headers;
+                sharedBody = shared.body;
+            } else {
+                // A stale entry that may stand in for a failed request is used if this one fails
+                bool staleIfError = cached && cached->usableOnError(requestTime);
+                bool failed = false;
+                bool decoded = true;
+                metrics.bytesOut = static_cast<boost::int64_t>(requestBody.size());
+                try {
+                    if (sink)
+                        response_ = streamRequest(method, request_, requestBody, requestBodyType, *receiver);
+                    else if (boost::iequals(method, "GET")) 
+                        response_ = client_.get(request_);
+                    else if (boost::iequals(method, "POST"))
+                        if (requestBodyType.empty())
+                            response_ = client_.post(request_, requestBody);
+                        else
+                            response_ = client_.post(request_, requestBody, requestBodyType);
+                    else if (boost::iequals(method, "PUT")) 
+                        if (requestBodyType.empty())
+                            response_ = client_.put(request_, requestBody);
+                        else
+                            response_ = client_.put(request_, requestBody, requestBodyType);
+                    else if (boost::iequals(method, "DELETE")) 
+                        response_ = client_.delete_(request_);
+                    
+                    status = http::status(response_);
+                    if (_timings) {
+                        _timings->markFirst(RequestTimings::kFirstByte);
+                    }
+                    responseHeaders_ = responseHeaders(response_);
+                    
+                    if (decoder && !sink) {
+                        // The whole body has arrived, so decode it in one piece
+                        std::string encoded = http::body(response_);
+                        decoder->expectEncoding(findHeader(responseHeaders_, "Content-Encoding"));
+                        if (!decoder->write(encoded.data(), encoded.size()) || !decoder->finish()) {
+                            LOG_ERROR << "Unable to decompress body: " << decoder->error();
+                            body_ = encoded;
+                            decoded = false;
+                        }
+                    } else {
+                        body_ = http::body(response_);
+                    }
+                    if (decoder && decoded && !_streamFailed && decoder->decoded()) {
+                        // Returned to Omnis and cached with the decoded body, so they have to describe it
+                        rewriteDecodedHeaders(responseHeaders_, decoder->decodedBytes());
+                    }
+                } catch (std::exception& e) {
+                    if (!staleIfError)
+                        throw;
+                    LOG_ERROR << "Request failed, using the stale cached response: " << e.what();
+                    failed = true;
+                }
+                
+                if (staleIfError && (failed || status == 500 || status == 502 || status == 503 || status == 504)) {
+                    status = cached->status;
+                    responseHeaders_ = cached->headers;
+                    sharedBody = cached->body;
+                    fromCache = true;
+                    ResponseCache::instance().countStale(cacheKey);
+                } else {
+                    if (useCache || leader) {
+                        // The body is handed to the cache and any requests waiting on this one, so it's shared from here on
+                        boost::shared_ptr<std::string> owned = boost::make_shared<std::string>();
+                        owned->swap(body_);
+                        sharedBody = owned;
+                    }
+                    
+                    if (useCache && decoded) {
+                        ResponseCache::EntryPtr reused = ResponseCache::instance().storeResponse(cacheKey, cached, status, responseHeaders_, sharedBody,
+                                                                                                 cacheRequestHeaders, std::time(0));
+                        if (reused) {
+                            // Not modified: the cached response is reused with its headers refreshed
+                            status = reused->status;
+                            responseHeaders_ = reused->headers;
+                            sharedBody = reused->body;
+                            fromCache = true;
+                        }
+                    }
+                }
+                
+                if (leader) {
+                    RequestCoalescer::Result published;
+                    published.status = status;
+                    published.headers = responseHeaders_;
+                    published.body = sharedBody;
+                    flightLeader.publish(published);
+                }
+            }
+            const std::string& responseBody = sharedBody ? *sharedBody : body_;
+            if (_timings) {
+                _timings->markFirst(RequestTimings::kLastByte);  // Unless the client has marked it already
+            }
             
-            status = http::status(response_);
-            std::string body_ = http::body(response_);
+            // Parse the body here rather than in Omnis code on the main thread
+            boost::shared_ptr<EXTqlist> bodyList;
+            if (projection) {
+                if (_streamFailed) {
+                    LOG_ERROR << "Unable to project body: " << projection->error();
+                }
+                bodyList = projection->list();  // Rows projected before any failure are kept
+            } else if (_recordStream) {
+                if (_streamFailed) {
+                    LOG_ERROR << "Record stream stopped: " << _recordStream->error();
+                }
+            } else if (fileSink || download) {
+                if (_streamFailed) {
+                    LOG_ERROR << "Download failed: " << (fileSink ? fileSink->error() : download->error());
+                }
+            } else if (boost::iequals(parse, "json")) {
+                bodyList = parseJsonBody(responseBody);
+            }
             
-            buildHeaderList(response_);
+            buildHeaderList(responseHeaders_);
             colName = initStr255("status");
             _listResult->addCol(fftInteger, 0, 1, &colName);
             
             colName = initStr255("headers");
             _listResult->addCol(fftList, dpFcharacter, 1, &colName);
             
-            colName = initStr255("body");
-            _listResult->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+            if (fileSink || download) {
+                // The body is on disk, so only report where and how much
+                colName = initStr255("bytes");
+                _listResult->addCol(fftNumber, 0, 0, &colName);
+                
+                colName = initStr255("path");
+                _listResult->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+            } else {
+                colName = initStr255("body");
+                if (bodyList)
+                    _listResult->addCol(fftList, dpFcharacter, 1, &colName);
+                else
+                    _listResult->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+            }
+            
+            colName = initStr255("compressed_bytes");
+            _listResult->addCol(fftNumber, 0, 0, &colName);
+            
+            colName = initStr255("decompressed_bytes");
+            _listResult->addCol(fftNumber, 0, 0, &colName);
             
             _listResult->insertRow();
             
@@ -172,9 +1014,39 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
             boost::shared_ptr<EXTqlist> ptr = boost::any_cast<boost::shared_ptr<EXTqlist> > (_headerResult);
             colVal.setList(ptr.get(), qtrue);
             
-            //add body
-            _listResult->getColValRef(1,3,colVal,qtrue);
-            getEXTFldValFromString(colVal,body_);
+            if (fileSink || download) {
+                //add bytes and path (empty if the download failed)
+                _listResult->getColValRef(1,3,colVal,qtrue);
+                getEXTFldValFromDouble(colVal, static_cast<double>(fileSink ? fileSink->bytes() : (_streamFailed ? 0 : download->bytes())));
+                
+                _listResult->getColValRef(1,4,colVal,qtrue);
+                getEXTFldValFromString(colVal, _streamFailed ? std::string() : (fileSink ? fileSink->path() : download->path()));
+            } else {
+                //add body
+                _listResult->getColValRef(1,3,colVal,qtrue);
+                if (bodyList)
+                    colVal.setList(bodyList.get(), qtrue);
+                else
+                    getEXTFldValFromString(colVal,responseBody);
+            }
+            
+            //add body sizes as received and after decoding
+            double compressedBytes, decompressedBytes;
+            if (decoder && !fromCache && !coalesced) {
+                compressedBytes = static_cast<double>(decoder->encodedBytes());
+                decompressedBytes = static_cast<double>(decoder->decodedBytes());
+            } else {
+                compressedBytes = decompressedBytes = static_cast<double>(download ? download->bytes() : (fileSink ? fileSink->bytes() : responseBody.size()));
+            }
+            qshort sizeCol = (fileSink || download) ? 5 : 4;
+            _listResult->getColValRef(1,sizeCol,colVal,qtrue);
+            getEXTFldValFromDouble(colVal, compressedBytes);
+            _listResult->getColValRef(1,sizeCol+1,colVal,qtrue);
+            getEXTFldValFromDouble(colVal, decompressedBytes);
+            
+            if (!fromCache && !coalesced)
+                metrics.bytesIn = static_cast<boost::int64_t>(compressedBytes);
+            metrics.status = status;
             
             // Return list via parameters
             result["Result"] = _listResult;
@@ -183,8 +1055,12 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
             http::client::response response_ = client_.head(request_);
             
             status = http::status(response_);
+            if (_timings) {
+                _timings->mark(RequestTimings::kFirstByte);
+                _timings->mark(RequestTimings::kLastByte);
+            }
             
-            buildHeaderList(response_);
+            buildHeaderList(responseHeaders(response_));
             colName = initStr255("status");
             _listResult->addCol(fftList, dpFcharacter, 1, &colName);
             
@@ -201,6 +1077,7 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
             _listResult->getColValRef(1,2,colVal,qtrue);
             boost::shared_ptr<EXTqlist> ptr = boost::any_cast<boost::shared_ptr<EXTqlist> > (_headerResult);
             colVal.setList(ptr.get(), qtrue);
+            metrics.status = status;
             
             // Return list via parameters
             result["Result"] = _listResult;
@@ -214,5 +1091,8 @@ OmnisTools::ParamMap CppNetlibDelegate::run(OmnisTools::ParamMap& params)
 	} catch (std::exception &e) {
 	}
     
+    if (_timings) {
+        result["Timings"] = _timings;
+    }
 	return result;
 }
\ No newline at end of file
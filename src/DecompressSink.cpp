@@ -0,0 +1,262 @@
+//
+//  DecompressSink.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "DecompressSink.h"
+
+#include <cstring>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/thread_time.hpp>
+
+static const std::size_t kBufferSize = 64 * 1024;  // Decoded data is passed on in pieces of up to this size
+static const long kDefaultTimeout = 60;             // Seconds to wait for the encoding without a timeout
+
+DecompressSink::DecompressSink(BodySink& sink)
+    : _sink(sink), _timeout(0), _codec(kUnknown), _length(0), _haveLength(false),
+      _zlibOpen(false), _zlibEnded(false), _gzip(false), _triedRaw(true),
+#ifdef HTTPLIB_HAVE_BROTLI
+      _brotli(0), _brotliEnded(false),
+#endif
+      _buffer(kBufferSize), _encodedBytes(0), _decodedBytes(0)
+{
+    memset(&_zlib, 0, sizeof(_zlib));
+}
+
+DecompressSink::~DecompressSink() {
+    if (_zlibOpen) {
+        inflateEnd(&_zlib);
+    }
+#ifdef HTTPLIB_HAVE_BROTLI
+    if (_brotli) {
+        BrotliDecoderDestroyInstance(_brotli);
+    }
+#endif
+}
+
+const char* DecompressSink::acceptEncoding() {
+#ifdef HTTPLIB_HAVE_BROTLI
+    return "gzip, deflate, br";
+#else
+    return "gzip, deflate";
+#endif
+}
+
+bool DecompressSink::fail(const std::string& message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+std::string DecompressSink::error() const {
+    return _error.empty() ? _sink.error() : _error;
+}
+
+void DecompressSink::expectLength(boost::uint64_t length) {
+    // Content-Length is the encoded length, so it only means anything to the sink if there's no encoding
+    bool forward;
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        _length = length;
+        _haveLength = true;
+        forward = (_codec == kIdentity);
+    }
+
+    if (forward) {
+        _sink.expectLength(length);
+    }
+}
+
+void DecompressSink::expectEncoding(const std::string& encoding) {
+    std::string name = boost::to_lower_copy(boost::trim_copy(encoding));
+
+    Codec codec = kIdentity;
+    if (name == "gzip" || name == "x-gzip") {
+        codec = kZlib;
+        _gzip = true;
+        _zlibOpen = (inflateInit2(&_zlib, 15 + 16) == Z_OK);
+    } else if (name == "deflate") {
+        codec = kZlib;
+        _triedRaw = false;
+        _zlibOpen = (inflateInit2(&_zlib, 15) == Z_OK);
+#ifdef HTTPLIB_HAVE_BROTLI
+    } else if (name == "br") {
+        codec = kBrotli;
+        _brotli = BrotliDecoderCreateInstance(0, 0, 0);
+        if (!_brotli) {
+            fail("Unable to start brotli decoder");
+        }
+#endif
+    } else if (!name.empty() && name != "identity") {
+        fail("Unsupported Content-Encoding: " + encoding);
+    }
+
+    if (codec == kZlib && !_zlibOpen) {
+        fail("Unable to start zlib decoder");
+    }
+
+    bool forward;
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        _codec = codec;
+        forward = (codec == kIdentity && _haveLength);
+        _known.notify_all();
+    }
+
+    if (forward) {
+        _sink.expectLength(_length);
+    }
+}
+
+void DecompressSink::abandon(const std::string& reason) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    if (_codec == kUnknown) {
+        fail(reason);
+        _codec = kIdentity;
+        _known.notify_all();
+    }
+}
+
+bool DecompressSink::output(std::size_t len) {
+    _decodedBytes += len;
+    return _sink.write(&_buffer[0], len);
+}
+
+bool DecompressSink::inflate(const char* data, std::size_t len) {
+    _zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    _zlib.avail_in = static_cast<uInt>(len);
+
+    for (;;) {
+        if (_zlibEnded) {
+            // Only another gzip member can follow the end of the stream, anything else is ignored
+            if (_zlib.avail_in == 0 || !_gzip || _zlib.next_in[0] != 0x1f) {
+                return true;
+            }
+            inflateReset(&_zlib);
+            _zlibEnded = false;
+        }
+
+        _zlib.next_out = reinterpret_cast<Bytef*>(&_buffer[0]);
+        _zlib.avail_out = static_cast<uInt>(_buffer.size());
+        int ret = ::inflate(&_zlib, Z_NO_FLUSH);
+
+        if (ret == Z_DATA_ERROR && !_triedRaw && _zlib.total_out == 0 && _encodedBytes == len) {
+            // deflate without the zlib header, start again on the same data as a raw stream
+            _triedRaw = true;
+            inflateEnd(&_zlib);
+            _zlibOpen = (inflateInit2(&_zlib, -15) == Z_OK);
+            if (!_zlibOpen) {
+                return fail("Unable to start zlib decoder");
+            }
+            return inflate(data, len);
+        }
+
+        if (ret == Z_STREAM_END) {
+            _zlibEnded = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return fail(std::string("Unable to decompress body: ") + (_zlib.msg ? _zlib.msg : "invalid data"));
+        }
+
+        std::size_t produced = _buffer.size() - _zlib.avail_out;
+        if (produced > 0 && !output(produced)) {
+            return false;
+        }
+
+        // Done with this piece once zlib has consumed it and has no more output pending
+        if (!_zlibEnded && _zlib.avail_in == 0 && _zlib.avail_out != 0) {
+            return true;
+        }
+        if (ret == Z_BUF_ERROR && produced == 0) {
+            return true;
+        }
+    }
+}
+
+#ifdef HTTPLIB_HAVE_BROTLI
+bool DecompressSink::decodeBrotli(const char* data, std::size_t len) {
+    const uint8_t* next = reinterpret_cast<const uint8_t*>(data);
+    size_t available = len;
+
+    for (;;) {
+        uint8_t* out = reinterpret_cast<uint8_t*>(&_buffer[0]);
+        size_t space = _buffer.size();
+        BrotliDecoderResult result = BrotliDecoderDecompressStream(_brotli, &available, &next, &space, &out, 0);
+        if (result == BROTLI_DECODER_RESULT_ERROR) {
+            return fail(std::string("Unable to decompress body: ") + BrotliDecoderErrorString(BrotliDecoderGetErrorCode(_brotli)));
+        }
+
+        std::size_t produced = _buffer.size() - space;
+        if (produced > 0 && !output(produced)) {
+            return false;
+        }
+
+        if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+            _brotliEnded = true;
+            return true;
+        }
+        if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+            return true;
+        }
+    }
+}
+#endif
+
+bool DecompressSink::write(const char* data, std::size_t len) {
+    {
+        // cpp-netlib starts delivering the body before the worker thread has seen the headers.  This
+        // is the io thread, so it gives up rather than wait forever if the headers never come.
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(_timeout > 0 ? _timeout : kDefaultTimeout);
+        while (_codec == kUnknown) {
+            if (!_known.timed_wait(lock, deadline) && _codec == kUnknown) {
+                fail("Timed out waiting for the response headers");
+                _codec = kIdentity;
+                _known.notify_all();
+            }
+        }
+    }
+
+    if (!_error.empty()) {
+        return false;
+    }
+    _encodedBytes += len;
+
+    switch (_codec) {
+        case kZlib:
+            return inflate(data, len);
+#ifdef HTTPLIB_HAVE_BROTLI
+        case kBrotli:
+            if (_brotliEnded) {
+                return true;
+            }
+            return decodeBrotli(data, len);
+#endif
+        default:
+            _decodedBytes += len;
+            return _sink.write(data, len);
+    }
+}
+
+bool DecompressSink::finish() {
+    if (!_error.empty()) {
+        return false;
+    }
+
+    if (_encodedBytes > 0) {
+        if (_codec == kZlib && !_zlibEnded) {
+            return fail("Compressed body is truncated");
+        }
+#ifdef HTTPLIB_HAVE_BROTLI
+        if (_codec == kBrotli && !_brotliEnded) {
+            return fail("Compressed body is truncated");
+        }
+#endif
+    }
+
+    return _sink.finish();
+}
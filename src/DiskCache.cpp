@@ -0,0 +1,948 @@
+//
+//  DiskCache.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "DiskCache.h"
+#include "Logging.he"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+using namespace boost::interprocess;
+
+static const char kIndexMagic[8] = { 'H', 'T', 'T', 'P', 'I', 'D', 'X', '1' };
+static const boost::uint32_t kRecordMagic = 0x31545248;       // "HRT1"
+static const boost::uint32_t kInitialSlots = 4096;            // Power of two
+static const double kMaxLoad = 0.7;                           // Share of slots used or deleted before the index is rebuilt
+static const boost::uint64_t kMinSegmentSize = 1024 * 1024;
+static const boost::uint64_t kMaxSegmentSize = 64 * 1024 * 1024;
+static const boost::uint64_t kSegmentsPerLimit = 8;           // Segments the size limit is split into
+static const double kMinLiveShare = 0.5;                      // Segments with less still in use are rewritten
+static const boost::uint64_t kRewriteBytesPerStep = 4 * 1024 * 1024;  // Copied before the lock is released
+
+enum SlotState {
+    kEmpty = 0,
+    kUsed = 1,
+    kDeleted = 2
+};
+
+struct DiskCache::IndexHeader {
+    char magic[8];
+    boost::uint32_t slotCount;     // Power of two
+    boost::uint32_t used;
+    boost::uint32_t deleted;
+    boost::uint32_t firstSegment;  // Oldest segment that may still exist
+    boost::uint32_t nextSegment;   // Id of the next new segment
+    boost::uint32_t reserved;
+};
+
+struct DiskCache::Slot {
+    boost::uint64_t hash;
+    boost::uint64_t offset;       // Of the record in its segment
+    boost::uint64_t length;       // Of the whole record, including the body when it's part of the record
+    boost::uint64_t bodyOffset;
+    boost::uint64_t bodyLength;
+    boost::uint32_t state;
+    boost::uint32_t segment;
+    boost::uint32_t bodySegment;  // The body is in an earlier record when the entry was revalidated
+    boost::uint32_t reserved;
+};
+
+// Written before the key, the serialised entry and (unless it refers to an earlier one) the body
+struct RecordHeader {
+    boost::uint32_t magic;
+    boost::uint32_t keyLength;
+    boost::uint32_t metaLength;
+    boost::uint32_t bodySegment;
+    boost::uint64_t bodyOffset;
+    boost::uint64_t bodyLength;
+};
+
+static int seekFile(std::FILE* file, boost::uint64_t offset) {
+#if defined(_WIN32)
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+static boost::uint64_t fileSize(std::FILE* file) {
+#if defined(_WIN32)
+    _fseeki64(file, 0, SEEK_END);
+    return static_cast<boost::uint64_t>(_ftelli64(file));
+#else
+    fseeko(file, 0, SEEK_END);
+    return static_cast<boost::uint64_t>(ftello(file));
+#endif
+}
+
+static void makeDirectory(const std::string& path) {
+#if defined(_WIN32)
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// FNV-1a, which unlike boost::hash is the same in every build, so the index can be reused
+static boost::uint64_t hashKey(const std::string& key) {
+    boost::uint64_t hash = 14695981039346656037ULL;
+    for (std::string::const_iterator c = key.begin(); c != key.end(); ++c) {
+        hash ^= static_cast<unsigned char>(*c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool bodyInRecord(boost::uint32_t segment, boost::uint64_t offset, boost::uint64_t length,
+                         boost::uint32_t bodySegment, boost::uint64_t bodyOffset) {
+    return bodySegment == segment && bodyOffset >= offset && bodyOffset < offset + length;
+}
+
+/* Entry serialisation */
+
+static void putU32(std::string& out, boost::uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putI64(std::string& out, boost::int64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putString(std::string& out, const std::string& value) {
+    putU32(out, static_cast<boost::uint32_t>(value.size()));
+    out += value;
+}
+
+static void putHeaders(std::string& out, const HttpStreamClient::Headers& headers) {
+    putU32(out, static_cast<boost::uint32_t>(headers.size()));
+    for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        putString(out, it->first);
+        putString(out, it->second);
+    }
+}
+
+static std::string serialize(const ResponseCache::Entry& entry) {
+    std::string meta;
+    putU32(meta, static_cast<boost::uint32_t>(entry.status));
+    putI64(meta, static_cast<boost::int64_t>(entry.responseTime));
+    putI64(meta, static_cast<boost::int64_t>(entry.expires));
+    putI64(meta, static_cast<boost::int64_t>(entry.staleWhileRevalidate));
+    putI64(meta, static_cast<boost::int64_t>(entry.staleIfError));
+    putString(meta, entry.etag);
+    putString(meta, entry.lastModified);
+    putHeaders(meta, entry.headers);
+    putHeaders(meta, entry.vary);
+    return meta;
+}
+
+// Reads serialised values, failing rather than reading past the end
+class MetaReader {
+public:
+    MetaReader(const std::string& data) : _pos(data.data()), _end(data.data() + data.size()), _ok(true) {}
+
+    bool ok() const { return _ok; }
+
+    template <class T>
+    T read() {
+        T value = T();
+        if (static_cast<std::size_t>(_end - _pos) < sizeof(T)) {
+            _ok = false;
+        } else {
+            std::memcpy(&value, _pos, sizeof(T));
+            _pos += sizeof(T);
+        }
+        return value;
+    }
+
+    std::string readString() {
+        boost::uint32_t length = read<boost::uint32_t>();
+        if (!_ok || static_cast<std::size_t>(_end - _pos) < length) {
+            _ok = false;
+            return std::string();
+        }
+        std::string value(_pos, length);
+        _pos += length;
+        return value;
+    }
+
+    void readHeaders(HttpStreamClient::Headers& headers) {
+        boost::uint32_t count = read<boost::uint32_t>();
+        for (boost::uint32_t i = 0; i < count && _ok; ++i) {
+            std::string name = readString();
+            std::string value = readString();
+            headers.push_back(std::make_pair(name, value));
+        }
+    }
+
+private:
+    const char* _pos;
+    const char* _end;
+    bool _ok;
+};
+
+static boost::shared_ptr<ResponseCache::Entry> deserialize(const std::string& meta) {
+    boost::shared_ptr<ResponseCache::Entry> entry = boost::make_shared<ResponseCache::Entry>();
+    MetaReader reader(meta);
+    entry->status = static_cast<int>(reader.read<boost::uint32_t>());
+    entry->responseTime = static_cast<std::time_t>(reader.read<boost::int64_t>());
+    entry->expires = static_cast<std::time_t>(reader.read<boost::int64_t>());
+    entry->staleWhileRevalidate = static_cast<long>(reader.read<boost::int64_t>());
+    entry->staleIfError = static_cast<long>(reader.read<boost::int64_t>());
+    entry->etag = reader.readString();
+    entry->lastModified = reader.readString();
+    reader.readHeaders(entry->headers);
+    reader.readHeaders(entry->vary);
+    return reader.ok() ? entry : boost::shared_ptr<ResponseCache::Entry>();
+}
+
+/* Cache */
+
+DiskCache& DiskCache::instance() {
+    static DiskCache theInst;
+
+    return theInst;
+}
+
+DiskCache::DiskCache()
+    : _maxBytes(kDefaultMaxBytes), _segmentLimit(kMinSegmentSize), _header(0), _slots(0), _active(0), _generation(0),
+      _reads(0), _writes(0), _compactions(0), _stopping(false)
+{ }
+
+DiskCache::~DiskCache() {
+    close();
+}
+
+DiskCache::SegmentFile::~SegmentFile() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+std::string DiskCache::segmentPath(boost::uint32_t id) const {
+    char name[32];
+    std::sprintf(name, "/segment-%08x.dat", static_cast<unsigned int>(id));
+    return _directory + name;
+}
+
+bool DiskCache::open(const std::string& directory, boost::uint64_t maxBytes, std::string& error) {
+    close();
+    if (directory.empty()) {
+        return true;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    makeDirectory(directory);
+    _directory = directory;
+    _maxBytes = maxBytes ? maxBytes : kDefaultMaxBytes;
+    _segmentLimit = std::min(std::max(_maxBytes / kSegmentsPerLimit, kMinSegmentSize), kMaxSegmentSize);
+
+    // A second process appending to the same segments would corrupt them
+    std::string lockPath = _directory + "/lock";
+    std::FILE* lockFile = std::fopen(lockPath.c_str(), "ab");
+    if (!lockFile) {
+        error = "Unable to create " + lockPath + ": " + std::strerror(errno);
+        closeAll();
+        return false;
+    }
+    std::fclose(lockFile);
+
+    try {
+        _lock.reset(new file_lock(lockPath.c_str()));
+        if (!_lock->try_lock()) {
+            error = "Cache directory is in use by another process: " + _directory;
+            _lock.reset();
+            closeAll();
+            return false;
+        }
+    } catch (const interprocess_exception& e) {
+        error = std::string("Unable to lock cache directory: ") + e.what();
+        _lock.reset();
+        closeAll();
+        return false;
+    }
+
+    if (!openIndex(error)) {
+        closeAll();
+        return false;
+    }
+    loadSegments();
+
+    _stopping = false;
+    _compactor = boost::thread(boost::bind(&DiskCache::compact, this));
+    return true;
+}
+
+void DiskCache::close() {
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopping = true;
+        _work.notify_all();
+    }
+    if (_compactor.joinable()) {
+        _compactor.join();
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    closeAll();
+}
+
+void DiskCache::closeAll() {
+    if (_region) {
+        _region->flush();
+    }
+    _region.reset();
+    _mapping.reset();
+    _header = 0;
+    _slots = 0;
+
+    _segments.clear();  // Files still being read or written are closed when that's done
+    ++_generation;
+
+    if (_lock) {
+        _lock->unlock();
+        _lock.reset();
+    }
+    _directory.clear();
+}
+
+bool DiskCache::mapIndex(const std::string& path, std::string& error) {
+    try {
+        _mapping.reset(new file_mapping(path.c_str(), read_write));
+        _region.reset(new mapped_region(*_mapping, read_write));
+    } catch (const interprocess_exception& e) {
+        error = std::string("Unable to map cache index: ") + e.what();
+        _region.reset();
+        _mapping.reset();
+        return false;
+    }
+
+    _header = static_cast<IndexHeader*>(_region->get_address());
+    _slots = reinterpret_cast<Slot*>(_header + 1);
+    return true;
+}
+
+bool DiskCache::openIndex(std::string& error) {
+    std::string path = _directory + "/index.dat";
+
+    // Reuse the index if it's intact, otherwise start again with an empty one
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file) {
+        IndexHeader header;
+        bool valid = std::fread(&header, sizeof(header), 1, file) == 1
+            && std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) == 0
+            && header.slotCount > 0 && (header.slotCount & (header.slotCount - 1)) == 0
+            && fileSize(file) == sizeof(IndexHeader) + static_cast<boost::uint64_t>(header.slotCount) * sizeof(Slot);
+        std::fclose(file);
+
+        if (valid) {
+            return mapIndex(path, error);
+        }
+        LOG_WARNING << "Cache index is invalid, starting with an empty cache: " << path;
+    }
+
+    IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.slotCount = kInitialSlots;
+
+    std::vector<Slot> slots(kInitialSlots);
+    std::memset(&slots[0], 0, slots.size() * sizeof(Slot));
+    if (!writeIndex(path, header, slots, error)) {
+        return false;
+    }
+    return mapIndex(path, error);
+}
+
+// Write an index file holding slots, which must be a power of two in number
+bool DiskCache::writeIndex(const std::string& path, const IndexHeader& header, const std::vector<Slot>& slots, std::string& error) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "Unable to create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(&slots[0], sizeof(Slot), slots.size(), file) == slots.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written) {
+        error = "Unable to write " + path;
+    }
+    return written;
+}
+
+// Rebuild the index without its deleted slots, doubling it unless most of the load was deleted slots
+void DiskCache::growIndex() {
+    boost::uint32_t count = _header->slotCount;
+    if (_header->used >= _header->deleted) {
+        count *= 2;
+    }
+
+    std::vector<Slot> slots(count);
+    std::memset(&slots[0], 0, slots.size() * sizeof(Slot));
+    for (boost::uint32_t i = 0; i < _header->slotCount; ++i) {
+        if (_slots[i].state != kUsed)
+            continue;
+        boost::uint32_t pos = static_cast<boost::uint32_t>(_slots[i].hash) & (count - 1);
+        while (slots[pos].state == kUsed) {
+            pos = (pos + 1) & (count - 1);
+        }
+        slots[pos] = _slots[i];
+    }
+
+    IndexHeader header = *_header;
+    header.slotCount = count;
+    header.deleted = 0;
+
+    std::string path = _directory + "/index.dat";
+    std::string newPath = _directory + "/index.new";
+    std::string error;
+    if (!writeIndex(newPath, header, slots, error)) {
+        LOG_ERROR << "Unable to rebuild cache index: " << error;
+        std::remove(newPath.c_str());
+        return;
+    }
+
+    // The old index is unmapped before it's replaced (rename doesn't replace files on Windows)
+    _region.reset();
+    _mapping.reset();
+    std::remove(path.c_str());
+    if (std::rename(newPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Unable to replace cache index: " << std::strerror(errno);
+    }
+    if (!mapIndex(path, error)) {
+        LOG_ERROR << error;
+        closeAll();  // The disk cache stops being used
+    }
+}
+
+DiskCache::Slot* DiskCache::findSlot(boost::uint64_t hash, bool insert) {
+    boost::uint32_t mask = _header->slotCount - 1;
+    boost::uint32_t pos = static_cast<boost::uint32_t>(hash) & mask;
+    Slot* deleted = 0;
+
+    for (boost::uint32_t n = 0; n < _header->slotCount; ++n, pos = (pos + 1) & mask) {
+        Slot& slot = _slots[pos];
+        if (slot.state == kEmpty) {
+            return insert ? (deleted ? deleted : &slot) : 0;
+        }
+        if (slot.state == kDeleted) {
+            if (!deleted)
+                deleted = &slot;
+        } else if (slot.hash == hash) {
+            return &slot;
+        }
+    }
+    return insert ? deleted : 0;
+}
+
+// Size up the existing segments, dropping index entries whose records have gone
+void DiskCache::loadSegments() {
+    for (boost::uint32_t id = _header->firstSegment; id != _header->nextSegment; ++id) {
+        std::FILE* file = std::fopen(segmentPath(id).c_str(), "rb");
+        if (file) {
+            _segments[id].size = fileSize(file);
+            std::fclose(file);
+        }
+    }
+
+    for (boost::uint32_t i = 0; i < _header->slotCount; ++i) {
+        Slot& slot = _slots[i];
+        if (slot.state != kUsed)
+            continue;
+
+        std::map<boost::uint32_t, Segment>::iterator record = _segments.find(slot.segment);
+        std::map<boost::uint32_t, Segment>::iterator body = _segments.find(slot.bodySegment);
+        if (record == _segments.end() || body == _segments.end()
+            || slot.offset + slot.length > record->second.size
+            || slot.bodyOffset + slot.bodyLength > body->second.size) {
+            slot.state = kDeleted;
+            --_header->used;
+            ++_header->deleted;
+            continue;
+        }
+
+        record->second.live += slot.length;
+        if (!bodyInRecord(slot.segment, slot.offset, slot.length, slot.bodySegment, slot.bodyOffset))
+            body->second.live += slot.bodyLength;
+    }
+
+    // Carry on appending to the newest segment unless it's full
+    if (_segments.empty() || _segments.rbegin()->second.size >= _segmentLimit) {
+        _active = _header->nextSegment++;
+        _segments[_active];
+    } else {
+        _active = _segments.rbegin()->first;
+    }
+    _header->firstSegment = _segments.begin()->first;
+}
+
+DiskCache::Segment* DiskCache::segment(boost::uint32_t id) {
+    std::map<boost::uint32_t, Segment>::iterator it = _segments.find(id);
+    if (it == _segments.end()) {
+        return 0;
+    }
+
+    Segment& segment = it->second;
+    if (!segment.file) {
+        std::string path = segmentPath(id);
+        std::FILE* file = std::fopen(path.c_str(), "r+b");
+        if (!file && segment.size == 0) {
+            file = std::fopen(path.c_str(), "w+b");  // New segment
+        }
+        if (!file) {
+            LOG_ERROR << "Unable to open " << path << ": " << std::strerror(errno);
+            return 0;
+        }
+        segment.file = boost::make_shared<SegmentFile>();
+        segment.file->file = file;
+    }
+    return &segment;
+}
+
+// The files holding a slot's record and body, if the slot is within them
+bool DiskCache::locate(const Slot& slot, SegmentFilePtr& record, SegmentFilePtr& body) {
+    Segment* recordSegment = segment(slot.segment);
+    Segment* bodySegment = segment(slot.bodySegment);
+    if (!recordSegment || !bodySegment || slot.offset + slot.length > recordSegment->size
+        || slot.bodyOffset + slot.bodyLength > bodySegment->size) {
+        return false;
+    }
+
+    record = recordSegment->file;
+    body = bodySegment->file;
+    return true;
+}
+
+// Whether a record written without the lock can still go in the index: the cache hasn't been closed
+// since, and the segments it's in haven't been compacted away
+bool DiskCache::current(const Slot& written, boost::uint64_t generation) const {
+    return _header && generation == _generation
+        && _segments.count(written.segment) && _segments.count(written.bodySegment);
+}
+
+// Append a record for entry to the active segment, describing where it was written in slot.  With
+// bodyFrom the record refers to that slot's body rather than writing it again.  Space is taken at
+// the end of the segment under the lock and the record is written after it's released; the caller
+// points the index at the record.
+bool DiskCache::append(const std::string& key, const ResponseCache::Entry& entry, const Slot* bodyFrom,
+                       boost::uint64_t generation, Slot& slot) {
+    std::string meta = serialize(entry);
+    RecordHeader header;
+    header.magic = kRecordMagic;
+    header.keyLength = static_cast<boost::uint32_t>(key.size());
+    header.metaLength = static_cast<boost::uint32_t>(meta.size());
+
+    boost::uint64_t length = sizeof(header) + key.size() + meta.size() + (bodyFrom ? 0 : entry.body->size());
+    boost::uint32_t id;
+    boost::uint64_t offset;
+    SegmentFilePtr file;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!_header || generation != _generation) {
+            return false;
+        }
+        if (_segments[_active].size >= _segmentLimit) {
+            _active = _header->nextSegment++;
+            _segments[_active];
+        }
+
+        id = _active;
+        Segment* active = segment(id);
+        if (!active) {
+            return false;
+        }
+        file = active->file;
+        offset = active->size;
+        active->size += length;
+        ++active->writers;
+    }
+
+    if (bodyFrom) {
+        header.bodySegment = bodyFrom->bodySegment;
+        header.bodyOffset = bodyFrom->bodyOffset;
+        header.bodyLength = bodyFrom->bodyLength;
+    } else {
+        header.bodySegment = id;
+        header.bodyOffset = offset + length - entry.body->size();
+        header.bodyLength = entry.body->size();
+    }
+
+    bool written;
+    {
+        boost::mutex::scoped_lock lock(file->mutex);
+        written = seekFile(file->file, offset) == 0
+            && std::fwrite(&header, sizeof(header), 1, file->file) == 1
+            && std::fwrite(key.data(), 1, key.size(), file->file) == key.size()
+            && std::fwrite(meta.data(), 1, meta.size(), file->file) == meta.size()
+            && (bodyFrom || entry.body->empty() || std::fwrite(entry.body->data(), 1, entry.body->size(), file->file) == entry.body->size())
+            && std::fflush(file->file) == 0;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    std::map<boost::uint32_t, Segment>::iterator active = _segments.find(id);
+    if (generation == _generation && active != _segments.end()) {
+        // A failed write is left to be overwritten by the next record, if nothing has been written after it
+        if (!written && active->second.size == offset + length) {
+            active->second.size = offset;
+        }
+        if (--active->second.writers == 0) {
+            _work.notify_all();  // It can be compacted now
+        }
+    }
+    if (!written) {
+        LOG_ERROR << "Unable to write to " << segmentPath(id) << ": " << std::strerror(errno);
+        return false;
+    }
+
+    std::memset(&slot, 0, sizeof(slot));
+    slot.hash = hashKey(key);
+    slot.state = kUsed;
+    slot.segment = id;
+    slot.offset = offset;
+    slot.length = length;
+    slot.bodySegment = header.bodySegment;
+    slot.bodyOffset = header.bodyOffset;
+    slot.bodyLength = header.bodyLength;
+
+    ++_writes;
+    return true;
+}
+
+// Read the key of the record a slot points at, and the entry too unless it's null.  Returns false if
+// the record is damaged.
+bool DiskCache::readRecord(const Slot& slot, const SegmentFilePtr& record, const SegmentFilePtr& body,
+                           std::string& key, boost::shared_ptr<ResponseCache::Entry>* entry) {
+    RecordHeader header;
+    std::string meta;
+    {
+        boost::mutex::scoped_lock lock(record->mutex);
+        if (seekFile(record->file, slot.offset) != 0 || std::fread(&header, sizeof(header), 1, record->file) != 1
+            || header.magic != kRecordMagic
+            || sizeof(header) + header.keyLength + header.metaLength > slot.length) {
+            return false;
+        }
+
+        key.resize(header.keyLength);
+        if (header.keyLength && std::fread(&key[0], 1, key.size(), record->file) != key.size()) {
+            return false;
+        }
+        if (!entry) {
+            return true;
+        }
+
+        meta.resize(header.metaLength);
+        if (header.metaLength && std::fread(&meta[0], 1, meta.size(), record->file) != meta.size()) {
+            return false;
+        }
+    }
+    *entry = deserialize(meta);
+    if (!*entry) {
+        return false;
+    }
+
+    boost::shared_ptr<std::string> data = boost::make_shared<std::string>(static_cast<std::size_t>(slot.bodyLength), '\0');
+    if (slot.bodyLength) {
+        boost::mutex::scoped_lock lock(body->mutex);
+        if (seekFile(body->file, slot.bodyOffset) != 0 || std::fread(&(*data)[0], 1, data->size(), body->file) != data->size()) {
+            return false;
+        }
+    }
+    (*entry)->body = data;
+    return true;
+}
+
+// Point slot at a record that was just written, accounting for the bytes it takes from the one it replaces
+void DiskCache::update(Slot* slot, const Slot& written) {
+    _segments[written.segment].live += written.length;
+    if (!bodyInRecord(written.segment, written.offset, written.length, written.bodySegment, written.bodyOffset))
+        _segments[written.bodySegment].live += written.bodyLength;
+
+    if (slot->state == kUsed) {
+        release(*slot);
+    } else {
+        ++_header->used;
+        if (slot->state == kDeleted)
+            --_header->deleted;
+    }
+    *slot = written;
+}
+
+void DiskCache::release(const Slot& slot) {
+    std::map<boost::uint32_t, Segment>::iterator record = _segments.find(slot.segment);
+    if (record != _segments.end())
+        record->second.live -= std::min(record->second.live, slot.length);
+
+    if (!bodyInRecord(slot.segment, slot.offset, slot.length, slot.bodySegment, slot.bodyOffset)) {
+        std::map<boost::uint32_t, Segment>::iterator body = _segments.find(slot.bodySegment);
+        if (body != _segments.end())
+            body->second.live -= std::min(body->second.live, slot.bodyLength);
+    }
+}
+
+void DiskCache::erase(Slot* slot) {
+    release(*slot);
+    slot->state = kDeleted;
+    --_header->used;
+    ++_header->deleted;
+}
+
+ResponseCache::EntryPtr DiskCache::load(const std::string& key) {
+    boost::uint64_t hash = hashKey(key);
+    boost::uint64_t generation;
+    Slot found;
+    SegmentFilePtr record, body;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!_header) {
+            return ResponseCache::EntryPtr();
+        }
+
+        Slot* slot = findSlot(hash, false);
+        if (!slot) {
+            return ResponseCache::EntryPtr();
+        }
+        if (!locate(*slot, record, body)) {
+            erase(slot);  // Its segment has gone
+            return ResponseCache::EntryPtr();
+        }
+        found = *slot;
+        generation = _generation;
+    }
+
+    // Read without holding up the rest of the cache
+    std::string storedKey;
+    boost::shared_ptr<ResponseCache::Entry> entry;
+    bool valid = readRecord(found, record, body, storedKey, &entry) && storedKey == key;
+
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!_header || generation != _generation) {
+        return ResponseCache::EntryPtr();
+    }
+    if (!valid) {
+        // Damaged, or another key with the same hash, unless it has been replaced meanwhile
+        Slot* slot = findSlot(hash, false);
+        if (slot && std::memcmp(slot, &found, sizeof(found)) == 0) {
+            erase(slot);
+        }
+        return ResponseCache::EntryPtr();
+    }
+
+    ++_reads;
+    return entry;
+}
+
+void DiskCache::storeEntry(const std::string& key, const ResponseCache::EntryPtr& entry, bool sameBody) {
+    if (!entry->body) {
+        return;
+    }
+
+    boost::uint64_t hash = hashKey(key);
+    boost::uint64_t generation;
+    Slot existing;
+    SegmentFilePtr record, body;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!_header) {
+            return;
+        }
+        generation = _generation;
+
+        if (entry->body->size() > _segmentLimit) {
+            // Too large to keep on disk, and the previous body is out of date
+            Slot* slot = findSlot(hash, false);
+            if (slot)
+                erase(slot);
+            return;
+        }
+
+        if (_header->used + _header->deleted + 1 > _header->slotCount * kMaxLoad) {
+            growIndex();
+            if (!_header)
+                return;
+        }
+
+        Slot* slot = sameBody ? findSlot(hash, false) : 0;
+        if (slot && locate(*slot, record, body)) {
+            existing = *slot;
+        }
+    }
+
+    // A revalidated entry refers to the body it already has, if it's really the same key's
+    const Slot* bodyFrom = 0;
+    std::string storedKey;
+    if (record && readRecord(existing, record, body, storedKey, 0) && storedKey == key) {
+        bodyFrom = &existing;
+    }
+
+    Slot written;
+    if (!append(key, *entry, bodyFrom, generation, written)) {
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    Slot* slot = current(written, generation) ? findSlot(hash, true) : 0;
+    if (slot) {
+        update(slot, written);
+        _work.notify_all();
+    }
+}
+
+void DiskCache::store(const std::string& key, const ResponseCache::EntryPtr& entry) {
+    storeEntry(key, entry, false);
+}
+
+void DiskCache::refresh(const std::string& key, const ResponseCache::EntryPtr& entry) {
+    storeEntry(key, entry, true);
+}
+
+void DiskCache::remove(const std::string& key) {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!_header) {
+        return;
+    }
+
+    Slot* slot = findSlot(hashKey(key), false);
+    if (slot) {
+        erase(slot);
+    }
+}
+
+DiskCache::Stats DiskCache::stats() const {
+    boost::mutex::scoped_lock lock(_mutex);
+
+    Stats stats;
+    stats.reads = _reads;
+    stats.writes = _writes;
+    stats.compactions = _compactions;
+    stats.maxBytes = _header ? _maxBytes : 0;
+    stats.entries = _header ? _header->used : 0;
+    for (std::map<boost::uint32_t, Segment>::const_iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        stats.bytes += it->second.size;
+    }
+    return stats;
+}
+
+/* Compaction */
+
+void DiskCache::compact() {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while (!_stopping) {
+        if (!_header || !compactStep(lock)) {
+            _work.wait(lock);
+            continue;
+        }
+
+        // Let requests at the cache between steps
+        lock.unlock();
+        boost::this_thread::yield();
+        lock.lock();
+    }
+}
+
+// Drop the oldest segment while the cache is over its size limit, otherwise rewrite the live
+// records of a segment that's mostly replaced ones.  Called with the lock held, which is released
+// while records are copied.  Returns false when there's nothing to do.
+bool DiskCache::compactStep(boost::unique_lock<boost::mutex>& lock) {
+    boost::uint64_t total = 0;
+    for (std::map<boost::uint32_t, Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        total += it->second.size;
+    }
+
+    // Segments with records still being written are left until they're done
+    boost::uint32_t victim = _active;
+    bool drop = false;
+    if (total > _maxBytes && _segments.size() > 1) {
+        if (_segments.begin()->second.writers == 0) {
+            victim = _segments.begin()->first;
+            drop = true;
+        }
+    } else {
+        for (std::map<boost::uint32_t, Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+            if (it->first != _active && it->second.writers == 0 && it->second.live < it->second.size * kMinLiveShare) {
+                victim = it->first;
+                break;
+            }
+        }
+    }
+    if (victim == _active) {
+        return false;
+    }
+
+    // Records still in the segment, a step's worth at a time
+    std::vector<Slot> moving;
+    boost::uint64_t copied = 0;
+    for (boost::uint32_t i = 0; i < _header->slotCount && copied < kRewriteBytesPerStep; ++i) {
+        Slot* slot = &_slots[i];
+        if (slot->state != kUsed || (slot->segment != victim && slot->bodySegment != victim))
+            continue;
+
+        if (drop) {
+            erase(slot);
+        } else {
+            moving.push_back(*slot);
+            copied += slot->length + slot->bodyLength;
+        }
+    }
+
+    if (!moving.empty()) {
+        // Copied to the active segment without the lock.  The index is swapped over to the copy unless
+        // the entry has been replaced or removed meanwhile, in which case the copy is left unused.
+        boost::uint64_t generation = _generation;
+        for (std::vector<Slot>::iterator it = moving.begin(); it != moving.end(); ++it) {
+            SegmentFilePtr record, body;
+            bool readable = locate(*it, record, body);
+
+            lock.unlock();
+            std::string key;
+            boost::shared_ptr<ResponseCache::Entry> entry;
+            Slot written;
+            bool moved = readable && readRecord(*it, record, body, key, &entry) && append(key, *entry, 0, generation, written);
+            record.reset();
+            body.reset();
+            lock.lock();
+
+            if (_stopping || !_header || generation != _generation) {
+                return true;
+            }
+            Slot* slot = findSlot(it->hash, false);
+            if (!slot || std::memcmp(slot, &*it, sizeof(Slot)) != 0) {
+                continue;
+            }
+            if (moved && current(written, generation)) {
+                update(slot, written);
+            } else if (!moved) {
+                erase(slot);
+            }
+        }
+        return true;  // Checked for anything left in the next step
+    }
+
+    // Nothing refers to the segment any more.  If it's still being read, it's removed in a later step.
+    Segment& segment = _segments[victim];
+    if (segment.file && !segment.file.unique()) {
+        return true;
+    }
+    segment.file.reset();
+    std::remove(segmentPath(victim).c_str());
+    _segments.erase(victim);
+    _header->firstSegment = _segments.empty() ? _header->nextSegment : _segments.begin()->first;
+    ++_compactions;
+    return true;
+}
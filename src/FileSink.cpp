@@ -0,0 +1,165 @@
+//
+//  FileSink.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "FileSink.h"
+#include "Logging.he"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const std::size_t kBufferSize = 1024 * 1024;  // Writes are made in blocks of this size
+
+bool preallocateFile(std::FILE* file, boost::uint64_t length, std::string& error) {
+#if defined(__linux__)
+    int err = posix_fallocate(fileno(file), 0, static_cast<off_t>(length));
+    if (err != 0) {
+        error = strerror(err);
+        return false;
+    }
+#elif defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(length), 0 };
+    if (fcntl(fileno(file), F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fileno(file), F_PREALLOCATE, &store) == -1) {
+            error = strerror(errno);
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+FileSink::FileSink(const std::string& path)
+    : _path(path), _partPath(path + ".part"), _file(0), _buffer(kBufferSize), _used(0), _bytes(0),
+      _expected(0), _haveExpected(false)
+{
+    _file = fopen(_partPath.c_str(), "wb");
+    if (!_file) {
+        fail("Unable to open " + _partPath + ": " + strerror(errno));
+        return;
+    }
+
+    // The sink does its own buffering
+    setvbuf(_file, 0, _IONBF, 0);
+}
+
+FileSink::~FileSink() {
+    if (_file) {
+        // Never finished, don't leave the partial file behind
+        fclose(_file);
+        remove(_partPath.c_str());
+    }
+}
+
+bool FileSink::fail(const std::string& message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+void FileSink::expectLength(boost::uint64_t length) {
+    {
+        boost::unique_lock<boost::mutex> lock(_lengthMutex);
+        _expected = length;
+        _haveExpected = true;
+    }
+
+    if (!_file || length == 0) {
+        return;
+    }
+
+    // Reserve the space so the file isn't extended (and fragmented) a block at a time
+    std::string error;
+    if (!preallocateFile(_file, length, error)) {
+        LOG_DEBUG << "Unable to preallocate " << _partPath << ": " << error;
+    }
+}
+
+bool FileSink::flush() {
+    if (_used == 0) {
+        return true;
+    }
+
+    if (fwrite(&_buffer[0], 1, _used, _file) != _used) {
+        return fail("Unable to write " + _partPath + ": " + strerror(errno));
+    }
+    _used = 0;
+
+    return true;
+}
+
+bool FileSink::write(const char* data, std::size_t len) {
+    if (!_file || !_error.empty()) {
+        return false;
+    }
+    _bytes += len;
+
+    // Fill the buffer, writing whole blocks as it fills up
+    while (len > 0) {
+        if (_used == 0 && len >= _buffer.size()) {
+            // Write whole blocks directly rather than copying them through the buffer
+            std::size_t direct = len - (len % _buffer.size());
+            if (fwrite(data, 1, direct, _file) != direct) {
+                return fail("Unable to write " + _partPath + ": " + strerror(errno));
+            }
+            data += direct;
+            len -= direct;
+            continue;
+        }
+
+        std::size_t count = std::min(len, _buffer.size() - _used);
+        memcpy(&_buffer[_used], data, count);
+        _used += count;
+        data += count;
+        len -= count;
+
+        if (_used == _buffer.size() && !flush()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FileSink::finish() {
+    if (!_file) {
+        return false;
+    }
+
+    bool ok = flush();
+    if (fclose(_file) != 0) {
+        ok = fail("Unable to close " + _partPath + ": " + strerror(errno));
+    }
+    _file = 0;
+
+    {
+        boost::unique_lock<boost::mutex> lock(_lengthMutex);
+        if (ok && _haveExpected && _bytes != _expected) {
+            ok = fail("Body is shorter or longer than its Content-Length");
+        }
+    }
+
+    // Replace any existing file (rename doesn't on Windows)
+    if (ok) {
+        remove(_path.c_str());
+        if (rename(_partPath.c_str(), _path.c_str()) != 0) {
+            ok = fail("Unable to rename " + _partPath + ": " + strerror(errno));
+        }
+    }
+
+    if (!ok) {
+        remove(_partPath.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,171 @@
+//
+//  FileSource.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "FileSource.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#elif defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+static const boost::int64_t kWindowSize = 16 * 1024 * 1024;  // Size of each mapped window of the file
+static const boost::int64_t kMaxSendFile = 1024 * 1024 * 1024;  // Largest single sendfile call
+
+FileSource::FileSource(const std::string& path) : _path(path), _fd(-1), _length(0), _offset(0)
+{
+#if defined(_WIN32)
+    _fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+    struct _stati64 info;
+    if (_fd < 0 || _fstati64(_fd, &info) != 0) {
+        fail("Unable to open " + path + ": " + strerror(errno));
+        return;
+    }
+#else
+    _fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (_fd < 0 || fstat(_fd, &info) != 0) {
+        fail("Unable to open " + path + ": " + strerror(errno));
+        return;
+    }
+#endif
+    _length = info.st_size;
+
+    if (_length > 0) {
+        try {
+            _mapping.reset(new boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only));
+        } catch (const boost::interprocess::interprocess_exception& e) {
+            fail("Unable to map " + path + ": " + e.what());
+        }
+    }
+}
+
+FileSource::~FileSource() {
+    if (_fd >= 0) {
+#if defined(_WIN32)
+        _close(_fd);
+#else
+        close(_fd);
+#endif
+    }
+}
+
+bool FileSource::fail(const std::string& message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+// Map the next window of the file
+bool FileSource::next(const char*& data, std::size_t& len) {
+    if (!_error.empty()) {
+        return false;
+    }
+
+    _region.reset();  // The previous window has been sent
+    if (_offset >= _length) {
+        data = 0;
+        len = 0;
+        return true;
+    }
+
+    std::size_t size = static_cast<std::size_t>(std::min(kWindowSize, _length - _offset));
+    try {
+        _region.reset(new boost::interprocess::mapped_region(*_mapping, boost::interprocess::read_only, _offset, size));
+        _region->advise(boost::interprocess::mapped_region::advice_sequential);
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        return fail("Unable to map " + _path + ": " + e.what());
+    }
+
+    data = static_cast<const char*>(_region->get_address());
+    len = size;
+    _offset += size;
+
+    return true;
+}
+
+bool FileSource::rewind() {
+    _region.reset();
+    _offset = 0;
+    return _error.empty();
+}
+
+bool FileSource::canSendFile() const {
+#if defined(__linux__) || defined(__APPLE__)
+    return _error.empty();
+#else
+    return false;
+#endif
+}
+
+// Send the rest of the file to a plain socket without copying it through user space
+bool FileSource::sendFile(int socket) {
+#if defined(__linux__)
+    // sendfile raises SIGPIPE if the connection is closed, so block it on this thread while sending
+    sigset_t pipe, previous;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, &previous);
+
+    off_t offset = static_cast<off_t>(_offset);
+    bool sent = true;
+    while (sent && offset < _length) {
+        ssize_t len = ::sendfile(socket, _fd, &offset, static_cast<std::size_t>(std::min(kMaxSendFile, _length - offset)));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            sent = fail("Unable to send " + _path + ": " + (len < 0 ? strerror(errno) : "file is shorter than expected"));
+        }
+    }
+    _offset = offset;
+
+    if (!sigismember(&previous, SIGPIPE)) {
+        struct timespec poll = { 0, 0 };
+        while (sigtimedwait(&pipe, 0, &poll) == SIGPIPE) {}  // Discard a SIGPIPE raised while blocked
+        pthread_sigmask(SIG_SETMASK, &previous, 0);
+    }
+    return sent;
+#elif defined(__APPLE__)
+    int noSigPipe = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+
+    while (_offset < _length) {
+        off_t sent = static_cast<off_t>(std::min(kMaxSendFile, _length - _offset));
+        int ret = ::sendfile(_fd, socket, static_cast<off_t>(_offset), &sent, 0, 0);
+        _offset += sent;  // Set even when interrupted part way through
+        if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+            return fail("Unable to send " + _path + ": " + strerror(errno));
+        }
+        if (ret == 0 && sent == 0) {
+            return fail("Unable to send " + _path + ": file is shorter than expected");
+        }
+    }
+    return true;
+#else
+    return fail("sendfile isn't available");
+#endif
+}
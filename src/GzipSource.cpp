@@ -0,0 +1,161 @@
+//
+//  GzipSource.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "GzipSource.h"
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+
+static const std::size_t kBlockSize = 256 * 1024;  // Compressed data is sent in blocks of this size
+static const std::size_t kMaxBlocks = 4;           // Blocks compressed ahead of the socket
+
+GzipSource::GzipSource(const boost::shared_ptr<BodySource>& source, int level)
+    : _source(source), _level(level), _started(false), _done(false), _stopped(false), _inputBytes(0), _outputBytes(0)
+{
+    if (_level < 1 || _level > 9) {
+        _level = Z_DEFAULT_COMPRESSION;
+    }
+}
+
+GzipSource::~GzipSource() {
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopped = true;
+        _changed.notify_all();
+    }
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+std::string GzipSource::error() const {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _error;
+}
+
+boost::uint64_t GzipSource::inputBytes() const {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _inputBytes;
+}
+
+boost::uint64_t GzipSource::outputBytes() const {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _outputBytes;
+}
+
+bool GzipSource::next(const char*& data, std::size_t& len) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    if (!_started) {
+        // Compression starts with the first request for data, once the connection is ready for it
+        _started = true;
+        _thread = boost::thread(boost::bind(&GzipSource::compress, this));
+    }
+
+    while (_ready.empty() && !_done) {
+        _changed.wait(lock);
+    }
+
+    if (!_ready.empty()) {
+        _sending.swap(_ready.front());
+        _ready.pop_front();
+        _changed.notify_all();
+
+        data = &_sending[0];
+        len = _sending.size();
+        return true;
+    }
+
+    data = 0;
+    len = 0;
+    return _error.empty();
+}
+
+// Queue a full block for sending, waiting while too many are queued.  Returns false if the source
+// has been destroyed.
+bool GzipSource::push(std::vector<char>& block) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while (_ready.size() >= kMaxBlocks && !_stopped) {
+        _changed.wait(lock);
+    }
+    if (_stopped) {
+        return false;
+    }
+
+    _outputBytes += block.size();
+    _ready.push_back(std::vector<char>());
+    _ready.back().swap(block);
+    _changed.notify_all();
+    return true;
+}
+
+void GzipSource::finish(const std::string& error) {
+    boost::mutex::scoped_lock lock(_mutex);
+    _error = error;
+    _done = true;
+    _changed.notify_all();
+}
+
+// Thread body: compress the source a block at a time
+void GzipSource::compress() {
+    z_stream zlib;
+    zlib.zalloc = Z_NULL;
+    zlib.zfree = Z_NULL;
+    zlib.opaque = Z_NULL;
+    if (deflateInit2(&zlib, _level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        finish("Unable to start gzip compression");
+        return;
+    }
+
+    std::vector<char> block(kBlockSize);
+    std::size_t used = 0;
+    std::string error;
+    bool ended = false;
+
+    while (!ended && error.empty()) {
+        const char* data;
+        std::size_t len;
+        if (!_source->next(data, len)) {
+            error = _source->error();
+            break;
+        }
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _inputBytes += len;
+        }
+
+        int flush = (len == 0) ? Z_FINISH : Z_NO_FLUSH;
+        zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zlib.avail_in = static_cast<uInt>(len);
+
+        // Deflate the piece, sending each block as it fills
+        do {
+            zlib.next_out = reinterpret_cast<Bytef*>(&block[used]);
+            zlib.avail_out = static_cast<uInt>(kBlockSize - used);
+            int ret = deflate(&zlib, flush);
+            if (ret == Z_STREAM_ERROR) {
+                error = "Unable to compress body";
+                break;
+            }
+            used = kBlockSize - zlib.avail_out;
+            ended = (ret == Z_STREAM_END);
+
+            if (used == kBlockSize || (ended && used > 0)) {
+                block.resize(used);
+                if (!push(block)) {
+                    error = "Compression stopped";
+                    break;
+                }
+                block.resize(kBlockSize);
+                used = 0;
+            }
+        } while (zlib.avail_in > 0 || (flush == Z_FINISH && !ended));
+    }
+
+    deflateEnd(&zlib);
+    finish(error);
+}
@@ -41,6 +41,8 @@
 #include "Logging.he"
 #include "Static.he"
 #include "NVObjHTTPWorker.he"
+#include "ListPool.h"
+#include "Logger.h"
 
 using OmnisTools::tThreadData;
 
@@ -177,6 +179,12 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		// For most components this can be removed - see other BLYTH component examples
 		case ECM_CONNECT:
 		{            
+            // Start the log writer first, so it's the last thing stopped
+            Logger::instance();
+            
+            // Allocate lists for background workers up front (this is the main thread)
+            ListPool::instance().replenish();
+            
             // Return external flags. Loaded & Has Non-Visual Objects
             return EXT_FLAG_LOADED|EXT_FLAG_REMAINLOADED|EXT_FLAG_ALWAYS_USABLE|EXT_FLAG_NVOBJECTS; 
 		} 
@@ -188,6 +196,8 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		// For most components this can be removed - see other BLYTH component examples
 		case ECM_DISCONNECT:
 		{ 
+            ListPool::instance().drain();
+            Logger::instance().flush();
             return qtrue;
 		}
 			
@@ -0,0 +1,923 @@
+//
+//  HttpStreamClient.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "HttpStreamClient.h"
+#include "RequestTimings.h"
+#include "Metrics.h"
+#include "Tracer.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/array.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/version.hpp>
+
+#if defined(__linux__)
+#include <cstddef>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
+using boost::asio::ip::tcp;
+
+static const std::size_t kReadSize = 64 * 1024;  // Most read from the socket at a time
+static const int kMaxRedirects = 5;              // As BOOST_NETWORK_HTTP_MAXIMUM_REDIRECT_COUNT in cpp-netlib
+
+namespace {
+
+    struct Url {
+        Url() : secure(false) {}
+
+        bool secure;
+        std::string host;       // Without the brackets of an IPv6 address
+        std::string port;
+        std::string authority;  // Host header
+        std::string target;     // Path and query
+    };
+
+    Url parseUrl(const std::string& url) {
+        Url parsed;
+        std::string::size_type schemeEnd = url.find("://");
+        std::string scheme = boost::to_lower_copy(url.substr(0, schemeEnd));
+        if (schemeEnd == std::string::npos || (scheme != "http" && scheme != "https")) {
+            throw std::runtime_error("Unsupported URL: " + url);
+        }
+        parsed.secure = (scheme == "https");
+
+        std::string::size_type start = schemeEnd + 3;
+        std::string::size_type end = url.find_first_of("/?#", start);
+        parsed.authority = url.substr(start, (end == std::string::npos) ? end : end - start);
+        std::string::size_type at = parsed.authority.rfind('@');
+        if (at != std::string::npos) {
+            parsed.authority.erase(0, at + 1);  // Credentials aren't sent
+        }
+
+        const std::string& authority = parsed.authority;
+        std::string::size_type portStart = std::string::npos;
+        if (!authority.empty() && authority[0] == '[') {
+            std::string::size_type close = authority.find(']');
+            if (close == std::string::npos) {
+                throw std::runtime_error("Invalid URL: " + url);
+            }
+            parsed.host = authority.substr(1, close - 1);
+            if (close + 1 < authority.size() && authority[close + 1] == ':') {
+                portStart = close + 2;
+            }
+        } else {
+            std::string::size_type colon = authority.rfind(':');
+            parsed.host = authority.substr(0, colon);
+            if (colon != std::string::npos) {
+                portStart = colon + 1;
+            }
+        }
+        if (portStart != std::string::npos) {
+            parsed.port = authority.substr(portStart);
+        }
+        if (parsed.host.empty()) {
+            throw std::runtime_error("Invalid URL: " + url);
+        }
+        if (parsed.port.empty()) {
+            parsed.port = parsed.secure ? "443" : "80";
+        }
+
+        if (end != std::string::npos) {
+            std::string::size_type fragment = url.find('#', end);
+            parsed.target = url.substr(end, (fragment == std::string::npos) ? fragment : fragment - end);
+        }
+        if (parsed.target.empty() || parsed.target[0] != '/') {
+            parsed.target.insert(0, "/");
+        }
+
+        return parsed;
+    }
+
+    // The Location of a redirect as an absolute URL (RFC 3986 5.2, without removing dot segments)
+    std::string resolveLocation(const Url& base, const std::string& location) {
+        std::string::size_type colon = location.find(':');
+        if (colon != std::string::npos && colon < location.find_first_of("/?#")) {
+            return location;
+        }
+
+        std::string scheme = base.secure ? "https:" : "http:";
+        if (boost::starts_with(location, "//")) {
+            return scheme + location;
+        }
+
+        std::string origin = scheme + "//" + base.authority;
+        if (boost::starts_with(location, "/")) {
+            return origin + location;
+        }
+        std::string path = base.target.substr(0, base.target.find('?'));
+        if (boost::starts_with(location, "?")) {
+            return origin + path + location;
+        }
+        return origin + path.substr(0, path.rfind('/') + 1) + location;
+    }
+
+    void removeHeader(HttpStreamClient::Headers& headers, const std::string& name) {
+        for (HttpStreamClient::Headers::iterator it = headers.begin(); it != headers.end(); ) {
+            if (boost::iequals(it->first, name))
+                it = headers.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Location of a response that is a redirect to follow, or empty if it isn't one
+    std::string redirectLocation(const HttpStreamClient::Response& response) {
+        if (response.status != 301 && response.status != 302 && response.status != 303
+            && response.status != 307 && response.status != 308) {
+            return std::string();
+        }
+        for (HttpStreamClient::Headers::const_iterator it = response.headers.begin(); it != response.headers.end(); ++it) {
+            if (boost::iequals(it->first, "Location"))
+                return it->second;
+        }
+        return std::string();
+    }
+
+    // Takes the body of a redirect, which isn't passed on
+    class DiscardSink : public BodySink {
+    public:
+        virtual bool write(const char*, std::size_t) { return true; }
+        virtual bool finish() { return true; }
+        virtual std::string error() const { return std::string(); }
+    };
+
+    // Headers set by the client itself rather than taken from the caller
+    bool reservedHeader(const std::string& name) {
+        return boost::iequals(name, "Host")
+            || boost::iequals(name, "Content-Length")
+            || boost::iequals(name, "Transfer-Encoding")
+            || boost::iequals(name, "Connection");
+    }
+
+    // True if a read failed because the server closed the connection
+    bool endOfStream(const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::eof) {
+            return true;
+        }
+#if BOOST_VERSION >= 106200
+        if (ec == boost::asio::ssl::error::stream_truncated) {
+            return true;  // Server closed a TLS connection without close_notify
+        }
+#endif
+#ifdef SSL_R_SHORT_READ
+        if (ec.category() == boost::asio::error::get_ssl_category() && ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ) {
+            return true;
+        }
+#endif
+        return false;
+    }
+
+#if defined(__linux__)
+    // The start of the kernel's struct tcp_info, up to tcpi_delivery_rate (Linux 4.9).  glibc's copy
+    // stops short of it, and the kernel only adds fields at the end and copies as much as it has.
+    struct KernelTcpInfo {
+        boost::uint8_t state, caState, retransmits, probes, backoff, options, windowScales, flags;
+        boost::uint32_t rto, ato, sndMss, rcvMss;
+        boost::uint32_t unacked, sacked, lost, retrans, fackets;
+        boost::uint32_t lastDataSent, lastAckSent, lastDataRecv, lastAckRecv;
+        boost::uint32_t pmtu, rcvSsthresh, rtt, rttVar, sndSsthresh, sndCwnd, advmss, reordering;
+        boost::uint32_t rcvRtt, rcvSpace;
+        boost::uint32_t totalRetrans;
+        boost::uint64_t pacingRate, maxPacingRate, bytesAcked, bytesReceived;
+        boost::uint32_t segsOut, segsIn, notsentBytes, minRtt, dataSegsIn, dataSegsOut;
+        boost::uint64_t deliveryRate;
+    };
+#endif
+
+    // The kernel's view of a connection, with retransmits as the total over its life.  Unsampled
+    // off Linux.
+    RequestTimings::TcpInfo sampleTcpInfo(tcp::socket& socket) {
+        RequestTimings::TcpInfo info;
+#if defined(__linux__)
+        KernelTcpInfo kernel;
+        std::memset(&kernel, 0, sizeof(kernel));
+        socklen_t len = sizeof(kernel);
+        if (getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_INFO, &kernel, &len) != 0
+            || len < offsetof(KernelTcpInfo, pacingRate)) {
+            return info;
+        }
+        info.sampled = true;
+        info.rtt = kernel.rtt;
+        info.rttVar = kernel.rttVar;
+        info.retransmits = kernel.totalRetrans;
+        info.cwnd = kernel.sndCwnd;
+        if (len >= offsetof(KernelTcpInfo, deliveryRate) + sizeof(kernel.deliveryRate)) {
+            info.deliveryRate = kernel.deliveryRate;
+        }
+#else
+        (void) socket;
+#endif
+        return info;
+    }
+
+    // Completion handlers for the asynchronous operations of a connection
+    void completed(const boost::system::error_code& result, boost::system::error_code* ec) {
+        *ec = result;
+    }
+
+    void transferred(const boost::system::error_code& result, std::size_t bytes, boost::system::error_code* ec, std::size_t* count) {
+        *ec = result;
+        *count = bytes;
+    }
+
+    void resolved(const boost::system::error_code& result, tcp::resolver::iterator endpoints,
+                  boost::system::error_code* ec, tcp::resolver::iterator* found) {
+        *ec = result;
+        *found = endpoints;
+    }
+
+    void connected(const boost::system::error_code& result, tcp::resolver::iterator, boost::system::error_code* ec) {
+        *ec = result;
+    }
+
+    void throwIfFailed(const boost::system::error_code& ec) {
+        if (ec) {
+            throw boost::system::system_error(ec);
+        }
+    }
+
+    // Runs the asynchronous operations of a connection one at a time on the calling thread, so that
+    // each can be given a timeout.  An operation still running when its time is up is cancelled and
+    // fails with timed_out.
+    class OperationTimer {
+    public:
+        OperationTimer(boost::asio::io_service& ioService, tcp::socket& socket, tcp::resolver& resolver)
+            : _ioService(ioService), _socket(socket), _resolver(resolver), _timer(ioService), _timeout(0)
+        { }
+
+        void setTimeout(long seconds) { _timeout = seconds; }
+
+        // Run the operation just started until it completes.  It was started with ec set to
+        // would_block, which its completion handler replaces.
+        void wait(boost::system::error_code& ec) {
+            bool timing = (_timeout > 0);
+            bool expired = false;
+            if (timing) {
+                _timer.expires_from_now(boost::posix_time::seconds(_timeout));
+                _timer.async_wait(boost::bind(&OperationTimer::expire, this, _1, &ec, &timing, &expired));
+            }
+
+            _ioService.reset();
+            while (ec == boost::asio::error::would_block) {
+                _ioService.run_one();
+            }
+            if (timing) {
+                _timer.cancel();
+                while (timing) {
+                    _ioService.run_one();
+                }
+            }
+
+            if (expired) {
+                ec = boost::asio::error::timed_out;
+            }
+        }
+
+    private:
+        void expire(const boost::system::error_code& result, const boost::system::error_code* ec, bool* timing, bool* expired) {
+            *timing = false;
+            if (result != boost::asio::error::operation_aborted && *ec == boost::asio::error::would_block) {
+                *expired = true;
+                boost::system::error_code ignored;
+                _socket.cancel(ignored);
+                _resolver.cancel();
+            }
+        }
+
+        boost::asio::io_service& _ioService;
+        tcp::socket& _socket;
+        tcp::resolver& _resolver;
+        boost::asio::deadline_timer _timer;
+        long _timeout;  // Seconds, or 0 for none
+    };
+
+    // A stream whose synchronous reads and writes are made as asynchronous operations run by the
+    // timer, so that an Exchange's reads and writes time out
+    template <typename Stream>
+    class TimedStream {
+    public:
+        TimedStream(Stream& stream, OperationTimer& timer) : _stream(stream), _timer(timer) {}
+
+        template <typename Buffers>
+        std::size_t read_some(const Buffers& buffers, boost::system::error_code& ec) {
+            std::size_t count = 0;
+            ec = boost::asio::error::would_block;
+            _stream.async_read_some(buffers, boost::bind(transferred, _1, _2, &ec, &count));
+            _timer.wait(ec);
+            return count;
+        }
+
+        template <typename Buffers>
+        std::size_t read_some(const Buffers& buffers) {
+            boost::system::error_code ec;
+            std::size_t count = read_some(buffers, ec);
+            throwIfFailed(ec);
+            return count;
+        }
+
+        template <typename Buffers>
+        std::size_t write_some(const Buffers& buffers, boost::system::error_code& ec) {
+            std::size_t count = 0;
+            ec = boost::asio::error::would_block;
+            _stream.async_write_some(buffers, boost::bind(transferred, _1, _2, &ec, &count));
+            _timer.wait(ec);
+            return count;
+        }
+
+        template <typename Buffers>
+        std::size_t write_some(const Buffers& buffers) {
+            boost::system::error_code ec;
+            std::size_t count = write_some(buffers, ec);
+            throwIfFailed(ec);
+            return count;
+        }
+
+    private:
+        Stream& _stream;
+        OperationTimer& _timer;
+    };
+
+    // Sends a request and reads the response over a connection, which is either a plain socket or
+    // a TLS stream on top of one
+    template <typename Stream>
+    class Exchange {
+    public:
+        Exchange(Stream& stream, tcp::socket& socket, bool plain, boost::asio::streambuf& buffer, BodySink& sink,
+                 RequestTimings* timings)
+            : _stream(stream), _socket(socket), _plain(plain), _buffer(buffer), _sink(&sink), _timings(timings),
+              _responded(false), _reusable(false)
+        { }
+
+        // True once any of the response has been read
+        bool responded() const { return _responded; }
+
+        // True if the connection can be used for another request after the response
+        bool reusable() const { return _reusable; }
+
+        void send(const std::string& head, BodySource* source) {
+            TraceSpan span("send", "http");
+            sendBody(head, source);
+            if (_timings) {
+                _timings->mark(RequestTimings::kRequestSent);
+            }
+        }
+
+        HttpStreamClient::Response receive(bool headRequest) {
+            TraceSpan span("receive", "http");
+            HttpStreamClient::Response response = receiveBody(headRequest);
+            if (_timings) {
+                _timings->mark(RequestTimings::kLastByte);
+            }
+            return response;
+        }
+
+    private:
+        void sendBody(const std::string& head, BodySource* source) {
+            boost::asio::write(_stream, boost::asio::buffer(head));
+            if (!source) {
+                return;
+            }
+
+            bool chunked = (source->length() == BodySource::kUnknownLength);
+            if (_plain && !chunked && source->canSendFile()) {
+                // The asynchronous operations leave the socket non-blocking, and sendfile needs it to block
+                boost::system::error_code ec;
+                _socket.native_non_blocking(false, ec);
+                if (!source->sendFile(static_cast<int>(_socket.native_handle()))) {
+                    throw std::runtime_error(source->error());
+                }
+                Metrics::instance().count(Metrics::kBytesOut, static_cast<boost::int64_t>(source->length()));
+                if (_timings) {
+                    _timings->addBytesOut(source->length());
+                }
+                return;
+            }
+
+            // Pieces are written straight from the source.  Chunks are framed with a gather write
+            // so the data is never copied.
+            const char* data;
+            std::size_t len;
+            char size[24];
+            for (;;) {
+                if (!source->next(data, len)) {
+                    throw std::runtime_error(source->error());
+                }
+                if (len == 0) {
+                    break;
+                }
+                Metrics::instance().count(Metrics::kBytesOut, static_cast<boost::int64_t>(len));
+                if (_timings) {
+                    _timings->addBytesOut(len);
+                }
+
+                if (chunked) {
+                    int sizeLen = sprintf(size, "%lx\r\n", static_cast<unsigned long>(len));
+                    boost::array<boost::asio::const_buffer, 3> pieces = {{
+                        boost::asio::buffer(size, sizeLen),
+                        boost::asio::buffer(data, len),
+                        boost::asio::buffer("\r\n", 2)
+                    }};
+                    boost::asio::write(_stream, pieces);
+                } else {
+                    boost::asio::write(_stream, boost::asio::buffer(data, len));
+                }
+            }
+            if (chunked) {
+                boost::asio::write(_stream, boost::asio::buffer("0\r\n\r\n", 5));
+            }
+        }
+
+        HttpStreamClient::Response receiveBody(bool headRequest) {
+            HttpStreamClient::Response response;
+            bool keepAlive;
+            do {
+                keepAlive = readHead(response);  // Skip interim responses such as 100 Continue
+            } while (response.status >= 100 && response.status < 200 && response.status != 101);
+
+            if (headRequest || response.status < 200 || response.status == 204 || response.status == 304) {
+                _reusable = keepAlive && response.status != 101 && _buffer.size() == 0;
+                return response;
+            }
+
+            bool chunked = false;
+            bool haveLength = false;
+            boost::uint64_t length = 0;
+            std::string encoding;
+            for (HttpStreamClient::Headers::iterator it = response.headers.begin(); it != response.headers.end(); ++it) {
+                if (boost::iequals(it->first, "Content-Encoding")) {
+                    encoding = it->second;
+                } else if (boost::iequals(it->first, "Transfer-Encoding")) {
+                    chunked = boost::iends_with(it->second, "chunked");
+                } else if (boost::iequals(it->first, "Content-Length")) {
+                    try {
+                        length = boost::lexical_cast<boost::uint64_t>(it->second);
+                        haveLength = true;
+                    } catch (const boost::bad_lexical_cast&) {
+                        throw std::runtime_error("Invalid Content-Length: " + it->second);
+                    }
+                }
+            }
+
+            // The body of a redirect is read, so that the connection can be reused, but not kept
+            if (!redirectLocation(response).empty()) {
+                _sink = &_discard;
+            }
+            _sink->expectEncoding(encoding);
+
+            bool complete;
+            if (chunked) {
+                complete = readChunks(response);
+            } else if (haveLength) {
+                _sink->expectLength(length);
+                complete = copy(length, false, response);
+            } else {
+                copy(0, true, response);
+                complete = false;  // Ended by closing the connection
+            }
+
+            _reusable = keepAlive && complete && _buffer.size() == 0;
+            return response;
+        }
+
+        std::string readLine() {
+            boost::asio::read_until(_stream, _buffer, "\r\n");
+            if (!_responded && _timings) {
+                _timings->mark(RequestTimings::kFirstByte);
+            }
+            _responded = true;
+            std::istream in(&_buffer);
+            std::string line;
+            std::getline(in, line);
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            return line;
+        }
+
+        // Read the status line and headers.  Returns true if the server will keep the connection open.
+        bool readHead(HttpStreamClient::Response& response) {
+            std::string line = readLine();
+            std::string::size_type space = line.find(' ');
+            if (!boost::starts_with(line, "HTTP/") || space == std::string::npos) {
+                throw std::runtime_error("Invalid status line: " + line);
+            }
+            response.status = atoi(line.c_str() + space + 1);
+            response.headers.clear();
+            bool keepAlive = boost::starts_with(line, "HTTP/1.1");
+
+            while (!(line = readLine()).empty()) {
+                std::string::size_type colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                response.headers.push_back(std::make_pair(boost::trim_copy(line.substr(0, colon)),
+                                                          boost::trim_copy(line.substr(colon + 1))));
+                if (boost::iequals(response.headers.back().first, "Connection")) {
+                    keepAlive = !boost::icontains(response.headers.back().second, "close");
+                }
+            }
+            return keepAlive;
+        }
+
+        // Returns false if the sink stopped accepting data
+        bool readChunks(HttpStreamClient::Response& response) {
+            for (;;) {
+                std::string line = readLine();
+                if (line.empty() || !isxdigit(static_cast<unsigned char>(line[0]))) {
+                    throw std::runtime_error("Invalid chunk size: " + line);
+                }
+
+                boost::uint64_t size = strtoul(line.c_str(), 0, 16);  // Chunk extensions are ignored
+                if (size == 0) {
+                    while (!readLine().empty()) {}  // Trailers
+                    return true;
+                }
+
+                if (!copy(size, false, response)) {
+                    return false;
+                }
+                readLine();
+            }
+        }
+
+        // Hand remaining bytes of the body (or everything up to the end of the connection) to the
+        // sink.  Returns false if the sink stopped accepting data.
+        bool copy(boost::uint64_t remaining, bool untilEnd, HttpStreamClient::Response& response) {
+            while (untilEnd || remaining > 0) {
+                if (_buffer.size() == 0) {
+                    boost::system::error_code ec;
+                    std::size_t read = _stream.read_some(_buffer.prepare(kReadSize), ec);
+                    _buffer.commit(read);
+                    _responded = true;
+                    if (read == 0 && ec) {
+                        if (untilEnd && endOfStream(ec)) {
+                            return true;
+                        }
+                        throw boost::system::system_error(ec);
+                    }
+                }
+
+                std::size_t len = _buffer.size();
+                if (!untilEnd && len > remaining) {
+                    len = static_cast<std::size_t>(remaining);
+                }
+                if (!_sink->write(boost::asio::buffer_cast<const char*>(_buffer.data()), len)) {
+                    response.sinkFailed = true;
+                    return false;
+                }
+                _buffer.consume(len);
+                remaining -= len;
+                if (_timings) {
+                    _timings->addBytesIn(len);
+                }
+            }
+            return true;
+        }
+
+        Stream& _stream;
+        tcp::socket& _socket;
+        bool _plain;
+        boost::asio::streambuf& _buffer;
+        BodySink* _sink;
+        DiscardSink _discard;
+        RequestTimings* _timings;
+        bool _responded;
+        bool _reusable;
+    };
+
+    template <typename Stream>
+    HttpStreamClient::Response exchange(Stream& stream, tcp::socket& socket, bool plain, boost::asio::streambuf& buffer,
+                                        const std::string& head, BodySource* source, bool headRequest, BodySink& sink,
+                                        RequestTimings* timings, bool& responded, bool& reusable)
+    {
+        Exchange<Stream> exchange(stream, socket, plain, buffer, sink, timings);
+        try {
+            exchange.send(head, source);
+            HttpStreamClient::Response response = exchange.receive(headRequest);
+            reusable = exchange.reusable();
+            return response;
+        } catch (...) {
+            responded = exchange.responded();
+            throw;
+        }
+    }
+}
+
+// A connection to one server, either a plain socket or a TLS stream
+class HttpStreamClient::Connection {
+public:
+    Connection(const Url& url)
+        : _key((url.secure ? "https://" : "http://") + url.authority), _retransmits(0), _timeout(0), _resolver(_ioService)
+    {
+        if (url.secure) {
+            // Peers aren't verified, as with the cpp-netlib client
+            _context.reset(new boost::asio::ssl::context(boost::asio::ssl::context::sslv23_client));
+            _context->set_verify_mode(boost::asio::ssl::verify_none);
+            _secureStream.reset(new boost::asio::ssl::stream<tcp::socket>(_ioService, *_context));
+        } else {
+            _plainSocket.reset(new tcp::socket(_ioService));
+        }
+        _timer.reset(new OperationTimer(_ioService, socket(), _resolver));
+    }
+
+    const std::string& key() const { return _key; }
+
+    tcp::socket& socket() { return _secureStream ? _secureStream->next_layer() : *_plainSocket; }
+
+    void setTimeout(long seconds) {
+        _timeout = seconds;
+        _timer->setTimeout(seconds);
+    }
+
+    void open(const Url& url, RequestTimings* timings) {
+        boost::system::error_code ec;
+        tcp::resolver::iterator endpoints;
+        {
+            TraceSpan span("dns", "http", url.host);
+            ec = boost::asio::error::would_block;
+            _resolver.async_resolve(tcp::resolver::query(url.host, url.port), boost::bind(resolved, _1, _2, &ec, &endpoints));
+            _timer->wait(ec);
+            throwIfFailed(ec);
+        }
+        if (timings) {
+            timings->mark(RequestTimings::kDnsDone);
+        }
+        {
+            TraceSpan span("connect", "http", url.host);
+            ec = boost::asio::error::would_block;
+            boost::asio::async_connect(socket(), endpoints, boost::bind(connected, _1, _2, &ec));
+            _timer->wait(ec);
+            throwIfFailed(ec);
+            socket().set_option(tcp::no_delay(true));
+        }
+        if (timings) {
+            timings->mark(RequestTimings::kConnected);
+        }
+        if (_secureStream) {
+            TraceSpan span("tls", "http", url.host);
+            SSL_set_tlsext_host_name(_secureStream->native_handle(), url.host.c_str());  // SNI
+            ec = boost::asio::error::would_block;
+            _secureStream->async_handshake(boost::asio::ssl::stream_base::client, boost::bind(completed, _1, &ec));
+            _timer->wait(ec);
+            throwIfFailed(ec);
+            if (timings) {
+                timings->mark(RequestTimings::kTlsDone);
+            }
+        }
+    }
+
+    HttpStreamClient::Response request(const std::string& head, BodySource* source, bool headRequest, BodySink& sink,
+                                       RequestTimings* timings, bool& responded, bool& reusable)
+    {
+        HttpStreamClient::Response response;
+        if (_secureStream) {
+            TimedStream<boost::asio::ssl::stream<tcp::socket> > stream(*_secureStream, *_timer);
+            response = exchange(stream, socket(), false, _buffer, head, source, headRequest, sink, timings, responded, reusable);
+        } else {
+            setSendTimeout();
+            TimedStream<tcp::socket> stream(*_plainSocket, *_timer);
+            response = exchange(stream, socket(), true, _buffer, head, source, headRequest, sink, timings, responded, reusable);
+        }
+        sampleConnection(timings);
+        return response;
+    }
+
+private:
+    // sendfile writes to the socket itself, blocking, so it's held to the timeout by a send timeout
+    void setSendTimeout() {
+#if defined(__linux__) || defined(__APPLE__)
+        struct timeval timeout = { static_cast<time_t>(_timeout), 0 };
+        setsockopt(socket().native_handle(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#endif
+    }
+
+    // Records the connection's TCP_INFO against the request just made on it.  Retransmits are counted
+    // from the previous request, so a reused connection's earlier losses aren't put down to this one.
+    void sampleConnection(RequestTimings* timings) {
+        RequestTimings::TcpInfo info = sampleTcpInfo(socket());
+        if (!info.sampled)
+            return;
+
+        boost::uint32_t total = info.retransmits;
+        info.retransmits = (total >= _retransmits) ? total - _retransmits : total;
+        _retransmits = total;
+
+        Metrics& metrics = Metrics::instance();
+        metrics.recordRtt(info.rtt);
+        if (info.retransmits)
+            metrics.count(Metrics::kTcpRetransmits, info.retransmits);
+        if (timings) {
+            timings->setTcpInfo(info);
+        }
+    }
+
+    std::string _key;  // Scheme and authority of the server
+    boost::uint32_t _retransmits;  // Over the life of the connection, as last sampled
+    long _timeout;
+
+    boost::asio::io_service _ioService;
+    tcp::resolver _resolver;
+    boost::scoped_ptr<boost::asio::ssl::context> _context;
+    boost::scoped_ptr<boost::asio::ssl::stream<tcp::socket> > _secureStream;
+    boost::scoped_ptr<tcp::socket> _plainSocket;
+    boost::scoped_ptr<OperationTimer> _timer;
+    boost::asio::streambuf _buffer;  // Read ahead of the response being parsed
+};
+
+class HttpStreamClient::SocketRegistration {
+public:
+    SocketRegistration(HttpStreamClient& client, tcp::socket& socket) : _client(client) {
+        boost::mutex::scoped_lock lock(_client._mutex);
+        _client._socket = &socket;
+    }
+
+    ~SocketRegistration() {
+        boost::mutex::scoped_lock lock(_client._mutex);
+        _client._socket = 0;
+    }
+
+private:
+    HttpStreamClient& _client;
+};
+
+HttpStreamClient::HttpStreamClient(bool keepAlive) : _keepAlive(keepAlive), _socket(0), _cancelled(false), _timeout(0), _timings(0)
+{ }
+
+void HttpStreamClient::cancel() {
+    boost::mutex::scoped_lock lock(_mutex);
+    _cancelled = true;
+    if (_socket) {
+        // Fails any blocking read or write on the worker thread
+        boost::system::error_code ec;
+        _socket->shutdown(tcp::socket::shutdown_both, ec);
+    }
+}
+
+void HttpStreamClient::checkCancelled() {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_cancelled) {
+        throw std::runtime_error("Request canceled");
+    }
+}
+
+void HttpStreamClient::clearCancelled() {
+    boost::mutex::scoped_lock lock(_mutex);
+    _cancelled = false;
+}
+
+HttpStreamClient::Response HttpStreamClient::request(const std::string& method,
+                                                     const std::string& url,
+                                                     const Headers& headers,
+                                                     const std::string& contentType,
+                                                     BodySource* source,
+                                                     BodySink& sink)
+{
+    // A cancel stops the request it arrived during (or before), and then the client can be used again
+    Response response;
+    try {
+        response = follow(method, url, headers, contentType, source, sink);
+    } catch (...) {
+        clearCancelled();
+        throw;
+    }
+    clearCancelled();
+    return response;
+}
+
+// Make the request, following redirects.  As browsers do (RFC 7231 6.4), a 303, or a 301 or 302 in
+// answer to a POST, is followed with a GET without the body; otherwise the method is kept and the
+// body sent again.  Credentials aren't passed on to another server.
+HttpStreamClient::Response HttpStreamClient::follow(std::string method,
+                                                    std::string url,
+                                                    Headers headers,
+                                                    std::string contentType,
+                                                    BodySource* source,
+                                                    BodySink& sink)
+{
+    for (int redirects = 0; ; ++redirects) {
+        Response response = send(method, url, headers, contentType, source, sink);
+        response.url = url;
+
+        std::string location = redirectLocation(response);
+        if (location.empty()) {
+            return response;
+        }
+        if (redirects == kMaxRedirects) {
+            throw std::runtime_error("Redirection exceeds maximum redirect count.");
+        }
+
+        Url from = parseUrl(url);
+        url = resolveLocation(from, location);
+        Url to = parseUrl(url);
+
+        if ((response.status == 303 && !boost::iequals(method, "HEAD"))
+            || ((response.status == 301 || response.status == 302) && boost::iequals(method, "POST"))) {
+            method = "GET";
+            source = 0;
+            contentType.clear();
+            removeHeader(headers, "Content-Type");
+            removeHeader(headers, "Content-Encoding");
+        } else if (source && !source->rewind()) {
+            throw std::runtime_error("Unable to send the body again for the redirect to " + url);
+        }
+
+        if (to.secure != from.secure || !boost::iequals(to.authority, from.authority)) {
+            removeHeader(headers, "Authorization");
+            removeHeader(headers, "Proxy-Authorization");
+            removeHeader(headers, "Cookie");
+        }
+    }
+}
+
+HttpStreamClient::Response HttpStreamClient::send(const std::string& method,
+                                                  const std::string& url,
+                                                  const Headers& headers,
+                                                  const std::string& contentType,
+                                                  BodySource* source,
+                                                  BodySink& sink)
+{
+    Url target = parseUrl(url);
+
+    std::string head = boost::to_upper_copy(method) + " " + target.target + " HTTP/1.1\r\n";
+    head += "Host: " + target.authority + "\r\n";
+    for (Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (!reservedHeader(it->first) && !(source && !contentType.empty() && boost::iequals(it->first, "Content-Type"))) {
+            head += it->first + ": " + it->second + "\r\n";
+        }
+    }
+    if (source) {
+        if (source->length() == BodySource::kUnknownLength)
+            head += "Transfer-Encoding: chunked\r\n";
+        else
+            head += "Content-Length: " + boost::lexical_cast<std::string>(source->length()) + "\r\n";
+        if (!contentType.empty())
+            head += "Content-Type: " + contentType + "\r\n";
+    }
+    head += _keepAlive ? "\r\n" : "Connection: close\r\n\r\n";
+
+    bool headRequest = boost::iequals(method, "HEAD");
+
+    // Reuse the idle connection if it's to the same server
+    boost::shared_ptr<Connection> connection;
+    bool reused = false;
+    if (_connection && _connection->key() == (target.secure ? "https://" : "http://") + target.authority) {
+        connection.swap(_connection);
+        reused = true;
+    }
+    _connection.reset();
+
+    for (;;) {
+        checkCancelled();
+        if (!connection) {
+            connection = boost::make_shared<Connection>(target);
+        }
+        connection->setTimeout(_timeout);
+
+        SocketRegistration registration(*this, connection->socket());
+        bool responded = false, reusable = false;
+        try {
+            if (!reused) {
+                connection->open(target, _timings);
+                checkCancelled();
+            }
+
+            HttpStreamClient::Response response = connection->request(head, source, headRequest, sink, _timings, responded, reusable);
+            if (_keepAlive && reusable) {
+                _connection = connection;
+            }
+            return response;
+        } catch (const std::exception&) {
+            // The server may have closed an idle connection just as it was reused, so try once more on
+            // a new connection (unless part of the body has already been sent from the source)
+            if (!reused || responded || source) {
+                throw;
+            }
+        }
+
+        connection.reset();
+        reused = false;
+    }
+}
@@ -0,0 +1,217 @@
+//
+//  InflightRegistry.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "InflightRegistry.h"
+#include "Logging.he"
+#include "Metrics.h"
+
+#include <boost/algorithm/string.hpp>
+
+namespace {
+    const long kWatchMs = 1000;
+
+    // Default thresholds in milliseconds
+    const double kDefaultThresholds[InflightRegistry::kStageCount] = { 30000, 15000, 30000, 300000, 10000 };
+}
+
+InflightRegistry& InflightRegistry::instance()
+{
+    static InflightRegistry theInst;
+
+    return theInst;
+}
+
+InflightRegistry::InflightRegistry() : _nextId(1), _stopping(false)
+{
+    Metrics::instance();  // Counted into by the watchdog, so created here on the main thread
+    for (int i = 0; i < kStageCount; ++i) {
+        _thresholds[i] = kDefaultThresholds[i];
+    }
+    _watchdog = boost::thread(&InflightRegistry::watch, this);
+}
+
+InflightRegistry::~InflightRegistry()
+{
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _watchdog.join();
+}
+
+const char* InflightRegistry::stageName(Stage stage)
+{
+    static const char* names[kStageCount] = { "queued", "connecting", "waiting", "receiving", "delivering" };
+    return names[stage];
+}
+
+bool InflightRegistry::parseStage(const std::string& name, Stage& stage)
+{
+    for (int i = 0; i < kStageCount; ++i) {
+        if (boost::iequals(name, stageName(static_cast<Stage>(i)))) {
+            stage = static_cast<Stage>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+boost::uint64_t InflightRegistry::add(const std::string& method, const std::string& url, const boost::shared_ptr<const RequestTimings>& timings)
+{
+    boost::uint64_t now = RequestTimings::now();
+
+    boost::mutex::scoped_lock lock(_mutex);
+    boost::uint64_t id = _nextId++;
+    Entry& entry = _entries[id];
+    entry.method = method;
+    entry.url = url;
+    entry.queuedAt = now;
+    entry.since = now;
+    entry.timings = timings;
+    return id;
+}
+
+void InflightRegistry::remove(boost::uint64_t id)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _entries.erase(id);
+}
+
+void InflightRegistry::start(boost::uint64_t id)
+{
+    boost::uint64_t now = RequestTimings::now();
+
+    boost::mutex::scoped_lock lock(_mutex);
+    Entries::iterator it = _entries.find(id);
+    if (it != _entries.end() && it->second.stage == kQueued) {
+        it->second.stage = kConnecting;
+        it->second.since = now;
+    }
+}
+
+void InflightRegistry::finish(boost::uint64_t id)
+{
+    boost::uint64_t now = RequestTimings::now();
+
+    boost::mutex::scoped_lock lock(_mutex);
+    Entries::iterator it = _entries.find(id);
+    if (it != _entries.end() && it->second.stage != kDelivering) {
+        it->second.stage = kDelivering;
+        it->second.since = now;
+    }
+}
+
+void InflightRegistry::setThreshold(Stage stage, double ms)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _thresholds[stage] = ms > 0 ? ms : 0;
+}
+
+double InflightRegistry::threshold(Stage stage)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _thresholds[stage];
+}
+
+// The stage a request is in, and when it began.  A running request's timings, if it has them, tell
+// how far it has got.
+InflightRegistry::Stage InflightRegistry::stage(const Entry& entry, boost::uint64_t& since)
+{
+    since = entry.since;
+    if (entry.stage != kConnecting || !entry.timings)
+        return entry.stage;
+
+    const RequestTimings& timings = *entry.timings;
+    switch (timings.latest()) {
+        case RequestTimings::kRequestSent:
+            since = timings.at(RequestTimings::kRequestSent);
+            return kWaiting;
+        case RequestTimings::kFirstByte:
+            since = timings.at(RequestTimings::kFirstByte);
+            return kReceiving;
+        case RequestTimings::kLastByte:
+        case RequestTimings::kDelivered:
+            since = timings.at(RequestTimings::kLastByte);
+            return kDelivering;
+        default:
+            return kConnecting;
+    }
+}
+
+// Delivered, but the object that made it is still around
+bool InflightRegistry::delivered(const Entry& entry)
+{
+    return entry.timings && entry.timings->marked(RequestTimings::kDelivered);
+}
+
+// Called with _mutex held
+InflightRegistry::Request InflightRegistry::describe(boost::uint64_t id, const Entry& entry, boost::uint64_t now)
+{
+    boost::uint64_t since = 0;
+    Request request;
+    request.id = id;
+    request.method = entry.method;
+    request.url = entry.url;
+    request.stage = stage(entry, since);
+
+    request.elapsed = (now > entry.queuedAt) ? static_cast<double>(now - entry.queuedAt) / 1000.0 : 0;
+    request.stageElapsed = (since && now > since) ? static_cast<double>(now - since) / 1000.0 : 0;
+    if (entry.timings) {
+        request.bytesIn = entry.timings->bytesIn();
+        request.bytesOut = entry.timings->bytesOut();
+    }
+    request.slow = (entry.reported != kStageCount);
+    return request;
+}
+
+std::vector<InflightRegistry::Request> InflightRegistry::requests()
+{
+    std::vector<Request> requests;
+    boost::uint64_t now = RequestTimings::now();
+
+    boost::mutex::scoped_lock lock(_mutex);
+    for (Entries::const_iterator it = _entries.begin(); it != _entries.end(); ++it) {
+        if (!delivered(it->second)) {
+            requests.push_back(describe(it->first, it->second, now));
+        }
+    }
+    return requests;
+}
+
+// Watchdog thread
+void InflightRegistry::watch()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    while (!_stopping) {
+        _wake.timed_wait(lock, boost::posix_time::milliseconds(kWatchMs));
+        if (_stopping)
+            break;
+
+        boost::uint64_t now = RequestTimings::now();
+        Entries::iterator it = _entries.begin();
+        while (it != _entries.end()) {
+            Entry& entry = it->second;
+            if (delivered(entry)) {
+                _entries.erase(it++);
+                continue;
+            }
+
+            Request request = describe(it->first, entry, now);
+            double limit = _thresholds[request.stage];
+            if (limit > 0 && request.stageElapsed > limit && entry.reported != request.stage) {
+                entry.reported = request.stage;
+                Metrics::instance().count(Metrics::kSlowRequests);
+                LOG_WARNING << "Slow request " << request.id << ": " << request.method << " " << request.url
+                            << " has been " << stageName(request.stage) << " for " << static_cast<long>(request.stageElapsed)
+                            << " ms (" << static_cast<long>(request.elapsed) << " ms since queued, "
+                            << request.bytesIn << " bytes in, " << request.bytesOut << " bytes out)";
+            }
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,398 @@
+//
+//  JsonListBuilder.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "JsonListBuilder.h"
+#include "ListPool.h"
+#include "OmnisTools.he"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+
+using namespace OmnisTools;
+
+/**************************************************************************************************
+ **                                     JSON WRITING                                             **
+ **************************************************************************************************/
+
+void writeJsonString(const char* data, std::size_t len, std::string& out) {
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Flush the run of characters that didn't need escaping
+        out.append(data + start, i - start);
+        start = i + 1;
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+                break;
+        }
+    }
+    out.append(data + start, len - start);
+    out += '"';
+}
+
+void writeJson(const JsonValue& value, std::string& out) {
+    char buffer[32];
+    switch (value.type) {
+        case JsonValue::kNull:
+            out += "null";
+            break;
+        case JsonValue::kBoolean:
+            out += value.boolean ? "true" : "false";
+            break;
+        case JsonValue::kInteger:
+            sprintf(buffer, "%.0f", value.number);
+            out += buffer;
+            break;
+        case JsonValue::kNumber:
+            sprintf(buffer, "%.17g", value.number);
+            out += buffer;
+            break;
+        case JsonValue::kString:
+            writeJsonString(value.text.data(), value.text.size(), out);
+            break;
+        case JsonValue::kArray:
+            out += '[';
+            for (std::size_t i = 0; i < value.items.size(); ++i) {
+                if (i > 0) out += ',';
+                writeJson(value.items[i], out);
+            }
+            out += ']';
+            break;
+        case JsonValue::kObject:
+            out += '{';
+            for (std::size_t i = 0; i < value.items.size(); ++i) {
+                if (i > 0) out += ',';
+                writeJsonString(value.keys[i].data(), value.keys[i].size(), out);
+                out += ':';
+                writeJson(value.items[i], out);
+            }
+            out += '}';
+            break;
+    }
+}
+
+/**************************************************************************************************
+ **                                   DOCUMENT BUILDING                                          **
+ **************************************************************************************************/
+
+JsonListBuilder::JsonListBuilder()
+{ }
+
+// Add a value to the currently open container (or as the root)
+void JsonListBuilder::add(const JsonValue& v) {
+    JsonValue* added;
+    if (_stack.empty()) {
+        _root = v;
+        added = &_root;
+    } else {
+        JsonValue* parent = _stack.back();
+        if (parent->type == JsonValue::kObject) {
+            parent->keys.push_back(_key);
+        }
+        parent->items.push_back(v);
+        added = &parent->items.back();  // Stays valid until the parent grows, which is after this closes
+    }
+
+    if (v.type == JsonValue::kArray || v.type == JsonValue::kObject) {
+        _stack.push_back(added);
+    }
+}
+
+void JsonListBuilder::null() {
+    add(JsonValue(JsonValue::kNull));
+}
+
+void JsonListBuilder::boolean(bool b) {
+    JsonValue v(JsonValue::kBoolean);
+    v.boolean = b;
+    add(v);
+}
+
+void JsonListBuilder::number(const std::string& text, bool isInteger) {
+    JsonValue v(isInteger ? JsonValue::kInteger : JsonValue::kNumber);
+    v.number = parseJsonNumber(text);
+    add(v);
+}
+
+void JsonListBuilder::string(const std::string& s) {
+    JsonValue v(JsonValue::kString);
+    add(v);
+
+    // Assign after adding to avoid copying the string twice
+    JsonValue& added = _stack.empty() ? _root : _stack.back()->items.back();
+    added.text = s;
+}
+
+void JsonListBuilder::key(const std::string& k) {
+    _key = k;
+}
+
+void JsonListBuilder::startObject() {
+    add(JsonValue(JsonValue::kObject));
+}
+
+void JsonListBuilder::endObject() {
+    _stack.pop_back();
+}
+
+void JsonListBuilder::startArray() {
+    add(JsonValue(JsonValue::kArray));
+}
+
+void JsonListBuilder::endArray() {
+    _stack.pop_back();
+}
+
+/**************************************************************************************************
+ **                                    LIST CONVERSION                                           **
+ **************************************************************************************************/
+
+namespace {
+
+    enum ColumnKind {
+        kColNone,
+        kColBoolean,
+        kColInteger,
+        kColNumber,
+        kColCharacter,
+        kColList
+    };
+
+    struct Column {
+        Column(const std::string& n) : name(n), kind(kColNone) {}
+
+        std::string name;
+        ColumnKind kind;
+    };
+
+    ColumnKind kindOf(const JsonValue& v) {
+        switch (v.type) {
+            case JsonValue::kNull:
+                return kColNone;
+            case JsonValue::kBoolean:
+                return kColBoolean;
+            case JsonValue::kInteger:
+                // Omnis integers are 32-bit, larger values are stored as numbers
+                return (std::fabs(v.number) <= 2147483647.0) ? kColInteger : kColNumber;
+            case JsonValue::kNumber:
+                return kColNumber;
+            case JsonValue::kString:
+                return kColCharacter;
+            default:
+                return kColList;
+        }
+    }
+
+    ColumnKind merge(ColumnKind a, ColumnKind b) {
+        if (a == kColNone || a == b) return b;
+        if (b == kColNone) return a;
+        if ((a == kColInteger && b == kColNumber) || (a == kColNumber && b == kColInteger)) return kColNumber;
+
+        return kColCharacter;  // Mixed columns are kept as text (containers as JSON)
+    }
+
+    void addColumn(EXTqlist* list, const Column& col) {
+        str255 colName = initStr255(col.name.c_str());
+        switch (col.kind) {
+            case kColBoolean:
+                list->addCol(fftBoolean, 0, 0, &colName);
+                break;
+            case kColInteger:
+                list->addCol(fftInteger, 0, 1, &colName);
+                break;
+            case kColNumber:
+                list->addCol(fftNumber, dpFmask, 0, &colName);
+                break;
+            case kColList:
+                list->addCol(fftList, dpFcharacter, 1, &colName);
+                break;
+            default:
+                list->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+                break;
+        }
+    }
+
+    // The columns and rows of the list a value becomes
+    struct Layout {
+        std::vector<Column> columns;
+        std::vector<std::vector<const JsonValue*> > rows;
+    };
+
+    void layOut(const JsonValue& value, Layout& layout) {
+        std::vector<Column>& columns = layout.columns;
+        std::vector<std::vector<const JsonValue*> >& rows = layout.rows;
+
+        bool arrayOfObjects = (value.type == JsonValue::kArray && !value.items.empty());
+        for (std::size_t i = 0; arrayOfObjects && i < value.items.size(); ++i) {
+            arrayOfObjects = (value.items[i].type == JsonValue::kObject);
+        }
+
+        if (value.type == JsonValue::kObject) {
+            // Single row, column per key
+            rows.resize(1);
+            for (std::size_t i = 0; i < value.items.size(); ++i) {
+                columns.push_back(Column(value.keys[i]));
+                columns.back().kind = kindOf(value.items[i]);
+                rows[0].push_back(&value.items[i]);
+            }
+        } else if (arrayOfObjects) {
+            // Row per object, column per key (in the order keys were first seen)
+            std::map<std::string, std::size_t> index;
+            rows.resize(value.items.size());
+            for (std::size_t r = 0; r < value.items.size(); ++r) {
+                const JsonValue& obj = value.items[r];
+                for (std::size_t i = 0; i < obj.items.size(); ++i) {
+                    std::map<std::string, std::size_t>::iterator it = index.find(obj.keys[i]);
+                    std::size_t c;
+                    if (it == index.end()) {
+                        c = columns.size();
+                        index[obj.keys[i]] = c;
+                        columns.push_back(Column(obj.keys[i]));
+                    } else {
+                        c = it->second;
+                    }
+
+                    if (rows[r].size() <= c) {
+                        rows[r].resize(c + 1, 0);
+                    }
+                    rows[r][c] = &obj.items[i];
+                    columns[c].kind = merge(columns[c].kind, kindOf(obj.items[i]));
+                }
+            }
+        } else if (value.type == JsonValue::kArray) {
+            // Row per item in a single value column
+            columns.push_back(Column("value"));
+            rows.resize(value.items.size());
+            for (std::size_t r = 0; r < value.items.size(); ++r) {
+                rows[r].push_back(&value.items[r]);
+                columns[0].kind = merge(columns[0].kind, kindOf(value.items[r]));
+            }
+        } else {
+            // Scalar document
+            columns.push_back(Column("value"));
+            columns[0].kind = kindOf(value);
+            rows.resize(1);
+            rows[0].push_back(&value);
+        }
+    }
+
+    // Lay out a value and every nested value that becomes a list of its own, in the order they're
+    // filled, so that the lists can all be checked out of the pool at once.  A deque, so that
+    // layouts aren't copied as it grows.
+    void layOutAll(const JsonValue& value, std::deque<Layout>& layouts) {
+        layouts.push_back(Layout());
+        Layout& layout = layouts.back();
+        layOut(value, layout);
+
+        for (std::size_t r = 0; r < layout.rows.size(); ++r) {
+            for (std::size_t c = 0; c < layout.rows[r].size(); ++c) {
+                const JsonValue* cell = layout.rows[r][c];
+                if (cell && cell->type != JsonValue::kNull && layout.columns[c].kind == kColList) {
+                    layOutAll(*cell, layouts);
+                }
+            }
+        }
+    }
+
+    // Fills a list per layout, in order: each list's nested lists are filled as their cells are reached
+    class ListFiller {
+    public:
+        ListFiller(const std::deque<Layout>& layouts, const std::vector<boost::shared_ptr<EXTqlist> >& lists)
+            : _layouts(layouts), _lists(lists), _next(0) {}
+
+        EXTqlist* fill() {
+            const Layout& layout = _layouts[_next];
+            EXTqlist* list = _lists[_next].get();
+            ++_next;
+
+            for (std::vector<Column>::const_iterator col = layout.columns.begin(); col != layout.columns.end(); ++col) {
+                addColumn(list, *col);
+            }
+
+            EXTfldval colVal;
+            for (std::size_t r = 0; r < layout.rows.size(); ++r) {
+                list->insertRow();
+                for (std::size_t c = 0; c < layout.rows[r].size(); ++c) {
+                    if (layout.rows[r][c]) {
+                        list->getColValRef(static_cast<qlong>(r + 1), static_cast<qshort>(c + 1), colVal, qtrue);
+                        setCell(colVal, *layout.rows[r][c], layout.columns[c].kind);
+                    }
+                }
+            }
+            return list;
+        }
+
+    private:
+        void setCell(EXTfldval& colVal, const JsonValue& v, ColumnKind kind) {
+            if (v.type == JsonValue::kNull) {
+                return;
+            }
+
+            switch (kind) {
+                case kColBoolean:
+                    getEXTFldValFromBool(colVal, v.boolean);
+                    break;
+                case kColInteger:
+                    colVal.setLong(static_cast<qlong>(v.number));
+                    break;
+                case kColNumber:
+                    getEXTFldValFromDouble(colVal, v.number);
+                    break;
+                case kColList:
+                    colVal.setList(fill(), qtrue);
+                    break;
+                default:
+                    if (v.type == JsonValue::kString) {
+                        getEXTFldValFromString(colVal, v.text);
+                    } else {
+                        std::string text;
+                        writeJson(v, text);
+                        getEXTFldValFromString(colVal, text);
+                    }
+                    break;
+            }
+        }
+
+        const std::deque<Layout>& _layouts;
+        const std::vector<boost::shared_ptr<EXTqlist> >& _lists;
+        std::size_t _next;
+    };
+}
+
+boost::shared_ptr<EXTqlist> JsonListBuilder::toList(std::vector<boost::shared_ptr<EXTqlist> >& owned) const {
+    std::deque<Layout> layouts;
+    layOutAll(_root, layouts);
+
+    std::vector<boost::shared_ptr<EXTqlist> > lists;
+    if (!ListPool::instance().checkout(layouts.size(), lists)) {
+        return boost::shared_ptr<EXTqlist>();
+    }
+
+    ListFiller(layouts, lists).fill();
+    owned.insert(owned.end(), lists.begin(), lists.end());
+    return lists.front();
+}
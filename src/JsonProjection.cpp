@@ -0,0 +1,303 @@
+//
+//  JsonProjection.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "JsonProjection.h"
+#include "JsonListBuilder.h"
+
+#include <cstdio>
+
+#include <boost/algorithm/string.hpp>
+
+static const std::size_t kNone = static_cast<std::size_t>(-1);
+
+JsonProjection::JsonProjection(const std::string& records, const std::vector<Column>& columns)
+    : Projection(columns), _reader(*this), _recordsDepth(kNone), _recordDepth(kNone)
+{
+    if (!parsePath(records, _recordsPath)) {
+        fail("Invalid records path: " + records);
+    }
+
+    _columnPaths.resize(_columns.size());
+    for (std::size_t c = 0; c < _columns.size(); ++c) {
+        if (!parsePath(_columns[c].path, _columnPaths[c])) {
+            fail("Invalid projection path: " + _columns[c].path);
+        }
+    }
+}
+
+bool JsonProjection::parsePath(const std::string& path, std::vector<std::string>& segments) {
+    segments.clear();
+    if (path.empty()) {
+        return true;
+    }
+
+    if (path[0] == '/') {
+        // JSON Pointer (RFC 6901)
+        std::size_t pos = 1;
+        for (;;) {
+            std::size_t end = path.find('/', pos);
+            std::string segment = path.substr(pos, (end == std::string::npos) ? std::string::npos : end - pos);
+            boost::replace_all(segment, "~1", "/");
+            boost::replace_all(segment, "~0", "~");
+            segments.push_back(segment);
+
+            if (end == std::string::npos) {
+                return true;
+            }
+            pos = end + 1;
+        }
+    }
+
+    if (path[0] != '$') {
+        return false;
+    }
+
+    // JSONPath, limited to child names, indexes and a trailing wildcard
+    std::size_t pos = 1;
+    while (pos < path.size()) {
+        bool wildcard = false;
+        if (path[pos] == '.') {
+            std::size_t end = path.find_first_of(".[", ++pos);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+
+            std::string name = path.substr(pos, end - pos);
+            if (name.empty()) {
+                return false;  // Recursive descent (..) can't be evaluated while streaming
+            } else if (name == "*") {
+                wildcard = true;
+            } else {
+                segments.push_back(name);
+            }
+            pos = end;
+        } else if (path[pos] == '[') {
+            std::size_t end = path.find(']', pos);
+            if (end == std::string::npos) {
+                return false;
+            }
+
+            std::string inner = path.substr(pos + 1, end - pos - 1);
+            if (inner == "*") {
+                wildcard = true;
+            } else if (inner.size() >= 2 && (inner[0] == '\'' || inner[0] == '"') && inner[inner.size() - 1] == inner[0]) {
+                segments.push_back(inner.substr(1, inner.size() - 2));
+            } else if (!inner.empty() && inner.find_first_not_of("0123456789") == std::string::npos) {
+                segments.push_back(inner);
+            } else {
+                return false;
+            }
+            pos = end + 1;
+        } else {
+            return false;
+        }
+
+        // A wildcard only makes sense as "each element" at the end of the path
+        if (wildcard && pos != path.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonProjection::write(const char* data, std::size_t len) {
+    if (!_reader.feed(data, len)) {
+        return fail(_reader.error());
+    }
+    return true;
+}
+
+bool JsonProjection::finish() {
+    if (!_reader.finish()) {
+        return fail(_reader.error());
+    }
+    return true;
+}
+
+// Compare path with the end of the current path, starting at depth from
+bool JsonProjection::matches(const std::vector<std::string>& path, std::size_t from) const {
+    if (path.size() != _path.size() - from) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        if (path[i] != _path[from + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Add a value to the text of the containers being captured
+void JsonProjection::capture(const std::string& json, bool isContainer) {
+    for (std::vector<Capture>::iterator c = _captures.begin(); c != _captures.end(); ++c) {
+        if (c->comma && c->open.back() == '[') {
+            c->text += ',';
+        }
+        c->text += json;
+
+        if (isContainer) {
+            c->open.push_back(json[0]);
+            c->comma = false;
+        } else {
+            c->comma = true;
+        }
+    }
+}
+
+// Work out the path of a value that's starting, then start a record or project it into a column
+void JsonProjection::beginValue(bool isContainer, bool isArray, const std::string* text) {
+    if (!_frames.empty()) {
+        Frame& parent = _frames.back();
+        if (parent.isArray) {
+            char index[24];
+            sprintf(index, "%ld", parent.index++);
+            _path.push_back(index);
+        } else {
+            _path.push_back(_key);
+        }
+    }
+    std::size_t depth = _path.size();
+
+    if (_recordDepth == kNone) {
+        if (_recordsDepth != kNone && depth == _recordsDepth + 1) {
+            // Element of the records array
+            _recordDepth = depth;
+            newRow();
+        } else if (_recordsDepth == kNone && matches(_recordsPath, 0)) {
+            if (isContainer && isArray) {
+                _recordsDepth = depth;
+            } else {
+                _recordDepth = depth;
+                newRow();
+            }
+        }
+    }
+
+    if (_recordDepth == kNone) {
+        return;
+    }
+
+    for (std::size_t c = 0; c < _columnPaths.size(); ++c) {
+        if (filled(c) || !matches(_columnPaths[c], _recordDepth)) {
+            continue;
+        }
+
+        if (isContainer) {
+            Capture cap;
+            cap.column = c;
+            cap.depth = depth;
+            cap.open.push_back(isArray ? '[' : '{');
+            cap.text = cap.open.back();
+            cap.comma = false;
+            _captures.push_back(cap);
+        } else if (text) {
+            setCell(c, *text);
+        }
+    }
+}
+
+// The value at the end of the current path is complete
+void JsonProjection::endValue() {
+    std::size_t depth = _path.size();
+    if (_recordDepth == depth) {
+        _recordDepth = kNone;
+    }
+    if (_recordsDepth == depth) {
+        _recordsDepth = kNone;
+    }
+
+    if (!_path.empty()) {
+        _path.pop_back();
+    }
+}
+
+void JsonProjection::scalar(const std::string* text, const std::string& json) {
+    if (!_captures.empty()) {
+        capture(json, false);
+    }
+    beginValue(false, false, text);
+    endValue();
+}
+
+void JsonProjection::startContainer(bool isArray) {
+    if (!_captures.empty()) {
+        capture(isArray ? "[" : "{", true);
+    }
+
+    beginValue(true, isArray, 0);
+    _frames.push_back(Frame(isArray));
+}
+
+void JsonProjection::endContainer() {
+    _frames.pop_back();
+
+    std::size_t depth = _path.size();
+    for (std::size_t i = _captures.size(); i-- > 0; ) {
+        Capture& c = _captures[i];
+        c.text += (c.open.back() == '[') ? ']' : '}';
+        c.open.pop_back();
+        c.comma = true;
+
+        if (c.depth == depth) {
+            setCell(c.column, c.text);
+            _captures.erase(_captures.begin() + i);
+        }
+    }
+
+    endValue();
+}
+
+void JsonProjection::null() {
+    scalar(0, "null");
+}
+
+void JsonProjection::boolean(bool b) {
+    std::string text = b ? "true" : "false";
+    scalar(&text, text);
+}
+
+void JsonProjection::number(const std::string& text, bool) {
+    scalar(&text, text);
+}
+
+void JsonProjection::string(const std::string& s) {
+    std::string json;
+    if (!_captures.empty()) {
+        writeJsonString(s.data(), s.size(), json);
+    }
+    scalar(&s, json);
+}
+
+void JsonProjection::key(const std::string& k) {
+    _key = k;
+
+    for (std::vector<Capture>::iterator c = _captures.begin(); c != _captures.end(); ++c) {
+        if (c->comma) {
+            c->text += ',';
+        }
+        writeJsonString(k.data(), k.size(), c->text);
+        c->text += ':';
+        c->comma = false;
+    }
+}
+
+void JsonProjection::startObject() {
+    startContainer(false);
+}
+
+void JsonProjection::endObject() {
+    endContainer();
+}
+
+void JsonProjection::startArray() {
+    startContainer(true);
+}
+
+void JsonProjection::endArray() {
+    endContainer();
+}
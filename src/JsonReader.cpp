@@ -0,0 +1,444 @@
+//
+//  JsonReader.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "JsonReader.h"
+
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+
+// Exactly representable powers of ten, for numbers that can be read without rounding twice
+static const double kPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double parseJsonNumber(const std::string& text) {
+    const char* p = text.c_str();
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        ++p;
+    }
+    const char* start = p;
+    bool negative = (*p == '-');
+    if (*p == '-' || *p == '+') {
+        ++p;
+    }
+
+    // Up to 19 significant digits, with the exponent of the last one kept
+    boost::uint64_t mantissa = 0;
+    int significant = 0;
+    long exponent = 0;
+    bool digits = false;
+    for (; *p >= '0' && *p <= '9'; ++p) {
+        digits = true;
+        if (significant >= 19) {
+            ++exponent;
+        } else if (mantissa || *p != '0') {
+            mantissa = mantissa * 10 + (*p - '0');
+            ++significant;
+        }
+    }
+    if (*p == '.' && p[1] >= '0' && p[1] <= '9') {
+        for (++p; *p >= '0' && *p <= '9'; ++p) {
+            digits = true;
+            if (significant < 19) {
+                if (mantissa || *p != '0') {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    ++significant;
+                }
+                --exponent;
+            }
+        }
+    }
+    if (!digits) {
+        return 0;
+    }
+    if ((*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = (*e == '-');
+        if (*e == '-' || *e == '+') {
+            ++e;
+        }
+        if (*e >= '0' && *e <= '9') {
+            long value = 0;
+            for (p = e; *p >= '0' && *p <= '9'; ++p) {
+                if (value < 100000) {
+                    value = value * 10 + (*p - '0');
+                }
+            }
+            exponent += negativeExponent ? -value : value;
+        }
+    }
+
+    if (mantissa == 0) {
+        return negative ? -0.0 : 0.0;
+    }
+
+    // With at most 15 digits the mantissa and the power of ten are both exact, so the one
+    // multiplication or division rounds correctly
+    if (significant <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = (exponent >= 0) ? value * kPowersOfTen[exponent] : value / kPowersOfTen[-exponent];
+        return negative ? -value : value;
+    }
+
+    // Otherwise the stream library rounds it, in the classic locale
+    std::istringstream in(std::string(start, p));
+    in.imbue(std::locale::classic());
+    double value = 0;
+    in >> value;
+    return value;
+}
+
+JsonReader::JsonReader(JsonHandler& handler) : _handler(handler)
+{
+    reset();
+}
+
+void JsonReader::reset() {
+    _state = kValue;
+    _token = kNoToken;
+    _stack.clear();
+    _text.clear();
+    _isKey = false;
+    _escape = 0;
+    _unicode = 0;
+    _highSurrogate = 0;
+    _numberPart = kInteger;
+    _error.clear();
+}
+
+bool JsonReader::fail(const char* message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+// Called whenever a complete value (scalar or container) has been reported
+void JsonReader::valueDone() {
+    _state = _stack.empty() ? kDone : kCommaOrEnd;
+}
+
+// Append a unicode code point to the current token as UTF-8
+void JsonReader::appendCodePoint(unsigned long cp) {
+    if (cp < 0x80) {
+        _text += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        _text += static_cast<char>(0xC0 | (cp >> 6));
+        _text += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        _text += static_cast<char>(0xE0 | (cp >> 12));
+        _text += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        _text += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        _text += static_cast<char>(0xF0 | (cp >> 18));
+        _text += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        _text += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        _text += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// A high surrogate that no low surrogate followed, or a low surrogate on its own, becomes U+FFFD
+void JsonReader::unpairedSurrogate() {
+    appendCodePoint(0xFFFD);
+    _highSurrogate = 0;
+}
+
+// Continue reading a string token.  Returns the position after the last consumed byte.
+std::size_t JsonReader::scanString(const char* data, std::size_t len, std::size_t pos) {
+    while (pos < len) {
+        if (_escape == 0) {
+            // Fast path: copy the run of plain characters up to the next quote or escape in one go
+            std::size_t start = pos;
+            while (pos < len && data[pos] != '"' && data[pos] != '\\') {
+                ++pos;
+            }
+            if (_highSurrogate && (pos > start || (pos < len && data[pos] == '"'))) {
+                unpairedSurrogate();
+            }
+            _text.append(data + start, pos - start);
+            if (pos == len) {
+                break;
+            }
+
+            if (data[pos++] == '"') {
+                if (_isKey) {
+                    _handler.key(_text);
+                    _state = kColon;
+                } else {
+                    _handler.string(_text);
+                    valueDone();
+                }
+                _token = kNoToken;
+                _text.clear();
+                return pos;
+            }
+            _escape = 1;
+        } else if (_escape == 1) {
+            char c = data[pos++];
+            _escape = 0;
+            if (_highSurrogate && c != 'u') {
+                unpairedSurrogate();
+            }
+            switch (c) {
+                case '"':  _text += '"';  break;
+                case '\\': _text += '\\'; break;
+                case '/':  _text += '/';  break;
+                case 'b':  _text += '\b'; break;
+                case 'f':  _text += '\f'; break;
+                case 'n':  _text += '\n'; break;
+                case 'r':  _text += '\r'; break;
+                case 't':  _text += '\t'; break;
+                case 'u':
+                    _escape = 2;
+                    _unicode = 0;
+                    break;
+                default:
+                    fail("Invalid escape sequence in string");
+                    return len;
+            }
+        } else {
+            // Reading the 4 hex digits of \uXXXX
+            char c = data[pos++];
+            unsigned long digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else {
+                fail("Invalid unicode escape in string");
+                return len;
+            }
+
+            _unicode = (_unicode << 4) | digit;
+            if (++_escape == 6) {
+                _escape = 0;
+                bool low = (_unicode >= 0xDC00 && _unicode <= 0xDFFF);
+                if (_highSurrogate && low) {
+                    appendCodePoint(0x10000 + ((_highSurrogate - 0xD800) << 10) + (_unicode - 0xDC00));
+                    _highSurrogate = 0;
+                } else {
+                    if (_highSurrogate || low) {
+                        unpairedSurrogate();
+                    }
+                    if (_unicode >= 0xD800 && _unicode <= 0xDBFF) {
+                        _highSurrogate = _unicode;  // Wait for the low surrogate
+                    } else if (!low) {
+                        appendCodePoint(_unicode);
+                    }
+                }
+            }
+        }
+    }
+    return pos;
+}
+
+// Report the number token once it has ended, if it's a whole number by the grammar
+bool JsonReader::endNumber() {
+    if (_numberPart != kZero && _numberPart != kInteger && _numberPart != kFraction && _numberPart != kExponentDigits) {
+        return fail("Invalid number");
+    }
+
+    _handler.number(_text, _numberPart == kZero || _numberPart == kInteger);
+    _token = kNoToken;
+    _text.clear();
+    valueDone();
+    return true;
+}
+
+// Continue reading a number token
+std::size_t JsonReader::scanNumber(const char* data, std::size_t len, std::size_t pos) {
+    std::size_t start = pos;
+    bool ended = false;
+    while (pos < len && !ended) {
+        char c = data[pos];
+        bool digit = (c >= '0' && c <= '9');
+        switch (_numberPart) {
+            case kMinus:
+                if (digit) _numberPart = (c == '0') ? kZero : kInteger;
+                else ended = true;
+                break;
+            case kZero:
+            case kInteger:
+                if (digit && _numberPart == kInteger) _numberPart = kInteger;
+                else if (c == '.') _numberPart = kPoint;
+                else if (c == 'e' || c == 'E') _numberPart = kExponent;
+                else ended = true;  // Including a digit after a leading 0, which is then unexpected
+                break;
+            case kPoint:
+            case kFraction:
+                if (digit) _numberPart = kFraction;
+                else if ((c == 'e' || c == 'E') && _numberPart == kFraction) _numberPart = kExponent;
+                else ended = true;
+                break;
+            case kExponent:
+                if (c == '+' || c == '-') _numberPart = kExponentSign;
+                else if (digit) _numberPart = kExponentDigits;
+                else ended = true;
+                break;
+            case kExponentSign:
+            case kExponentDigits:
+                if (digit) _numberPart = kExponentDigits;
+                else ended = true;
+                break;
+        }
+        if (!ended) {
+            ++pos;
+        }
+    }
+    _text.append(data + start, pos - start);
+
+    if (ended && !endNumber()) {
+        return len;
+    }
+    return pos;
+}
+
+// Continue reading true, false or null
+std::size_t JsonReader::scanLiteral(const char* data, std::size_t len, std::size_t pos, bool atEnd) {
+    while (pos < len && data[pos] >= 'a' && data[pos] <= 'z') {
+        _text += data[pos++];
+    }
+
+    if (pos < len || atEnd || _text.size() >= 5) {
+        if (_text == "true") {
+            _handler.boolean(true);
+        } else if (_text == "false") {
+            _handler.boolean(false);
+        } else if (_text == "null") {
+            _handler.null();
+        } else {
+            fail("Invalid literal");
+            return len;
+        }
+        _token = kNoToken;
+        _text.clear();
+        valueDone();
+    }
+    return pos;
+}
+
+// Handle a structural character or the first character of a value
+bool JsonReader::structural(char c) {
+    switch (_state) {
+        case kValue:
+        case kFirstValueOrEnd:
+            if (c == ']' && _state == kFirstValueOrEnd) {
+                _stack.pop_back();
+                _handler.endArray();
+                valueDone();
+            } else if (c == '{') {
+                _stack.push_back('{');
+                _handler.startObject();
+                _state = kFirstKeyOrEnd;
+            } else if (c == '[') {
+                _stack.push_back('[');
+                _handler.startArray();
+                _state = kFirstValueOrEnd;
+            } else if (c == '"') {
+                _token = kStringToken;
+                _isKey = false;
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+                _token = kNumberToken;
+                _numberPart = (c == '-') ? kMinus : (c == '0') ? kZero : kInteger;
+                _text += c;
+            } else if (c == 't' || c == 'f' || c == 'n') {
+                _token = kLiteralToken;
+                _text += c;
+            } else {
+                return fail("Unexpected character, expected a value");
+            }
+            return true;
+        case kFirstKeyOrEnd:
+        case kKey:
+            if (c == '}' && _state == kFirstKeyOrEnd) {
+                _stack.pop_back();
+                _handler.endObject();
+                valueDone();
+            } else if (c == '"') {
+                _token = kStringToken;
+                _isKey = true;
+            } else {
+                return fail("Unexpected character, expected an object key");
+            }
+            return true;
+        case kColon:
+            if (c != ':') {
+                return fail("Expected ':' after object key");
+            }
+            _state = kValue;
+            return true;
+        case kCommaOrEnd:
+            if (c == ',') {
+                _state = (_stack.back() == '{') ? kKey : kValue;
+            } else if (c == '}' && _stack.back() == '{') {
+                _stack.pop_back();
+                _handler.endObject();
+                valueDone();
+            } else if (c == ']' && _stack.back() == '[') {
+                _stack.pop_back();
+                _handler.endArray();
+                valueDone();
+            } else {
+                return fail("Expected ',' or end of container");
+            }
+            return true;
+        case kDone:
+            return fail("Unexpected data after end of document");
+    }
+    return false;
+}
+
+bool JsonReader::feed(const char* data, std::size_t len) {
+    std::size_t pos = 0;
+    while (pos < len && _error.empty()) {
+        switch (_token) {
+            case kStringToken:
+                pos = scanString(data, len, pos);
+                break;
+            case kNumberToken:
+                pos = scanNumber(data, len, pos);
+                break;
+            case kLiteralToken:
+                pos = scanLiteral(data, len, pos);
+                break;
+            case kNoToken:
+            {
+                char c = data[pos++];
+                if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+                    continue;
+                }
+                structural(c);
+                break;
+            }
+        }
+    }
+
+    return _error.empty();
+}
+
+bool JsonReader::finish() {
+    if (!_error.empty()) {
+        return false;
+    }
+
+    // A top-level number or literal has no terminating character
+    if (_token == kNumberToken) {
+        if (!endNumber()) {
+            return false;
+        }
+    } else if (_token == kLiteralToken) {
+        scanLiteral("", 0, 0, true);
+    }
+
+    if (_state != kDone) {
+        return fail("Unexpected end of document");
+    }
+    return true;
+}
@@ -0,0 +1,171 @@
+//
+//  ListPool.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ListPool.h"
+#include "Logging.he"
+#include "Metrics.h"
+
+#include <algorithm>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+static const std::size_t kDefaultTarget = 16;    // Lists kept in stock when there is no demand
+static const std::size_t kMaxTarget = 1024;      // Upper bound for the stock after growing
+static const std::size_t kMaxPerTick = 64;       // Lists allocated per replenish to keep timer ticks short,
+                                                 // besides those that waiting checkouts need
+static const int kWaitMS = 50;                   // Time a background checkout waits between checks
+static const long kDefaultMaxWaitMS = 5000;      // Time a background checkout waits in all, 50 timer ticks
+
+// The pool is created the first time it's used, which must be on the main thread (ECM_CONNECT)
+ListPool::ListPool() : _target(kDefaultTarget), _shortfall(0), _waiting(0), _maxWait(kDefaultMaxWaitMS), _mainThread(boost::this_thread::get_id())
+{
+    Metrics::instance();  // Checkouts are counted in the metrics, which have to be created on the main thread as well
+}
+
+ListPool::~ListPool() {
+    drain();
+}
+
+ListPool& ListPool::instance() {
+    static ListPool theInst;
+
+    return theInst;
+}
+
+bool ListPool::onMainThread() {
+    return boost::this_thread::get_id() == _mainThread;
+}
+
+// Allocate lists until the pool is back at its target.  Demand that couldn't be met since the
+// last replenish grows the target so that batches of requests don't keep waiting on the timer.
+// Checkouts that are waiting get all the lists they need in this tick, however many that is, so
+// that a large document doesn't wait out a tick for every kMaxPerTick of its lists.
+void ListPool::replenish() {
+    if (!onMainThread()) {
+        return;
+    }
+
+    std::size_t needed;
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        if (_shortfall > 0) {
+            _target = std::min(kMaxTarget, std::max(_target * 2, _target + _shortfall));
+            _shortfall = 0;
+        }
+        needed = (_lists.size() < _target) ? std::min(_target - _lists.size(), kMaxPerTick) : 0;
+        if (_waiting > _lists.size()) {
+            needed = std::max(needed, _waiting - _lists.size());
+        }
+    }
+
+    if (needed == 0) {
+        return;
+    }
+
+    // Allocate outside of the lock so that background checkouts aren't held up
+    std::vector<EXTqlist*> fresh;
+    fresh.reserve(needed);
+    for (std::size_t i = 0; i < needed; ++i) {
+        fresh.push_back(new EXTqlist(listVlen));
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        _lists.insert(_lists.end(), fresh.begin(), fresh.end());
+    }
+    _replenished.notify_all();
+}
+
+// Free all lists remaining in the pool
+void ListPool::drain() {
+    std::vector<EXTqlist*> old;
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        old.swap(_lists);
+    }
+
+    for (std::vector<EXTqlist*>::iterator it = old.begin(); it != old.end(); ++it) {
+        delete *it;
+    }
+}
+
+// Take a list out of the pool, or an empty pointer if a background thread has waited too long for one
+boost::shared_ptr<EXTqlist> ListPool::checkout() {
+    std::vector<boost::shared_ptr<EXTqlist> > lists;
+    if (!checkout(1, lists)) {
+        return boost::shared_ptr<EXTqlist>();
+    }
+    return lists.back();
+}
+
+// Take count lists out of the pool, all or none
+bool ListPool::checkout(std::size_t count, std::vector<boost::shared_ptr<EXTqlist> >& lists) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+
+    std::size_t allocate = 0;
+    if (_lists.size() < count) {
+        Metrics::instance().count(Metrics::kPoolMisses, static_cast<boost::int64_t>(count));
+        if (onMainThread()) {
+            // Nothing to wait for on the main thread, just allocate what the pool is short of
+            allocate = count - _lists.size();
+        } else {
+            _shortfall += count - _lists.size();
+            _waiting += count;
+            LOG_DEBUG << "List pool short of " << count - _lists.size() << " lists, waiting for replenish";
+            boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(_maxWait);
+            while (_lists.size() < count && boost::get_system_time() < deadline) {
+                _replenished.timed_wait(lock, boost::posix_time::milliseconds(kWaitMS));
+            }
+            _waiting -= count;
+
+            if (_lists.size() < count) {
+                LOG_ERROR << "List pool still short of " << count - _lists.size() << " lists after " << _maxWait << " ms";
+                return false;
+            }
+        }
+    } else {
+        Metrics::instance().count(Metrics::kPoolHits, static_cast<boost::int64_t>(count));
+    }
+
+    lists.reserve(lists.size() + count);
+    std::size_t pooled = count - allocate;
+    for (std::size_t i = 0; i < pooled; ++i) {
+        lists.push_back(boost::shared_ptr<EXTqlist>(_lists.back()));
+        _lists.pop_back();
+    }
+    lock.unlock();
+
+    for (std::size_t i = 0; i < allocate; ++i) {
+        lists.push_back(boost::shared_ptr<EXTqlist>(new EXTqlist(listVlen)));
+    }
+    return true;
+}
+
+std::size_t ListPool::available() {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    return _lists.size();
+}
+
+std::size_t ListPool::target() {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    return _target;
+}
+
+void ListPool::setTarget(std::size_t t) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    _target = std::min(kMaxTarget, t);
+}
+
+long ListPool::maxWait() {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    return _maxWait;
+}
+
+void ListPool::setMaxWait(long ms) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    _maxWait = ms;
+}
@@ -0,0 +1,287 @@
+//
+//  ListSerializer.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ListSerializer.h"
+#include "JsonListBuilder.h"
+#include "OmnisTools.he"
+
+#include <cstdio>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+
+using namespace OmnisTools;
+
+static const std::size_t kBytesPerCell = 16;  // Estimate used to reserve the output up front
+
+bool ListSerializer::parseFormat(const std::string& name, Format& format) {
+    if (name.empty() || boost::iequals(name, "json")) {
+        format = kJson;
+    } else if (boost::iequals(name, "ndjson")) {
+        format = kNdjson;
+    } else if (boost::iequals(name, "csv")) {
+        format = kCsv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* ListSerializer::contentType(Format format) {
+    switch (format) {
+        case kNdjson:
+            return "application/x-ndjson";
+        case kCsv:
+            return "text/csv; charset=utf-8";
+        default:
+            return "application/json";
+    }
+}
+
+ListSerializer::ListSerializer(Format format) : _format(format)
+{ }
+
+// Read a character value as UTF-8.  The data stays valid until the next call.
+std::size_t ListSerializer::readChars(EXTfldval& val, const char*& data) {
+    qlong maxLength = val.getBinLen() + 1;  // Use binary length as approximation of maximum size
+    if (_chars.size() < static_cast<std::size_t>(maxLength)) {
+        _chars.resize(maxLength);
+    }
+
+    qlong length = 0;
+    val.getChar(maxLength, &_chars[0], length);
+
+    // UTF-8 is never longer than the qchar data, so it's converted in place
+    qbyte* utf8 = reinterpret_cast<qbyte*>(&_chars[0]);
+    std::size_t utf8Length = CHRunicode::charToUtf8(&_chars[0], length, utf8);
+    data = reinterpret_cast<const char*>(utf8);
+
+    return utf8Length;
+}
+
+void ListSerializer::readColumns(EXTqlist* list, std::vector<Column>& columns) {
+    str255 colName;
+    EXTfldval colTitleVal;
+
+    columns.resize(list->colCnt());
+    for (qshort col = 1; col <= list->colCnt(); ++col) {
+        list->getCol(col, qfalse, colName);
+        colTitleVal.setChar(colName);
+
+        Column& c = columns[col - 1];
+        c.name = getStringFromEXTFldVal(colTitleVal);
+        writeJsonString(c.name.data(), c.name.size(), c.key);
+        c.key += ':';
+    }
+}
+
+void ListSerializer::writeJsonValue(EXTfldval& val, std::string& out) {
+    if (val.isNull()) {
+        out += "null";
+        return;
+    }
+
+    char buffer[32];
+    const char* data;
+    std::size_t len;
+    EXTqlist* nested;
+
+    switch (getType(val).valType) {
+        case fftCharacter:
+            len = readChars(val, data);
+            writeJsonString(data, len, out);
+            break;
+        case fftInteger:
+            sprintf(buffer, "%ld", static_cast<long>(val.getLong()));
+            out += buffer;
+            break;
+        case fftNumber:
+        {
+            qreal number;
+            qshort dp;
+            val.getNum(number, dp);
+            if (boost::math::isfinite(number)) {
+                sprintf(buffer, "%.15g", number);
+                out += buffer;
+            } else {
+                out += "null";
+            }
+            break;
+        }
+        case fftBoolean:
+            out += getBoolFromEXTFldVal(val) ? "true" : "false";
+            break;
+        case fftDate:
+        {
+            std::string date = getISO8601DateStringFromEXTFldVal(val);
+            writeJsonString(date.data(), date.size(), out);
+            break;
+        }
+        case fftList:
+        case fftRow:
+            nested = val.getList(qfalse);
+            if (nested) {
+                writeArray(nested, out);
+                delete nested;
+            } else {
+                out += "null";
+            }
+            break;
+        case fftBinary:
+        case fftPicture:
+        case fftObject:
+        case fftObjref:
+            out += "null";  // No sensible JSON representation
+            break;
+        default:
+        {
+            std::string text = getStringFromEXTFldVal(val);
+            writeJsonString(text.data(), text.size(), out);
+            break;
+        }
+    }
+}
+
+void ListSerializer::writeObject(EXTqlist* list, qlong row, const std::vector<Column>& columns, std::string& out) {
+    EXTfldval colVal;
+
+    out += '{';
+    for (qshort col = 1; col <= static_cast<qshort>(columns.size()); ++col) {
+        if (col > 1) out += ',';
+        out += columns[col - 1].key;
+
+        list->getColValRef(row, col, colVal, qfalse);
+        writeJsonValue(colVal, out);
+    }
+    out += '}';
+}
+
+void ListSerializer::writeArray(EXTqlist* list, std::string& out) {
+    std::vector<Column> columns;
+    readColumns(list, columns);
+
+    out += '[';
+    for (qlong row = 1; row <= list->rowCnt(); ++row) {
+        if (row > 1) out += ',';
+        writeObject(list, row, columns, out);
+    }
+    out += ']';
+}
+
+void ListSerializer::writeCsvText(const char* data, std::size_t len, std::string& out) {
+    bool quote = false;
+    for (std::size_t i = 0; i < len && !quote; ++i) {
+        quote = (data[i] == ',' || data[i] == '"' || data[i] == '\r' || data[i] == '\n');
+    }
+
+    if (!quote) {
+        out.append(data, len);
+        return;
+    }
+
+    out += '"';
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        if (data[i] == '"') {
+            out.append(data + start, i - start + 1);
+            out += '"';
+            start = i + 1;
+        }
+    }
+    out.append(data + start, len - start);
+    out += '"';
+}
+
+void ListSerializer::writeCsvValue(EXTfldval& val, std::string& out) {
+    if (val.isNull()) {
+        return;
+    }
+
+    const char* data;
+    std::size_t len;
+    switch (getType(val).valType) {
+        case fftCharacter:
+            len = readChars(val, data);
+            writeCsvText(data, len, out);
+            break;
+        case fftList:
+        case fftRow:
+        {
+            // Nested lists are written as JSON text
+            std::string json;
+            writeJsonValue(val, json);
+            writeCsvText(json.data(), json.size(), out);
+            break;
+        }
+        case fftDate:
+            out += getISO8601DateStringFromEXTFldVal(val);
+            break;
+        default:
+        {
+            std::string json;
+            writeJsonValue(val, json);
+            if (json != "null") {
+                out += json;
+            }
+            break;
+        }
+    }
+}
+
+void ListSerializer::write(EXTqlist* list, std::string& out) {
+    out.reserve(out.size() + list->rowCnt() * list->colCnt() * kBytesPerCell);
+    
+    begin(list, out);
+    for (qlong row = 1; row <= list->rowCnt(); ++row) {
+        writeRow(list, row, out);
+    }
+    end(out);
+}
+
+void ListSerializer::begin(EXTqlist* list, std::string& out) {
+    readColumns(list, _columns);
+    
+    if (_format == kJson) {
+        out += '[';
+    } else if (_format == kCsv) {
+        for (std::size_t col = 0; col < _columns.size(); ++col) {
+            if (col > 0) out += ',';
+            writeCsvText(_columns[col].name.data(), _columns[col].name.size(), out);
+        }
+        out += "\r\n";
+    }
+}
+
+void ListSerializer::writeRow(EXTqlist* list, qlong row, std::string& out) {
+    switch (_format) {
+        case kJson:
+            if (row > 1) out += ',';
+            writeObject(list, row, _columns, out);
+            break;
+        case kNdjson:
+            writeObject(list, row, _columns, out);
+            out += '\n';
+            break;
+        case kCsv:
+        {
+            EXTfldval colVal;
+            for (qshort col = 1; col <= static_cast<qshort>(_columns.size()); ++col) {
+                if (col > 1) out += ',';
+                list->getColValRef(row, col, colVal, qfalse);
+                writeCsvValue(colVal, out);
+            }
+            out += "\r\n";
+            break;
+        }
+    }
+}
+
+void ListSerializer::end(std::string& out) {
+    if (_format == kJson) {
+        out += ']';
+    }
+}
@@ -0,0 +1,39 @@
+//
+//  ListSource.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ListSource.h"
+
+static const std::size_t kBatchSize = 64 * 1024;  // Rows are serialised until a batch reaches this size
+
+ListSource::ListSource(const boost::shared_ptr<EXTqlist>& list, ListSerializer::Format format)
+    : _list(list), _serializer(format), _row(0), _finished(false)
+{ }
+
+bool ListSource::next(const char*& data, std::size_t& len) {
+    _batch.clear();  // Keeps its capacity, so the buffer is reused for every batch
+    
+    if (!_finished) {
+        if (_row == 0) {
+            _serializer.begin(_list.get(), _batch);
+            _row = 1;
+        }
+        
+        qlong rows = _list->rowCnt();
+        while (_row <= rows && _batch.size() < kBatchSize) {
+            _serializer.writeRow(_list.get(), _row++, _batch);
+        }
+        
+        if (_row > rows) {
+            _serializer.end(_batch);
+            _finished = true;
+        }
+    }
+    
+    data = _batch.data();
+    len = _batch.size();
+    return true;
+}
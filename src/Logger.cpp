@@ -0,0 +1,293 @@
+//
+//  Logger.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace {
+    const long kWakeMs = 50;  // Longest a message waits before it's written
+
+    // Orders the writes to a ring's entries against the write to its head or tail
+    inline void memoryBarrier()
+    {
+#if defined(_WIN32)
+        MemoryBarrier();
+#else
+        __sync_synchronize();
+#endif
+    }
+}
+
+volatile int Logger::_level = Logger::kInfo;
+
+Logger& Logger::instance()
+{
+    static Logger theInst;
+
+    return theInst;
+}
+
+Logger::Logger() : _retiredDropped(0), _flushRequested(0), _flushed(0), _file(stdout), _fileBytes(0),
+                   _maxBytes(kDefaultMaxBytes), _maxFiles(kDefaultMaxFiles), _stopping(false), _ring(&Logger::retire)
+{
+    _writer = boost::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _writer.join();
+
+    // Rings of threads still running are left to the process exit, in case they log on the way out
+    _ring.release();
+    closeFile();
+}
+
+const char* Logger::levelName(Level level)
+{
+    static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "OFF" };
+    return names[level];
+}
+
+bool Logger::parseLevel(const std::string& name, Level& level)
+{
+    std::string upper(name);
+    for (std::string::iterator it = upper.begin(); it != upper.end(); ++it) {
+        *it = static_cast<char>(std::toupper(static_cast<unsigned char>(*it)));
+    }
+    if (upper == "WARN")
+        upper = "WARNING";
+
+    for (int i = kTrace; i <= kOff; ++i) {
+        if (upper == levelName(static_cast<Level>(i))) {
+            level = static_cast<Level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called as a thread exits: the writer deletes its ring once everything in it is written
+void Logger::retire(Ring* ring)
+{
+    Logger& logger = instance();
+    boost::mutex::scoped_lock lock(logger._mutex);
+    ring->retired = true;
+}
+
+Logger::Ring& Logger::ring()
+{
+    Ring* ring = _ring.get();
+    if (!ring) {
+        ring = new Ring();
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _rings.push_back(ring);
+        }
+        _ring.reset(ring);
+    }
+    return *ring;
+}
+
+void Logger::write(Level level, const std::string& message)
+{
+    if (!enabled(level))
+        return;
+
+    Ring& r = ring();
+    boost::uint32_t head = r.head;
+    if (head - r.tail >= Ring::kSize) {
+        ++r.dropped;
+        return;
+    }
+
+    Entry& entry = r.entries[head % Ring::kSize];
+    entry.level = level;
+    entry.time = boost::posix_time::microsec_clock::local_time();
+    entry.message = message;
+    memoryBarrier();
+    r.head = head + 1;
+
+    // Errors are written straight away, and a ring filling up is emptied before it's full
+    if (level >= kError || head - r.tail == Ring::kSize / 2)
+        _wake.notify_one();
+}
+
+bool Logger::setFile(const std::string& path, boost::uint64_t maxBytes, int maxFiles, std::string& error)
+{
+    std::FILE* file = stdout;
+    boost::uint64_t size = 0;
+    if (!path.empty()) {
+        file = std::fopen(path.c_str(), "ab");
+        if (!file) {
+            error = "Unable to open log file " + path;
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long end = std::ftell(file);
+        size = end > 0 ? static_cast<boost::uint64_t>(end) : 0;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    closeFile();
+    _path = path;
+    _file = file;
+    _fileBytes = size;
+    _maxBytes = maxBytes;
+    _maxFiles = std::max(0, maxFiles);
+    return true;
+}
+
+void Logger::flush()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    boost::uint64_t wanted = ++_flushRequested;
+    _wake.notify_all();
+    while (_flushed < wanted && !_stopping) {
+        _drained.wait(lock);
+    }
+}
+
+boost::uint64_t Logger::dropped()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    boost::uint64_t total = _retiredDropped;
+    for (std::vector<Ring*>::const_iterator it = _rings.begin(); it != _rings.end(); ++it) {
+        total += (*it)->dropped;
+    }
+    return total;
+}
+
+bool Logger::earlier(const Entry& a, const Entry& b)
+{
+    return a.time < b.time;
+}
+
+// Writer thread
+void Logger::run()
+{
+    std::vector<Entry> entries;
+    boost::mutex::scoped_lock lock(_mutex);
+    for (;;) {
+        bool stopping = _stopping;
+        if (!stopping && _flushed == _flushRequested) {
+            _wake.timed_wait(lock, boost::posix_time::milliseconds(kWakeMs));
+            stopping = _stopping;
+        }
+        boost::uint64_t requested = _flushRequested;
+
+        drain(entries);
+        if (!entries.empty()) {
+            // Stable, so messages from one thread in the same microsecond stay in order
+            std::stable_sort(entries.begin(), entries.end(), &Logger::earlier);
+            output(entries);
+            entries.clear();
+        }
+        if (requested != _flushed && _file)
+            std::fflush(_file);  // Including lines written on earlier passes, before the flush was asked for
+
+        _flushed = requested;
+        _drained.notify_all();
+        if (stopping)
+            break;
+    }
+}
+
+// Called with _mutex held.  Takes everything queued so far and deletes rings whose threads have exited.
+void Logger::drain(std::vector<Entry>& entries)
+{
+    std::vector<Ring*>::iterator it = _rings.begin();
+    while (it != _rings.end()) {
+        Ring& r = **it;
+        bool retired = r.retired;  // Read first: a retired ring gets nothing more
+        boost::uint32_t head = r.head;
+        memoryBarrier();
+        for (boost::uint32_t tail = r.tail; tail != head; ++tail) {
+            Entry& entry = r.entries[tail % Ring::kSize];
+            entries.push_back(Entry());
+            entries.back().level = entry.level;
+            entries.back().time = entry.time;
+            entries.back().message.swap(entry.message);
+        }
+        memoryBarrier();
+        r.tail = head;
+
+        if (retired) {
+            _retiredDropped += r.dropped;
+            delete *it;
+            it = _rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Called with _mutex held
+void Logger::output(const std::vector<Entry>& entries)
+{
+    bool flush = false;
+    for (std::vector<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (!_path.empty() && _maxBytes > 0 && _fileBytes >= _maxBytes)
+            rotate();
+        if (!_file)
+            return;
+
+        boost::gregorian::date date = it->time.date();
+        boost::posix_time::time_duration time = it->time.time_of_day();
+        int written = std::fprintf(_file, "%04d-%02d-%02d %02d:%02d:%02d.%06ld [%s] ",
+                                   static_cast<int>(date.year()), static_cast<int>(date.month()), static_cast<int>(date.day()),
+                                   static_cast<int>(time.hours()), static_cast<int>(time.minutes()), static_cast<int>(time.seconds()),
+                                   static_cast<long>(time.total_microseconds() % 1000000), levelName(it->level));
+        std::fwrite(it->message.data(), 1, it->message.size(), _file);
+        std::fputc('\n', _file);
+        _fileBytes += static_cast<boost::uint64_t>(std::max(written, 0)) + it->message.size() + 1;
+        flush = flush || it->level >= kError;
+    }
+    if (flush || _stopping)
+        std::fflush(_file);
+}
+
+// Called with _mutex held.  path becomes path.1, path.1 becomes path.2 and so on, dropping the oldest.
+void Logger::rotate()
+{
+    closeFile();
+    if (_maxFiles > 0) {
+        std::remove((_path + "." + boost::lexical_cast<std::string>(_maxFiles)).c_str());
+        for (int i = _maxFiles - 1; i >= 1; --i) {
+            std::string from = _path + "." + boost::lexical_cast<std::string>(i);
+            std::rename(from.c_str(), (_path + "." + boost::lexical_cast<std::string>(i + 1)).c_str());
+        }
+        std::rename(_path.c_str(), (_path + ".1").c_str());
+    }
+    _file = std::fopen(_path.c_str(), "wb");
+    if (!_file)
+        _file = stdout;
+    _fileBytes = 0;
+}
+
+void Logger::closeFile()
+{
+    if (_file && _file != stdout) {
+        std::fclose(_file);
+    } else if (_file) {
+        std::fflush(_file);
+    }
+    _file = 0;
+}
@@ -0,0 +1,278 @@
+//
+//  Metrics.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Metrics.h"
+
+#include <algorithm>
+
+const char* Metrics::kOtherHosts = "(other)";
+const char* Metrics::kTcpSampled = "streamed requests (Linux)";
+
+/* Histogram */
+
+Metrics::Histogram::Histogram() : _count(0), _sum(0)
+{
+    std::fill(_counts, _counts + kBuckets, 0);
+}
+
+// Values below 2 * kSubBuckets have a bucket each.  Above that each power of two is split into
+// kSubBuckets, indexed by the value's top kSubBucketBits + 1 bits.
+int Metrics::Histogram::bucket(boost::uint64_t value)
+{
+    if (value < 2 * kSubBuckets)
+        return static_cast<int>(value);
+
+    int top = 0;
+    for (boost::uint64_t v = value; v >>= 1; )
+        ++top;
+    if (top >= kMaxBits)
+        return kBuckets - 1;
+
+    int shift = top - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + static_cast<int>((value >> shift) - kSubBuckets);
+}
+
+boost::uint64_t Metrics::Histogram::highestValue(int bucket)
+{
+    if (bucket < 2 * kSubBuckets)
+        return static_cast<boost::uint64_t>(bucket);
+
+    int shift = bucket / kSubBuckets - 1;
+    boost::uint64_t subBucket = static_cast<boost::uint64_t>(bucket % kSubBuckets + kSubBuckets);
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void Metrics::Histogram::record(boost::uint64_t value)
+{
+    ++_counts[bucket(value)];
+    ++_count;
+    _sum += value;
+}
+
+void Metrics::Histogram::add(const Histogram& other)
+{
+    for (int i = 0; i < kBuckets; ++i) {
+        _counts[i] += other._counts[i];
+    }
+    _count += other._count;
+    _sum += other._sum;
+}
+
+void Metrics::Histogram::subtract(const Histogram& other)
+{
+    for (int i = 0; i < kBuckets; ++i) {
+        _counts[i] -= std::min(_counts[i], other._counts[i]);
+    }
+    _count -= std::min(_count, other._count);
+    _sum -= std::min(_sum, other._sum);
+}
+
+double Metrics::Histogram::mean() const
+{
+    return _count ? static_cast<double>(_sum) / static_cast<double>(_count) : 0;
+}
+
+boost::uint64_t Metrics::Histogram::percentile(double percent) const
+{
+    if (_count == 0)
+        return 0;
+
+    // Rank of the value wanted, counting from 1
+    boost::uint64_t rank = static_cast<boost::uint64_t>(percent / 100.0 * static_cast<double>(_count) + 0.5);
+    rank = std::max<boost::uint64_t>(1, std::min(rank, _count));
+
+    boost::uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += _counts[i];
+        if (seen >= rank)
+            return highestValue(i);
+    }
+    return highestValue(kBuckets - 1);
+}
+
+/* Snapshot */
+
+Metrics::Snapshot::Snapshot()
+{
+    std::fill(counters, counters + kCounterCount, 0);
+}
+
+/* Shards */
+
+Metrics::Shard::Shard()
+{
+    std::fill(counters, counters + kCounterCount, 0);
+    std::fill(hosts, hosts + kMaxHosts + 1, static_cast<Histogram*>(0));
+}
+
+Metrics::Shard::~Shard()
+{
+    for (std::size_t i = 0; i <= kMaxHosts; ++i) {
+        delete hosts[i];
+    }
+}
+
+void Metrics::Shard::clear()
+{
+    for (int i = 0; i < kCounterCount; ++i) {
+        if (i != kQueueDepth)
+            counters[i] = 0;
+    }
+    for (std::size_t i = 0; i <= kMaxHosts; ++i) {
+        delete hosts[i];
+        hosts[i] = 0;
+    }
+    for (int i = 0; i < kStatusClassCount; ++i) {
+        statuses[i] = Histogram();
+    }
+    deliveryLag = Histogram();
+    tcpRtt = Histogram();
+}
+
+/* Metrics */
+
+Metrics& Metrics::instance()
+{
+    static Metrics theInst;
+
+    return theInst;
+}
+
+Metrics::Metrics() : _nextShard(0)
+{ }
+
+const char* Metrics::counterName(Counter counter)
+{
+    static const char* names[kCounterCount] = { "requests_started", "requests_completed", "requests_failed", "bytes_in",
+                                                "bytes_out", "tcp_retransmits", "pool_hits", "pool_misses", "slow_requests",
+                                                "queue_depth" };
+    return names[counter];
+}
+
+const char* Metrics::statusClassName(StatusClass statusClass)
+{
+    static const char* names[kStatusClassCount] = { "1xx", "2xx", "3xx", "4xx", "5xx", "failed" };
+    return names[statusClass];
+}
+
+Metrics::StatusClass Metrics::statusClass(int status)
+{
+    if (status < 100 || status > 599)
+        return kStatusFailed;
+    return static_cast<StatusClass>(status / 100 - 1);
+}
+
+Metrics::Shard& Metrics::shard()
+{
+    std::size_t* index = _shard.get();
+    if (!index) {
+        boost::mutex::scoped_lock lock(_mutex);
+        index = new std::size_t(_nextShard++ % kShards);
+        _shard.reset(index);
+    }
+    return _shards[*index];
+}
+
+// Slot of the host's histogram, shared by every shard so their histograms can be merged
+std::size_t Metrics::hostSlot(Shard& shard, const std::string& host)
+{
+    std::map<std::string, std::size_t>::iterator it = shard.hostSlots.find(host);
+    if (it != shard.hostSlots.end())
+        return it->second;
+
+    std::size_t slot;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        std::map<std::string, std::size_t>::iterator shared = _hostSlots.find(host);
+        if (shared != _hostSlots.end()) {
+            slot = shared->second;
+        } else if (_hosts.size() < kMaxHosts) {
+            slot = _hosts.size();
+            _hosts.push_back(host);
+            _hostSlots[host] = slot;
+        } else {
+            slot = kMaxHosts;
+        }
+    }
+    shard.hostSlots[host] = slot;
+    return slot;
+}
+
+void Metrics::count(Counter counter, boost::int64_t amount)
+{
+    Shard& s = shard();
+    boost::mutex::scoped_lock lock(s.mutex);
+    s.counters[counter] += amount;
+}
+
+void Metrics::recordLatency(const std::string& host, int status, boost::uint64_t micros)
+{
+    Shard& s = shard();
+    boost::mutex::scoped_lock lock(s.mutex);
+    s.statuses[statusClass(status)].record(micros);
+
+    std::size_t slot = hostSlot(s, host);
+    if (!s.hosts[slot])
+        s.hosts[slot] = new Histogram();
+    s.hosts[slot]->record(micros);
+}
+
+void Metrics::recordDeliveryLag(boost::uint64_t micros)
+{
+    Shard& s = shard();
+    boost::mutex::scoped_lock lock(s.mutex);
+    s.deliveryLag.record(micros);
+}
+
+void Metrics::recordRtt(boost::uint64_t micros)
+{
+    Shard& s = shard();
+    boost::mutex::scoped_lock lock(s.mutex);
+    s.tcpRtt.record(micros);
+}
+
+// Called with the shard's lock held
+void Metrics::addTo(Snapshot& snapshot, const Shard& shard)
+{
+    for (int i = 0; i < kCounterCount; ++i) {
+        snapshot.counters[i] += shard.counters[i];
+    }
+    for (std::size_t slot = 0; slot <= kMaxHosts; ++slot) {
+        if (shard.hosts[slot]) {
+            std::string host;
+            {
+                // A slot the shard has used is always named, as slots are named before they're handed out
+                boost::mutex::scoped_lock lock(_mutex);
+                host = (slot < _hosts.size()) ? _hosts[slot] : kOtherHosts;
+            }
+            snapshot.hosts[host].add(*shard.hosts[slot]);
+        }
+    }
+    for (int i = 0; i < kStatusClassCount; ++i) {
+        snapshot.statuses[i].add(shard.statuses[i]);
+    }
+    snapshot.deliveryLag.add(shard.deliveryLag);
+    snapshot.tcpRtt.add(shard.tcpRtt);
+}
+
+Metrics::Snapshot Metrics::snapshot()
+{
+    Snapshot snapshot;
+    for (std::size_t i = 0; i < kShards; ++i) {
+        boost::mutex::scoped_lock lock(_shards[i].mutex);
+        addTo(snapshot, _shards[i]);
+    }
+    return snapshot;
+}
+
+void Metrics::reset()
+{
+    for (std::size_t i = 0; i < kShards; ++i) {
+        boost::mutex::scoped_lock lock(_shards[i].mutex);
+        _shards[i].clear();
+    }
+}
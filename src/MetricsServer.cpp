@@ -0,0 +1,267 @@
+//
+//  MetricsServer.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "MetricsServer.h"
+#include "Logging.he"
+#include "JsonListBuilder.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/network/protocol/http/server.hpp>
+
+namespace {
+    struct Handler;
+    typedef boost::network::http::async_server<Handler> HttpServer;
+
+    // Called on the server's handler thread for each request
+    struct Handler {
+        void operator()(HttpServer::request const& request, HttpServer::connection_ptr connection) {
+            std::string path = request.destination.substr(0, request.destination.find('?'));
+
+            HttpServer::connection::status_t status = HttpServer::connection::ok;
+            std::string body;
+            std::string type = "text/plain; version=0.0.4";
+            if (request.method != "GET") {
+                status = HttpServer::connection::not_supported;
+                body = "Only GET is supported\n";
+            } else if (path == "/metrics") {
+                body = MetricsServer::prometheus(Metrics::instance().snapshot());
+            } else if (path == "/inflight") {
+                body = MetricsServer::inflightJson(InflightRegistry::instance().requests());
+                type = "application/json";
+            } else {
+                status = HttpServer::connection::not_found;
+                body = "Not found\n";
+            }
+
+            std::string length = boost::lexical_cast<std::string>(body.size());
+            HttpServer::response_header headers[] = {
+                { "Content-Type", type },
+                { "Content-Length", length },
+                { "Connection", "close" }
+            };
+            connection->set_status(status);
+            connection->set_headers(boost::make_iterator_range(headers, headers + 3));
+            connection->write(body);
+        }
+    };
+
+    // Quantiles reported for each histogram
+    const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    const int kQuantileCount = sizeof(kQuantiles) / sizeof(kQuantiles[0]);
+
+    std::string number(double value)
+    {
+        char text[32];
+        std::sprintf(text, "%.9g", value);
+        return text;
+    }
+
+    // A label value with \, " and newlines escaped
+    std::string labelValue(const std::string& value)
+    {
+        std::string escaped;
+        for (std::string::const_iterator it = value.begin(); it != value.end(); ++it) {
+            if (*it == '\\' || *it == '"') {
+                escaped += '\\';
+                escaped += *it;
+            } else if (*it == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += *it;
+            }
+        }
+        return escaped;
+    }
+
+    // Requests made through cpp-netlib aren't sampled, so the TCP figures say which ones they cover
+    std::string tcpCoverage()
+    {
+        return std::string("Sampled from TCP_INFO for ") + Metrics::kTcpSampled + " only, not those made through cpp-netlib.";
+    }
+
+    void writeHeader(std::string& out, const std::string& name, const char* type, const std::string& help)
+    {
+        out += "# HELP " + name + " " + help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+    }
+
+    // A histogram in microseconds as a summary in seconds
+    void writeSummary(std::string& out, const std::string& name, const std::string& labels, const Metrics::Histogram& histogram)
+    {
+        std::string separator = labels.empty() ? "" : ",";
+        for (int i = 0; i < kQuantileCount; ++i) {
+            double seconds = static_cast<double>(histogram.percentile(kQuantiles[i] * 100.0)) / 1000000.0;
+            out += name + "{" + labels + separator + "quantile=\"" + number(kQuantiles[i]) + "\"} " + number(seconds) + "\n";
+        }
+        std::string braced = labels.empty() ? "" : "{" + labels + "}";
+        out += name + "_sum" + braced + " " + number(static_cast<double>(histogram.sum()) / 1000000.0) + "\n";
+        out += name + "_count" + braced + " " + boost::lexical_cast<std::string>(histogram.count()) + "\n";
+    }
+}
+
+struct MetricsServer::Listener {
+    Listener(int port)
+        : service(boost::make_shared<boost::asio::io_service>()),
+          options(handler),
+          server(options.address("127.0.0.1").port(boost::lexical_cast<std::string>(port)).reuse_address(true).io_service(service))
+    { }
+
+    // Server thread.  The server is already listening, so this only runs its io_service: calling
+    // server.run() would listen again, which can undo a stop() that comes before the thread is going.
+    void run() {
+        for (;;) {
+            try {
+                service->run();
+                return;
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Metrics server: " << e.what();
+            }
+        }
+    }
+
+    Handler handler;
+    boost::shared_ptr<boost::asio::io_service> service;
+    HttpServer::options options;
+    HttpServer server;
+};
+
+MetricsServer& MetricsServer::instance()
+{
+    static MetricsServer theInst;
+
+    return theInst;
+}
+
+MetricsServer::MetricsServer() : _port(0)
+{ }
+
+MetricsServer::~MetricsServer()
+{
+    stopListener();
+}
+
+bool MetricsServer::start(int port, std::string& error)
+{
+    // Read by the server thread, so created here on the main thread
+    Metrics::instance();
+    InflightRegistry::instance();
+
+    boost::mutex::scoped_lock lock(_mutex);
+    stopListener();
+    if (port <= 0 || port > 65535) {
+        error = "Invalid metrics port " + boost::lexical_cast<std::string>(port);
+        return false;
+    }
+
+    try {
+        _listener.reset(new Listener(port));
+        _listener->server.listen();  // Throws if the port can't be bound
+    } catch (const std::exception& e) {
+        error = "Unable to listen on port " + boost::lexical_cast<std::string>(port) + ": " + e.what();
+        _listener.reset();
+        return false;
+    }
+
+    _thread = boost::thread(boost::bind(&Listener::run, _listener.get()));
+    _port = port;
+    LOG_INFO << "Serving metrics on http://127.0.0.1:" << port << "/metrics";
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    stopListener();
+}
+
+int MetricsServer::port()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _port;
+}
+
+// Called with _mutex held
+void MetricsServer::stopListener()
+{
+    if (!_listener)
+        return;
+
+    _listener->server.stop();
+    _thread.join();
+    _listener.reset();  // Waits for the handler thread
+    _port = 0;
+}
+
+std::string MetricsServer::prometheus(const Metrics::Snapshot& snapshot)
+{
+    std::string out;
+
+    for (int counter = 0; counter < Metrics::kCounterCount; ++counter) {
+        std::string name = std::string("httplib_") + Metrics::counterName(static_cast<Metrics::Counter>(counter));
+        if (counter == Metrics::kQueueDepth) {
+            writeHeader(out, name, "gauge", "Requests started in the background and not yet delivered.");
+        } else if (counter == Metrics::kTcpRetransmits) {
+            name += "_total";
+            writeHeader(out, name, "counter", "TCP segments retransmitted since the last $resetMetrics. " + tcpCoverage());
+        } else {
+            name += "_total";
+            writeHeader(out, name, "counter", "Count since the last $resetMetrics.");
+        }
+        out += name + " " + boost::lexical_cast<std::string>(snapshot.counters[counter]) + "\n";
+    }
+
+    std::string name = "httplib_request_duration_seconds";
+    writeHeader(out, name, "summary", "Request latency by host.");
+    for (std::map<std::string, Metrics::Histogram>::const_iterator it = snapshot.hosts.begin(); it != snapshot.hosts.end(); ++it) {
+        writeSummary(out, name, "host=\"" + labelValue(it->first) + "\"", it->second);
+    }
+
+    name = "httplib_request_duration_by_status_seconds";
+    writeHeader(out, name, "summary", "Request latency by status class.");
+    for (int statusClass = 0; statusClass < Metrics::kStatusClassCount; ++statusClass) {
+        writeSummary(out, name, std::string("status=\"") + Metrics::statusClassName(static_cast<Metrics::StatusClass>(statusClass)) + "\"",
+                     snapshot.statuses[statusClass]);
+    }
+
+    name = "httplib_delivery_lag_seconds";
+    writeHeader(out, name, "summary", "Time from a worker completing to its result reaching Omnis.");
+    writeSummary(out, name, std::string(), snapshot.deliveryLag);
+
+    name = "httplib_tcp_rtt_seconds";
+    writeHeader(out, name, "summary", "Smoothed TCP round trip time of each connection as its response finished. " + tcpCoverage());
+    writeSummary(out, name, std::string(), snapshot.tcpRtt);
+
+    return out;
+}
+
+std::string MetricsServer::inflightJson(const std::vector<InflightRegistry::Request>& requests)
+{
+    std::string out = "[";
+    for (std::vector<InflightRegistry::Request>::const_iterator it = requests.begin(); it != requests.end(); ++it) {
+        if (it != requests.begin())
+            out += ",";
+        out += "\n{\"id\":" + boost::lexical_cast<std::string>(it->id) + ",\"method\":";
+        writeJsonString(it->method.data(), it->method.size(), out);
+        out += ",\"url\":";
+        writeJsonString(it->url.data(), it->url.size(), out);
+        out += std::string(",\"stage\":\"") + InflightRegistry::stageName(it->stage) + "\"";
+        out += ",\"elapsed_ms\":" + number(it->elapsed);
+        out += ",\"stage_elapsed_ms\":" + number(it->stageElapsed);
+        out += ",\"bytes_in\":" + boost::lexical_cast<std::string>(it->bytesIn);
+        out += ",\"bytes_out\":" + boost::lexical_cast<std::string>(it->bytesOut);
+        out += std::string(",\"slow\":") + (it->slow ? "true" : "false") + "}";
+    }
+    out += "\n]\n";
+    return out;
+}
@@ -0,0 +1,190 @@
+//
+//  MultipartSource.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "MultipartSource.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+using namespace OmnisTools;
+
+// Read a text or binary column of a part.  Returns false if it's missing or another type.
+static bool readPartValue(ParamMap& part, const char* column, std::string& value)
+{
+    ParamMap::iterator it = part.find(column);
+    if (it == part.end()) {
+        return false;
+    }
+    
+    if (std::string* text = boost::any_cast<std::string>(&it->second)) {
+        value.swap(*text);
+        return true;
+    }
+    if (std::vector<unsigned char>* binary = boost::any_cast<std::vector<unsigned char> >(&it->second)) {
+        value.assign(binary->begin(), binary->end());
+        std::vector<unsigned char>().swap(*binary);
+        return true;
+    }
+    return false;
+}
+
+// Quote a name or filename for Content-Disposition as browsers do: quotes and line breaks are percent encoded
+static std::string quoteName(const std::string& name)
+{
+    std::string quoted = "\"";
+    for (std::string::const_iterator c = name.begin(); c != name.end(); ++c) {
+        if (*c == '"')
+            quoted += "%22";
+        else if (*c == '\r')
+            quoted += "%0D";
+        else if (*c == '\n')
+            quoted += "%0A";
+        else
+            quoted += *c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+MultipartSource::MultipartSource(std::vector<ParamMap>& parts) : _piece(0), _textSent(false), _length(0)
+{
+    std::string id = boost::uuids::to_string(boost::uuids::random_generator()());
+    boost::erase_all(id, "-");
+    _boundary = "----HTTPlibBoundary" + id;
+    
+    for (std::vector<ParamMap>::iterator part = parts.begin(); part != parts.end() && _error.empty(); ++part) {
+        addPart(*part);
+    }
+    
+    if (_error.empty()) {
+        Piece closing;
+        closing.text = "--" + _boundary + "--\r\n";
+        _length += closing.text.size();
+        _pieces.push_back(closing);
+    }
+}
+
+std::string MultipartSource::contentType() const
+{
+    return "multipart/form-data; boundary=" + _boundary;
+}
+
+bool MultipartSource::fail(const std::string& message)
+{
+    _error = message;
+    return false;
+}
+
+void MultipartSource::addPart(ParamMap& part)
+{
+    std::string name, filename, contentType, value, path;
+    if (!readPartValue(part, "name", name) || name.empty()) {
+        fail("Multipart part has no name");
+        return;
+    }
+    readPartValue(part, "filename", filename);
+    readPartValue(part, "content_type", contentType);
+    readPartValue(part, "path", path);
+    bool hasValue = readPartValue(part, "value", value);
+    
+    if (path.empty() == !hasValue) {
+        fail("Multipart part " + name + " needs one of value and path");
+        return;
+    }
+    
+    Piece piece;
+    if (!path.empty()) {
+        // Checked (and sized) now so a missing file fails before anything is sent
+        FileSource file(path);
+        if (!file.error().empty()) {
+            fail(file.error());
+            return;
+        }
+        piece.path = path;
+        piece.fileLength = file.length();
+        
+        if (filename.empty()) {
+            std::size_t slash = path.find_last_of("/\\");
+            filename = (slash == std::string::npos) ? path : path.substr(slash + 1);
+        }
+        if (contentType.empty()) {
+            contentType = "application/octet-stream";
+        }
+    }
+    
+    // The delimiter of the previous part (or the start of the body) is written with the headers
+    piece.text = "--" + _boundary + "\r\nContent-Disposition: form-data; name=" + quoteName(name);
+    if (!filename.empty()) {
+        piece.text += "; filename=" + quoteName(filename);
+    }
+    piece.text += "\r\n";
+    if (!contentType.empty()) {
+        piece.text += "Content-Type: " + contentType + "\r\n";
+    }
+    piece.text += "\r\n";
+    
+    if (hasValue) {
+        piece.text += value;
+    }
+    _length += piece.text.size() + piece.fileLength;
+    _pieces.push_back(piece);
+    
+    // Line break ending the part's content
+    Piece ending;
+    ending.text = "\r\n";
+    _length += ending.text.size();
+    _pieces.push_back(ending);
+}
+
+bool MultipartSource::next(const char*& data, std::size_t& len)
+{
+    data = 0;
+    len = 0;
+    if (!_error.empty()) {
+        return false;
+    }
+    
+    while (_piece < _pieces.size()) {
+        Piece& piece = _pieces[_piece];
+        if (!_textSent) {
+            _textSent = true;
+            if (!piece.text.empty()) {
+                data = piece.text.data();
+                len = piece.text.size();
+                return true;
+            }
+        }
+        
+        if (!piece.path.empty()) {
+            if (!piece.file) {
+                piece.file = boost::make_shared<FileSource>(piece.path);
+                if (!piece.file->error().empty()) {
+                    return fail(piece.file->error());
+                }
+                if (piece.file->length() != piece.fileLength) {
+                    return fail("File changed size while uploading: " + piece.path);  // The Content-Length would be wrong
+                }
+            }
+            if (!piece.file->next(data, len)) {
+                return fail(piece.file->error());
+            }
+            if (len > 0) {
+                return true;
+            }
+            piece.file.reset();  // Closes the file and unmaps its last window
+        }
+        
+        // Text already sent is released as the body goes
+        std::string().swap(piece.text);
+        ++_piece;
+        _textSent = false;
+    }
+    return true;
+}
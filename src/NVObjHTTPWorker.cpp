@@ -11,6 +11,9 @@
 #include "ThreadTimer.he"
 #include "Logging.he"
 #include "CppNetlibDelegate.h"
+#include "RequestTimings.h"
+#include "Metrics.h"
+#include "Tracer.h"
 
 #include <boost/make_shared.hpp>
 #include <boost/thread.hpp>
@@ -27,7 +30,7 @@ using namespace OmnisTools;
  **************************************************************************************************/
 
 // Constructor
-NVObjHTTPWorker::NVObjHTTPWorker(qobjinst objinst, tThreadData* pThreadData) : NVObjBase(objinst) {
+NVObjHTTPWorker::NVObjHTTPWorker(qobjinst objinst, tThreadData* pThreadData) : NVObjBase(objinst), _queued(false) {
 
 }
 
@@ -36,6 +39,8 @@ NVObjHTTPWorker::~NVObjHTTPWorker() {
     // Unsubscribe this instance from the timer
     ThreadTimer& timerInst = ThreadTimer::instance();
     timerInst.unsubscribe(this);
+    
+    dequeue();
 }
 
 /**************************************************************************************************
@@ -54,7 +59,9 @@ const static qshort cMethodError      = 4000,
                     cMethodInitialize = 4001,
                     cMethodRun        = 4002,
                     cMethodStart      = 4003,
-                    cMethodCancel     = 4004;
+                    cMethodCancel     = 4004,
+                    cMethodWriteChunk = 4005,
+                    cMethodEndChunks  = 4006;
 
 /**************************************************************************************************
  **                                 INSTANCE METHODS                                             **
@@ -88,6 +95,14 @@ qlong NVObjHTTPWorker::methodCall( tThreadData* pThreadData )
             pThreadData->mCurMethodName = "$cancel";
             result = methodCancel(pThreadData, paramCount);
             break;
+        case cMethodWriteChunk:
+            pThreadData->mCurMethodName = "$writeChunk";
+            result = methodWriteChunk(pThreadData, paramCount);
+            break;
+        case cMethodEndChunks:
+            pThreadData->mCurMethodName = "$endChunks";
+            result = methodEndChunks(pThreadData, paramCount);
+            break;
 	}
 	
 	callErrorMethod(pThreadData, result);
@@ -164,7 +179,8 @@ ECOparam cHTTPWorkerMethodsParamsTable[] =
 	4900, fftInteger  , 0, 0,
 	4901, fftCharacter, 0, 0,
 	4902, fftCharacter, 0, 0,
-	4903, fftCharacter, 0, 0
+	4903, fftCharacter, 0, 0,
+	4905, fftCharacter, 0, 0
 };
 
 // Table of Methods available for Simple
@@ -182,7 +198,9 @@ ECOmethodEvent cHTTPWorkerMethodsTable[] =
 	cMethodInitialize, cMethodInitialize, fftBoolean, 0,                                 0, 0, 0,
     cMethodRun,        cMethodRun,        fftNone,    0,                                 0, 0, 0,
     cMethodStart,      cMethodStart,      fftNone,    0,                                 0, 0, 0,
-    cMethodCancel,     cMethodCancel,     fftNone,    0,                                 0, 0, 0
+    cMethodCancel,     cMethodCancel,     fftNone,    0,                                 0, 0, 0,
+    cMethodWriteChunk, cMethodWriteChunk, fftBoolean, 1, &cHTTPWorkerMethodsParamsTable[4], 0, 0,
+    cMethodEndChunks,  cMethodEndChunks,  fftBoolean, 0,                                 0, 0, 0
 };
 
 // List of methods in Simple
@@ -222,13 +240,71 @@ qlong NVObjHTTPWorker::returnProperties( tThreadData* pThreadData )
  **************************************************************************************************/
 
 
+// Milliseconds from the start of the request to each phase, empty for phases it didn't go through
+// TCP_INFO columns after the phases, each null unless the connection was sampled
+static const char* kTcpColumns[] = { "tcp_rtt", "tcp_rtt_var", "tcp_retransmits", "tcp_cwnd", "tcp_delivery_rate" };
+static const int kTcpColumnCount = sizeof(kTcpColumns) / sizeof(kTcpColumns[0]);
+
+static void readTimings(EXTfldval& row, RequestTimings& timings) {
+    
+    str255 colName;
+    EXTfldval colVal;
+    EXTqlist* retList = new EXTqlist(listVlen);
+    
+    for (int phase = 0; phase < RequestTimings::kPhaseCount; ++phase) {
+        colName = initStr255(RequestTimings::name(static_cast<RequestTimings::Phase>(phase)));
+        retList->addCol(fftNumber, dpFmask, 0, &colName);
+    }
+    for (int column = 0; column < kTcpColumnCount; ++column) {
+        colName = initStr255(kTcpColumns[column]);
+        retList->addCol(fftNumber, dpFmask, 0, &colName);
+    }
+    
+    retList->insertRow();
+    for (int phase = 0; phase < RequestTimings::kPhaseCount; ++phase) {
+        retList->getColValRef(1, static_cast<qshort>(phase + 1), colVal, qtrue);
+        if (timings.marked(static_cast<RequestTimings::Phase>(phase)))
+            getEXTFldValFromDouble(colVal, timings.elapsed(static_cast<RequestTimings::Phase>(phase)));
+        else
+            colVal.setNull(fftNumber, dpFmask);
+    }
+    
+    // Round trip times in milliseconds, like the phases; the delivery rate in bytes per second
+    const RequestTimings::TcpInfo& tcp = timings.tcpInfo();
+    double tcpValues[kTcpColumnCount] = { tcp.rtt / 1000.0, tcp.rttVar / 1000.0, static_cast<double>(tcp.retransmits),
+                                          static_cast<double>(tcp.cwnd), static_cast<double>(tcp.deliveryRate) };
+    for (int column = 0; column < kTcpColumnCount; ++column) {
+        retList->getColValRef(1, static_cast<qshort>(RequestTimings::kPhaseCount + column + 1), colVal, qtrue);
+        bool reported = tcp.sampled && (column != kTcpColumnCount - 1 || tcp.deliveryRate);
+        if (reported)
+            getEXTFldValFromDouble(colVal, tcpValues[column]);
+        else
+            colVal.setNull(fftNumber, dpFmask);
+    }
+    
+    row.setList(retList, qtrue);
+}
+
 static bool readResult(EXTfldval& row, OmnisTools::ParamMap& params) {
+    TraceSpan span("convert", "omnis");
     
     OmnisTools::ParamMap::iterator it;
     str255 colName;
     EXTfldval colVal;
     EXTqlist* retList = new EXTqlist(listVlen); // Return row
     
+    // Timings are only there for a final result, and only if they weren't turned off
+    boost::shared_ptr<RequestTimings> timings;
+    it = params.find("Timings");
+    if( it != params.end()) {
+        try {
+            timings = boost::any_cast<boost::shared_ptr<RequestTimings> >(it->second);
+            timings->mark(RequestTimings::kDelivered);
+        } catch( const boost::bad_any_cast& e ) {
+            LOG_ERROR << "Unable to cast timings from HTTP worker.";
+        }
+    }
+    
     // Add all output columns
     colName = initStr255("Method");
     retList->addCol(fftRow, dpDefault, 0, &colName);
@@ -236,6 +312,10 @@ static bool readResult(EXTfldval& row, OmnisTools::ParamMap& params) {
     retList->addCol(fftRow, dpDefault, 0, &colName);
     colName = initStr255("Result");
     retList->addCol(fftRow, dpDefault, 0, &colName);
+    if (timings) {
+        colName = initStr255("Timings");
+        retList->addCol(fftRow, dpDefault, 0, &colName);
+    }
     
     retList->insertRow();
     
@@ -273,6 +353,11 @@ static bool readResult(EXTfldval& row, OmnisTools::ParamMap& params) {
         }
     }
     
+    if (timings) {
+        retList->getColValRef(1,4,colVal,qtrue);
+        readTimings(colVal, *timings);
+    }
+    
     row.setList(retList,qtrue);
     
     return true;
@@ -282,25 +367,77 @@ static bool readResult(EXTfldval& row, OmnisTools::ParamMap& params) {
  **                       THREAD TIMER NOTIFIER                                                  **
  **************************************************************************************************/
 
+const static int kMaxPartialResultsPerTick = 4;  // $rows calls per timer tick while the worker is running
+
+// Pass results that arrived before completion to $rows.  All are delivered when the worker is complete,
+// otherwise a few per tick so that a fast stream doesn't hold up the main thread.
+void NVObjHTTPWorker::deliverPartialResults(bool all)
+{
+    boost::shared_ptr<WorkerDelegate> delegate = _worker->delegate();
+    if (!delegate) {
+        return;
+    }
+    
+    OmnisTools::ParamMap pm;
+    for (int delivered = 0; (all || delivered < kMaxPartialResultsPerTick) && delegate->partialResult(pm); ++delivered) {
+        EXTfldval retVal;
+        readResult(retVal, pm);
+        
+        str31 methodName(initStr31("$rows"));
+        TraceSpan span("$rows", "ECOdoMethod");
+        ECOdoMethod( this->getInstance(), &methodName, &retVal, 1 );
+        pm.clear();
+    }
+}
+
+// The worker's result has been delivered (or it was canceled), so it's no longer queued
+void NVObjHTTPWorker::dequeue()
+{
+    if (_queued) {
+        Metrics::instance().count(Metrics::kQueueDepth, -1);
+        _queued = false;
+    }
+}
+
 int NVObjHTTPWorker::notify() 
 {        
+    TraceSpan span("notify", "omnis");
+    
     if(_worker->complete()) {
+        // Deliver any remaining rows before the result
+        deliverPartialResults(true);
+        
         // Worker completed.  Call back into Omnis
         EXTfldval retVal;
         OmnisTools::ParamMap pm = _worker->result();
         readResult(retVal, pm);
         
+        boost::uint64_t completedAt = _worker->completedAt();
+        if (completedAt) {
+            Metrics::instance().recordDeliveryLag(RequestTimings::now() - completedAt);
+        }
+        dequeue();
+        if (_worker->delegate()) {
+            _worker->delegate()->delivered();
+        }
+        
         str31 methodName(initStr31("$completed"));
+        TraceSpan callSpan("$completed", "ECOdoMethod");
         ECOdoMethod( this->getInstance(), &methodName, &retVal, 1 );
         
         return ThreadTimer::kTimerStop;
     } else if (_worker->cancelled()) {
+        dequeue();
+        
         str31 methodName(initStr31("$canceled"));
+        TraceSpan callSpan("$canceled", "ECOdoMethod");
         ECOdoMethod( this->getInstance(), &methodName, 0, 0 );
         
         return ThreadTimer::kTimerStop;
     }
     
+    deliverPartialResults(false);
+    
     return ThreadTimer::kTimerContinue;
 }
 
@@ -317,9 +454,10 @@ tResult NVObjHTTPWorker::methodInitialize( tThreadData* pThreadData, qshort pPar
         return ERR_METHOD_FAILED;
     }
     
-    // Convert row into parameters
+    // Convert row into parameters (a list body is serialised by the worker instead)
     OmnisTools::ParamMap params;
-    if( getParamsFromRow(pThreadData, rowVal, params) == false) {
+    std::vector<std::string> rawLists(1, "body");
+    if( getParamsFromRow(pThreadData, rowVal, params, rawLists) == false) {
         pThreadData->mExtraErrorText = "1st parameter must be a row of parameters";
         return ERR_METHOD_FAILED;
     }
@@ -361,6 +499,11 @@ tResult NVObjHTTPWorker::methodStart( tThreadData* pThreadData, qshort pParamCou
     ThreadTimer& timerInst = ThreadTimer::instance();
     timerInst.subscribe(this);
     
+    if (!_queued) {
+        Metrics::instance().count(Metrics::kQueueDepth);
+        _queued = true;
+    }
+    
     _worker->start();  // Run background thread
     
 	return METHOD_DONE_RETURN;
@@ -374,5 +517,61 @@ tResult NVObjHTTPWorker::methodCancel( tThreadData* pThreadData, qshort pParamCo
     
     _worker->cancel();  // Attempt to cancel worker
     
+	return METHOD_DONE_RETURN;
+}
+
+// Write the next piece of a body_chunks request body.  Waits while the request has as much queued
+// as it will buffer, so Omnis writes the body no faster than it's sent.
+tResult NVObjHTTPWorker::methodWriteChunk( tThreadData* pThreadData, qshort pParamCount )
+{
+    if( _worker == boost::shared_ptr<Worker>() ) {
+        return ERR_METHOD_FAILED;
+    }
+    
+    EXTfldval chunkVal;
+    if (getParamVar(pThreadData, 1, chunkVal) == qfalse) {
+        pThreadData->mExtraErrorText = "1st parameter must be the chunk to write";
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Binary is written as it is, anything else as UTF-8 text
+    std::string chunk;
+    if (getType(chunkVal).valType == fftBinary) {
+        std::vector<unsigned char> data = getBinaryVectorFromEXTFldVal(chunkVal);
+        chunk.assign(data.begin(), data.end());
+    } else {
+        chunk = getStringFromEXTFldVal(chunkVal);
+    }
+    
+    bool written = false;
+    boost::shared_ptr<WorkerDelegate> delegate = _worker->delegate();
+    if (delegate) {
+        written = delegate->writeChunk(chunk);
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromBool(retVal, written);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+	return METHOD_DONE_RETURN;
+}
+
+// End a body_chunks request body once the chunks written so far have been sent
+tResult NVObjHTTPWorker::methodEndChunks( tThreadData* pThreadData, qshort pParamCount )
+{
+    if( _worker == boost::shared_ptr<Worker>() ) {
+        return ERR_METHOD_FAILED;
+    }
+    
+    bool ended = false;
+    boost::shared_ptr<WorkerDelegate> delegate = _worker->delegate();
+    if (delegate) {
+        ended = delegate->endChunks();
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromBool(retVal, ended);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
 	return METHOD_DONE_RETURN;
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 
 #include "OmnisTools.he"
 #include "Logging.he"
+#include "Tracer.h"
 
 #include <sstream>
 #include <iostream>
@@ -286,7 +287,7 @@ qchar* OmnisTools::getQCharFromWString(const std::wstring readString, qlong &ret
 	CHRconvFromUtf32ToChar utf32conv(utf32data, length, qfalse);
 	retLength = length = utf32conv.len();
 	
-	omnisString = new qchar[length];
+	omnisString = new qchar[length + 1];  // OMstrcpy copies the terminator too
 	OMstrcpy(omnisString, utf32conv.dataPtr()); // Copy string so it lives past the end of this function
 #endif
 	
@@ -733,10 +734,13 @@ boost::any OmnisTools::getAnyFromEXTFldVal(EXTfldval& val) {
         case fftRow:
         case fftList:
             listVal = val.getList(qfalse);
+            if (!listVal)
+                break;
             listVector.clear();
-            for( qlong curRow = 1; curRow < listVal->rowCnt(); ++curRow ) {
+            listVector.reserve(listVal->rowCnt());
+            for( qlong curRow = 1; curRow <= listVal->rowCnt(); ++curRow ) {
                 ParamMap row;
-                for( qlong curCol = 1; curCol < listVal->colCnt(); ++curCol ) {
+                for( qlong curCol = 1; curCol <= listVal->colCnt(); ++curCol ) {
                     listVal->getCol(curCol, qfalse, colName);
                     colTitleVal.setChar(colName);
                     listVal->getColValRef(curRow, curCol, colVal, qfalse);
@@ -744,6 +748,7 @@ boost::any OmnisTools::getAnyFromEXTFldVal(EXTfldval& val) {
                 }
                 listVector.push_back(row);
             }
+            delete listVal;
             ret = listVector;
             break;
         default:
@@ -755,7 +760,12 @@ boost::any OmnisTools::getAnyFromEXTFldVal(EXTfldval& val) {
 }
 
 bool OmnisTools::getParamsFromRow(tThreadData* pThreadData, EXTfldval& row, ParamMap& params) {
+    return getParamsFromRow(pThreadData, row, params, std::vector<std::string>());
+}
+
+bool OmnisTools::getParamsFromRow(tThreadData* pThreadData, EXTfldval& row, ParamMap& params, const std::vector<std::string>& rawLists) {
     
+    TraceSpan span("convert params", "omnis");
     if(getType(row).valType != fftRow && getType(row).valType != fftList) {
         return false;
     }
@@ -770,7 +780,19 @@ bool OmnisTools::getParamsFromRow(tThreadData* pThreadData, EXTfldval& row, Para
         colTitleVal.setChar(colName);
         rowData.getColValRef(1, col, colVal, qfalse);
         
-        params[getStringFromEXTFldVal(colTitleVal)] = getAnyFromEXTFldVal(colVal);
+        std::string key = getStringFromEXTFldVal(colTitleVal);
+        ffttype fft = getType(colVal).valType;
+        bool raw = false;
+        for (std::vector<std::string>::const_iterator it = rawLists.begin(); it != rawLists.end(); ++it) {
+            raw = raw || boost::iequals(*it, key);
+        }
+        
+        if (raw && (fft == fftList || fft == fftRow)) {
+            // Copy of the list that the caller owns (the original may change once the method returns)
+            params[key] = boost::shared_ptr<EXTqlist>(colVal.getList(qtrue));
+        } else {
+            params[key] = getAnyFromEXTFldVal(colVal);
+        }
     }    
     
     return true;
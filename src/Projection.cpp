@@ -0,0 +1,153 @@
+//
+//  Projection.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Projection.h"
+#include "JsonProjection.h"
+#include "XmlProjection.h"
+#include "ListPool.h"
+
+#include <cstdlib>
+
+#include <boost/algorithm/string.hpp>
+
+using namespace OmnisTools;
+
+namespace {
+    // Read a character column out of a projection row
+    std::string readString(const ParamMap& row, const char* name) {
+        ParamMap::const_iterator it = row.find(name);
+        if (it == row.end()) {
+            return std::string();
+        }
+
+        try {
+            return boost::any_cast<std::string>(it->second);
+        } catch (const boost::bad_any_cast&) {
+            return std::string();
+        }
+    }
+}
+
+boost::shared_ptr<Projection> Projection::create(const std::string& format,
+                                                 const std::string& records,
+                                                 const std::vector<ParamMap>& rows,
+                                                 std::string& error)
+{
+    std::vector<Column> columns;
+    for (std::vector<ParamMap>::const_iterator it = rows.begin(); it != rows.end(); ++it) {
+        Column col;
+        col.path = readString(*it, "path");
+        col.name = readString(*it, "name");
+        if (col.name.empty()) {
+            col.name = col.path;
+        }
+
+        std::string type = readString(*it, "type");
+        if (type.empty() || boost::iequals(type, "character")) {
+            col.type = kCharacter;
+        } else if (boost::iequals(type, "integer")) {
+            col.type = kInteger;
+        } else if (boost::iequals(type, "number")) {
+            col.type = kNumber;
+        } else if (boost::iequals(type, "boolean")) {
+            col.type = kBoolean;
+        } else {
+            error = "Unknown projection column type: " + type;
+            return boost::shared_ptr<Projection>();
+        }
+        columns.push_back(col);
+    }
+
+    if (columns.empty()) {
+        error = "Projection has no columns";
+        return boost::shared_ptr<Projection>();
+    }
+
+    boost::shared_ptr<Projection> projection;
+    if (boost::iequals(format, "json")) {
+        projection.reset(new JsonProjection(records, columns));
+    } else if (boost::iequals(format, "xml")) {
+        projection.reset(new XmlProjection(records, columns));
+    } else {
+        error = "Projection requires parse to be json or xml";
+        return boost::shared_ptr<Projection>();
+    }
+
+    // Paths are checked when the projection is constructed
+    if (!projection->_error.empty()) {
+        error = projection->_error;
+        projection.reset();
+    }
+    return projection;
+}
+
+Projection::Projection(const std::vector<Column>& columns) : _columns(columns), _row(0), _filled(columns.size(), false)
+{
+    _list = ListPool::instance().checkout();
+    if (!_list) {
+        _error = "No list available from the list pool";
+        return;
+    }
+
+    str255 colName;
+    for (std::vector<Column>::iterator col = _columns.begin(); col != _columns.end(); ++col) {
+        colName = initStr255(col->name.c_str());
+        switch (col->type) {
+            case kInteger:
+                _list->addCol(fftInteger, 0, 1, &colName);
+                break;
+            case kNumber:
+                _list->addCol(fftNumber, dpFmask, 0, &colName);
+                break;
+            case kBoolean:
+                _list->addCol(fftBoolean, 0, 0, &colName);
+                break;
+            default:
+                _list->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+                break;
+        }
+    }
+}
+
+bool Projection::fail(const std::string& message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+// Start the row for the next record
+void Projection::newRow() {
+    _list->insertRow();
+    ++_row;
+    _filled.assign(_columns.size(), false);
+}
+
+// Set a cell of the current row from the text of the projected value
+void Projection::setCell(std::size_t col, const std::string& text) {
+    if (_row == 0 || _filled[col]) {
+        return;
+    }
+    _filled[col] = true;
+
+    EXTfldval colVal;
+    _list->getColValRef(_row, static_cast<qshort>(col + 1), colVal, qtrue);
+    switch (_columns[col].type) {
+        case kInteger:
+            colVal.setLong(static_cast<qlong>(strtol(text.c_str(), 0, 10)));
+            break;
+        case kNumber:
+            getEXTFldValFromDouble(colVal, parseJsonNumber(text));
+            break;
+        case kBoolean:
+            getEXTFldValFromBool(colVal, boost::iequals(text, "true") || text == "1");
+            break;
+        default:
+            getEXTFldValFromString(colVal, text);
+            break;
+    }
+}
@@ -0,0 +1,355 @@
+//
+//  RecordStream.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "RecordStream.h"
+#include "JsonReader.h"
+#include "ListPool.h"
+#include "OmnisTools.he"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/algorithm/string.hpp>
+
+using namespace OmnisTools;
+
+bool RecordStream::parseFormat(const std::string& name, Format& format) {
+    if (boost::iequals(name, "ndjson")) {
+        format = kNdjson;
+    } else if (boost::iequals(name, "csv")) {
+        format = kCsv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+RecordStream::RecordStream(Format format, std::size_t batchSize, std::size_t maxBatches)
+    : _format(format), _batchSize(batchSize), _maxBatches(maxBatches), _haveColumns(false),
+      _inQuotes(false), _afterQuote(false), _batchRows(0), _rows(0), _cancelled(false)
+{ }
+
+std::string RecordStream::error() const {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    return _error;
+}
+
+bool RecordStream::fail(const std::string& message) {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+void RecordStream::cancel() {
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        _cancelled = true;
+        _batches.clear();
+    }
+    _taken.notify_all();
+}
+
+boost::shared_ptr<EXTqlist> RecordStream::takeBatch() {
+    boost::shared_ptr<EXTqlist> batch;
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        if (_batches.empty()) {
+            return batch;
+        }
+        batch = _batches.front();
+        _batches.pop_front();
+    }
+    _taken.notify_all();
+
+    return batch;
+}
+
+// Queue the current batch, waiting while the queue is full
+bool RecordStream::pushBatch() {
+    if (!_batch) {
+        return true;
+    }
+
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while (_batches.size() >= _maxBatches && !_cancelled) {
+        _taken.wait(lock);
+    }
+    if (_cancelled) {
+        return false;
+    }
+
+    _batches.push_back(_batch);
+    _batch.reset();
+    _batchRows = 0;
+
+    return true;
+}
+
+// Add a row to the current batch, starting a new batch if needed
+bool RecordStream::newRow() {
+    if (!_batch) {
+        _batch = ListPool::instance().checkout();
+        if (!_batch) {
+            return fail("No list available from the list pool");
+        }
+
+        str255 colName;
+        for (std::vector<Column>::iterator col = _columns.begin(); col != _columns.end(); ++col) {
+            colName = initStr255(col->name.c_str());
+            switch (col->kind) {
+                case kInteger:
+                    _batch->addCol(fftInteger, 0, 1, &colName);
+                    break;
+                case kNumber:
+                    _batch->addCol(fftNumber, dpFmask, 0, &colName);
+                    break;
+                case kBoolean:
+                    _batch->addCol(fftBoolean, 0, 0, &colName);
+                    break;
+                default:
+                    _batch->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+                    break;
+            }
+        }
+    }
+
+    _batch->insertRow();
+    ++_batchRows;
+    ++_rows;
+
+    return true;
+}
+
+// CSV record.  The first record holds the column names.
+bool RecordStream::record(const std::vector<std::string>& fields) {
+    if (fields.size() == 1 && fields[0].empty()) {
+        return true;  // Blank line
+    }
+
+    if (!_haveColumns) {
+        for (std::vector<std::string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+            Column col;
+            col.name = *it;
+            col.kind = kCharacter;
+            _columns.push_back(col);
+        }
+        _haveColumns = true;
+        return true;
+    }
+
+    if (!newRow()) {
+        return false;
+    }
+    EXTfldval colVal;
+    std::size_t count = std::min(fields.size(), _columns.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        _batch->getColValRef(_batchRows, static_cast<qshort>(i + 1), colVal, qtrue);
+        getEXTFldValFromString(colVal, fields[i]);
+    }
+
+    return (_batchRows < static_cast<qlong>(_batchSize)) || pushBatch();
+}
+
+void RecordStream::setCell(qshort col, const JsonValue& value) {
+    if (value.type == JsonValue::kNull) {
+        return;
+    }
+
+    bool numeric = (value.type == JsonValue::kInteger || value.type == JsonValue::kNumber);
+    EXTfldval colVal;
+    _batch->getColValRef(_batchRows, col, colVal, qtrue);
+
+    switch (_columns[col - 1].kind) {
+        case kInteger:
+            colVal.setLong(static_cast<qlong>(numeric ? value.number : strtol(value.text.c_str(), 0, 10)));
+            break;
+        case kNumber:
+            getEXTFldValFromDouble(colVal, numeric ? value.number : parseJsonNumber(value.text));
+            break;
+        case kBoolean:
+            getEXTFldValFromBool(colVal, (value.type == JsonValue::kBoolean) ? value.boolean : boost::iequals(value.text, "true"));
+            break;
+        default:
+            if (value.type == JsonValue::kString) {
+                getEXTFldValFromString(colVal, value.text);
+            } else {
+                std::string json;
+                writeJson(value, json);
+                getEXTFldValFromString(colVal, json);
+            }
+            break;
+    }
+}
+
+// NDJSON record.  The first record decides the columns and their types.
+bool RecordStream::record(const JsonValue& object) {
+    if (object.type != JsonValue::kObject) {
+        return fail("NDJSON record is not an object");
+    }
+
+    if (!_haveColumns) {
+        for (std::size_t i = 0; i < object.keys.size(); ++i) {
+            Column col;
+            col.name = object.keys[i];
+            switch (object.items[i].type) {
+                case JsonValue::kInteger:
+                    col.kind = (std::fabs(object.items[i].number) <= 2147483647.0) ? kInteger : kNumber;
+                    break;
+                case JsonValue::kNumber:
+                    col.kind = kNumber;
+                    break;
+                case JsonValue::kBoolean:
+                    col.kind = kBoolean;
+                    break;
+                default:
+                    col.kind = kCharacter;
+                    break;
+            }
+            _columns.push_back(col);
+        }
+        _haveColumns = true;
+    }
+
+    if (!newRow()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < object.keys.size(); ++i) {
+        // Keys are usually in the same order as the first record, so check that column first
+        std::size_t c = i;
+        if (c >= _columns.size() || _columns[c].name != object.keys[i]) {
+            for (c = 0; c < _columns.size() && _columns[c].name != object.keys[i]; ++c) {}
+        }
+        if (c < _columns.size()) {
+            setCell(static_cast<qshort>(c + 1), object.items[i]);
+        }
+    }
+
+    return (_batchRows < static_cast<qlong>(_batchSize)) || pushBatch();
+}
+
+// Complete NDJSON line
+bool RecordStream::line(const char* data, std::size_t len) {
+    if (len > 0 && data[len - 1] == '\r') {
+        --len;
+    }
+
+    std::size_t start = 0;
+    while (start < len && (data[start] == ' ' || data[start] == '\t')) {
+        ++start;
+    }
+    if (start == len) {
+        return true;  // Blank line
+    }
+
+    JsonListBuilder builder;
+    JsonReader reader(builder);
+    if (!reader.feed(data + start, len - start) || !reader.finish()) {
+        return fail("Invalid NDJSON record: " + reader.error());
+    }
+    return record(builder.root());
+}
+
+// Continue reading CSV records (RFC 4180, quoted fields may span lines)
+bool RecordStream::csv(const char* data, std::size_t len) {
+    for (std::size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (_inQuotes) {
+            if (c == '"') {
+                _inQuotes = false;
+                _afterQuote = true;
+            } else {
+                _field += c;
+            }
+            continue;
+        }
+
+        if (_afterQuote) {
+            _afterQuote = false;
+            if (c == '"') {
+                _field += '"';  // Escaped quote
+                _inQuotes = true;
+                continue;
+            }
+        }
+
+        if (c == ',') {
+            _fields.push_back(_field);
+            _field.clear();
+        } else if (c == '\n') {
+            _fields.push_back(_field);
+            _field.clear();
+            bool ok = record(_fields);
+            _fields.clear();
+            if (!ok) {
+                return false;
+            }
+        } else if (c == '"' && _field.empty()) {
+            _inQuotes = true;
+        } else if (c != '\r') {
+            _field += c;
+        }
+    }
+    return true;
+}
+
+bool RecordStream::write(const char* data, std::size_t len) {
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        if (_cancelled || !_error.empty()) {
+            return false;
+        }
+    }
+
+    if (_format == kCsv) {
+        return csv(data, len);
+    }
+
+    const char* end = data + len;
+    while (data < end) {
+        const char* nl = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!nl) {
+            _line.append(data, end - data);
+            break;
+        }
+
+        bool ok;
+        if (_line.empty()) {
+            ok = line(data, nl - data);  // Whole line is in this chunk, no need to copy it
+        } else {
+            _line.append(data, nl - data);
+            ok = line(_line.data(), _line.size());
+            _line.clear();
+        }
+        if (!ok) {
+            return false;
+        }
+        data = nl + 1;
+    }
+    return true;
+}
+
+bool RecordStream::finish() {
+    // The last record may not have a line ending
+    bool ok = true;
+    if (_format == kCsv) {
+        if (_inQuotes) {
+            return fail("Unterminated quoted CSV field");
+        }
+        if (!_field.empty() || !_fields.empty()) {
+            _fields.push_back(_field);
+            ok = record(_fields);
+        }
+    } else if (!_line.empty()) {
+        ok = line(_line.data(), _line.size());
+    }
+
+    return ok && pushBatch();
+}
@@ -0,0 +1,91 @@
+//
+//  RequestCoalescer.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "RequestCoalescer.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/make_shared.hpp>
+
+RequestCoalescer::Flight::Outcome RequestCoalescer::Flight::wait(const bool& interrupted, Result& result)
+{
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while (!_done && !interrupted) {
+        _finished.wait(lock);
+    }
+
+    if (interrupted)
+        return kInterrupted;
+    if (!_ok)
+        return kFailed;
+
+    result = _result;
+    return kShared;
+}
+
+void RequestCoalescer::Flight::interrupt(bool& interrupted)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    interrupted = true;
+    _finished.notify_all();
+}
+
+RequestCoalescer& RequestCoalescer::instance()
+{
+    static RequestCoalescer theInst;
+
+    return theInst;
+}
+
+std::string RequestCoalescer::key(const std::string& method, const std::string& url, const HttpStreamClient::Headers& headers)
+{
+    std::string key = boost::to_upper_copy(method) + " " + url;
+    for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        key += "\n" + boost::to_lower_copy(it->first) + ": " + it->second;
+    }
+    return key;
+}
+
+RequestCoalescer::FlightPtr RequestCoalescer::join(const std::string& key, bool& leader)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    std::map<std::string, FlightPtr>::iterator it = _flights.find(key);
+    if (it != _flights.end()) {
+        leader = false;
+        ++_coalesced;
+        return it->second;
+    }
+
+    leader = true;
+    FlightPtr flight = boost::make_shared<Flight>();
+    _flights[key] = flight;
+    return flight;
+}
+
+void RequestCoalescer::finish(const std::string& key, const FlightPtr& flight, const Result* result)
+{
+    {
+        // Requests from here on start a new flight
+        boost::mutex::scoped_lock lock(_mutex);
+        std::map<std::string, FlightPtr>::iterator it = _flights.find(key);
+        if (it != _flights.end() && it->second == flight)
+            _flights.erase(it);
+    }
+
+    boost::mutex::scoped_lock lock(flight->_mutex);
+    flight->_done = true;
+    flight->_ok = (result != 0);
+    if (result)
+        flight->_result = *result;
+    flight->_finished.notify_all();
+}
+
+boost::uint64_t RequestCoalescer::coalesced() const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _coalesced;
+}
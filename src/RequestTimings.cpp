@@ -0,0 +1,73 @@
+//
+//  RequestTimings.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "RequestTimings.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+RequestTimings::RequestTimings() : _bytesOut(0), _bytesIn(0)
+{
+    for (int i = 0; i < kPhaseCount; ++i) {
+        _at[i] = 0;
+    }
+}
+
+boost::uint64_t RequestTimings::now()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<boost::uint64_t>(counter.QuadPart / frequency.QuadPart * 1000000
+                                        + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase = { 0, 0 };
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+const char* RequestTimings::name(Phase phase)
+{
+    static const char* names[kPhaseCount] = { "queued", "started", "dns", "connect", "tls", "sent",
+                                              "first_byte", "last_byte", "delivered" };
+    return names[phase];
+}
+
+double RequestTimings::elapsed(Phase phase) const
+{
+    if (!_at[phase])
+        return 0;
+
+    boost::uint64_t origin = 0;
+    for (int i = 0; i < kPhaseCount && !origin; ++i) {
+        origin = _at[i];
+    }
+    return static_cast<double>(_at[phase] - origin) / 1000.0;
+}
+
+RequestTimings::Phase RequestTimings::latest() const
+{
+    for (int i = kPhaseCount - 1; i >= 0; --i) {
+        if (_at[i])
+            return static_cast<Phase>(i);
+    }
+    return kPhaseCount;
+}
@@ -0,0 +1,491 @@
+//
+//  ResponseCache.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "ResponseCache.h"
+#include "DiskCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/make_shared.hpp>
+
+typedef std::map<std::string, std::string> Directives;
+
+static const std::size_t kEntryOverhead = 128;     // Estimate of the bookkeeping per entry, in bytes
+static const std::time_t kHeuristicDivisor = 10;   // Share of the time since Last-Modified an entry stays fresh
+
+// Values of every header with the given name, joined as a comma separated list
+static std::string headerValues(const HttpStreamClient::Headers& headers, const std::string& name)
+{
+    std::string values;
+    for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (boost::iequals(it->first, name)) {
+            if (!values.empty())
+                values += ", ";
+            values += it->second;
+        }
+    }
+    return values;
+}
+
+// Cache-Control directives by lower case name, with any quotes removed from their values
+static Directives cacheControl(const HttpStreamClient::Headers& headers)
+{
+    Directives directives;
+    std::vector<std::string> items;
+    std::string value = headerValues(headers, "Cache-Control");
+    boost::split(items, value, boost::is_any_of(","));
+    for (std::vector<std::string>::iterator item = items.begin(); item != items.end(); ++item) {
+        std::string name = *item, argument;
+        std::size_t equals = item->find('=');
+        if (equals != std::string::npos) {
+            name = item->substr(0, equals);
+            argument = item->substr(equals + 1);
+            boost::trim(argument);
+            boost::trim_if(argument, boost::is_any_of("\""));
+        }
+        boost::trim(name);
+        boost::to_lower(name);
+        if (!name.empty())
+            directives[name] = argument;
+    }
+    return directives;
+}
+
+// Number of seconds in a directive or header, or -1 if it's missing or invalid
+static long readSeconds(const std::string& text)
+{
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        return -1;
+    return std::strtol(text.c_str(), 0, 10);
+}
+
+// Days from 1970-01-01 to a date in the proleptic Gregorian calendar
+static long daysFromCivil(long year, long month, long day)
+{
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yearOfEra = year - era * 400;
+    long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Accepts the three date formats HTTP/1.1 allows: RFC 1123, RFC 850 and asctime
+bool ResponseCache::parseHttpDate(const std::string& text, std::time_t& time)
+{
+    static const char* kMonths = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    char weekday[16], monthName[4];
+    int day, year, hour, minute, second;
+    const char* s = text.c_str();
+    if (std::sscanf(s, "%15[A-Za-z], %d %3s %d %d:%d:%d", weekday, &day, monthName, &year, &hour, &minute, &second) != 7
+        && std::sscanf(s, "%15[A-Za-z], %d-%3s-%d %d:%d:%d", weekday, &day, monthName, &year, &hour, &minute, &second) != 7
+        && std::sscanf(s, "%15s %3s %d %d:%d:%d %d", weekday, monthName, &day, &hour, &minute, &second, &year) != 7) {
+        return false;
+    }
+
+    const char* month = std::strstr(kMonths, monthName);
+    if (std::strlen(monthName) != 3 || !month || (month - kMonths) % 3 != 0)
+        return false;
+    if (year < 100)
+        year += (year < 70) ? 2000 : 1900;  // Two digit RFC 850 years
+
+    long days = daysFromCivil(year, (month - kMonths) / 3 + 1, day);
+    time = static_cast<std::time_t>(((days * 24 + hour) * 60 + minute) * 60 + second);
+    return true;
+}
+
+std::string ResponseCache::key(const std::string& method, const std::string& url)
+{
+    return boost::to_upper_copy(method) + " " + url;
+}
+
+std::size_t ResponseCache::Entry::size() const
+{
+    std::size_t total = kEntryOverhead + etag.size() + lastModified.size() + (body ? body->size() : 0);
+    for (HttpStreamClient::Headers::const_iterator it = headers.begin(); it != headers.end(); ++it)
+        total += it->first.size() + it->second.size();
+    for (HttpStreamClient::Headers::const_iterator it = vary.begin(); it != vary.end(); ++it)
+        total += it->first.size() + it->second.size();
+    return total;
+}
+
+bool ResponseCache::cacheable(const std::string& method, const HttpStreamClient::Headers& requestHeaders)
+{
+    if (!boost::iequals(method, "GET"))
+        return false;
+
+    // Requests that are already conditional or partial are the caller's own business
+    if (!headerValues(requestHeaders, "If-None-Match").empty()
+        || !headerValues(requestHeaders, "If-Modified-Since").empty()
+        || !headerValues(requestHeaders, "Range").empty())
+        return false;
+
+    return cacheControl(requestHeaders).count("no-store") == 0;
+}
+
+// Freshness is worked out from the response headers as they are now, so this is shared by new
+// responses and those refreshed by a 304
+static ResponseCache::EntryPtr buildEntry(int status,
+                                          const HttpStreamClient::Headers& headers,
+                                          const boost::shared_ptr<const std::string>& body,
+                                          const HttpStreamClient::Headers& requestHeaders,
+                                          std::time_t now)
+{
+    ResponseCache::EntryPtr none;
+
+    // Statuses that may be cached without explicit freshness (RFC 7231 section 6.1)
+    if (status != 200 && status != 203 && status != 204 && status != 300 && status != 301 && status != 404 && status != 410)
+        return none;
+
+    Directives directives = cacheControl(headers);
+    if (directives.count("no-store"))
+        return none;
+
+    // The cache is shared by every worker (and kept on disk), so it mustn't hold responses meant for
+    // one user: private ones, or answers to authorised requests that the server hasn't said may be
+    // shared (RFC 7234 section 3.2)
+    if (directives.count("private"))
+        return none;
+    if (!headerValues(requestHeaders, "Authorization").empty()
+        && !directives.count("public") && !directives.count("s-maxage") && !directives.count("must-revalidate"))
+        return none;
+
+    std::string vary = headerValues(headers, "Vary");
+    if (vary.find('*') != std::string::npos)
+        return none;
+
+    boost::shared_ptr<ResponseCache::Entry> entry = boost::make_shared<ResponseCache::Entry>();
+    entry->status = status;
+    entry->headers = headers;
+    entry->body = body;
+    entry->responseTime = now;
+    entry->etag = headerValues(headers, "ETag");
+    entry->lastModified = headerValues(headers, "Last-Modified");
+
+    std::time_t date = now, expires = 0, lastModified = 0;
+    ResponseCache::parseHttpDate(headerValues(headers, "Date"), date);
+
+    long lifetime = 0;
+    Directives::iterator maxAge = directives.find("max-age");
+    if (maxAge != directives.end()) {
+        lifetime = std::max(readSeconds(maxAge->second), 0L);
+    } else if (!headerValues(headers, "Expires").empty()) {
+        if (ResponseCache::parseHttpDate(headerValues(headers, "Expires"), expires))  // An invalid date means already expired
+            lifetime = static_cast<long>(expires - date);
+    } else if (ResponseCache::parseHttpDate(entry->lastModified, lastModified) && lastModified < date) {
+        lifetime = static_cast<long>((date - lastModified) / kHeuristicDivisor);
+    }
+    if (directives.count("no-cache"))
+        lifetime = 0;  // Stored, but always revalidated
+
+    long age = std::max(readSeconds(headerValues(headers, "Age")), 0L);
+    entry->expires = now + lifetime - age;
+
+    // Stale use is ruled out by anything that insists on revalidation
+    if (!directives.count("no-cache") && !directives.count("must-revalidate") && !directives.count("proxy-revalidate")) {
+        Directives::iterator stale = directives.find("stale-while-revalidate");
+        if (stale != directives.end())
+            entry->staleWhileRevalidate = std::max(readSeconds(stale->second), 0L);
+        if ((stale = directives.find("stale-if-error")) != directives.end())
+            entry->staleIfError = std::max(readSeconds(stale->second), 0L);
+    }
+
+    // An entry that's already stale is only worth keeping if it can be revalidated or used stale
+    if (!entry->fresh(now) && !entry->hasValidator() && !entry->usableWhileRevalidating(now) && !entry->usableOnError(now))
+        return none;
+
+    std::vector<std::string> names;
+    boost::split(names, vary, boost::is_any_of(","));
+    for (std::vector<std::string>::iterator name = names.begin(); name != names.end(); ++name) {
+        boost::trim(*name);
+        if (!name->empty())
+            entry->vary.push_back(std::make_pair(*name, headerValues(requestHeaders, *name)));
+    }
+
+    return entry;
+}
+
+ResponseCache::EntryPtr ResponseCache::makeEntry(int status,
+                                                 const HttpStreamClient::Headers& headers,
+                                                 const boost::shared_ptr<const std::string>& body,
+                                                 const HttpStreamClient::Headers& requestHeaders,
+                                                 std::time_t now)
+{
+    return buildEntry(status, headers, body, requestHeaders, now);
+}
+
+ResponseCache::EntryPtr ResponseCache::revalidate(const EntryPtr& entry,
+                                                  const HttpStreamClient::Headers& notModifiedHeaders,
+                                                  const HttpStreamClient::Headers& requestHeaders,
+                                                  std::time_t now)
+{
+    // Headers of the 304 replace the stored ones of the same name, except those describing the body
+    HttpStreamClient::Headers headers = entry->headers;
+    for (HttpStreamClient::Headers::const_iterator it = notModifiedHeaders.begin(); it != notModifiedHeaders.end(); ++it) {
+        if (boost::iequals(it->first, "Content-Length") || boost::iequals(it->first, "Transfer-Encoding")
+            || boost::iequals(it->first, "Content-Encoding")) {
+            continue;
+        }
+
+        HttpStreamClient::Headers::iterator stored = headers.begin();
+        while (stored != headers.end()) {
+            if (boost::iequals(stored->first, it->first))
+                stored = headers.erase(stored);
+            else
+                ++stored;
+        }
+    }
+    for (HttpStreamClient::Headers::const_iterator it = notModifiedHeaders.begin(); it != notModifiedHeaders.end(); ++it) {
+        if (!boost::iequals(it->first, "Content-Length") && !boost::iequals(it->first, "Transfer-Encoding")
+            && !boost::iequals(it->first, "Content-Encoding")) {
+            headers.push_back(*it);
+        }
+    }
+
+    return buildEntry(entry->status, headers, entry->body, requestHeaders, now);
+}
+
+void ResponseCache::addValidators(const EntryPtr& entry, HttpStreamClient::Headers& requestHeaders)
+{
+    if (!entry->etag.empty() && headerValues(requestHeaders, "If-None-Match").empty())
+        requestHeaders.push_back(std::make_pair(std::string("If-None-Match"), entry->etag));
+    if (!entry->lastModified.empty() && headerValues(requestHeaders, "If-Modified-Since").empty())
+        requestHeaders.push_back(std::make_pair(std::string("If-Modified-Since"), entry->lastModified));
+}
+
+ResponseCache& ResponseCache::instance()
+{
+    static ResponseCache theInst;
+
+    return theInst;
+}
+
+ResponseCache::ResponseCache()
+{
+    for (std::size_t i = 0; i < kShards; ++i) {
+        _shards[i].capacity = kDefaultCapacity / kShards;
+    }
+    DiskCache::instance();  // Created here too, while still on the main thread
+}
+
+ResponseCache::Shard& ResponseCache::shard(const std::string& key)
+{
+    return _shards[boost::hash<std::string>()(key) % kShards];
+}
+
+void ResponseCache::Shard::evict(std::size_t limit)
+{
+    while (bytes > limit && !lru.empty()) {
+        bytes -= lru.back().second->size();
+        index.erase(lru.back().first);
+        lru.pop_back();
+        ++evictions;
+    }
+}
+
+void ResponseCache::Shard::put(const std::string& key, const EntryPtr& entry)
+{
+    take(key);
+
+    std::size_t size = entry->size();
+    if (size > capacity)
+        return;  // Would evict everything else in the shard
+
+    lru.push_front(std::make_pair(key, entry));
+    index[key] = lru.begin();
+    bytes += size;
+    evict(capacity);
+}
+
+void ResponseCache::Shard::take(const std::string& key)
+{
+    std::map<std::string, LruList::iterator>::iterator it = index.find(key);
+    if (it != index.end()) {
+        bytes -= it->second->second->size();
+        lru.erase(it->second);
+        index.erase(it);
+    }
+}
+
+ResponseCache::EntryPtr ResponseCache::find(const std::string& key,
+                                            const HttpStreamClient::Headers& requestHeaders,
+                                            std::time_t now,
+                                            const StaleLimits& limits)
+{
+    Shard& s = shard(key);
+    EntryPtr entry;
+    {
+        boost::mutex::scoped_lock lock(s.mutex);
+        std::map<std::string, LruList::iterator>::iterator it = s.index.find(key);
+        if (it != s.index.end()) {
+            entry = it->second->second;
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+        }
+    }
+
+    // Entries that aren't in memory may still be on disk (read without holding up the rest of the shard)
+    if (!entry) {
+        entry = DiskCache::instance().load(key);
+        if (entry) {
+            boost::mutex::scoped_lock lock(s.mutex);
+            if (!s.index.count(key))
+                s.put(key, entry);
+        }
+    }
+
+    boost::mutex::scoped_lock lock(s.mutex);
+    if (!entry) {
+        ++s.misses;
+        return EntryPtr();
+    }
+
+    for (HttpStreamClient::Headers::const_iterator vary = entry->vary.begin(); vary != entry->vary.end(); ++vary) {
+        if (headerValues(requestHeaders, vary->first) != vary->second) {
+            ++s.misses;
+            return EntryPtr();
+        }
+    }
+
+    // The request can ask for a fresher response than the entry's own lifetime allows
+    bool fresh = entry->fresh(now);
+    Directives directives = cacheControl(requestHeaders);
+    if (directives.count("no-cache") || boost::icontains(headerValues(requestHeaders, "Pragma"), "no-cache"))
+        fresh = false;
+    Directives::iterator maxAge = directives.find("max-age");
+    if (maxAge != directives.end() && now - entry->responseTime > readSeconds(maxAge->second))
+        fresh = false;
+
+    if (fresh) {
+        ++s.hits;
+        return entry;
+    }
+
+    ++s.misses;
+
+    // Stale: returned to be revalidated or used stale, so it's moved to expire now.  An entry that's
+    // only stale because the request insists on a fresh one mustn't be used while it's revalidated.
+    boost::shared_ptr<Entry> stale = boost::make_shared<Entry>(*entry);
+    if (limits.whileRevalidate >= 0)
+        stale->staleWhileRevalidate = limits.whileRevalidate;
+    if (limits.ifError >= 0)
+        stale->staleIfError = limits.ifError;
+    if (entry->fresh(now)) {
+        stale->expires = now;
+        stale->staleWhileRevalidate = 0;
+    }
+
+    if (!stale->hasValidator() && !stale->usableWhileRevalidating(now) && !stale->usableOnError(now)) {
+        // Nothing left to reuse it for
+        s.take(key);
+        lock.unlock();
+        DiskCache::instance().remove(key);
+        return EntryPtr();
+    }
+    return stale;
+}
+
+void ResponseCache::store(const std::string& key, const EntryPtr& entry)
+{
+    {
+        Shard& s = shard(key);
+        boost::mutex::scoped_lock lock(s.mutex);
+        s.put(key, entry);
+    }
+    DiskCache::instance().store(key, entry);
+}
+
+void ResponseCache::refresh(const std::string& key, const EntryPtr& entry)
+{
+    {
+        Shard& s = shard(key);
+        boost::mutex::scoped_lock lock(s.mutex);
+        s.put(key, entry);
+    }
+    DiskCache::instance().refresh(key, entry);
+}
+
+void ResponseCache::remove(const std::string& key)
+{
+    {
+        Shard& s = shard(key);
+        boost::mutex::scoped_lock lock(s.mutex);
+        s.take(key);
+    }
+    DiskCache::instance().remove(key);
+}
+
+ResponseCache::EntryPtr ResponseCache::storeResponse(const std::string& key,
+                                                     const EntryPtr& cached,
+                                                     int status,
+                                                     const HttpStreamClient::Headers& headers,
+                                                     const boost::shared_ptr<const std::string>& body,
+                                                     const HttpStreamClient::Headers& requestHeaders,
+                                                     std::time_t now)
+{
+    if (status == 304 && cached) {
+        // Not modified: the cached response is reused with its headers refreshed
+        EntryPtr refreshed = revalidate(cached, headers, requestHeaders, now);
+        countRevalidation(key);
+        if (refreshed)
+            refresh(key, refreshed);
+        else
+            remove(key);
+        return refreshed ? refreshed : cached;
+    }
+
+    EntryPtr entry = makeEntry(status, headers, body, requestHeaders, now);
+    if (entry)
+        store(key, entry);
+    return EntryPtr();
+}
+
+void ResponseCache::countRevalidation(const std::string& key)
+{
+    Shard& s = shard(key);
+    boost::mutex::scoped_lock lock(s.mutex);
+    ++s.revalidations;
+}
+
+void ResponseCache::countStale(const std::string& key)
+{
+    Shard& s = shard(key);
+    boost::mutex::scoped_lock lock(s.mutex);
+    ++s.stale;
+}
+
+void ResponseCache::setCapacity(std::size_t bytes)
+{
+    for (std::size_t i = 0; i < kShards; ++i) {
+        boost::mutex::scoped_lock lock(_shards[i].mutex);
+        _shards[i].capacity = bytes / kShards;
+        _shards[i].evict(_shards[i].capacity);
+    }
+}
+
+ResponseCache::Stats ResponseCache::stats() const
+{
+    Stats total;
+    for (std::size_t i = 0; i < kShards; ++i) {
+        const Shard& s = _shards[i];
+        boost::mutex::scoped_lock lock(s.mutex);
+        total.hits += s.hits;
+        total.misses += s.misses;
+        total.revalidations += s.revalidations;
+        total.stale += s.stale;
+        total.evictions += s.evictions;
+        total.entries += s.lru.size();
+        total.bytes += s.bytes;
+        total.capacity += s.capacity;
+    }
+    return total;
+}
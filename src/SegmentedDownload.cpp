@@ -0,0 +1,499 @@
+//
+//  SegmentedDownload.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "SegmentedDownload.h"
+#include "FileSink.h"
+#include "Logging.he"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+
+static const boost::uint64_t kMinRangeSize = 1024 * 1024;       // Smallest range fetched in one request
+static const boost::uint64_t kMaxRangeSize = 16 * 1024 * 1024;  // Largest, so a failed request loses little
+static const std::size_t kRangesPerConnection = 4;
+static const std::size_t kInitialConnections = 2;
+static const std::size_t kMaxFailures = 3;     // Failed ranges in a row before the download gives up
+static const double kMinGain = 0.5;            // Share of the per-connection throughput a new connection must add
+static const long kSampleMS = 1000;            // Throughput is measured over this interval
+
+static int seekFile(std::FILE* file, boost::uint64_t offset) {
+#if defined(_WIN32)
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+// Writes the body of a range response in place in the part file
+class SegmentedDownload::RangeSink : public BodySink {
+public:
+    RangeSink(std::FILE* file, const Range& range, SegmentedDownload& download)
+        : _file(file), _size(range.end - range.start), _download(download), _written(0)
+    { }
+
+    virtual void expectLength(boost::uint64_t length) {
+        if (length != _size) {
+            fail("Response isn't the requested range");  // A full response would overwrite other ranges
+        }
+    }
+
+    virtual bool write(const char* data, std::size_t len) {
+        if (!_error.empty()) {
+            return false;
+        }
+        if (_written + len > _size) {
+            return fail("Response is longer than the requested range");
+        }
+        if (fwrite(data, 1, len, _file) != len) {
+            return fail(std::string("Unable to write range: ") + strerror(errno));
+        }
+        _written += len;
+
+        boost::mutex::scoped_lock lock(_download._mutex);
+        _download._received += len;
+        return true;
+    }
+
+    virtual bool finish() { return _error.empty(); }
+    virtual std::string error() const { return _error; }
+
+    boost::uint64_t written() const { return _written; }
+
+private:
+    bool fail(const std::string& message) {
+        if (_error.empty()) {
+            _error = message;
+        }
+        return false;
+    }
+
+    std::FILE* _file;
+    boost::uint64_t _size;
+    SegmentedDownload& _download;
+    boost::uint64_t _written;
+    std::string _error;
+};
+
+SegmentedDownload::SegmentedDownload(const std::string& url,
+                                     const HttpStreamClient::Headers& headers,
+                                     const std::string& path,
+                                     std::size_t maxConnections)
+    : _url(url), _requestHeaders(headers), _path(path), _partPath(path + ".part"), _statePath(path + ".part.state"),
+      _maxConnections(maxConnections), _timeout(0), _status(0), _length(0), _active(0), _failures(0), _received(0),
+      _failed(false), _cancelled(false)
+{ }
+
+std::string SegmentedDownload::error() const {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _error;
+}
+
+// Record a failure.  Called with _mutex locked.
+bool SegmentedDownload::fail(const std::string& message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    _failed = true;
+    _changed.notify_all();
+    return false;
+}
+
+void SegmentedDownload::cancel() {
+    boost::mutex::scoped_lock lock(_mutex);
+    _cancelled = true;
+    for (std::vector<boost::shared_ptr<HttpStreamClient> >::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        (*it)->cancel();
+    }
+    _changed.notify_all();
+}
+
+// Add a completed range, merging it with its neighbours.  Called with _mutex locked.
+void SegmentedDownload::markDone(const Range& range) {
+    std::vector<Range> merged;
+    bool added = false;
+    for (std::vector<Range>::iterator it = _done.begin(); it != _done.end(); ++it) {
+        if (!added && range.start < it->start) {
+            merged.push_back(range);
+            added = true;
+        }
+        merged.push_back(*it);
+    }
+    if (!added) {
+        merged.push_back(range);
+    }
+
+    _done.clear();
+    for (std::vector<Range>::iterator it = merged.begin(); it != merged.end(); ++it) {
+        if (!_done.empty() && it->start <= _done.back().end) {
+            _done.back().end = std::max(_done.back().end, it->end);
+        } else {
+            _done.push_back(*it);
+        }
+    }
+}
+
+// Load the ranges completed by an earlier attempt, if it was for the same version of the file
+void SegmentedDownload::loadState() {
+    _done.clear();
+    if (_validator.empty()) {
+        return;  // No way to tell whether the file has changed since
+    }
+
+    std::ifstream in(_statePath.c_str());
+    std::string line;
+    if (!std::getline(in, line) || line != "length " + boost::lexical_cast<std::string>(_length)) {
+        return;
+    }
+    if (!std::getline(in, line) || line != "validator " + _validator) {
+        return;
+    }
+
+    boost::uint64_t start, end;
+    while (in >> start >> end) {
+        if (start < end && end <= _length) {
+            markDone(Range(start, end));
+        }
+    }
+}
+
+// Called with _mutex locked
+void SegmentedDownload::saveState() {
+    std::ofstream out(_statePath.c_str(), std::ios::out | std::ios::trunc);
+    out << "length " << _length << "\n";
+    out << "validator " << _validator << "\n";
+    for (std::vector<Range>::iterator it = _done.begin(); it != _done.end(); ++it) {
+        out << it->start << " " << it->end << "\n";
+    }
+
+    if (!out) {
+        LOG_DEBUG << "Unable to save " << _statePath;
+    }
+}
+
+// Open the part file to resume, or create and preallocate a new one
+bool SegmentedDownload::prepareFile() {
+    boost::mutex::scoped_lock lock(_mutex);
+    loadState();
+
+    std::FILE* file = 0;
+    if (!_done.empty()) {
+        file = fopen(_partPath.c_str(), "r+b");
+    }
+
+    if (file) {
+        LOG_DEBUG << "Resuming " << _partPath;
+    } else {
+        _done.clear();
+        file = fopen(_partPath.c_str(), "wb");
+        if (!file) {
+            return fail("Unable to open " + _partPath + ": " + strerror(errno));
+        }
+
+        std::string error;
+        if (!preallocateFile(file, _length, error)) {
+            LOG_DEBUG << "Unable to preallocate " << _partPath << ": " << error;
+        }
+    }
+    fclose(file);
+
+    saveState();
+    return true;
+}
+
+boost::shared_ptr<HttpStreamClient> SegmentedDownload::newClient() {
+    boost::shared_ptr<HttpStreamClient> client = boost::make_shared<HttpStreamClient>(true);
+    client->setTimeout(_timeout);
+    return client;
+}
+
+// Download over one connection when the server doesn't accept ranges
+bool SegmentedDownload::single(HttpStreamClient& client) {
+    FileSink sink(_path);
+    HttpStreamClient::Response response;
+    try {
+        if (sink.error().empty()) {
+            response = client.request("GET", _url, _requestHeaders, "", 0, sink);
+        }
+    } catch (const std::exception& e) {
+        boost::mutex::scoped_lock lock(_mutex);
+        return fail(e.what());
+    }
+
+    _status = response.status;
+    _headers = response.headers;
+    if (_status < 200 || _status >= 300) {
+        // An error page isn't the file; the sink removes it when it's destroyed unfinished
+        boost::mutex::scoped_lock lock(_mutex);
+        return fail("Unexpected response status " + boost::lexical_cast<std::string>(_status));
+    }
+    if (!sink.error().empty() || response.sinkFailed || !sink.finish()) {
+        boost::mutex::scoped_lock lock(_mutex);
+        return fail(sink.error());
+    }
+
+    _length = sink.bytes();
+    remove(_statePath.c_str());  // From an earlier segmented attempt
+    return true;
+}
+
+// Start fetching ranges on another connection.  Called with _mutex locked.
+void SegmentedDownload::addConnection(const boost::shared_ptr<HttpStreamClient>& client) {
+    if (std::find(_clients.begin(), _clients.end(), client) == _clients.end()) {
+        _clients.push_back(client);
+    }
+    ++_active;
+    _threads.create_thread(boost::bind(&SegmentedDownload::fetch, this, client));
+}
+
+// Request one range.  Returns true if all of it was written; written is set to the length of the
+// start of the range that was (which is kept even if the rest failed).
+bool SegmentedDownload::fetchRange(HttpStreamClient& client, std::FILE* file, const Range& range, boost::uint64_t& written) {
+    written = 0;
+    if (seekFile(file, range.start) != 0) {
+        boost::mutex::scoped_lock lock(_mutex);
+        return fail("Unable to seek " + _partPath + ": " + strerror(errno));
+    }
+
+    HttpStreamClient::Headers headers = _requestHeaders;
+    headers.push_back(std::make_pair(std::string("Range"), "bytes=" + boost::lexical_cast<std::string>(range.start)
+                                                           + "-" + boost::lexical_cast<std::string>(range.end - 1)));
+    if (!_validator.empty()) {
+        headers.push_back(std::make_pair(std::string("If-Range"), _validator));
+    }
+
+    RangeSink sink(file, range, *this);
+    HttpStreamClient::Response response;
+    try {
+        response = client.request("GET", _url, headers, "", 0, sink);
+    } catch (const std::exception& e) {
+        LOG_DEBUG << "Range request failed: " << e.what();
+        return false;
+    }
+
+    if (response.status == 200) {
+        // If-Range didn't match, so the file has changed since the ranges already written
+        boost::mutex::scoped_lock lock(_mutex);
+        remove(_statePath.c_str());
+        return fail("File changed on the server during the download");
+    }
+
+    std::string expected = "bytes " + boost::lexical_cast<std::string>(range.start) + "-";
+    bool matched = false;
+    for (HttpStreamClient::Headers::iterator it = response.headers.begin(); it != response.headers.end(); ++it) {
+        if (boost::iequals(it->first, "Content-Range")) {
+            matched = boost::istarts_with(it->second, expected);
+        }
+    }
+    if (response.status != 206 || !matched) {
+        LOG_DEBUG << "Unexpected response to range request: " << response.status;
+        return false;
+    }
+
+    written = sink.written();
+    if (response.sinkFailed) {
+        LOG_DEBUG << sink.error();
+    }
+    return written == range.end - range.start;
+}
+
+// Thread body for each connection: fetch ranges until none are left
+void SegmentedDownload::fetch(boost::shared_ptr<HttpStreamClient> client) {
+    std::FILE* file = fopen(_partPath.c_str(), "r+b");
+    if (file) {
+        setvbuf(file, 0, _IONBF, 0);  // Responses are already read in large pieces
+    } else {
+        boost::mutex::scoped_lock lock(_mutex);
+        fail("Unable to open " + _partPath + ": " + strerror(errno));
+    }
+
+    while (file) {
+        Range range;
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            if (_failed || _cancelled || _pending.empty()) {
+                break;
+            }
+            range = _pending.front();
+            _pending.pop_front();
+        }
+
+        boost::uint64_t written = 0;
+        bool complete = fetchRange(*client, file, range, written);
+
+        boost::mutex::scoped_lock lock(_mutex);
+        if (written > 0) {
+            markDone(Range(range.start, range.start + written));
+            saveState();
+        }
+
+        if (complete) {
+            _failures = 0;
+        } else {
+            _pending.push_front(Range(range.start + written, range.end));
+            if (!_cancelled && ++_failures >= kMaxFailures) {
+                fail("Download failed after " + boost::lexical_cast<std::string>(kMaxFailures) + " attempts");
+            }
+        }
+        _changed.notify_all();
+    }
+
+    if (file) {
+        fclose(file);
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    --_active;
+    _changed.notify_all();
+}
+
+bool SegmentedDownload::run() {
+    using boost::posix_time::ptime;
+    using boost::posix_time::microsec_clock;
+
+    boost::shared_ptr<HttpStreamClient> first = newClient();
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (_cancelled) {
+            return fail("Download canceled");
+        }
+        _clients.push_back(first);
+    }
+
+    // Find the length and whether the server accepts ranges.  The connection is kept for the first ranges.
+    std::string ignored;
+    StringSink noBody(ignored);
+    HttpStreamClient::Response head;
+    try {
+        head = first->request("HEAD", _url, _requestHeaders, "", 0, noBody);
+    } catch (const std::exception& e) {
+        boost::mutex::scoped_lock lock(_mutex);
+        return fail(e.what());
+    }
+
+    _status = head.status;
+    _headers = head.headers;
+    _url = head.url;  // Ranges are fetched from where the redirects ended
+    bool acceptsRanges = false;
+    std::string lastModified;
+    for (HttpStreamClient::Headers::iterator it = head.headers.begin(); it != head.headers.end(); ++it) {
+        if (boost::iequals(it->first, "Accept-Ranges")) {
+            acceptsRanges = boost::icontains(it->second, "bytes");
+        } else if (boost::iequals(it->first, "Content-Length")) {
+            try {
+                _length = boost::lexical_cast<boost::uint64_t>(it->second);
+            } catch (const boost::bad_lexical_cast&) {
+                _length = 0;
+            }
+        } else if (boost::iequals(it->first, "ETag") && !boost::starts_with(it->second, "W/")) {
+            _validator = it->second;  // Weak ETags can't be used with If-Range
+        } else if (boost::iequals(it->first, "Last-Modified")) {
+            lastModified = it->second;
+        }
+    }
+    if (_validator.empty()) {
+        _validator = lastModified;
+    }
+
+    if (_status != 200 || !acceptsRanges || _length < 2 * kMinRangeSize || _maxConnections < 2) {
+        return single(*first);
+    }
+
+    if (!prepareFile()) {
+        return false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(_mutex);
+
+    // Split what's left into ranges
+    boost::uint64_t rangeSize = _length / (_maxConnections * kRangesPerConnection);
+    rangeSize = std::min(std::max(rangeSize, kMinRangeSize), kMaxRangeSize);
+
+    std::vector<Range> done = _done;
+    done.push_back(Range(_length, _length));
+    boost::uint64_t pos = 0;
+    for (std::vector<Range>::iterator it = done.begin(); it != done.end(); ++it) {
+        for (boost::uint64_t start = pos; start < it->start; start += rangeSize) {
+            _pending.push_back(Range(start, std::min(start + rangeSize, it->start)));
+        }
+        pos = std::max(pos, it->end);
+    }
+
+    addConnection(first);
+    while (_clients.size() < std::min(kInitialConnections, _maxConnections)) {
+        addConnection(newClient());
+    }
+
+    // Add a connection at a time while each new one pulls its weight.  The interval after a connection
+    // is added isn't measured, since it includes the connection's setup and slow start.
+    ptime sampleStart = microsec_clock::universal_time();
+    boost::uint64_t sampleBytes = _received;
+    double previousRate = 0;
+    std::size_t previousConnections = 0;
+    bool growing = (_clients.size() < _maxConnections);
+    bool warmingUp = true;
+
+    while (_active > 0) {
+        _changed.timed_wait(lock, boost::posix_time::milliseconds(kSampleMS));
+
+        ptime now = microsec_clock::universal_time();
+        long elapsed = static_cast<long>((now - sampleStart).total_milliseconds());
+        if (!growing || elapsed < kSampleMS) {
+            continue;
+        }
+
+        double rate = static_cast<double>(_received - sampleBytes) * 1000.0 / elapsed;
+        sampleStart = now;
+        sampleBytes = _received;
+        if (warmingUp) {
+            warmingUp = false;
+            continue;
+        }
+
+        if (previousConnections > 0 && rate - previousRate < kMinGain * previousRate / previousConnections) {
+            LOG_DEBUG << "Download settled at " << previousConnections << " connections";
+            growing = false;
+        } else if (_clients.size() >= _maxConnections || _pending.empty() || _failed || _cancelled) {
+            growing = false;
+        } else {
+            previousRate = rate;
+            previousConnections = _clients.size();
+            addConnection(newClient());
+            warmingUp = true;
+        }
+    }
+
+    lock.unlock();
+    _threads.join_all();
+    lock.lock();
+
+    if (_failed) {
+        return false;
+    }
+    if (_cancelled) {
+        return fail("Download canceled");
+    }
+    if (_done.size() != 1 || _done[0].start != 0 || _done[0].end != _length) {
+        return fail("Download is incomplete");
+    }
+
+    // Replace any existing file (rename doesn't on Windows)
+    remove(_path.c_str());
+    if (rename(_partPath.c_str(), _path.c_str()) != 0) {
+        return fail("Unable to rename " + _partPath + ": " + strerror(errno));
+    }
+    remove(_statePath.c_str());
+
+    return true;
+}
@@ -1,238 +1,702 @@
-/* Copyright (c) 2010 David McKeone
- * All rights reserved.
- * 
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- * notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- * notice, this list of conditions and the following disclaimer in the
- * documentation and/or other materials provided with the distribution.
- * 3. The name of the author may not be used to endorse or promote products
- * derived from this software without specific prior written permission.
- * 
- * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
- * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
- * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
- * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
- * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
- * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
- * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
- * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
- * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-/* STATIC METHODS (IMPLEMENTATION)
- * 
- * This file implements all static methods for the external.
- *
- * February 18, 2011 David McKeone (Created)
- */
-
-#include "Static.he"
-
-#include <extcomp.he>
-#include "OmnisTools.he"
-#include "Logging.he"
-
-using namespace OmnisTools;
-
-// Define static methods
-const static qshort cStaticMethodLogTrace   = 20000,
-                    cStaticMethodLogDebug   = 20001,
-                    cStaticMethodLogInfo    = 20002,
-                    cStaticMethodLogWarning = 20003,
-                    cStaticMethodLogError   = 20004,
-                    cStaticMethodLogFatal   = 20005;
-
-// Parameters for Static Methods
-// Columns are:
-// 1) Name of Parameter (Resource #)
-// 2) Return type (fft value)
-// 3) Parameter flags of type EXTD_FLAG_xxxx
-// 4) Extended flags.  Documentation states, "Must be 0"
-ECOparam cStaticMethodsParamsTable[] = 
-{
-	// $logTrace
-    5900, fftCharacter, 0, 0,
-    // $logDebug
-    5901, fftCharacter, 0, 0,
-    // $logInfo
-    5902, fftCharacter, 0, 0,
-    // $logWarning
-    5903, fftCharacter, 0, 0,
-    // $logError
-    5904, fftCharacter, 0, 0,
-    // $logFatal
-    5905, fftCharacter, 0, 0
-};
-
-// Table of Methods available for Simple
-// Columns are:
-// 1) Unique ID 
-// 2) Name of Method (Resource #)
-// 3) Return Type 
-// 4) # of Parameters
-// 5) Array of Parameter Names (Taken from MethodsParamsTable.  Increments # of parameters past this pointer) 
-// 6) Enum Start (Not sure what this does, 0 = disabled)
-// 7) Enum Stop (Not sure what this does, 0 = disabled)
-ECOmethodEvent cStaticMethodsTable[] = 
-{
-	cStaticMethodLogTrace,   cStaticMethodLogTrace,   fftBoolean, 1, &cStaticMethodsParamsTable[0], 0, 0,
-    cStaticMethodLogDebug,   cStaticMethodLogDebug,   fftBoolean, 1, &cStaticMethodsParamsTable[1], 0, 0,
-    cStaticMethodLogInfo,    cStaticMethodLogInfo,    fftBoolean, 1, &cStaticMethodsParamsTable[2], 0, 0,
-    cStaticMethodLogWarning, cStaticMethodLogWarning, fftBoolean, 1, &cStaticMethodsParamsTable[3], 0, 0,
-    cStaticMethodLogError,   cStaticMethodLogError,   fftBoolean, 1, &cStaticMethodsParamsTable[4], 0, 0,
-    cStaticMethodLogFatal,   cStaticMethodLogFatal,   fftBoolean, 1, &cStaticMethodsParamsTable[5], 0, 0
-};
-
-// List of methods in Simple
-qlong returnStaticMethods(tThreadData* pThreadData)
-{
-	const qshort cStaticMethodCount = sizeof(cStaticMethodsTable) / sizeof(ECOmethodEvent);
-	
-	return ECOreturnMethods( gInstLib, pThreadData->mEci, &cStaticMethodsTable[0], cStaticMethodCount );
-}
-
-// Log trace message
-void methodStaticLogTrace(tThreadData* pThreadData, qshort paramCount) {
-	
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_TRACE << getStringFromEXTFldVal(messageVal);
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Log debug message
-void methodStaticLogDebug(tThreadData* pThreadData, qshort paramCount) {
-	
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_DEBUG << getStringFromEXTFldVal(messageVal);
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Log info message
-void methodStaticLogInfo(tThreadData* pThreadData, qshort paramCount) {
-    
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_INFO << getStringFromEXTFldVal(messageVal);
-        
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Log warning message
-void methodStaticLogWarning(tThreadData* pThreadData, qshort paramCount) {
-	
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_WARNING << getStringFromEXTFldVal(messageVal);
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Log error message
-void methodStaticLogError(tThreadData* pThreadData, qshort paramCount) {
-	
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_ERROR << getStringFromEXTFldVal(messageVal);
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Log fatal message
-void methodStaticLogFatal(tThreadData* pThreadData, qshort paramCount) {
-	
-    // Read message and post to log
-    EXTfldval messageVal;
-    bool success = false;
-	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
-        LOG_FATAL << getStringFromEXTFldVal(messageVal);
-        success = true;
-    }
-    
-    // Return bool to caller
-    EXTfldval retVal;    
-    getEXTFldValFromBool(retVal, success);
-    ECOaddParam(pThreadData->mEci, &retVal);
-}
-
-// Static method dispatch
-qlong staticMethodCall( OmnisTools::tThreadData* pThreadData ) {
-	
-	qshort funcId = (qshort)ECOgetId(pThreadData->mEci);
-	qshort paramCount = ECOgetParamCount(pThreadData->mEci);
-	
-	switch( funcId )
-	{
-		case cStaticMethodLogTrace:
-			pThreadData->mCurMethodName = "$logTrace";
-			methodStaticLogTrace(pThreadData, paramCount);
-			break;
-        case cStaticMethodLogDebug:
-			pThreadData->mCurMethodName = "$logDebug";
-			methodStaticLogDebug(pThreadData, paramCount);
-			break;
-        case cStaticMethodLogInfo:
-			pThreadData->mCurMethodName = "$logInfo";
-			methodStaticLogInfo(pThreadData, paramCount);
-			break;
-        case cStaticMethodLogWarning:
-			pThreadData->mCurMethodName = "$logWarning";
-			methodStaticLogWarning(pThreadData, paramCount);
-			break;
-        case cStaticMethodLogError:
-			pThreadData->mCurMethodName = "$logError";
-			methodStaticLogError(pThreadData, paramCount);
-			break;
-        case cStaticMethodLogFatal:
-			pThreadData->mCurMethodName = "$logFatal";
-			methodStaticLogFatal(pThreadData, paramCount);
-			break;
-	}
-	
-	return 0L;
-}
-
+/* Copyright (c) 2010 David McKeone
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* STATIC METHODS (IMPLEMENTATION)
+ * 
+ * This file implements all static methods for the external.
+ *
+ * February 18, 2011 David McKeone (Created)
+ */
+
+#include "Static.he"
+
+#include <extcomp.he>
+#include "OmnisTools.he"
+#include "Logging.he"
+#include "ResponseCache.h"
+#include "DiskCache.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include "MetricsServer.h"
+#include "InflightRegistry.h"
+
+#include <algorithm>
+
+using namespace OmnisTools;
+
+// Define static methods
+const static qshort cStaticMethodLogTrace   = 20000,
+                    cStaticMethodLogDebug   = 20001,
+                    cStaticMethodLogInfo    = 20002,
+                    cStaticMethodLogWarning = 20003,
+                    cStaticMethodLogError   = 20004,
+                    cStaticMethodLogFatal   = 20005,
+                    cStaticMethodSetCacheSize = 20006,
+                    cStaticMethodCacheStats   = 20007,
+                    cStaticMethodSetCacheDirectory = 20008,
+                    cStaticMethodMetrics      = 20009,
+                    cStaticMethodResetMetrics = 20010,
+                    cStaticMethodSetLogLevel  = 20011,
+                    cStaticMethodSetLogFile   = 20012,
+                    cStaticMethodStartTrace   = 20013,
+                    cStaticMethodStopTrace    = 20014,
+                    cStaticMethodDumpTrace    = 20015,
+                    cStaticMethodStartMetricsServer = 20016,
+                    cStaticMethodStopMetricsServer  = 20017,
+                    cStaticMethodInflight           = 20018,
+                    cStaticMethodSetSlowThreshold   = 20019;
+
+// Parameters for Static Methods
+// Columns are:
+// 1) Name of Parameter (Resource #)
+// 2) Return type (fft value)
+// 3) Parameter flags of type EXTD_FLAG_xxxx
+// 4) Extended flags.  Documentation states, "Must be 0"
+ECOparam cStaticMethodsParamsTable[] = 
+{
+	// $logTrace
+    5900, fftCharacter, 0, 0,
+    // $logDebug
+    5901, fftCharacter, 0, 0,
+    // $logInfo
+    5902, fftCharacter, 0, 0,
+    // $logWarning
+    5903, fftCharacter, 0, 0,
+    // $logError
+    5904, fftCharacter, 0, 0,
+    // $logFatal
+    5905, fftCharacter, 0, 0,
+    // $setCacheSize
+    20906, fftNumber, 0, 0,
+    // $setCacheDirectory
+    20907, fftCharacter, 0, 0,
+    20908, fftNumber, 0, 0,
+    // $setLogLevel
+    20909, fftCharacter, 0, 0,
+    // $setLogFile
+    20910, fftCharacter, 0, 0,
+    20911, fftNumber, 0, 0,
+    20912, fftNumber, 0, 0,
+    // $startTrace
+    20913, fftNumber, 0, 0,
+    // $dumpTrace
+    20914, fftCharacter, 0, 0,
+    // $startMetricsServer
+    20915, fftNumber, 0, 0,
+    // $setSlowThreshold
+    20916, fftCharacter, 0, 0,
+    20917, fftNumber, 0, 0
+};
+
+// Table of Methods available for Simple
+// Columns are:
+// 1) Unique ID 
+// 2) Name of Method (Resource #)
+// 3) Return Type 
+// 4) # of Parameters
+// 5) Array of Parameter Names (Taken from MethodsParamsTable.  Increments # of parameters past this pointer) 
+// 6) Enum Start (Not sure what this does, 0 = disabled)
+// 7) Enum Stop (Not sure what this does, 0 = disabled)
+ECOmethodEvent cStaticMethodsTable[] = 
+{
+	cStaticMethodLogTrace,   cStaticMethodLogTrace,   fftBoolean, 1, &cStaticMethodsParamsTable[0], 0, 0,
+    cStaticMethodLogDebug,   cStaticMethodLogDebug,   fftBoolean, 1, &cStaticMethodsParamsTable[1], 0, 0,
+    cStaticMethodLogInfo,    cStaticMethodLogInfo,    fftBoolean, 1, &cStaticMethodsParamsTable[2], 0, 0,
+    cStaticMethodLogWarning, cStaticMethodLogWarning, fftBoolean, 1, &cStaticMethodsParamsTable[3], 0, 0,
+    cStaticMethodLogError,   cStaticMethodLogError,   fftBoolean, 1, &cStaticMethodsParamsTable[4], 0, 0,
+    cStaticMethodLogFatal,   cStaticMethodLogFatal,   fftBoolean, 1, &cStaticMethodsParamsTable[5], 0, 0,
+    cStaticMethodSetCacheSize, cStaticMethodSetCacheSize, fftBoolean, 1, &cStaticMethodsParamsTable[6], 0, 0,
+    cStaticMethodCacheStats,   cStaticMethodCacheStats,   fftRow,     0, 0,                             0, 0,
+    cStaticMethodSetCacheDirectory, cStaticMethodSetCacheDirectory, fftBoolean, 2, &cStaticMethodsParamsTable[7], 0, 0,
+    cStaticMethodMetrics,      cStaticMethodMetrics,      fftList,    0, 0,                             0, 0,
+    cStaticMethodResetMetrics, cStaticMethodResetMetrics, fftBoolean, 0, 0,                             0, 0,
+    cStaticMethodSetLogLevel,  cStaticMethodSetLogLevel,  fftBoolean, 1, &cStaticMethodsParamsTable[9],  0, 0,
+    cStaticMethodSetLogFile,   cStaticMethodSetLogFile,   fftBoolean, 3, &cStaticMethodsParamsTable[10], 0, 0,
+    cStaticMethodStartTrace,   cStaticMethodStartTrace,   fftBoolean, 1, &cStaticMethodsParamsTable[13], 0, 0,
+    cStaticMethodStopTrace,    cStaticMethodStopTrace,    fftBoolean, 0, 0,                             0, 0,
+    cStaticMethodDumpTrace,    cStaticMethodDumpTrace,    fftBoolean, 1, &cStaticMethodsParamsTable[14], 0, 0,
+    cStaticMethodStartMetricsServer, cStaticMethodStartMetricsServer, fftBoolean, 1, &cStaticMethodsParamsTable[15], 0, 0,
+    cStaticMethodStopMetricsServer,  cStaticMethodStopMetricsServer,  fftBoolean, 0, 0,                              0, 0,
+    cStaticMethodInflight,           cStaticMethodInflight,           fftList,    0, 0,                              0, 0,
+    cStaticMethodSetSlowThreshold,   cStaticMethodSetSlowThreshold,   fftBoolean, 2, &cStaticMethodsParamsTable[16], 0, 0
+};
+
+// List of methods in Simple
+qlong returnStaticMethods(tThreadData* pThreadData)
+{
+	const qshort cStaticMethodCount = sizeof(cStaticMethodsTable) / sizeof(ECOmethodEvent);
+	
+	return ECOreturnMethods( gInstLib, pThreadData->mEci, &cStaticMethodsTable[0], cStaticMethodCount );
+}
+
+// Log trace message
+void methodStaticLogTrace(tThreadData* pThreadData, qshort paramCount) {
+	
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kTrace)) {
+            Logger::instance().write(Logger::kTrace, getStringFromEXTFldVal(messageVal));
+        }
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Log debug message
+void methodStaticLogDebug(tThreadData* pThreadData, qshort paramCount) {
+	
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kDebug)) {
+            Logger::instance().write(Logger::kDebug, getStringFromEXTFldVal(messageVal));
+        }
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Log info message
+void methodStaticLogInfo(tThreadData* pThreadData, qshort paramCount) {
+    
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kInfo)) {
+            Logger::instance().write(Logger::kInfo, getStringFromEXTFldVal(messageVal));
+        }
+        
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Log warning message
+void methodStaticLogWarning(tThreadData* pThreadData, qshort paramCount) {
+	
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kWarning)) {
+            Logger::instance().write(Logger::kWarning, getStringFromEXTFldVal(messageVal));
+        }
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Log error message
+void methodStaticLogError(tThreadData* pThreadData, qshort paramCount) {
+	
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kError)) {
+            Logger::instance().write(Logger::kError, getStringFromEXTFldVal(messageVal));
+        }
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Log fatal message
+void methodStaticLogFatal(tThreadData* pThreadData, qshort paramCount) {
+	
+    // Read message and post to log
+    EXTfldval messageVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, messageVal) == qtrue ) {
+        if (Logger::enabled(Logger::kFatal)) {
+            Logger::instance().write(Logger::kFatal, getStringFromEXTFldVal(messageVal));
+        }
+        success = true;
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Set the size of the response cache in bytes
+void methodStaticSetCacheSize(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval bytesVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, bytesVal) == qtrue ) {
+        double bytes = getDoubleFromEXTFldVal(bytesVal);
+        if (bytes >= 0) {
+            ResponseCache::instance().setCapacity(static_cast<std::size_t>(bytes));
+            success = true;
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Return the response cache counters as a row
+void methodStaticCacheStats(tThreadData* pThreadData, qshort paramCount) {
+    
+    ResponseCache::Stats stats = ResponseCache::instance().stats();
+    DiskCache::Stats disk = DiskCache::instance().stats();
+    const char* names[] = { "hits", "misses", "revalidations", "stale", "evictions", "entries", "bytes", "capacity",
+                            "disk_reads", "disk_writes", "disk_compactions", "disk_entries", "disk_bytes", "disk_capacity" };
+    boost::uint64_t values[] = { stats.hits, stats.misses, stats.revalidations, stats.stale, stats.evictions, stats.entries, stats.bytes, stats.capacity,
+                                 disk.reads, disk.writes, disk.compactions, disk.entries, disk.bytes, disk.maxBytes };
+    const qshort columns = sizeof(values) / sizeof(values[0]);
+    
+    str255 colName;
+    EXTfldval colVal;
+    EXTqlist* retList = new EXTqlist(listVlen);
+    for (qshort col = 1; col <= columns; ++col) {
+        colName = initStr255(names[col - 1]);
+        retList->addCol(fftNumber, 0, 0, &colName);
+    }
+    
+    retList->insertRow();
+    for (qshort col = 1; col <= columns; ++col) {
+        retList->getColValRef(1, col, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, static_cast<double>(values[col - 1]));
+    }
+    
+    // Return row to caller
+    EXTfldval retVal;
+    retVal.setList(retList, qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Keep the response cache in a directory as well as in memory
+void methodStaticSetCacheDirectory(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval pathVal, bytesVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, pathVal) == qtrue ) {
+        double bytes = 0;
+        if (paramCount >= 2 && getParamVar(pThreadData, 2, bytesVal) == qtrue) {
+            bytes = getDoubleFromEXTFldVal(bytesVal);
+        }
+        
+        std::string error;
+        ResponseCache::instance();  // The disk cache is used through it, so it's created here on the main thread
+        success = DiskCache::instance().open(getStringFromEXTFldVal(pathVal), static_cast<boost::uint64_t>(std::max(bytes, 0.0)), error);
+        if (!success) {
+            LOG_ERROR << "Unable to open cache directory: " << error;
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Add a row of metrics: a counter has only a value, and a histogram its count, mean and percentiles in milliseconds
+static void addMetricsRow(EXTqlist* list, const std::string& metric, const std::string& label, double value, const Metrics::Histogram* histogram) {
+    
+    EXTfldval colVal;
+    qlong row = list->insertRow();
+    
+    list->getColValRef(row, 1, colVal, qtrue);
+    getEXTFldValFromString(colVal, metric);
+    list->getColValRef(row, 2, colVal, qtrue);
+    getEXTFldValFromString(colVal, label);
+    list->getColValRef(row, 3, colVal, qtrue);
+    getEXTFldValFromDouble(colVal, value);
+    
+    if (histogram) {
+        const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+        list->getColValRef(row, 4, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, histogram->mean() / 1000.0);
+        for (qshort col = 5; col <= 9; ++col) {
+            list->getColValRef(row, col, colVal, qtrue);
+            getEXTFldValFromDouble(colVal, static_cast<double>(histogram->percentile(percentiles[col - 5])) / 1000.0);
+        }
+    }
+}
+
+// Return the request metrics as a list, one row per counter and per latency histogram.  The TCP rows are
+// labelled with the requests they cover, since only those made by the HttpStreamClient are sampled
+void methodStaticMetrics(tThreadData* pThreadData, qshort paramCount) {
+    
+    Metrics::Snapshot snapshot = Metrics::instance().snapshot();
+    
+    const char* names[] = { "metric", "label", "value", "mean", "p50", "p90", "p99", "p999", "max" };
+    str255 colName;
+    EXTqlist* retList = new EXTqlist(listVlen);
+    for (qshort col = 1; col <= 9; ++col) {
+        colName = initStr255(names[col - 1]);
+        if (col <= 2)
+            retList->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+        else
+            retList->addCol(fftNumber, dpFmask, 0, &colName);
+    }
+    
+    for (int counter = 0; counter < Metrics::kCounterCount; ++counter) {
+        std::string label = (counter == Metrics::kTcpRetransmits) ? Metrics::kTcpSampled : "";
+        addMetricsRow(retList, Metrics::counterName(static_cast<Metrics::Counter>(counter)), label,
+                      static_cast<double>(snapshot.counters[counter]), 0);
+    }
+    for (int statusClass = 0; statusClass < Metrics::kStatusClassCount; ++statusClass) {
+        const Metrics::Histogram& histogram = snapshot.statuses[statusClass];
+        addMetricsRow(retList, "latency_by_status", Metrics::statusClassName(static_cast<Metrics::StatusClass>(statusClass)),
+                      static_cast<double>(histogram.count()), &histogram);
+    }
+    for (std::map<std::string, Metrics::Histogram>::iterator it = snapshot.hosts.begin(); it != snapshot.hosts.end(); ++it) {
+        addMetricsRow(retList, "latency_by_host", it->first, static_cast<double>(it->second.count()), &it->second);
+    }
+    addMetricsRow(retList, "delivery_lag", std::string(), static_cast<double>(snapshot.deliveryLag.count()), &snapshot.deliveryLag);
+    addMetricsRow(retList, "tcp_rtt", Metrics::kTcpSampled, static_cast<double>(snapshot.tcpRtt.count()), &snapshot.tcpRtt);
+    
+    // Return list to caller
+    EXTfldval retVal;
+    retVal.setList(retList, qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Start the metrics again from zero
+void methodStaticResetMetrics(tThreadData* pThreadData, qshort paramCount) {
+    
+    Metrics::instance().reset();
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, true);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Only log messages at or above a level (trace, debug, info, warning, error, fatal or off)
+void methodStaticSetLogLevel(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval levelVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, levelVal) == qtrue ) {
+        Logger::Level level;
+        success = Logger::parseLevel(getStringFromEXTFldVal(levelVal), level);
+        if (success) {
+            Logger::setLevel(level);
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Write the log to a file, rotated when it reaches bytes and keeping the given number of older files
+void methodStaticSetLogFile(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval pathVal, bytesVal, filesVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, pathVal) == qtrue ) {
+        double bytes = static_cast<double>(Logger::kDefaultMaxBytes);
+        if (paramCount >= 2 && getParamVar(pThreadData, 2, bytesVal) == qtrue) {
+            bytes = getDoubleFromEXTFldVal(bytesVal);
+        }
+        double files = Logger::kDefaultMaxFiles;
+        if (paramCount >= 3 && getParamVar(pThreadData, 3, filesVal) == qtrue) {
+            files = getDoubleFromEXTFldVal(filesVal);
+        }
+        
+        std::string error;
+        success = Logger::instance().setFile(getStringFromEXTFldVal(pathVal), static_cast<boost::uint64_t>(std::max(bytes, 0.0)),
+                                             static_cast<int>(files), error);
+        if (!success) {
+            LOG_ERROR << error;
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Start recording spans, keeping the most recent spans up to a limit
+void methodStaticStartTrace(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval capacityVal;
+    double capacity = static_cast<double>(Tracer::kDefaultCapacity);
+    if (paramCount >= 1 && getParamVar(pThreadData, 1, capacityVal) == qtrue) {
+        capacity = getDoubleFromEXTFldVal(capacityVal);
+    }
+    Tracer::instance().start(static_cast<std::size_t>(std::max(capacity, 1.0)));
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, true);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Stop recording spans, keeping those already recorded
+void methodStaticStopTrace(tThreadData* pThreadData, qshort paramCount) {
+    
+    Tracer::stop();
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, true);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Write the recorded spans to a file as Chrome Trace Event JSON
+void methodStaticDumpTrace(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval pathVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, pathVal) == qtrue ) {
+        std::string error;
+        success = Tracer::instance().write(getStringFromEXTFldVal(pathVal), error);
+        if (!success) {
+            LOG_ERROR << error;
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Serve the metrics over HTTP on 127.0.0.1:port
+void methodStaticStartMetricsServer(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval portVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, portVal) == qtrue ) {
+        std::string error;
+        success = MetricsServer::instance().start(static_cast<int>(getDoubleFromEXTFldVal(portVal)), error);
+        if (!success) {
+            LOG_ERROR << error;
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Stop serving the metrics over HTTP
+void methodStaticStopMetricsServer(tThreadData* pThreadData, qshort paramCount) {
+    
+    MetricsServer::instance().stop();
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, true);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Return the requests started and not yet delivered, oldest first
+void methodStaticInflight(tThreadData* pThreadData, qshort paramCount) {
+    
+    std::vector<InflightRegistry::Request> requests = InflightRegistry::instance().requests();
+    
+    const char* names[] = { "id", "method", "url", "stage", "elapsed", "stage_elapsed", "bytes_in", "bytes_out", "slow" };
+    str255 colName;
+    EXTqlist* retList = new EXTqlist(listVlen);
+    for (qshort col = 1; col <= 9; ++col) {
+        colName = initStr255(names[col - 1]);
+        if (col >= 2 && col <= 4)
+            retList->addCol(fftCharacter, dpFcharacter, 10000000, &colName);
+        else if (col == 9)
+            retList->addCol(fftBoolean, 0, 0, &colName);
+        else
+            retList->addCol(fftNumber, dpFmask, 0, &colName);
+    }
+    
+    EXTfldval colVal;
+    for (std::vector<InflightRegistry::Request>::iterator it = requests.begin(); it != requests.end(); ++it) {
+        qlong row = retList->insertRow();
+        retList->getColValRef(row, 1, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, static_cast<double>(it->id));
+        retList->getColValRef(row, 2, colVal, qtrue);
+        getEXTFldValFromString(colVal, it->method);
+        retList->getColValRef(row, 3, colVal, qtrue);
+        getEXTFldValFromString(colVal, it->url);
+        retList->getColValRef(row, 4, colVal, qtrue);
+        getEXTFldValFromString(colVal, InflightRegistry::stageName(it->stage));
+        retList->getColValRef(row, 5, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, it->elapsed);
+        retList->getColValRef(row, 6, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, it->stageElapsed);
+        retList->getColValRef(row, 7, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, static_cast<double>(it->bytesIn));
+        retList->getColValRef(row, 8, colVal, qtrue);
+        getEXTFldValFromDouble(colVal, static_cast<double>(it->bytesOut));
+        retList->getColValRef(row, 9, colVal, qtrue);
+        getEXTFldValFromBool(colVal, it->slow);
+    }
+    
+    // Return list to caller
+    EXTfldval retVal;
+    retVal.setList(retList, qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Report requests that stay in a stage (queued, connecting, waiting, receiving or delivering) longer than ms.  0 never reports them.
+void methodStaticSetSlowThreshold(tThreadData* pThreadData, qshort paramCount) {
+    
+    EXTfldval stageVal, msVal;
+    bool success = false;
+	if( getParamVar(pThreadData, 1, stageVal) == qtrue && getParamVar(pThreadData, 2, msVal) == qtrue ) {
+        InflightRegistry::Stage stage;
+        success = InflightRegistry::parseStage(getStringFromEXTFldVal(stageVal), stage);
+        if (success) {
+            InflightRegistry::instance().setThreshold(stage, getDoubleFromEXTFldVal(msVal));
+        }
+    }
+    
+    // Return bool to caller
+    EXTfldval retVal;    
+    getEXTFldValFromBool(retVal, success);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Static method dispatch
+qlong staticMethodCall( OmnisTools::tThreadData* pThreadData ) {
+	
+	qshort funcId = (qshort)ECOgetId(pThreadData->mEci);
+	qshort paramCount = ECOgetParamCount(pThreadData->mEci);
+	
+	switch( funcId )
+	{
+		case cStaticMethodLogTrace:
+			pThreadData->mCurMethodName = "$logTrace";
+			methodStaticLogTrace(pThreadData, paramCount);
+			break;
+        case cStaticMethodLogDebug:
+			pThreadData->mCurMethodName = "$logDebug";
+			methodStaticLogDebug(pThreadData, paramCount);
+			break;
+        case cStaticMethodLogInfo:
+			pThreadData->mCurMethodName = "$logInfo";
+			methodStaticLogInfo(pThreadData, paramCount);
+			break;
+        case cStaticMethodLogWarning:
+			pThreadData->mCurMethodName = "$logWarning";
+			methodStaticLogWarning(pThreadData, paramCount);
+			break;
+        case cStaticMethodLogError:
+			pThreadData->mCurMethodName = "$logError";
+			methodStaticLogError(pThreadData, paramCount);
+			break;
+        case cStaticMethodLogFatal:
+			pThreadData->mCurMethodName = "$logFatal";
+			methodStaticLogFatal(pThreadData, paramCount);
+			break;
+        case cStaticMethodSetCacheSize:
+			pThreadData->mCurMethodName = "$setCacheSize";
+			methodStaticSetCacheSize(pThreadData, paramCount);
+			break;
+        case cStaticMethodCacheStats:
+			pThreadData->mCurMethodName = "$cacheStats";
+			methodStaticCacheStats(pThreadData, paramCount);
+			break;
+        case cStaticMethodSetCacheDirectory:
+			pThreadData->mCurMethodName = "$setCacheDirectory";
+			methodStaticSetCacheDirectory(pThreadData, paramCount);
+			break;
+        case cStaticMethodMetrics:
+			pThreadData->mCurMethodName = "$metrics";
+			methodStaticMetrics(pThreadData, paramCount);
+			break;
+        case cStaticMethodResetMetrics:
+			pThreadData->mCurMethodName = "$resetMetrics";
+			methodStaticResetMetrics(pThreadData, paramCount);
+			break;
+        case cStaticMethodSetLogLevel:
+			pThreadData->mCurMethodName = "$setLogLevel";
+			methodStaticSetLogLevel(pThreadData, paramCount);
+			break;
+        case cStaticMethodSetLogFile:
+			pThreadData->mCurMethodName = "$setLogFile";
+			methodStaticSetLogFile(pThreadData, paramCount);
+			break;
+        case cStaticMethodStartTrace:
+			pThreadData->mCurMethodName = "$startTrace";
+			methodStaticStartTrace(pThreadData, paramCount);
+			break;
+        case cStaticMethodStopTrace:
+			pThreadData->mCurMethodName = "$stopTrace";
+			methodStaticStopTrace(pThreadData, paramCount);
+			break;
+        case cStaticMethodDumpTrace:
+			pThreadData->mCurMethodName = "$dumpTrace";
+			methodStaticDumpTrace(pThreadData, paramCount);
+			break;
+        case cStaticMethodStartMetricsServer:
+			pThreadData->mCurMethodName = "$startMetricsServer";
+			methodStaticStartMetricsServer(pThreadData, paramCount);
+			break;
+        case cStaticMethodStopMetricsServer:
+			pThreadData->mCurMethodName = "$stopMetricsServer";
+			methodStaticStopMetricsServer(pThreadData, paramCount);
+			break;
+        case cStaticMethodInflight:
+			pThreadData->mCurMethodName = "$inflight";
+			methodStaticInflight(pThreadData, paramCount);
+			break;
+        case cStaticMethodSetSlowThreshold:
+			pThreadData->mCurMethodName = "$setSlowThreshold";
+			methodStaticSetSlowThreshold(pThreadData, paramCount);
+			break;
+	}
+	
+	return 0L;
+}
+
@@ -8,6 +8,7 @@
 
 #include "ThreadTimer.he"
 #include "NVObjBase.he"
+#include "ListPool.h"
 #include <map>
 #include <boost/foreach.hpp>
 
@@ -57,6 +58,9 @@ void OMNISWNDPROC ThreadTimer::timerMsgProc( HWND hwnd, UINT Msg, UINT idTimer,
         }
     }   
     
+    // Top up lists for background workers while the main thread is idle
+    ListPool::instance().replenish();
+    
     timerProcessing = false;
 }
 
@@ -0,0 +1,136 @@
+//
+//  Tracer.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "Tracer.h"
+#include "JsonListBuilder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/lexical_cast.hpp>
+
+volatile bool Tracer::_enabled = false;
+
+Tracer& Tracer::instance()
+{
+    static Tracer theInst;
+
+    return theInst;
+}
+
+Tracer::Tracer() : _next(0), _recorded(0), _threads(0), _mainThread(0)
+{ }
+
+// Small number for the calling thread, used as its row in the trace
+int Tracer::thread()
+{
+    int* id = _thread.get();
+    if (!id) {
+        id = new int(++_threads);  // Called with _mutex held
+        _thread.reset(id);
+    }
+    return *id;
+}
+
+void Tracer::start(std::size_t capacity)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _spans.assign(std::max<std::size_t>(capacity, 1), Span());
+    _next = 0;
+    _recorded = 0;
+    _mainThread = thread();
+    _enabled = true;
+}
+
+void Tracer::stop()
+{
+    _enabled = false;
+}
+
+void Tracer::record(const char* name, const char* category, boost::uint64_t begin, boost::uint64_t end, const std::string& detail)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_spans.empty())
+        return;
+
+    Span& span = _spans[_next];
+    span.name = name;
+    span.category = category;
+    span.begin = begin;
+    span.end = std::max(begin, end);
+    span.thread = thread();
+    span.detail = detail;
+    _next = (_next + 1) % _spans.size();
+    ++_recorded;
+}
+
+std::string Tracer::json()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":";
+    out += boost::lexical_cast<std::string>(_recorded);
+    out += ",\"dropped\":";
+    out += boost::lexical_cast<std::string>(_recorded > _spans.size() ? _recorded - _spans.size() : 0);
+    out += "},\"traceEvents\":[";
+
+    // A name for each thread's row
+    for (int thread = 1; thread <= _threads; ++thread) {
+        if (thread > 1)
+            out += ',';
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+        out += boost::lexical_cast<std::string>(thread);
+        out += ",\"args\":{\"name\":";
+        std::string name = (thread == _mainThread) ? "Omnis main thread" : "Thread " + boost::lexical_cast<std::string>(thread);
+        writeJsonString(name.data(), name.size(), out);
+        out += "}}";
+    }
+
+    // Oldest first
+    std::size_t count = static_cast<std::size_t>(std::min<boost::uint64_t>(_recorded, _spans.size()));
+    std::size_t first = (_recorded > _spans.size()) ? _next : 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const Span& span = _spans[(first + i) % _spans.size()];
+        out += ",{\"name\":";
+        writeJsonString(span.name, std::strlen(span.name), out);
+        out += ",\"cat\":";
+        writeJsonString(span.category, std::strlen(span.category), out);
+        out += ",\"ph\":\"X\",\"pid\":1,\"tid\":";
+        out += boost::lexical_cast<std::string>(span.thread);
+        out += ",\"ts\":";
+        out += boost::lexical_cast<std::string>(span.begin);
+        out += ",\"dur\":";
+        out += boost::lexical_cast<std::string>(span.end - span.begin);
+        if (!span.detail.empty()) {
+            out += ",\"args\":{\"detail\":";
+            writeJsonString(span.detail.data(), span.detail.size(), out);
+            out += '}';
+        }
+        out += '}';
+    }
+
+    out += "]}";
+    return out;
+}
+
+bool Tracer::write(const std::string& path, std::string& error)
+{
+    std::string trace = json();
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "Unable to open trace file " + path;
+        return false;
+    }
+    bool written = std::fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written) {
+        error = "Unable to write trace file " + path;
+    }
+    return written;
+}
@@ -12,19 +12,17 @@
 #include "Worker.h"
 #include "Logging.he"
 #include "OmnisTools.he"
-
-#include <boost/format.hpp>
+#include "RequestTimings.h"
 
 using namespace OmnisTools;
-using boost::format;
 
 static const int SLEEP_MS = 100;  // Time to sleep when waiting for connection to finish on PostgreSQL server side
 static const int WAIT_MS = 500;  // Time to sleep when nothing is done and waiting for notifications
 
-Worker::Worker() : _complete(false), _running(false), _cancelled(false) 
+Worker::Worker() : _complete(false), _running(false), _cancelled(false), _completedAt(0) 
 { }
 
-Worker::Worker(const OmnisTools::ParamMap& p, boost::shared_ptr<WorkerDelegate> d) : _params(p), _delegate(d), _complete(false), _running(false), _cancelled(false) 
+Worker::Worker(const OmnisTools::ParamMap& p, boost::shared_ptr<WorkerDelegate> d) : _params(p), _delegate(d), _complete(false), _running(false), _cancelled(false), _completedAt(0) 
 { }
 
 Worker::Worker(const Worker& w)
@@ -36,6 +34,7 @@ Worker::Worker(const Worker& w)
     _running = w._running;
     _complete = w._complete;
     _cancelled = w._cancelled;
+    _completedAt = w._completedAt;
     
     _queue = w._queue;
     _delegate = w._delegate;
@@ -49,7 +48,7 @@ Worker::~Worker() {
 // Description of object used for logging
 std::string Worker::desc() {
     if (!_workerName.empty()) {
-        return str(format("Worker (%s)") % _workerName);
+        return "Worker (" + _workerName + ")";
     } else {
         return "Worker";
     }  
@@ -57,7 +56,7 @@ std::string Worker::desc() {
 
 // Override point for sub-classes to init objects that must run in the main thread
 void Worker::init() {
-    if (_delegate) {
+    if(_delegate) {
         _delegate->init(_params);
     }
 	_complete = false;
@@ -88,6 +87,14 @@ void Worker::setComplete(bool c) {
     // Get unique lock
     boost::unique_lock<boost::shared_mutex> lock(_completeMutex);
     _complete = c;
+    _completedAt = c ? RequestTimings::now() : 0;
+}
+
+boost::uint64_t Worker::completedAt() {
+    // Get shared lock (multiple readers / one writer)
+    boost::shared_lock<boost::shared_mutex> lock(_completeMutex);
+    
+    return _completedAt;
 }
 
 OmnisTools::ParamMap Worker::result() 
@@ -139,7 +146,9 @@ void Worker::reset() {
 // Run worker
 void Worker::run() {
     if(_delegate) {
+        _delegate->queued();
         setResult( _delegate->run(_params) );
+        setComplete(true);
     }
 }
 
@@ -151,6 +160,10 @@ void Worker::start() {
         return;
     }
     
+    if(_delegate) {
+        _delegate->queued();
+    }
+    
     // Run thread
     _thread = boost::thread(WorkerThread(shared_from_this(), _delegate));
 }
@@ -165,6 +178,10 @@ void Worker::start(boost::shared_ptr<Queue> q) {
     
     _queue = q;
     
+    if(_delegate) {
+        _delegate->queued();
+    }
+    
     // Run thread
     _thread = boost::thread(WorkerThread(shared_from_this(), _delegate));
 }
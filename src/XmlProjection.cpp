@@ -0,0 +1,160 @@
+//
+//  XmlProjection.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "XmlProjection.h"
+
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+static const std::size_t kNone = static_cast<std::size_t>(-1);
+
+XmlProjection::XmlProjection(const std::string& records, const std::vector<Column>& columns)
+    : Projection(columns), _reader(*this), _anyDepth(false), _recordDepth(kNone)
+{
+    std::string path = records;
+    if (path.compare(0, 2, "//") == 0) {
+        _anyDepth = true;
+        path.erase(0, 2);
+    } else if (path.compare(0, 1, "/") == 0) {
+        path.erase(0, 1);
+    } else {
+        fail("Records path must start with / or //: " + records);
+    }
+
+    boost::split(_recordsPath, path, boost::is_any_of("/"));
+    if (path.empty() || std::find(_recordsPath.begin(), _recordsPath.end(), std::string()) != _recordsPath.end()) {
+        fail("Invalid records path: " + records);
+    }
+
+    _columnPaths.resize(_columns.size());
+    _columnAttributes.resize(_columns.size());
+    for (std::size_t c = 0; c < _columns.size(); ++c) {
+        path = _columns[c].path;
+        if (path.empty() || path == ".") {
+            continue;
+        }
+        if (path[0] == '/') {
+            fail("Projection paths are relative to the record: " + path);
+            continue;
+        }
+
+        std::vector<std::string>& segments = _columnPaths[c];
+        boost::split(segments, path, boost::is_any_of("/"));
+        if (segments.back() == "text()") {
+            segments.pop_back();
+        } else if (segments.back()[0] == '@') {
+            _columnAttributes[c] = segments.back().substr(1);
+            segments.pop_back();
+        }
+        if (std::find(segments.begin(), segments.end(), std::string()) != segments.end()) {
+            fail("Invalid projection path: " + path);
+        }
+    }
+}
+
+bool XmlProjection::write(const char* data, std::size_t len) {
+    if (!_reader.feed(data, len)) {
+        return fail(_reader.error());
+    }
+    return true;
+}
+
+bool XmlProjection::finish() {
+    if (!_reader.finish()) {
+        return fail(_reader.error());
+    }
+    return true;
+}
+
+// An unprefixed pattern matches the local part of a prefixed name
+bool XmlProjection::nameMatches(const std::string& pattern, const std::string& name) {
+    if (pattern == "*" || pattern == name) {
+        return true;
+    }
+
+    std::size_t colon = name.find(':');
+    return colon != std::string::npos
+        && pattern.find(':') == std::string::npos
+        && name.compare(colon + 1, std::string::npos, pattern) == 0;
+}
+
+// Compare path with the open elements below depth from
+bool XmlProjection::matches(const std::vector<std::string>& path, std::size_t from) const {
+    if (path.size() != _stack.size() - from) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        if (!nameMatches(path[i], _stack[from + i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the element that was just opened starts a record
+bool XmlProjection::isRecord() const {
+    if (_anyDepth) {
+        return _stack.size() >= _recordsPath.size() && matches(_recordsPath, _stack.size() - _recordsPath.size());
+    }
+    return matches(_recordsPath, 0);
+}
+
+void XmlProjection::startElement(const std::string& name, const Attributes& attributes) {
+    _stack.push_back(name);
+
+    if (_recordDepth == kNone) {
+        if (!isRecord()) {
+            return;
+        }
+        _recordDepth = _stack.size();
+        newRow();
+    }
+
+    for (std::size_t c = 0; c < _columnPaths.size(); ++c) {
+        if (filled(c) || !matches(_columnPaths[c], _recordDepth)) {
+            continue;
+        }
+
+        if (_columnAttributes[c].empty()) {
+            Capture cap;
+            cap.column = c;
+            cap.depth = _stack.size();
+            _captures.push_back(cap);
+        } else {
+            for (Attributes::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+                if (nameMatches(_columnAttributes[c], it->first)) {
+                    setCell(c, it->second);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void XmlProjection::endElement(const std::string&) {
+    std::size_t depth = _stack.size();
+    for (std::size_t i = _captures.size(); i-- > 0; ) {
+        if (_captures[i].depth == depth) {
+            setCell(_captures[i].column, boost::trim_copy(_captures[i].text));
+            _captures.erase(_captures.begin() + i);
+        }
+    }
+
+    if (_recordDepth == depth) {
+        _recordDepth = kNone;
+    }
+    _stack.pop_back();
+}
+
+// Text belongs to every element being captured (the XPath string value includes descendants)
+void XmlProjection::text(const std::string& text) {
+    for (std::vector<Capture>::iterator c = _captures.begin(); c != _captures.end(); ++c) {
+        c->text += text;
+    }
+}
@@ -0,0 +1,290 @@
+//
+//  XmlReader.cpp
+//  HTTPlib
+//
+//  Copyright 2013 __MyCompanyName__. All rights reserved.
+//
+
+#include "XmlReader.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    bool endsWith(const std::string& s, const char* suffix) {
+        std::size_t len = strlen(suffix);
+        return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+    }
+
+    void appendUtf8(unsigned long cp, std::string& out) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+}
+
+XmlReader::XmlReader(XmlHandler& handler) : _handler(handler)
+{
+    reset();
+}
+
+void XmlReader::reset() {
+    _state = kText;
+    _text.clear();
+    _markup.clear();
+    _quote = 0;
+    _stack.clear();
+    _seenRoot = false;
+    _error.clear();
+}
+
+bool XmlReader::fail(const char* message) {
+    if (_error.empty()) {
+        _error = message;
+    }
+    return false;
+}
+
+// Expand entity and character references
+void XmlReader::decode(const std::string& raw, std::string& out) {
+    std::size_t start = 0;
+    for (;;) {
+        std::size_t amp = raw.find('&', start);
+        out.append(raw, start, (amp == std::string::npos) ? std::string::npos : amp - start);
+        if (amp == std::string::npos) {
+            return;
+        }
+
+        std::size_t semi = raw.find(';', amp);
+        if (semi == std::string::npos) {
+            out.append(raw, amp, std::string::npos);
+            return;
+        }
+
+        std::string name = raw.substr(amp + 1, semi - amp - 1);
+        if (name == "lt") out += '<';
+        else if (name == "gt") out += '>';
+        else if (name == "amp") out += '&';
+        else if (name == "quot") out += '"';
+        else if (name == "apos") out += '\'';
+        else if (name.size() > 1 && name[0] == '#') {
+            bool hex = (name[1] == 'x' || name[1] == 'X');
+            appendUtf8(strtoul(name.c_str() + (hex ? 2 : 1), 0, hex ? 16 : 10), out);
+        } else {
+            out.append(raw, amp, semi - amp + 1);  // Unknown entity, leave it as it is
+        }
+        start = semi + 1;
+    }
+}
+
+void XmlReader::flushText() {
+    if (_text.empty()) {
+        return;
+    }
+
+    std::string decoded;
+    decode(_text, decoded);
+    _text.clear();
+
+    if (_stack.empty()) {
+        // Only whitespace is allowed outside of the root element
+        for (std::string::iterator it = decoded.begin(); it != decoded.end(); ++it) {
+            if (!isSpace(*it)) {
+                fail("Text outside of the root element");
+                return;
+            }
+        }
+        return;
+    }
+    _handler.text(decoded);
+}
+
+// Called at each '>' to check whether it closes the markup being read
+bool XmlReader::markupComplete() {
+    if (_markup.compare(0, 3, "!--") == 0) {
+        return _markup.size() >= 6 && endsWith(_markup, "-->");
+    }
+    if (_markup.compare(0, 8, "![CDATA[") == 0) {
+        return _markup.size() >= 11 && endsWith(_markup, "]]>");
+    }
+    if (_markup[0] == '?') {
+        return endsWith(_markup, "?>");
+    }
+    if (_markup[0] == '!') {
+        // DOCTYPE, may have an internal subset in brackets
+        int depth = 0;
+        for (std::string::iterator it = _markup.begin(); it != _markup.end(); ++it) {
+            if (*it == '[') ++depth;
+            else if (*it == ']') --depth;
+        }
+        return depth <= 0;
+    }
+    return _quote == 0;
+}
+
+// Handle a complete piece of markup
+void XmlReader::markup() {
+    if (_markup.compare(0, 8, "![CDATA[") == 0) {
+        if (_stack.empty()) {
+            fail("CDATA outside of the root element");
+        } else {
+            _handler.text(_markup.substr(8, _markup.size() - 11));
+        }
+    } else if (_markup[0] != '!' && _markup[0] != '?') {
+        tag();
+    }
+    _markup.clear();
+}
+
+// Handle a start, end or empty element tag
+void XmlReader::tag() {
+    std::size_t end = _markup.size() - 1;  // Without the '>'
+
+    if (_markup[0] == '/') {
+        std::size_t nameEnd = 1;
+        while (nameEnd < end && !isSpace(_markup[nameEnd])) {
+            ++nameEnd;
+        }
+
+        std::string name = _markup.substr(1, nameEnd - 1);
+        if (_stack.empty() || _stack.back() != name) {
+            fail("Mismatched end tag");
+            return;
+        }
+        _stack.pop_back();
+        _handler.endElement(name);
+        return;
+    }
+
+    bool empty = false;
+    while (end > 0 && isSpace(_markup[end - 1])) {
+        --end;
+    }
+    if (end > 0 && _markup[end - 1] == '/') {
+        empty = true;
+        --end;
+    }
+
+    std::size_t pos = 0;
+    while (pos < end && !isSpace(_markup[pos]) && _markup[pos] != '/') {
+        ++pos;
+    }
+    std::string name = _markup.substr(0, pos);
+    if (name.empty()) {
+        fail("Missing element name");
+        return;
+    }
+    if (_stack.empty() && _seenRoot) {
+        fail("More than one root element");
+        return;
+    }
+
+    XmlHandler::Attributes attributes;
+    while (pos < end) {
+        while (pos < end && isSpace(_markup[pos])) {
+            ++pos;
+        }
+        if (pos == end) {
+            break;
+        }
+
+        std::size_t eq = _markup.find('=', pos);
+        if (eq == std::string::npos || eq >= end) {
+            fail("Malformed attribute");
+            return;
+        }
+        std::size_t nameEnd = eq;
+        while (nameEnd > pos && isSpace(_markup[nameEnd - 1])) {
+            --nameEnd;
+        }
+
+        std::size_t open = eq + 1;
+        while (open < end && isSpace(_markup[open])) {
+            ++open;
+        }
+        if (open == end || (_markup[open] != '"' && _markup[open] != '\'')) {
+            fail("Attribute value must be quoted");
+            return;
+        }
+        std::size_t close = _markup.find(_markup[open], open + 1);
+        if (close == std::string::npos || close >= end) {
+            fail("Unterminated attribute value");
+            return;
+        }
+
+        std::string value;
+        decode(_markup.substr(open + 1, close - open - 1), value);
+        attributes.push_back(std::make_pair(_markup.substr(pos, nameEnd - pos), value));
+        pos = close + 1;
+    }
+
+    _seenRoot = true;
+    _stack.push_back(name);
+    _handler.startElement(name, attributes);
+    if (empty) {
+        _stack.pop_back();
+        _handler.endElement(name);
+    }
+}
+
+bool XmlReader::feed(const char* data, std::size_t len) {
+    std::size_t pos = 0;
+    while (pos < len && _error.empty()) {
+        if (_state == kText) {
+            // Copy the run of character data up to the next markup in one go
+            const char* lt = static_cast<const char*>(memchr(data + pos, '<', len - pos));
+            std::size_t end = lt ? static_cast<std::size_t>(lt - data) : len;
+            _text.append(data + pos, end - pos);
+            pos = end;
+
+            if (lt) {
+                flushText();
+                _state = kMarkup;
+                _quote = 0;
+                ++pos;
+            }
+        } else {
+            char c = data[pos++];
+            _markup += c;
+
+            bool isTag = (_markup[0] != '!' && _markup[0] != '?');
+            if (isTag && (c == '"' || c == '\'')) {
+                if (_quote == 0) _quote = c;
+                else if (_quote == c) _quote = 0;
+            } else if (c == '>' && markupComplete()) {
+                markup();
+                _state = kText;
+            }
+        }
+    }
+
+    return _error.empty();
+}
+
+bool XmlReader::finish() {
+    if (!_error.empty()) {
+        return false;
+    }
+
+    flushText();
+    if (_state != kText || !_stack.empty() || !_seenRoot) {
+        return fail("Unexpected end of document");
+    }
+    return _error.empty();
+}